@@ -1,27 +1,240 @@
+#include "query_exec.h"
+#include "schema_tables.h"
 #include <SQLParser.h>
+#include <list>
 #include <string>
+#include <unordered_map>
 
 #ifndef EXECUTE_H_
 #define EXECUTE_H_
 
+/**
+ * @class PreparedStatement - a SELECT or INSERT planned once, to be run any
+ * number of times with new parameter values
+ *
+ * The tables it reads or writes are borrowed from the catalog while it is
+ * borrowing: for as long as it lives if PREPAREd, so they stay open (and
+ * can't be dropped) while it does, but only while it runs if it is a cached
+ * plan, so that cached plans don't keep the catalog from closing tables.
+ */
+class PreparedStatement {
+public:
+  hsql::StatementType type; // kStmtSelect or kStmtInsert
+  Row parameters;           // one per placeholder, set before each run
+  TableNames borrowed;      // tables it reads or writes
+  bool borrowing;           // whether it has them borrowed now
+  PlanOperator *plan;       // SELECT: the plan's root
+  DbRelation *relation;     // INSERT: table inserted into
+  ColumnNames column_names; // INSERT: columns given values
+  PlanExprs values;         // INSERT: their values, one per column
+
+  PreparedStatement(hsql::StatementType type)
+      : type(type), borrowing(false), plan(nullptr), relation(nullptr) {}
+
+  /**
+   * Deletes the plan and values; its tables must already be given back.
+   */
+  virtual ~PreparedStatement();
+
+  PreparedStatement(const PreparedStatement &other) = delete;
+
+  PreparedStatement(PreparedStatement &&temp) = delete;
+
+  PreparedStatement &operator=(const PreparedStatement &other) = delete;
+
+  PreparedStatement &operator=(PreparedStatement &&temp) = delete;
+};
+
 /**
  * Static class that contains execute function and helpers
+ *
+ * Statements run against the tables of the catalog, which is opened (or
+ * created) in _DB_ENV the first time it is needed. A SELECT is planned into
+ * a tree of PlanOperators and its rows are written out as they come from
+ * the root. A GROUP BY aggregates on as many threads as set_threads() last
+ * gave. CREATE TABLE makes tables of the engine last given to
+ * set_engine(). CREATE INDEX ... USING HASH, BTREE or BITMAP indexes a table
+ * through the catalog, which reattaches the index whenever it opens the table.
+ *
+ * PREPARE plans a statement with ? placeholders under a name, for EXECUTE to
+ * run with values for them. execute_cached() does the same for SQL text
+ * without being asked: a SELECT or INSERT is keyed by its text with the
+ * literals taken out, and the plan is kept, so when the same statement comes
+ * again with other literals neither parsing nor planning is repeated. A kept
+ * plan gives its tables back to the catalog between runs, and is forgotten
+ * when the catalog closes one of them to make room (or it is dropped).
  */
 class Execute {
+  friend class ExecuteTest;
+
 public:
+  static const size_t PLAN_CACHE_SIZE = 64;
+
   /**
    * Executes a given parse tree
    * @param tree      A SQL parse tree root
+   * @returns         what each statement did, or the rows it returned
+   * @throws          DbRelationError if a statement can't be run
+   * @throws          NotImplementedError for SQL that isn't supported
    */
   static std::string execute(const hsql::SQLParserResult *tree);
 
+  /**
+   * Executes a SELECT or INSERT from the plan cache, planning it (and
+   * keeping the plan) if it isn't there.
+   * @param sql     one SQL statement
+   * @param result  set to what the statement did, or the rows it returned
+   * @returns       false if the statement can't be cached, in which case it
+   *                hasn't been run and should be parsed and execute()d
+   * @throws        as execute()
+   */
+  static bool execute_cached(const std::string &sql, std::string &result);
+
+  /**
+   * @returns  plans kept by execute_cached()
+   */
+  static size_t get_cached_plans() { return plans.size(); }
+
+  /**
+   * @returns  times execute_cached() found the plan it needed kept
+   */
+  static size_t get_plan_hits() { return plan_hits; }
+
+  /**
+   * Choose the storage engine CREATE TABLE gives tables from now on (HEAP to
+   * begin with), since the SQL has no clause for it.
+   * @param engine_name  HEAP, COLUMN, PAX, MEMORY or LSM, in any case
+   * @returns            what was set
+   * @throws             DbRelationError if there's no such engine
+   */
+  static std::string set_engine(const Identifier &engine_name);
+
+  /**
+   * Choose how many threads a GROUP BY or aggregate query aggregates on (one
+   * per core to begin with). Cached plans are forgotten so they are planned
+   * again with it; PREPAREd statements keep the count they were planned with.
+   * @param threads  most threads to use (0 for one per core)
+   * @returns        what was set
+   */
+  static std::string set_threads(uint threads);
+
+  /**
+   * Gather statistics on a table, borrowing it from the catalog meanwhile,
+   * and save them in the statistics file in place of any it had. Dropping
+   * the table forgets them.
+   * @param table_name  a table in the catalog
+   * @returns           what was learned
+   * @throws            DbRelationError if there's no such table
+   */
+  static std::string analyze(const Identifier &table_name);
+
+  /**
+   * Close the catalog and every table opened through it, forgetting all
+   * prepared statements and cached plans.
+   */
+  static void close();
+
 protected:
+  typedef std::vector<const hsql::Expr *> Conjuncts;
+
+  class CachedPlan {
+  public:
+    PreparedStatement *prepared;
+    std::list<std::string>::iterator recent; // its place in recently_run
+  };
+
+  static Tables *tables; // the catalog, once opened
+  static TableOptions table_options; // for CREATE TABLE
+  static uint aggregate_threads; // for HashAggregate, 0 for one per core
+  static std::map<Identifier, PreparedStatement *> prepared; // by name
+  static std::unordered_map<std::string, CachedPlan> plans; // by normal form
+  static std::list<std::string> recently_run; // keys, most recent first
+  static size_t plan_hits;
+
+  // While a statement is being prepared: the row its parameters are read
+  // from, and the placeholders' positions in order, which give their indexes.
+  static Row *parameters;
+  static std::vector<int64_t> placeholders;
+
+  static Tables &catalog();
+
   // Protect these classes because they are only called in execute
   static std::string create(const hsql::CreateStatement *create);
-  static std::string select(const hsql::SelectStatement *select);
-  static std::string expr(const hsql::Expr *expr);
-  static std::string table(const hsql::TableRef *table);
-  static std::string join(const hsql::JoinDefinition *join);
+  static std::string drop(const hsql::DropStatement *drop);
+  static std::string show(const hsql::ShowStatement *show);
+  static std::string prepare(const hsql::PrepareStatement *prepare);
+  static std::string execute_prepared(const hsql::ExecuteStatement *execute);
+
+  /**
+   * Plan a SELECT or INSERT.
+   * @param values  values for its placeholders, if known, which settle their
+   *                types
+   * @returns       the statement, to be discard()ed
+   */
+  static PreparedStatement *
+  prepare_statement(const hsql::SQLStatement *statement,
+                    const Row &values = Row());
+
+  /**
+   * Run a prepared statement with its current parameters.
+   */
+  static std::string run(PreparedStatement *prepared);
+
+  /**
+   * Give back a prepared statement's tables, if it is borrowing them, and
+   * delete it.
+   */
+  static void discard(PreparedStatement *prepared);
+
+  /**
+   * Borrow a cached plan's tables back from the catalog for a run.
+   * @returns  false if the plan was forgotten meanwhile, since borrowing
+   *           one table closed another of them; then none are borrowed
+   */
+  static bool reborrow(const std::string &key);
+
+  /**
+   * Give a prepared statement's tables back to the catalog.
+   */
+  static void give_back(PreparedStatement *prepared);
+
+  /**
+   * Forget cached plans: those that use the given table, or all of them if
+   * it's empty.
+   */
+  static void uncache(const Identifier &table_name = "");
+
+  /**
+   * Run a plan, writing out its column names and then its rows.
+   */
+  static std::string run(PlanOperator *plan);
+
+  /**
+   * Build the plan for a SELECT. The tables it reads are borrowed from the
+   * catalog and their names added to borrowed, for release once the plan
+   * is deleted.
+   */
+  static PlanOperator *plan(const hsql::SelectStatement *select,
+                            TableNames &borrowed);
+
+  /**
+   * Scan a named table. Terms of where that compare one of its columns for
+   * equality with a constant are taken out of it and left to the table.
+   */
+  static PlanOperator *scan(const hsql::TableRef *table, TableNames &borrowed,
+                            Conjuncts *where = nullptr);
+
+  static PlanOperator *table(const hsql::TableRef *table,
+                             TableNames &borrowed);
+
+  /**
+   * Plan a join: a HashJoin keyed on the terms of its condition that equate
+   * a column of each side, if there are any, otherwise a NestedLoopJoin.
+   */
+  static PlanOperator *join(const hsql::JoinDefinition *join,
+                            TableNames &borrowed);
+
+  static PlanExpr *expr(const hsql::Expr *expr, const PlanColumns &columns);
 
 private:
   Execute();
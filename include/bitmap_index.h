@@ -0,0 +1,209 @@
+/**
+ * @file bitmap_index.h - Bitmap index implementation of DbIndex.
+ * Bitmap
+ * BitmapIndex: DbIndex
+ *
+ * @see "Seattle University, CPSC5300, Winter Quarter 2024"
+ */
+#pragma once
+
+#include "db_cxx.h"
+#include "row_codec.h"
+#include "storage_engine.h"
+#include <string>
+
+/**
+ * @class Bitmap - compressed set of row positions (Roaring layout)
+ *
+ * A row's position packs its Handle into 32 bits, block id above record id,
+ * so iterating a bitmap visits rows in heap order. Positions are split on
+ * their high 16 bits into containers. A container with up to ARRAY_MAX
+ * members is a sorted array of the low 16 bits; a fuller one is a 65536-bit
+ * bitmap. AND, OR and AND NOT of two bitmap containers are straight loops over
+ * 64-bit words, which the compiler vectorizes; the array cases merge or probe.
+ */
+class Bitmap {
+public:
+  typedef u_int32_t Position;
+
+  /**
+   * bits of a position holding the record id; SlottedPage can't hold more
+   * records than this allows
+   */
+  static const uint RECORD_BITS = 10;
+
+  /**
+   * most members an array container holds before becoming a bitmap (where
+   * both take 8kB)
+   */
+  static const uint ARRAY_MAX = 4096;
+
+  Bitmap() {}
+
+  virtual ~Bitmap() {}
+
+  /**
+   * @param handle  a row
+   * @returns       the row's position
+   * @throws        DbRelationError if the block id is too big to pack
+   */
+  static Position position(Handle handle);
+
+  /**
+   * @param position  a row's position
+   * @returns         the row's handle
+   */
+  static Handle handle(Position position);
+
+  void add(Position position);
+
+  void remove(Position position);
+
+  bool contains(Position position) const;
+
+  u_int64_t cardinality() const;
+
+  bool empty() const { return this->containers.empty(); }
+
+  Bitmap &operator&=(const Bitmap &other);
+
+  Bitmap &operator|=(const Bitmap &other);
+
+  /**
+   * AND NOT: remove every member of other.
+   */
+  Bitmap &operator-=(const Bitmap &other);
+
+  /**
+   * @returns  handles of the members in position (heap) order, freed by caller
+   */
+  Handles *handles() const;
+
+  bool operator==(const Bitmap &other) const {
+    return this->containers == other.containers;
+  }
+
+protected:
+  friend class BitmapIndex;
+
+  static const uint WORDS = 65536 / 64;
+
+  class Container {
+  public:
+    std::vector<u_int16_t> array; // sorted members, if an array container
+    std::vector<u_int64_t> words; // WORDS words, if a bitmap container
+    uint card;
+
+    Container() : card(0) {}
+
+    bool is_bitmap() const { return !this->words.empty(); }
+
+    bool contains(u_int16_t low) const;
+
+    void add(u_int16_t low);
+
+    void remove(u_int16_t low);
+
+    void intersect(const Container &other);
+
+    void unite(const Container &other);
+
+    void subtract(const Container &other);
+
+    /**
+     * Re-count a bitmap container after word operations and switch it to an
+     * array if it has become sparse (or to a bitmap if an array grew dense).
+     */
+    void normalize();
+
+    /**
+     * Serialized container: a one-byte kind, then the array's u16s or the
+     * bitmap's words.
+     */
+    std::string marshal() const;
+
+    void unmarshal(const char *bytes, uint size);
+
+    bool operator==(const Container &other) const {
+      return this->array == other.array && this->words == other.words;
+    }
+  };
+
+  std::map<u_int16_t, Container> containers; // by high 16 bits
+};
+
+/**
+ * @class BitmapIndex - persistent bitmap index for low-cardinality columns
+ *
+ * Keeps a Bitmap of row positions for each distinct key. The bitmaps live in
+ * a Berkeley DB BTree file with one record per container, keyed by the key's
+ * RowCodec encoding followed by the container's high bits, so an insert or
+ * delete rewrites at most 8kB. All bitmaps are read into memory on open().
+ *
+ * Combining predicates (AND, OR, NOT) is done on the bitmaps from
+ * lookup_bitmap() and universe() before any heap block is read; HeapTable
+ * intersects the bitmap indexes covering a where-clause on its own.
+ */
+class BitmapIndex : public DbIndex {
+public:
+  BitmapIndex(DbRelation &relation, Identifier name, ColumnNames key_columns,
+              bool unique = false);
+
+  virtual ~BitmapIndex();
+
+  BitmapIndex(const BitmapIndex &other) = delete;
+
+  BitmapIndex(BitmapIndex &&temp) = delete;
+
+  BitmapIndex &operator=(const BitmapIndex &other) = delete;
+
+  BitmapIndex &operator=(BitmapIndex &&temp) = delete;
+
+  virtual void create();
+
+  virtual void drop();
+
+  virtual void open();
+
+  virtual void close();
+
+  virtual Handles *lookup(const ValueDict *key_values) const;
+
+  virtual void insert(Handle handle);
+
+  virtual void del(Handle handle);
+
+  /**
+   * Rows with a key.
+   * @param key_values  values for every key column
+   * @returns           their bitmap (empty if the key isn't present)
+   */
+  virtual Bitmap lookup_bitmap(const ValueDict *key_values) const;
+
+  /**
+   * Every row in the index, to complement against for NOT.
+   * @returns  the union of all the index's bitmaps
+   */
+  virtual Bitmap universe() const;
+
+  /**
+   * @returns  number of distinct keys
+   */
+  virtual size_t get_key_count() const { return this->bitmaps.size(); }
+
+protected:
+  std::string dbfilename;
+  Db *db; // Berkeley DB handles can't be reopened, so one per open()
+  RowCodec codec;
+  std::map<std::string, Bitmap> bitmaps; // by encoded key
+
+  virtual void db_open(uint flags = 0);
+
+  virtual void load();
+
+  virtual void save(const std::string &key, u_int16_t high);
+
+  virtual std::string key_of(Handle handle) const;
+
+  virtual std::string encode_key(const ValueDict *key_values) const;
+};
@@ -0,0 +1,99 @@
+/**
+ * @file bloom_filter.h - Per-block Bloom filters used to skip blocks during
+ * equality scans.
+ * BloomFilter
+ *
+ * @see "Seattle University, CPSC5300, Winter Quarter 2024"
+ */
+#pragma once
+
+#include "db_cxx.h"
+#include "storage_engine.h"
+
+/**
+ * @class BloomFilter - one Bloom filter per block over chosen columns of a table
+ *
+ * Each block's filter holds a (column, value) entry for every row whose Handle
+ * names the block, so like a ZoneMap it covers forwarded rows through their
+ * stubs. A miss proves the block has no row with that value; a hit may be a
+ * false positive. Entries are never removed, so deletes and updates only make
+ * a filter more likely to say yes.
+ *
+ * Values are hashed with 64-bit FNV-1a and probed with double hashing, so the
+ * bits on disk don't depend on the standard library. The filters live in a
+ * Berkeley DB RecNo file next to the heap file, one fixed-length record per
+ * block, cached in memory while open and written through as bits get set.
+ */
+class BloomFilter {
+public:
+  /**
+   * @param table_name     table the filters belong to
+   * @param column_names   the table's columns
+   * @param filtered       columns to put in the filters (may be empty)
+   * @param bits           size of each block's filter, a multiple of 8
+   * @param fp_rate        target false-positive rate; picks the number of
+   *                       probes per value
+   * @throws DbRelationError for an unknown column or a bad size or rate
+   */
+  BloomFilter(Identifier table_name, const ColumnNames &column_names,
+              const ColumnNames &filtered, uint bits, double fp_rate);
+
+  virtual ~BloomFilter();
+
+  BloomFilter(const BloomFilter &other) = delete;
+
+  BloomFilter(BloomFilter &&temp) = delete;
+
+  BloomFilter &operator=(const BloomFilter &other) = delete;
+
+  BloomFilter &operator=(BloomFilter &&temp) = delete;
+
+  virtual void create();
+
+  virtual void drop();
+
+  virtual void open();
+
+  virtual void close();
+
+  /**
+   * Add a row's values to a block's filter.
+   * @param block_id  the block the row's Handle names
+   * @param row       the row (must hold every filtered column)
+   */
+  virtual void add(BlockID block_id, const ValueDict *row);
+
+  /**
+   * Could a block hold a row with this value in a column?
+   * @param block_id  block to check
+   * @param column    schema position of the column
+   * @param value     value looked for
+   * @returns         false only if the block certainly has no such row
+   */
+  virtual bool may_contain(BlockID block_id, uint column,
+                           const Value &value) const;
+
+  /**
+   * @returns  whether any columns are filtered
+   */
+  virtual bool is_enabled() const { return !this->filtered.empty(); }
+
+protected:
+  typedef std::vector<u_int8_t> Filter;
+
+  std::string dbfilename;
+  std::vector<std::pair<Identifier, uint>> filtered; // (name, schema position)
+  std::vector<bool> is_filtered;                     // by schema position
+  uint bits;
+  uint probes;
+  std::vector<Filter> filters; // [block_id - 1]
+  Db *db; // Berkeley DB handles can't be reopened, so one per open()
+
+  virtual void db_open(uint flags = 0);
+
+  virtual void load();
+
+  virtual void save(BlockID block_id);
+
+  virtual u_int64_t hash(uint column, const Value &value, u_int64_t seed) const;
+};
@@ -0,0 +1,138 @@
+/**
+ * @file btree.h - B+tree implementation of DbIndex.
+ * BTreeNode
+ * BTreeIndex: DbIndex
+ *
+ * @see "Seattle University, CPSC5300, Winter Quarter 2024"
+ */
+#pragma once
+
+#include "heap_storage.h"
+#include "storage_engine.h"
+
+typedef std::vector<Value> KeyValue;
+typedef std::vector<ColumnAttribute::DataType> KeyProfile;
+
+/**
+ * @class BTreeNode - in-memory copy of one node of a BTreeIndex
+ *
+ * Leaves hold sorted (key, Handle) entries and link to the next leaf to the
+ * right. Interior nodes hold sorted separator keys: link is the subtree of
+ * keys below keys[0], and children[i] the subtree of keys from keys[i] up to
+ * keys[i+1].
+ */
+class BTreeNode {
+public:
+  BTreeNode(BlockID id, bool leaf) : id(id), leaf(leaf), link(0) {}
+
+  virtual ~BTreeNode() {}
+
+  BlockID id;
+  bool leaf;
+  BlockID link; // leaf: next leaf (0 for the last); interior: first child
+  std::vector<KeyValue> keys;
+  Handles handles;   // leaf only: row for each key
+  BlockIDs children; // interior only: subtree for each key
+};
+
+/**
+ * @class BTreeIndex - persistent B+tree index supporting range scans
+ *
+ * Each node is a SlottedPage block in a HeapFile: record 1 holds the node's
+ * kind and link, then one record per entry in key order. Block 1 holds the
+ * root's block id and the height of the tree. Nodes are read into a BTreeNode,
+ * changed in memory and written back whole.
+ *
+ * Deletes do not merge underfull nodes; create() builds a packed tree bottom
+ * up from the sorted contents of the relation.
+ */
+class BTreeIndex : public DbIndex {
+public:
+  /**
+   * percentage of each node filled when bulk building, leaving room for
+   * inserts before leaves start to split
+   */
+  static const uint BULK_FILL = 90;
+
+  BTreeIndex(DbRelation &relation, Identifier name, ColumnNames key_columns,
+             bool unique = false);
+
+  virtual ~BTreeIndex() {}
+
+  BTreeIndex(const BTreeIndex &other) = delete;
+
+  BTreeIndex(BTreeIndex &&temp) = delete;
+
+  BTreeIndex &operator=(const BTreeIndex &other) = delete;
+
+  BTreeIndex &operator=(BTreeIndex &&temp) = delete;
+
+  virtual void create();
+
+  virtual void drop();
+
+  virtual void open();
+
+  virtual void close();
+
+  virtual Handles *lookup(const ValueDict *key_values) const;
+
+  virtual Handles *range(const ValueDict *min_key,
+                         const ValueDict *max_key) const;
+
+  virtual void insert(Handle handle);
+
+  virtual void del(Handle handle);
+
+  virtual bool is_ordered() const { return true; }
+
+  /**
+   * Build the tree bottom up from entries already sorted by key, replacing
+   * whatever the index held.
+   * @param entries  (key, handle) pairs in key order
+   */
+  virtual void bulk_load(
+      const std::vector<std::pair<KeyValue, Handle>> &entries);
+
+  /**
+   * @returns  number of levels in the tree (1 when the root is a leaf)
+   */
+  virtual uint get_height() const { return height; }
+
+protected:
+  static const BlockID STAT = 1;
+  static const uint MAX_KEY_SZ = DbBlock::BLOCK_SZ / 4;
+
+  mutable HeapFile file;
+  KeyProfile key_profile;
+  BlockID root;
+  uint height;
+  bool closed;
+
+  virtual KeyValue key_of(Handle handle) const;
+
+  virtual KeyValue key_of(const ValueDict *key_values) const;
+
+  virtual int compare(const KeyValue &key, const KeyValue &bound) const;
+
+  virtual BTreeNode *find_leaf(const KeyValue &key, bool leftmost,
+                               BlockIDs *path) const;
+
+  virtual void insert_into(BTreeNode *node, BlockIDs &path);
+
+  virtual BTreeNode *load(BlockID id) const;
+
+  virtual void save(const BTreeNode *node);
+
+  virtual BTreeNode *new_node(bool leaf);
+
+  virtual void save_stat();
+
+  virtual uint node_size(const BTreeNode *node) const;
+
+  virtual uint key_size(const KeyValue &key) const;
+
+  virtual uint marshal_key(const KeyValue &key, char *bytes) const;
+
+  virtual uint unmarshal_key(const char *bytes, KeyValue &key) const;
+};
@@ -0,0 +1,202 @@
+/**
+ * @file column_storage.h - Implementation of storage_engine with one file per
+ * column. ColumnBlock: DbBlock ColumnFile: DbFile ColumnTable: DbRelation
+ *
+ * @see "Seattle University, CPSC5300, Winter Quarter 2024"
+ */
+#pragma once
+
+#include "db_cxx.h"
+#include "storage_engine.h"
+
+/**
+ * @class ColumnBlock - one column's values for a run of rows
+ *
+ * Values are stored by type rather than as marshaled rows:
+ *   Bytes 0x00 - 0x01: number of values
+ *   Bytes 0x02 - 0x03: offset to end of free space (TEXT only)
+ *   INT:  the int32 values packed from byte 0x04 on, so value i is at a fixed
+ *         offset and a scan of the column is a walk down an array
+ *   TEXT: a 2-byte start offset for each value from byte 0x04 on; the bytes
+ *         themselves are packed down from the end of the block, each running
+ *         up to the start of the one before
+ *
+ * Values are appended and never change, and record ids run from 1 like
+ * SlottedPage's.
+ */
+class ColumnBlock : public DbBlock {
+public:
+  ColumnBlock(Dbt &block, BlockID block_id,
+              ColumnAttribute::DataType data_type, bool is_new = false);
+
+  virtual ~ColumnBlock() {}
+
+  ColumnBlock(const ColumnBlock &other) = delete;
+
+  ColumnBlock(ColumnBlock &&temp) = delete;
+
+  ColumnBlock &operator=(const ColumnBlock &other) = delete;
+
+  ColumnBlock &operator=(ColumnBlock &temp) = delete;
+
+  virtual RecordID add(const Dbt *data);
+
+  virtual Dbt *get(RecordID record_id);
+
+  virtual void put(RecordID record_id, const Dbt &data);
+
+  virtual void del(RecordID record_id);
+
+  virtual RecordIDs *ids(void);
+
+  /**
+   * @param size  bytes of a value (ignored for INT)
+   * @returns     whether one more value fits
+   */
+  virtual bool has_room(u_int16_t size);
+
+  /**
+   * @returns  number of values in the block
+   */
+  virtual u_int16_t size() const { return this->num_values; }
+
+  virtual int32_t get_int(RecordID record_id);
+
+  virtual std::string get_text(RecordID record_id);
+
+  virtual Value get_value(RecordID record_id);
+
+protected:
+  static const u_int16_t HEADER_SZ = 4;
+
+  ColumnAttribute::DataType data_type;
+  u_int16_t num_values;
+  u_int16_t end_free;
+
+  virtual void check(RecordID record_id);
+
+  virtual u_int16_t get_n(u_int16_t offset);
+
+  virtual void put_n(u_int16_t offset, u_int16_t n);
+
+  virtual void *address(u_int16_t offset);
+};
+
+/**
+ * @class ColumnFile - the blocks of one column, built like HeapFile on a
+ * Berkeley DB RecNo file with one record per block
+ */
+class ColumnFile : public DbFile {
+public:
+  ColumnFile(std::string name, ColumnAttribute::DataType data_type)
+      : DbFile(name), data_type(data_type), last(0), closed(true),
+        db(_DB_ENV, 0) {}
+
+  virtual ~ColumnFile() {}
+
+  ColumnFile(const ColumnFile &other) = delete;
+
+  ColumnFile(ColumnFile &&temp) = delete;
+
+  ColumnFile &operator=(const ColumnFile &other) = delete;
+
+  ColumnFile &operator=(ColumnFile &&temp) = delete;
+
+  virtual void create(void);
+
+  virtual void drop(void);
+
+  virtual void open(void);
+
+  virtual void close(void);
+
+  virtual ColumnBlock *get_new(void);
+
+  virtual ColumnBlock *get(BlockID block_id);
+
+  virtual void put(DbBlock *block);
+
+  virtual BlockIDs *block_ids();
+
+  virtual u_int32_t get_last_block_id() { return last; }
+
+protected:
+  ColumnAttribute::DataType data_type;
+  u_int32_t last;
+  bool closed;
+  Db db;
+
+  virtual void db_open(uint flags = 0);
+};
+
+/**
+ * @class ColumnTable - Column storage engine (implementation of DbRelation)
+ *
+ * Each column lives in its own ColumnFile, so reading a few columns of a wide
+ * table only touches those columns' blocks. The files are kept in step: block
+ * b of every file holds the same rows (a row group), and when any column runs
+ * out of room every file starts a new block together. A row's Handle is its
+ * row group and its position in the group, good for every column.
+ *
+ * Rows are append only: update() and del() aren't supported.
+ */
+class ColumnTable : public DbRelation {
+public:
+  ColumnTable(Identifier table_name, ColumnNames column_names,
+              ColumnAttributes column_attributes);
+
+  virtual ~ColumnTable();
+
+  ColumnTable(const ColumnTable &other) = delete;
+
+  ColumnTable(ColumnTable &&temp) = delete;
+
+  ColumnTable &operator=(const ColumnTable &other) = delete;
+
+  ColumnTable &operator=(ColumnTable &&temp) = delete;
+
+  virtual void create();
+
+  virtual void create_if_not_exists();
+
+  virtual void drop();
+
+  virtual void open();
+
+  virtual void close();
+
+  virtual Handle insert(const ValueDict *row);
+
+  virtual void update(const Handle handle, const ValueDict *new_values);
+
+  virtual void del(const Handle handle);
+
+  virtual Handles *select();
+
+  virtual Handles *select(const ValueDict *where);
+
+  virtual ValueDict *project(Handle handle);
+
+  virtual ValueDict *project(Handle handle, const ColumnNames *column_names);
+
+  /**
+   * @returns  the table's row groups in order (freed by caller)
+   */
+  virtual BlockIDs *group_ids();
+
+  /**
+   * Read some columns of every row in a row group, one column at a time.
+   * @param group_id      which row group
+   * @param column_names  columns to read
+   * @param batch         replaced with the group's handles and values
+   */
+  virtual void read_batch(BlockID group_id, const ColumnNames *column_names,
+                          ColumnBatch &batch);
+
+protected:
+  std::vector<ColumnFile *> files; // parallel to column_names
+
+  virtual uint column_index(const Identifier &column_name);
+
+  virtual Dbt *marshal(uint column, const Value &value, char *bytes);
+};
@@ -0,0 +1,62 @@
+/**
+ * @file hash_index.h - Hash index implementation of DbIndex.
+ * HashIndex: DbIndex
+ *
+ * @see "Seattle University, CPSC5300, Winter Quarter 2024"
+ */
+#pragma once
+
+#include "db_cxx.h"
+#include "row_codec.h"
+#include "storage_engine.h"
+
+/**
+ * @class HashIndex - persistent hash index for equality lookups
+ *
+ * Built on a Berkeley DB Hash file with sorted duplicates, so a lookup costs a
+ * bucket probe no matter how big the relation is. The key is the key columns
+ * encoded with the same RowCodec format rows use on disk; each data item is a
+ * marshaled Handle (block id, record id).
+ */
+class HashIndex : public DbIndex {
+public:
+  HashIndex(DbRelation &relation, Identifier name, ColumnNames key_columns,
+            bool unique = false);
+
+  virtual ~HashIndex();
+
+  HashIndex(const HashIndex &other) = delete;
+
+  HashIndex(HashIndex &&temp) = delete;
+
+  HashIndex &operator=(const HashIndex &other) = delete;
+
+  HashIndex &operator=(HashIndex &&temp) = delete;
+
+  virtual void create();
+
+  virtual void drop();
+
+  virtual void open();
+
+  virtual void close();
+
+  virtual Handles *lookup(const ValueDict *key_values) const;
+
+  virtual void insert(Handle handle);
+
+  virtual void del(Handle handle);
+
+protected:
+  static const uint HANDLE_SZ = sizeof(BlockID) + sizeof(RecordID);
+
+  std::string dbfilename;
+  Db *db; // Berkeley DB handles can't be reopened, so one per open()
+  RowCodec codec;
+
+  virtual void db_open(uint flags = 0);
+
+  virtual ValueDict *key_of(Handle handle) const;
+
+  virtual uint encode_key(const ValueDict *key_values, char *bytes) const;
+};
@@ -1,14 +1,18 @@
 /**
  * @file heap_storage.h - Implementation of storage_engine with a heap file
- * structure. SlottedPage: DbBlock HeapFile: DbFile HeapTable: DbRelation
+ * structure. SlottedPage: DbBlock BasicHeapFile: DbFile HeapTable: DbRelation
  *
  * @author Kevin Lundeen
  * @see "Seattle University, CPSC5300, Winter Quarter 2024"
  */
 #pragma once
 
+#include "bloom_filter.h"
 #include "db_cxx.h"
+#include "parallel_scan.h"
+#include "row_codec.h"
 #include "storage_engine.h"
+#include "zone_map.h"
 
 /**
  * @class SlottedPage - heap file implementation of DbBlock.
@@ -28,6 +32,22 @@ class SlottedPage : public DbBlock {
   friend class SlottedPageTest;
 
 public:
+  /**
+   * Flag bits stored in the high end of a record's size. A FORWARDED record is
+   * a stub holding the Handle of the block and record the row moved to, so
+   * handles to it stay valid. The row it points at is MOVED and is left out
+   * of ids() since scans reach it through the stub.
+   */
+  static const u_int16_t FORWARDED = 0x8000;
+  static const u_int16_t MOVED = 0x4000;
+  static const u_int16_t SIZE_MASK = 0x3FFF;
+
+  /**
+   * size of a forwarding stub; records are never smaller than this so any
+   * record can be turned into a stub in place
+   */
+  static const u_int16_t FORWARD_SZ = sizeof(BlockID) + sizeof(RecordID);
+
   SlottedPage(Dbt &block, BlockID block_id, bool is_new = false);
 
   // Big 5 - we only need the destructor, copy-ctor, move-ctor, and op= are
@@ -45,6 +65,10 @@ public:
 
   virtual RecordID add(const Dbt *data);
 
+  virtual RecordID reserve(u_int16_t size, u_int16_t slack = 0);
+
+  virtual void *record(RecordID record_id);
+
   virtual Dbt *get(RecordID record_id);
 
   virtual void put(RecordID record_id, const Dbt &data);
@@ -53,6 +77,14 @@ public:
 
   virtual RecordIDs *ids(void);
 
+  virtual u_int16_t get_flags(RecordID record_id);
+
+  virtual void set_flags(RecordID record_id, u_int16_t flags);
+
+  virtual void put_forward(RecordID record_id, Handle to);
+
+  virtual bool get_forward(RecordID record_id, Handle &to);
+
 protected:
   u_int16_t num_records;
   u_int16_t end_free;
@@ -60,7 +92,7 @@ protected:
   virtual void get_header(u_int16_t &size, u_int16_t &loc, RecordID id = 0);
 
   virtual void put_header(RecordID id = 0, u_int16_t size = 0,
-                          u_int16_t loc = 0);
+                          u_int16_t loc = 0, u_int16_t flags = 0);
 
   virtual bool has_room(u_int16_t size);
 
@@ -74,27 +106,34 @@ protected:
 };
 
 /**
- * @class HeapFile - heap file implementation of DbFile
+ * @class BasicHeapFile - heap file implementation of DbFile
  *
  * Heap file organization. Built on top of Berkeley DB RecNo file. There is one
  of our database blocks for each Berkeley DB record in the RecNo file. In this
- way we are using Berkeley DB for buffer management and file management. Uses
- SlottedPage for storing records within blocks.
+ way we are using Berkeley DB for buffer management and file management. The
+ Page type lays out the records within blocks; it must be a DbBlock that can
+ be constructed from (block, block_id, is_new). HeapFile stores rows in
+ SlottedPages.
  */
-class HeapFile : public DbFile {
+template <class Page> class BasicHeapFile : public DbFile {
 public:
-  HeapFile(std::string name)
-      : DbFile(name), dbfilename(""), last(0), closed(true), db(_DB_ENV, 0) {}
+  /**
+   * @param name  file name, without its .db suffix
+   * @param env   environment to open the file in (nullptr for _DB_ENV)
+   */
+  BasicHeapFile(std::string name, DbEnv *env = nullptr)
+      : DbFile(name), dbfilename(""), last(0), closed(true),
+        env(env != nullptr ? env : _DB_ENV), db(this->env, 0) {}
 
-  virtual ~HeapFile() {}
+  virtual ~BasicHeapFile() {}
 
-  HeapFile(const HeapFile &other) = delete;
+  BasicHeapFile(const BasicHeapFile &other) = delete;
 
-  HeapFile(HeapFile &&temp) = delete;
+  BasicHeapFile(BasicHeapFile &&temp) = delete;
 
-  HeapFile &operator=(const HeapFile &other) = delete;
+  BasicHeapFile &operator=(const BasicHeapFile &other) = delete;
 
-  HeapFile &operator=(HeapFile &&temp) = delete;
+  BasicHeapFile &operator=(BasicHeapFile &&temp) = delete;
 
   virtual void create(void);
 
@@ -104,9 +143,9 @@ public:
 
   virtual void close(void);
 
-  virtual SlottedPage *get_new(void);
+  virtual Page *get_new(void);
 
-  virtual SlottedPage *get(BlockID block_id);
+  virtual Page *get(BlockID block_id);
 
   virtual void put(DbBlock *block);
 
@@ -118,19 +157,39 @@ protected:
   std::string dbfilename;
   u_int32_t last;
   bool closed;
+  DbEnv *env;
   Db db;
 
   virtual void db_open(uint flags = 0);
 };
 
+typedef BasicHeapFile<SlottedPage> HeapFile;
+
+/**
+ * @class ScanStats - what the most recent select on a HeapTable cost
+ */
+class ScanStats {
+public:
+  uint blocks_read;
+  uint blocks_skipped;  // ruled out by the zone map without being read
+  uint blocks_filtered; // ruled out by a Bloom filter without being read
+
+  ScanStats() : blocks_read(0), blocks_skipped(0), blocks_filtered(0) {}
+};
+
 /**
  * @class HeapTable - Heap storage engine (implementation of DbRelation)
+ *
+ * Keeps a ZoneMap of its INT columns, and a BloomFilter on any columns named
+ * in TableOptions::bloom_columns, so filtered scans can pass over blocks that
+ * can't hold a match.
  */
 
 class HeapTable : public DbRelation {
 public:
   HeapTable(Identifier table_name, ColumnNames column_names,
-            ColumnAttributes column_attributes);
+            ColumnAttributes column_attributes,
+            TableOptions options = TableOptions());
 
   virtual ~HeapTable() {}
 
@@ -166,16 +225,173 @@ public:
 
   virtual ValueDict *project(Handle handle, const ColumnNames *column_names);
 
+  /**
+   * @returns  the table's blocks in order (freed by caller)
+   */
+  virtual BlockIDs *group_ids();
+
+  /**
+   * Read some columns of the rows whose home is a block, decoding each row.
+   */
+  virtual void read_batch(BlockID block_id, const ColumnNames *column_names,
+                          ColumnBatch &batch);
+
+  /**
+   * Conceptually, execute: SELECT <handle> FROM <table_name> WHERE <where>
+   * where every predicate bounds a column to a range.
+   * @param where  column ranges (inclusive, possibly open-ended)
+   * @returns      a pointer to a list of handles for qualifying rows (freed by
+   *               caller)
+   */
+  virtual Handles *select_range(const RangeDict *where);
+
+  /**
+   * select_range() over a single block, for scans that narrow their ranges
+   * as they go. Indexes aren't used, and the scan stats aren't touched.
+   * @param block_id  one of group_ids()
+   * @param where     column ranges (inclusive, possibly open-ended)
+   * @param handles   qualifying rows whose home is the block are appended
+   * @returns         false if the zone map ruled the block out unread
+   */
+  virtual bool select_range(BlockID block_id, const RangeDict *where,
+                            Handles &handles);
+
+  /**
+   * Conceptually, execute: SELECT <handle> FROM <table_name> WHERE <where>
+   * ORDER BY <order_by>. Served straight from an ordered index on order_by when
+   * there is one; otherwise the qualifying rows are sorted.
+   * @param order_by  column to order by (ascending)
+   * @param where     column ranges (may be nullptr)
+   * @returns         a pointer to a list of handles in order (freed by caller)
+   */
+  virtual Handles *select_ordered(const Identifier &order_by,
+                                  const RangeDict *where = nullptr);
+
+  /**
+   * Keep an open index up to date with this table's inserts, updates and
+   * deletes, and use it to answer select(where).
+   * @param index  index on this table (not owned by the table)
+   */
+  virtual void add_index(DbIndex *index);
+
+  /**
+   * Stop maintaining and using an index.
+   * @param index  an index previously passed to add_index
+   */
+  virtual void remove_index(DbIndex *index);
+
+  /**
+   * How many blocks the last select read and how many it skipped. Selects
+   * answered from an index read no blocks.
+   * @returns  counters for the most recent select
+   */
+  virtual const ScanStats &get_scan_stats() const { return scan_stats; }
+
+  /**
+   * select(where) with the blocks split into morsels scanned by worker
+   * threads. Each worker joins the Berkeley DB environment through a handle
+   * of its own and reads through its own handle on the file, so neither the
+   * environment nor any handle is shared between threads. Indexes aren't
+   * used; the zone map and Bloom filters are.
+   * @param where    where-clause predicates
+   * @param threads  number of workers (0 for one per core)
+   * @returns        handles in block order (freed by caller)
+   */
+  virtual Handles *parallel_select(const ValueDict *where, uint threads = 0);
+
+  /**
+   * Aggregate an INT column over the rows matching where, in parallel as
+   * parallel_select() does. Each worker keeps its own partial aggregate and
+   * the partials are merged at the end.
+   * @param column_name  an INT column
+   * @param where        where-clause predicates
+   * @param threads      number of workers (0 for one per core)
+   */
+  virtual ScanAggregate parallel_aggregate(const Identifier &column_name,
+                                           const ValueDict *where,
+                                           uint threads = 0);
+
 protected:
+  // where-clause with column names resolved to schema positions
+  typedef std::vector<std::pair<uint, Value>> Predicates;
+  typedef std::vector<std::pair<uint, ValueRange>> RangePredicates;
+  // called with each matching row's handle and bytes
+  typedef std::function<void(Handle, const char *)> RowVisitor;
+
   HeapFile file;
+  RowCodec codec;
+  TableOptions options;
+  u_int16_t slack; // bytes per block that inserts leave free for updates
+  DbIndexes indexes;
+  ZoneMap zones;
+  BloomFilter blooms;
+  ScanStats scan_stats;
 
   virtual ValueDict *validate(const ValueDict *row);
 
   virtual Handle append(const ValueDict *row);
 
+  virtual SlottedPage *reserve(u_int16_t size, RecordID &record_id,
+                               u_int16_t slack = 0);
+
+  virtual Handle relocate(const Dbt *data);
+
+  virtual bool try_put(SlottedPage *block, RecordID record_id, const Dbt *data,
+                       u_int16_t flags);
+
+  virtual void del_record(Handle handle);
+
+  virtual SlottedPage *get_row(Handle handle, RecordID &record_id);
+
+  virtual Predicates compile(const ValueDict *where);
+
+  virtual bool matches(const char *bytes, const Predicates &predicates);
+
+  virtual bool selected(Handle handle, const Predicates &predicates);
+
+  virtual DbIndex *index_for(const ValueDict *where);
+
+  virtual Handles *bitmap_select(const ValueDict *where,
+                                 const Predicates &predicates);
+
+  virtual RangePredicates compile(const RangeDict *where);
+
+  virtual bool select_block(BlockID block_id,
+                            const RangePredicates &predicates,
+                            Handles &handles);
+
+  virtual bool matches(const char *bytes, const RangePredicates &predicates);
+
+  virtual bool selected(Handle handle, const RangePredicates &predicates);
+
+  virtual bool may_contain(BlockID block_id, const Predicates &predicates);
+
+  virtual bool may_contain(BlockID block_id,
+                           const RangePredicates &predicates);
+
+  virtual bool filtered_out(BlockID block_id, const Predicates &predicates);
+
+  virtual void scan_morsel(HeapFile &file, const Morsel &morsel,
+                           const Predicates &predicates, ScanStats &stats,
+                           RowVisitor visit);
+
+  virtual void parallel_scan(
+      ParallelScan &scan, const Predicates &predicates,
+      std::function<void(uint worker, Handle, const char *)> visit);
+
+  virtual DbIndex *ordered_index_for(const Identifier &column_name);
+
+  virtual Handles *index_range(DbIndex *index, const RangeDict *where);
+
   virtual Dbt *marshal(const ValueDict *row);
 
+  virtual u_int16_t marshaled_size(const ValueDict *row);
+
+  virtual void marshal(const ValueDict *row, char *bytes);
+
   virtual ValueDict *unmarshal(Dbt *data);
 };
 
 bool test_heap_storage();
+
+void bench_heap_storage();
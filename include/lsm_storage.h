@@ -0,0 +1,412 @@
+/**
+ * @file lsm_storage.h - Log-structured merge-tree storage engine for tables
+ * that are mostly inserted into.
+ * LsmCursor MemtableCursor RunCursor MergeCursor LsmRun LsmStats LsmTable
+ *
+ * @see "Seattle University, CPSC5300, Winter Quarter 2024"
+ */
+#pragma once
+
+#include "db_cxx.h"
+#include "heap_storage.h"
+#include <condition_variable>
+#include <exception>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+/**
+ * An LSM tree's rows by key. An empty row is a tombstone: the row with that
+ * key has been deleted.
+ */
+typedef std::map<u_int64_t, std::string> Memtable;
+
+/**
+ * @class LsmCursor - walks the entries of a memtable or run in key order
+ */
+class LsmCursor {
+public:
+  virtual ~LsmCursor() {}
+
+  virtual bool valid() const = 0;
+
+  virtual u_int64_t key() const = 0;
+
+  /**
+   * @returns  the entry's encoded row, good until next()
+   */
+  virtual const char *row() const = 0;
+
+  /**
+   * @returns  size of row(); 0 for a tombstone
+   */
+  virtual u_int16_t size() const = 0;
+
+  virtual void next() = 0;
+};
+
+/**
+ * @class MemtableCursor - LsmCursor over a Memtable, which mustn't change
+ * while the cursor is in use
+ */
+class MemtableCursor : public LsmCursor {
+public:
+  MemtableCursor(const Memtable &memtable)
+      : it(memtable.begin()), end(memtable.end()) {}
+
+  virtual bool valid() const { return it != end; }
+
+  virtual u_int64_t key() const { return it->first; }
+
+  virtual const char *row() const { return it->second.data(); }
+
+  virtual u_int16_t size() const { return it->second.size(); }
+
+  virtual void next() { ++it; }
+
+protected:
+  Memtable::const_iterator it, end;
+};
+
+class LsmRun;
+
+/**
+ * @class RunCursor - LsmCursor over a run's file through a handle of its own,
+ * so it can be used alongside other readers of the run (or on another thread)
+ */
+class RunCursor : public LsmCursor {
+public:
+  /**
+   * @param run  the run to read, kept (and its file kept) while the cursor is
+   */
+  RunCursor(std::shared_ptr<LsmRun> run);
+
+  virtual ~RunCursor();
+
+  RunCursor(const RunCursor &other) = delete;
+
+  RunCursor(RunCursor &&temp) = delete;
+
+  RunCursor &operator=(const RunCursor &other) = delete;
+
+  RunCursor &operator=(RunCursor &&temp) = delete;
+
+  virtual bool valid() const { return block != nullptr; }
+
+  virtual u_int64_t key() const { return current_key; }
+
+  virtual const char *row() const { return current_row; }
+
+  virtual u_int16_t size() const { return current_size; }
+
+  virtual void next();
+
+protected:
+  std::shared_ptr<LsmRun> run;
+  HeapFile file;
+  SlottedPage *block;
+  BlockID block_id;
+  RecordID record_id;
+  u_int16_t records;
+  u_int64_t current_key;
+  const char *current_row;
+  u_int16_t current_size;
+
+  virtual void load(BlockID block_id);
+
+  virtual void position();
+};
+
+/**
+ * @class MergeCursor - LsmCursor merging several sources into one key order
+ *
+ * Sources are given newest first. Where several hold the same key only the
+ * newest entry is seen; the older ones are shadowed.
+ */
+class MergeCursor : public LsmCursor {
+public:
+  /**
+   * @param sources  cursors to merge, newest first (owned by the merge)
+   */
+  MergeCursor(std::vector<LsmCursor *> sources);
+
+  virtual ~MergeCursor();
+
+  MergeCursor(const MergeCursor &other) = delete;
+
+  MergeCursor(MergeCursor &&temp) = delete;
+
+  MergeCursor &operator=(const MergeCursor &other) = delete;
+
+  MergeCursor &operator=(MergeCursor &&temp) = delete;
+
+  virtual bool valid() const { return current != nullptr; }
+
+  virtual u_int64_t key() const { return current->key(); }
+
+  virtual const char *row() const { return current->row(); }
+
+  virtual u_int16_t size() const { return current->size(); }
+
+  virtual void next();
+
+protected:
+  std::vector<LsmCursor *> sources;
+  LsmCursor *current;
+
+  virtual void settle();
+};
+
+/**
+ * @class LsmStats - what point reads on an LsmTable have cost since it was
+ * opened
+ */
+class LsmStats {
+public:
+  uint runs_filtered; // ruled out by a Bloom filter without being read
+  uint blocks_read;
+
+  LsmStats() : runs_filtered(0), blocks_read(0) {}
+};
+
+/**
+ * @class LsmRun - an immutable sorted run of an LSM tree
+ *
+ * The entries are stored in key order in a heap file of SlottedPages, one
+ * record per entry: the 8-byte key followed by the encoded row (nothing for a
+ * tombstone). The first key of each block (the fences) and a Bloom filter over
+ * all the keys are kept in memory, so a point read reads at most one block,
+ * and none at all from most runs that don't hold the key.
+ */
+class LsmRun {
+public:
+  u_int32_t run_id;
+  uint level;          // 0 for runs flushed from the memtable
+  u_int64_t entries;   // tombstones included
+  u_int64_t bytes;     // of encoded rows
+  u_int64_t min_key, max_key;
+  bool obsolete;       // merged away: the file is dropped with the last user
+
+  /**
+   * @param table_name  table the run belongs to
+   * @param run_id      unique within the table
+   * @param level       level of the tree the run is in
+   */
+  LsmRun(Identifier table_name, u_int32_t run_id, uint level);
+
+  virtual ~LsmRun();
+
+  LsmRun(const LsmRun &other) = delete;
+
+  LsmRun(LsmRun &&temp) = delete;
+
+  LsmRun &operator=(const LsmRun &other) = delete;
+
+  LsmRun &operator=(LsmRun &&temp) = delete;
+
+  /**
+   * Create the run's file and fill it from a source.
+   * @param source           entries in key order
+   * @param keep_tombstones  whether older runs below may still hold rows the
+   *                         tombstones have to hide
+   * @param fp_rate          target false-positive rate of the Bloom filter
+   */
+  virtual void write(LsmCursor &source, bool keep_tombstones, double fp_rate);
+
+  virtual void open();
+
+  /**
+   * Point read.
+   * @param key    key looked for
+   * @param row    set to the entry's row (empty for a tombstone)
+   * @param stats  counts the block read or the Bloom filter's miss
+   * @returns      whether the run has an entry for key
+   */
+  virtual bool get(u_int64_t key, std::string &row, LsmStats &stats);
+
+  /**
+   * @returns  the name of the run's heap file
+   */
+  virtual std::string get_name() const { return name; }
+
+  /**
+   * @returns  the run's metadata (not its entries) for the manifest
+   */
+  virtual std::string marshal() const;
+
+  /**
+   * @param bytes  what marshal() returned
+   * @throws       DbRelationError if they're cut short
+   */
+  virtual void unmarshal(const std::string &bytes);
+
+protected:
+  std::string name;
+  HeapFile file;
+  std::vector<u_int64_t> fences; // first key in each block
+  std::vector<u_int8_t> bloom;
+  u_int8_t probes;
+
+  virtual bool may_contain(u_int64_t key) const;
+};
+
+/**
+ * @class LsmTable - Log-structured merge-tree storage engine (implementation
+ * of DbRelation)
+ *
+ * Inserts, updates and deletes only go to the memtable, a sorted map in
+ * memory, so writing a row costs no block reads or writes. When the memtable
+ * reaches TableOptions::memtable_bytes it is written out in one pass as a new
+ * level-0 run. A background thread does leveled compaction: once there are
+ * L0_RUNS level-0 runs they are merged with level 1, and once level i (i >= 1)
+ * outgrows its limit it is merged into level i + 1. Level i + 1's limit is
+ * LEVEL_RATIO times level i's, and every level from 1 down is one sorted run.
+ *
+ * Rows are keyed by a row number handed out on insert; a row's Handle is its
+ * key split into (key >> 16, key & 0xFFFF). Point reads look in the memtable,
+ * then the level-0 runs newest first, then each level down, and stop at the
+ * first entry found. Scans merge all of them.
+ *
+ * The list of runs lives in a Berkeley DB BTree manifest beside the run files.
+ * Every write to the memtable is first appended to a write-ahead log, a
+ * Berkeley DB Recno file of (key, row) records, which is emptied once a flush
+ * has put the memtable's rows in a run. open() replays the log, so rows not yet
+ * flushed when a table was last let go of without close() come back. The log
+ * isn't synced on each write, so a crash of the machine may still lose the
+ * last writes.
+ */
+class LsmTable : public DbRelation {
+public:
+  static const uint L0_RUNS = 4;     // level-0 runs that start a compaction
+  static const uint L0_STALL = 12;   // level-0 runs that make a flush wait
+  static const uint LEVEL_RATIO = 10;
+
+  LsmTable(Identifier table_name, ColumnNames column_names,
+           ColumnAttributes column_attributes,
+           TableOptions options = TableOptions());
+
+  virtual ~LsmTable();
+
+  LsmTable(const LsmTable &other) = delete;
+
+  LsmTable(LsmTable &&temp) = delete;
+
+  LsmTable &operator=(const LsmTable &other) = delete;
+
+  LsmTable &operator=(LsmTable &&temp) = delete;
+
+  virtual void create();
+
+  virtual void create_if_not_exists();
+
+  virtual void drop();
+
+  virtual void open();
+
+  virtual void close();
+
+  virtual Handle insert(const ValueDict *row);
+
+  virtual void update(const Handle handle, const ValueDict *new_values);
+
+  virtual void del(const Handle handle);
+
+  virtual Handles *select();
+
+  virtual Handles *select(const ValueDict *where);
+
+  virtual ValueDict *project(Handle handle);
+
+  virtual ValueDict *project(Handle handle, const ColumnNames *column_names);
+
+  /**
+   * Write the memtable out as a level-0 run, if it has anything in it.
+   */
+  virtual void flush();
+
+  /**
+   * Block until the background thread has no compaction left to do.
+   * @throws  whatever stopped a compaction
+   */
+  virtual void wait_for_compaction();
+
+  /**
+   * @returns  the number of runs in each level, level 0 first
+   */
+  virtual std::vector<size_t> get_level_runs();
+
+  virtual const LsmStats &get_lookup_stats() const { return stats; }
+
+protected:
+  typedef std::vector<std::vector<std::shared_ptr<LsmRun>>> Levels;
+
+  RowCodec codec;
+  TableOptions options;
+  Memtable memtable;
+  size_t memtable_bytes;
+  u_int64_t next_key;
+  LsmStats stats;
+
+  // shared with the compaction thread and guarded by mutex
+  std::mutex mutex;
+  std::condition_variable wake; // the compaction thread may have work
+  std::condition_variable idle; // a compaction finished
+  Levels levels;                // level 0 newest first
+  u_int64_t flushed_key;        // next_key when the memtable was last flushed
+  u_int32_t next_run_id;
+  Db *manifest;
+  Db *wal;                // write-ahead log of the memtable
+  db_recno_t wal_records; // records in the log
+  bool stopping;
+  bool compacting;
+  std::exception_ptr compaction_error;
+  std::thread compactor;
+
+  virtual void manifest_open(uint flags = 0);
+
+  virtual void load_manifest();
+
+  virtual void save_manifest();
+
+  virtual void put_run(const LsmRun &run);
+
+  virtual void wal_open();
+
+  virtual void wal_close();
+
+  /**
+   * Put the log's writes back in the memtable.
+   */
+  virtual void replay_wal();
+
+  virtual void start_compactor();
+
+  virtual void stop_compactor();
+
+  virtual void compact_loop();
+
+  virtual bool plan_compaction(std::vector<std::shared_ptr<LsmRun>> &inputs,
+                               uint &target, bool &keep_tombstones);
+
+  virtual u_int64_t level_limit(uint level) const;
+
+  virtual bool lookup(u_int64_t key, std::string &row);
+
+  virtual MergeCursor *scan();
+
+  virtual std::string encode(const ValueDict *row);
+
+  virtual void write(u_int64_t key, const std::string &row);
+
+  /**
+   * Put a row (or tombstone) in the memtable, without logging it.
+   */
+  virtual void apply(u_int64_t key, const std::string &row);
+
+  virtual uint column_index(const Identifier &column_name);
+
+  static u_int64_t key_of(Handle handle);
+
+  static Handle handle_of(u_int64_t key);
+};
@@ -0,0 +1,128 @@
+/**
+ * @file mem_storage.h - Implementation of storage_engine held in memory, for
+ * temporary and hot tables. MemFile: DbFile MemTable: DbRelation
+ *
+ * @see "Seattle University, CPSC5300, Winter Quarter 2024"
+ */
+#pragma once
+
+#include "heap_storage.h"
+
+/**
+ * @class MemFile - blocks kept in an arena in RAM instead of a Berkeley DB file
+ *
+ * Blocks are carved out of chunks of CHUNK_BLOCKS blocks and stay put until
+ * the file is dropped, so a block handed out by get() is the block itself:
+ * changes to it are live at once and put() has nothing to do. Nothing is
+ * written to disk; the blocks last as long as the MemFile.
+ */
+class MemFile : public DbFile {
+public:
+  static const uint CHUNK_BLOCKS = 64;
+
+  MemFile(std::string name) : DbFile(name), last(0) {}
+
+  virtual ~MemFile() { drop(); }
+
+  MemFile(const MemFile &other) = delete;
+
+  MemFile(MemFile &&temp) = delete;
+
+  MemFile &operator=(const MemFile &other) = delete;
+
+  MemFile &operator=(MemFile &&temp) = delete;
+
+  virtual void create(void);
+
+  virtual void drop(void);
+
+  virtual void open(void) {}
+
+  virtual void close(void) {}
+
+  virtual SlottedPage *get_new(void);
+
+  virtual SlottedPage *get(BlockID block_id);
+
+  virtual void put(DbBlock *) {}
+
+  virtual BlockIDs *block_ids();
+
+  virtual u_int32_t get_last_block_id() { return last; }
+
+  /**
+   * @param block_id  a block of this file
+   * @returns         the block's memory (BLOCK_SZ bytes)
+   * @throws          DbRelationError if there's no such block
+   */
+  virtual char *address(BlockID block_id);
+
+protected:
+  std::vector<char *> chunks;
+  u_int32_t last;
+};
+
+/**
+ * @class MemTable - In-memory storage engine (implementation of DbRelation)
+ *
+ * Rows are laid out in SlottedPages exactly as HeapTable lays them out, with
+ * RowCodec rows, padding to SlottedPage::FORWARD_SZ and forwarding stubs for
+ * rows that outgrow their block, but the blocks live in a MemFile. Blocks are
+ * worked on in place, so no block is ever copied.
+ */
+class MemTable : public DbRelation {
+public:
+  MemTable(Identifier table_name, ColumnNames column_names,
+           ColumnAttributes column_attributes);
+
+  virtual ~MemTable() {}
+
+  MemTable(const MemTable &other) = delete;
+
+  MemTable(MemTable &&temp) = delete;
+
+  MemTable &operator=(const MemTable &other) = delete;
+
+  MemTable &operator=(MemTable &&temp) = delete;
+
+  virtual void create();
+
+  virtual void create_if_not_exists();
+
+  virtual void drop();
+
+  virtual void open();
+
+  virtual void close();
+
+  virtual Handle insert(const ValueDict *row);
+
+  virtual void update(const Handle handle, const ValueDict *new_values);
+
+  virtual void del(const Handle handle);
+
+  virtual Handles *select();
+
+  virtual Handles *select(const ValueDict *where);
+
+  virtual ValueDict *project(Handle handle);
+
+  virtual ValueDict *project(Handle handle, const ColumnNames *column_names);
+
+  virtual BlockIDs *group_ids();
+
+  virtual void read_batch(BlockID block_id, const ColumnNames *column_names,
+                          ColumnBatch &batch);
+
+protected:
+  MemFile file;
+  RowCodec codec;
+
+  virtual u_int16_t encode(const ValueDict *row, char *bytes);
+
+  virtual Handle append(const char *bytes, u_int16_t size, u_int16_t flags);
+
+  virtual const char *locate(Handle handle);
+
+  virtual uint column_index(const Identifier &column_name);
+};
@@ -0,0 +1,147 @@
+/**
+ * @file parallel_scan.h - Morsel-driven parallel scans: a table's blocks are
+ * cut into runs (morsels) that worker threads take from a work-stealing queue.
+ * MorselQueue ParallelScan ScanAggregate
+ *
+ * @see "Seattle University, CPSC5300, Winter Quarter 2024"
+ */
+#pragma once
+
+#include "storage_engine.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+
+/**
+ * A run of blocks, first through last.
+ */
+typedef std::pair<BlockID, BlockID> Morsel;
+
+/**
+ * @class MorselQueue - per-worker queues of morsels with work stealing
+ *
+ * Each worker starts with its own contiguous share of the blocks and works
+ * through it front to back. A worker whose queue runs dry steals from the back
+ * of another's, so the one it robs keeps scanning blocks next to each other.
+ */
+class MorselQueue {
+public:
+  /**
+   * @param first          first block to scan
+   * @param last           last block to scan
+   * @param morsel_blocks  blocks per morsel
+   * @param workers        number of workers
+   */
+  MorselQueue(BlockID first, BlockID last, uint morsel_blocks, uint workers);
+
+  virtual ~MorselQueue() {}
+
+  MorselQueue(const MorselQueue &other) = delete;
+
+  MorselQueue(MorselQueue &&temp) = delete;
+
+  MorselQueue &operator=(const MorselQueue &other) = delete;
+
+  MorselQueue &operator=(MorselQueue &&temp) = delete;
+
+  /**
+   * Take the next morsel for a worker.
+   * @param worker  which worker is asking
+   * @param morsel  set to the morsel taken
+   * @returns       false once every morsel has been taken
+   */
+  virtual bool pop(uint worker, Morsel &morsel);
+
+  /**
+   * @returns  number of morsels taken from another worker's queue
+   */
+  virtual uint get_steals() const { return steals; }
+
+protected:
+  std::vector<std::deque<Morsel>> queues; // one per worker
+  std::vector<std::mutex> locks;          // parallel to queues
+  std::atomic<uint> steals;
+};
+
+/**
+ * @class ParallelScan - runs a task over every morsel of a range of blocks on
+ * a pool of worker threads
+ *
+ * The workers are started for each run() and joined before it returns. Tasks
+ * are given their worker's number so they can keep per-thread results (and
+ * per-thread Berkeley DB handles) to merge afterwards.
+ */
+class ParallelScan {
+public:
+  static const uint MORSEL_BLOCKS = 16;
+
+  typedef std::function<void(uint worker, const Morsel &morsel)> MorselTask;
+
+  /**
+   * @param workers        number of worker threads (0 for one per core)
+   * @param morsel_blocks  blocks per morsel
+   */
+  ParallelScan(uint workers = 0, uint morsel_blocks = MORSEL_BLOCKS);
+
+  virtual ~ParallelScan() {}
+
+  ParallelScan(const ParallelScan &other) = delete;
+
+  ParallelScan(ParallelScan &&temp) = delete;
+
+  ParallelScan &operator=(const ParallelScan &other) = delete;
+
+  ParallelScan &operator=(ParallelScan &&temp) = delete;
+
+  /**
+   * Run task over blocks first through last.
+   * @throws  the first exception any task threw, once all workers are done
+   */
+  virtual void run(BlockID first, BlockID last, MorselTask task);
+
+  virtual uint get_workers() const { return workers; }
+
+  /**
+   * @returns  morsels stolen during the last run()
+   */
+  virtual uint get_steals() const { return steals; }
+
+protected:
+  uint workers;
+  uint morsel_blocks;
+  uint steals;
+};
+
+/**
+ * @class ScanAggregate - COUNT, SUM, MIN and MAX of an INT column, built up
+ * per thread and merged
+ *
+ * Each takes a cache line of its own so that workers' partials kept side by
+ * side don't contend.
+ */
+class alignas(64) ScanAggregate {
+public:
+  u_int64_t count;
+  int64_t sum;
+  int32_t min; // meaningless while count is 0
+  int32_t max;
+
+  ScanAggregate() : count(0), sum(0), min(INT32_MAX), max(INT32_MIN) {}
+
+  void add(int32_t value) {
+    this->count++;
+    this->sum += value;
+    this->min = std::min(this->min, value);
+    this->max = std::max(this->max, value);
+  }
+
+  void merge(const ScanAggregate &other) {
+    this->count += other.count;
+    this->sum += other.sum;
+    this->min = std::min(this->min, other.min);
+    this->max = std::max(this->max, other.max);
+  }
+};
@@ -0,0 +1,200 @@
+/**
+ * @file pax_storage.h - Implementation of storage_engine with PAX pages: rows
+ * stay within a block but each column's values are grouped together in it.
+ * PaxPage: DbBlock PaxTable: DbRelation
+ *
+ * @see "Seattle University, CPSC5300, Winter Quarter 2024"
+ */
+#pragma once
+
+#include "heap_storage.h"
+
+/**
+ * @class PaxPage - a block of rows stored column by column (Partition
+ * Attributes Across)
+ *
+ * The block is cut into one minipage per column, each an array with a slot
+ * for every row the page can hold, so one column's values sit next to each
+ * other in memory while a whole row is still within the block:
+ *   Bytes 0x00 - 0x01: number of records (including deleted ones)
+ *   Bytes 0x02 - 0x03: offset to end of free space in the text area
+ *   Bytes 0x04 - 0x05: capacity, the number of rows the minipages have slots
+ *                      for (0 until the page is formatted)
+ *   Bytes 0x06 - 0x07: number of columns
+ *   then for each column 2 bytes: offset of its minipage, high bit set if TEXT
+ *   then a bitmap of which records are present
+ *   then the minipages, each 8-byte aligned: an INT minipage is an int32 array;
+ *   a TEXT minipage is an array of (offset, size) u16 pairs
+ *   and last the text area, filled from the end of the block
+ *
+ * The page describes itself, so it can be read with no schema at hand. A new
+ * page is blank until format() lays it out for a table's columns.
+ *
+ * Records go in and come out in the RowCodec row format, so a PaxPage is a
+ * DbBlock like any other; the column accessors read the minipages directly.
+ */
+class PaxPage : public DbBlock {
+public:
+  /**
+   * average TEXT size format() plans for when sizing the minipages
+   */
+  static const u_int16_t TEXT_GUESS = 16;
+
+  PaxPage(Dbt &block, BlockID block_id, bool is_new = false);
+
+  virtual ~PaxPage() {}
+
+  PaxPage(const PaxPage &other) = delete;
+
+  PaxPage(PaxPage &&temp) = delete;
+
+  PaxPage &operator=(const PaxPage &other) = delete;
+
+  PaxPage &operator=(PaxPage &temp) = delete;
+
+  /**
+   * Lay out a blank page for rows of a table.
+   * @param column_attributes  the table's column types
+   * @throws DbBlockNoRoomError if not even one row would fit
+   */
+  virtual void format(const ColumnAttributes &column_attributes);
+
+  virtual bool is_formatted() const { return this->capacity != 0; }
+
+  virtual RecordID add(const Dbt *data);
+
+  virtual Dbt *get(RecordID record_id);
+
+  virtual void put(RecordID record_id, const Dbt &data);
+
+  virtual void del(RecordID record_id);
+
+  virtual RecordIDs *ids(void);
+
+  /**
+   * @param data  an encoded row
+   * @returns     whether add(data) would succeed
+   */
+  virtual bool has_room(const Dbt *data);
+
+  /**
+   * @returns  number of record slots used, including deleted records
+   */
+  virtual u_int16_t size() const { return this->num_records; }
+
+  virtual bool is_present(RecordID record_id);
+
+  /**
+   * @param column  an INT column's position
+   * @returns       its minipage: the value for record id r is at [r - 1]
+   */
+  virtual const int32_t *int_column(uint column);
+
+  virtual std::string get_text(RecordID record_id, uint column);
+
+  virtual Value get_value(RecordID record_id, uint column);
+
+protected:
+  static const u_int16_t HEADER_SZ = 8;
+  static const u_int16_t TEXT_FLAG = 0x8000;
+
+  u_int16_t num_records;
+  u_int16_t end_free;
+  u_int16_t capacity;
+  u_int16_t num_columns;
+
+  virtual void put_header();
+
+  virtual bool is_text(uint column);
+
+  virtual u_int16_t minipage(uint column);
+
+  virtual u_int16_t presence();
+
+  virtual void set_present(RecordID record_id, bool present);
+
+  virtual uint text_size(const char *bytes);
+
+  virtual void compact();
+
+  virtual void check(RecordID record_id);
+
+  virtual u_int16_t get_n(u_int16_t offset);
+
+  virtual void put_n(u_int16_t offset, u_int16_t n);
+
+  virtual void *address(u_int16_t offset);
+};
+
+/**
+ * @class PaxTable - PAX storage engine (implementation of DbRelation)
+ *
+ * A heap file of PaxPages. Filters run over a page's minipages one column at a
+ * time, and read_batch() hands over whole columns of a page, while projecting
+ * a row still reads just the one block. Rows are updated in place; an update
+ * that no longer fits in the row's page is refused.
+ */
+class PaxTable : public DbRelation {
+public:
+  PaxTable(Identifier table_name, ColumnNames column_names,
+           ColumnAttributes column_attributes);
+
+  virtual ~PaxTable() {}
+
+  PaxTable(const PaxTable &other) = delete;
+
+  PaxTable(PaxTable &&temp) = delete;
+
+  PaxTable &operator=(const PaxTable &other) = delete;
+
+  PaxTable &operator=(PaxTable &&temp) = delete;
+
+  virtual void create();
+
+  virtual void create_if_not_exists();
+
+  virtual void drop();
+
+  virtual void open();
+
+  virtual void close();
+
+  virtual Handle insert(const ValueDict *row);
+
+  /**
+   * @throws DbBlockNoRoomError if the changed row doesn't fit in its block
+   */
+  virtual void update(const Handle handle, const ValueDict *new_values);
+
+  virtual void del(const Handle handle);
+
+  virtual Handles *select();
+
+  virtual Handles *select(const ValueDict *where);
+
+  virtual ValueDict *project(Handle handle);
+
+  virtual ValueDict *project(Handle handle, const ColumnNames *column_names);
+
+  /**
+   * @returns  the table's blocks in order (freed by caller)
+   */
+  virtual BlockIDs *group_ids();
+
+  /**
+   * Read some columns of every row in a block, one minipage at a time.
+   * @param block_id      which block
+   * @param column_names  columns to read
+   * @param batch         replaced with the block's handles and values
+   */
+  virtual void read_batch(BlockID block_id, const ColumnNames *column_names,
+                          ColumnBatch &batch);
+
+protected:
+  BasicHeapFile<PaxPage> file;
+  RowCodec codec;
+
+  virtual PaxPage *get_page(BlockID block_id);
+
+  virtual uint column_index(const Identifier &column_name);
+};
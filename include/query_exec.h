@@ -0,0 +1,1167 @@
+/**
+ * @file query_exec.h - Row-at-a-time query execution: a plan is a tree of
+ * operators, and each pulls its rows from its inputs one at a time.
+ * PlanColumn PlanExpr CompiledExpr SpillFile SortKey DynamicFilter Aggregate
+ * PlanOperator TableScan Filter Project NestedLoopJoin HashJoin Sort TopN
+ * HashAggregate Limit
+ *
+ * @see "Seattle University, CPSC5300, Winter Quarter 2024"
+ */
+#pragma once
+
+#include "heap_storage.h"
+#include "storage_engine.h"
+#include <atomic>
+#include <optional>
+
+/**
+ * One row passing between plan operators, a field per output column in
+ * order. A field with no value is NULL (the missing side of an outer join).
+ */
+typedef std::vector<std::optional<Value>> Row;
+
+/**
+ * @class PlanColumn - a column of an operator's rows: the table (or alias)
+ * it came from, if any, its name and its type
+ */
+class PlanColumn {
+public:
+  Identifier table; // empty for computed columns
+  Identifier name;
+  ColumnAttribute::DataType data_type;
+
+  PlanColumn(const Identifier &table, const Identifier &name,
+             ColumnAttribute::DataType data_type)
+      : table(table), name(name), data_type(data_type) {}
+};
+
+typedef std::vector<PlanColumn> PlanColumns;
+
+/**
+ * Find a column by name, and by table if one is given.
+ * @param columns  columns to search
+ * @param table    table or alias qualifying the name, or empty
+ * @param name     column name
+ * @returns        the column's position in columns
+ * @throws         DbRelationError if there's no such column, or more than
+ *                 one when table is empty
+ */
+uint find_column(const PlanColumns &columns, const Identifier &table,
+                 const Identifier &name);
+
+/**
+ * @class PlanExpr - a scalar expression over the fields of a row
+ *
+ * Comparisons and AND/OR/NOT give INT 1 or 0; any NULL operand gives NULL,
+ * except that AND is false and OR true once either side settles it. Types
+ * are checked when the expression is built.
+ *
+ * A PARAMETER is a field of a row of parameters held outside the plan, so a
+ * plan can be run again with new values without being rebuilt. Until it is
+ * given a type it takes the one its context needs: that of the other side of
+ * a comparison, otherwise INT.
+ */
+class PlanExpr {
+public:
+  enum Kind {
+    COLUMN,
+    CONSTANT,
+    PARAMETER,
+    EQ,
+    NE,
+    LT,
+    LE,
+    GT,
+    GE,
+    AND,
+    OR,
+    NOT,
+    ADD,
+    SUB,
+    MUL,
+    DIV,
+    MOD,
+    NEG
+  };
+
+  /**
+   * The field at position column of a row.
+   */
+  static PlanExpr *column(uint column, ColumnAttribute::DataType data_type);
+
+  static PlanExpr *constant(const Value &value);
+
+  /**
+   * Field index of parameters, whose type is set by infer() or by the
+   * operators it is an operand of.
+   * @param parameters  the parameter values (not owned), set before each run
+   */
+  static PlanExpr *parameter(uint index, const Row *parameters);
+
+  /**
+   * A comparison, logical or arithmetic operator.
+   * @param left, right  operands (owned, deleted with this one); right is
+   *                     nullptr for NOT and NEG
+   * @throws             DbRelationError if the operand types don't suit it
+   *                     (the operands are deleted)
+   */
+  static PlanExpr *op(Kind kind, PlanExpr *left, PlanExpr *right = nullptr);
+
+  virtual ~PlanExpr();
+
+  PlanExpr(const PlanExpr &other) = delete;
+
+  PlanExpr(PlanExpr &&temp) = delete;
+
+  PlanExpr &operator=(const PlanExpr &other) = delete;
+
+  PlanExpr &operator=(PlanExpr &&temp) = delete;
+
+  /**
+   * Give a parameter with no type yet the given one.
+   * @returns  whether this is such a parameter
+   */
+  virtual bool infer(ColumnAttribute::DataType data_type);
+
+  /**
+   * @returns  the expression's value for a row, or nothing for NULL
+   * @throws   DbRelationError on division by zero or a parameter value of
+   *           the wrong type
+   */
+  virtual std::optional<Value> eval(const Row &row) const;
+
+  /**
+   * @returns  whether the expression is true (not NULL and not 0) for a row
+   */
+  virtual bool test(const Row &row) const;
+
+  virtual Kind get_kind() const { return kind; }
+
+  virtual ColumnAttribute::DataType get_data_type() const { return data_type; }
+
+  /**
+   * @returns  whether the expression has neither columns nor parameters, so
+   *           its value is the same for every row
+   */
+  virtual bool is_constant() const;
+
+  virtual uint get_column_index() const { return column_index; }
+
+  virtual const Value &get_value() const { return value; }
+
+  virtual const Row *get_parameters() const { return parameters; }
+
+  virtual const PlanExpr *get_left() const { return left; }
+
+  virtual const PlanExpr *get_right() const { return right; }
+
+protected:
+  Kind kind;
+  ColumnAttribute::DataType data_type;
+  uint column_index;      // COLUMN, PARAMETER
+  Value value;            // CONSTANT
+  const Row *parameters;  // PARAMETER
+  bool typed;             // false for a PARAMETER until it has a type
+  PlanExpr *left, *right; // operators
+
+  PlanExpr(Kind kind, ColumnAttribute::DataType data_type);
+};
+
+typedef std::vector<PlanExpr *> PlanExprs;
+
+/**
+ * Column values computed each time a plan runs, keyed by column name.
+ */
+typedef std::map<Identifier, PlanExpr *> ExprDict;
+
+/**
+ * @class CompiledExpr - a PlanExpr compiled for evaluating row after row
+ *
+ * The expression tree is turned once into a flat list of instructions over
+ * registers, each instruction specialized for the types of its operands, so
+ * evaluating a row is one loop with no recursion, no virtual calls and no
+ * Values built or copied until the result. TEXT registers point at the row's
+ * fields rather than copying them. Subexpressions without columns or
+ * parameters are worked out when compiling, as are AND/OR with a constant
+ * side, and a comparison of an INT column with a constant is a single
+ * instruction.
+ *
+ * Evaluation gives the same results as PlanExpr::eval(), but uses registers
+ * held by the object, so one CompiledExpr must not evaluate rows on two
+ * threads at once.
+ */
+class CompiledExpr {
+public:
+  /**
+   * @param expr  expression to compile (not kept, so it may be deleted)
+   */
+  explicit CompiledExpr(const PlanExpr &expr);
+
+  virtual ~CompiledExpr() {}
+
+  CompiledExpr(const CompiledExpr &other) = delete;
+
+  CompiledExpr(CompiledExpr &&temp) = delete;
+
+  CompiledExpr &operator=(const CompiledExpr &other) = delete;
+
+  CompiledExpr &operator=(CompiledExpr &&temp) = delete;
+
+  /**
+   * @returns  the expression's value for a row, or nothing for NULL
+   * @throws   DbRelationError as PlanExpr::eval()
+   */
+  virtual std::optional<Value> eval(const Row &row) const;
+
+  /**
+   * @returns  whether the expression is true (not NULL and not 0) for a row
+   */
+  virtual bool test(const Row &row) const;
+
+  virtual ColumnAttribute::DataType get_data_type() const { return data_type; }
+
+  /**
+   * @returns  the number of instructions run for each row
+   */
+  virtual size_t size() const { return code.size(); }
+
+protected:
+  enum Opcode {
+    INT_COLUMN,     // dest = row[a]
+    TEXT_COLUMN,
+    INT_CONSTANT,   // dest = n
+    TEXT_CONSTANT,  // dest = constants[a]
+    INT_PARAMETER,  // dest = (*parameters)[a], type checked
+    TEXT_PARAMETER,
+    EQ_INT,         // dest = a op b, in the order of PlanExpr's comparisons
+    NE_INT,
+    LT_INT,
+    LE_INT,
+    GT_INT,
+    GE_INT,
+    EQ_TEXT,
+    NE_TEXT,
+    LT_TEXT,
+    LE_TEXT,
+    GT_TEXT,
+    GE_TEXT,
+    EQ_INT_COLUMN,  // dest = row[a] op n
+    NE_INT_COLUMN,
+    LT_INT_COLUMN,
+    LE_INT_COLUMN,
+    GT_INT_COLUMN,
+    GE_INT_COLUMN,
+    ADD,            // dest = a op b
+    SUB,
+    MUL,
+    DIV,
+    MOD,
+    NOT,            // dest = op a
+    NEG,
+    TRUTH,          // dest = a != 0
+    SKIP_IF_FALSE,  // if a is false, dest = 0 and skip n instructions
+    SKIP_IF_TRUE,   // if a is true, dest = 1 and skip n instructions
+    AND,            // dest = a op b, once neither settled it
+    OR
+  };
+
+  class Instruction {
+  public:
+    Opcode opcode;
+    uint dest; // register set
+    uint a, b; // registers read, or a column, parameter or constant index
+    int32_t n; // immediate INT, or instructions to skip
+  };
+
+  class Register {
+  public:
+    bool null;
+    int32_t n;
+    const std::string *s; // TEXT: a row field or a constant
+  };
+
+  std::vector<Instruction> code;
+  std::vector<std::string> constants;
+  const Row *parameters;
+  ColumnAttribute::DataType data_type;
+  uint result; // register holding the value once code has run
+  mutable std::vector<Register> registers;
+
+  uint compile(const PlanExpr &expr);
+  uint load(const Value &value);
+  uint emit(Opcode opcode, uint a = 0, uint b = 0, int32_t n = 0);
+  void run(const Row &row) const;
+};
+
+typedef std::vector<CompiledExpr *> CompiledExprs;
+
+/**
+ * @class SpillFile - rows an operator has no memory left for, written to a
+ * temporary HeapFile and read back in the order they were written
+ *
+ * Each row is one record of its fields in order, each a tag byte (NULL, INT
+ * or TEXT) followed by the value: INT as 4 bytes, TEXT as a 2-byte length
+ * and that many bytes. The file is dropped when the SpillFile is deleted.
+ */
+class SpillFile {
+public:
+  SpillFile();
+
+  virtual ~SpillFile();
+
+  SpillFile(const SpillFile &other) = delete;
+
+  SpillFile(SpillFile &&temp) = delete;
+
+  SpillFile &operator=(const SpillFile &other) = delete;
+
+  SpillFile &operator=(SpillFile &&temp) = delete;
+
+  /**
+   * Add a row at the end.
+   * @throws  DbRelationError if it is too big for a block
+   */
+  virtual void append(const Row &row);
+
+  /**
+   * Get ready to read from the first row; no more may be appended.
+   */
+  virtual void rewind();
+
+  /**
+   * Read the next row.
+   * @param row  replaced with the row
+   * @returns    false once there are no more
+   */
+  virtual bool next(Row &row);
+
+  /**
+   * @returns  the number of rows appended
+   */
+  virtual size_t size() const { return rows; }
+
+  /**
+   * @returns  the bytes taken by the rows appended
+   */
+  virtual size_t get_bytes() const { return bytes; }
+
+protected:
+  static std::atomic<u_int32_t> created; // files so far, to name them apart
+
+  HeapFile file;
+  SlottedPage *block;    // the block being filled, or being read
+  RecordIDs *record_ids; // of the block being read
+  size_t next_record;    // of record_ids
+  bool writing;
+  size_t rows;
+  size_t bytes;
+
+  static std::string next_name();
+};
+
+/**
+ * @class SortKey - a column to order rows by, and which way
+ */
+class SortKey {
+public:
+  uint column;
+  bool descending;
+
+  SortKey(uint column, bool descending = false)
+      : column(column), descending(descending) {}
+};
+
+typedef std::vector<SortKey> SortKeys;
+
+/**
+ * Normalize a row's sort key into bytes that memcmp() orders (a prefix
+ * first) as the rows are to be ordered.
+ *
+ * Each key column is a byte for NULL (0) or not (1) and then its value: an
+ * INT as 4 big-endian bytes with the sign bit flipped, a TEXT as its bytes
+ * with each 0 escaped as 0 255 and then 0 0 to end it. A descending column's
+ * bytes are all inverted. So NULLs come first, or last when descending.
+ * @param key  set to the bytes
+ */
+void normalize_key(const Row &row, const SortKeys &keys, std::string &key);
+
+/**
+ * @returns  <0, 0 or >0 as a sorts before, with or after b
+ */
+int compare_keys(const std::string &a, const std::string &b);
+
+/**
+ * @class DynamicFilter - a bound on a sort key that rows must not sort after,
+ * tightened by an operator above a scan as it learns which rows it can use
+ *
+ * Until a bound is set every row passes. A row whose key equals the bound
+ * passes, since it may still win on later keys.
+ */
+class DynamicFilter {
+public:
+  /**
+   * @param key  the column (of the rows checked) and its order
+   */
+  DynamicFilter(const SortKey &key) : keys({key}), bounded(false) {}
+
+  virtual ~DynamicFilter() {}
+
+  DynamicFilter(const DynamicFilter &other) = delete;
+
+  DynamicFilter(DynamicFilter &&temp) = delete;
+
+  DynamicFilter &operator=(const DynamicFilter &other) = delete;
+
+  DynamicFilter &operator=(DynamicFilter &&temp) = delete;
+
+  const SortKey &get_key() const { return keys[0]; }
+
+  /**
+   * Let every row through again.
+   */
+  virtual void reset() { bounded = false; }
+
+  /**
+   * Only let through rows whose key column sorts no later than value.
+   */
+  virtual void set_bound(const std::optional<Value> &value);
+
+  virtual bool is_bounded() const { return bounded; }
+
+  /**
+   * @returns  the bound; only meaningful once is_bounded()
+   */
+  virtual const std::optional<Value> &get_bound() const { return bound; }
+
+  /**
+   * @returns  false if the row certainly sorts after the bound
+   */
+  virtual bool passes(const Row &row) const;
+
+protected:
+  SortKeys keys; // just the one
+  bool bounded;
+  std::optional<Value> bound;
+  std::string bound_key;       // normalized
+  mutable std::string row_key; // scratch for passes()
+};
+
+/**
+ * @class Aggregate - an aggregate function of a column over a group of rows
+ *
+ * Each gives an INT. COUNT(*) counts rows and COUNT(column) those where the
+ * column isn't NULL; SUM and AVG (truncated toward zero) skip NULLs and are
+ * NULL if every value was.
+ */
+class Aggregate {
+public:
+  enum Function { COUNT_STAR, COUNT, SUM, AVG };
+
+  Function function;
+  uint column; // unused for COUNT_STAR
+
+  Aggregate(Function function, uint column = 0)
+      : function(function), column(column) {}
+};
+
+typedef std::vector<Aggregate> Aggregates;
+
+/**
+ * @class PlanOperator - a node in a query plan
+ *
+ * A plan runs by calling open() on its root, then next() until it returns
+ * false, then close(). Each operator asks its inputs for rows only as it
+ * needs them, so rows flow up the tree one at a time and only operators that
+ * must see a whole input first (like the inner side of a join) hold rows.
+ */
+class PlanOperator {
+public:
+  PlanOperator() {}
+
+  virtual ~PlanOperator() {}
+
+  PlanOperator(const PlanOperator &other) = delete;
+
+  PlanOperator(PlanOperator &&temp) = delete;
+
+  PlanOperator &operator=(const PlanOperator &other) = delete;
+
+  PlanOperator &operator=(PlanOperator &&temp) = delete;
+
+  /**
+   * Get ready to produce rows from the start.
+   */
+  virtual void open() = 0;
+
+  /**
+   * Produce the next row.
+   * @param row  replaced with the row
+   * @returns    false once there are no more
+   */
+  virtual bool next(Row &row) = 0;
+
+  /**
+   * Let go of anything held for producing rows.
+   */
+  virtual void close() = 0;
+
+  /**
+   * @returns  the columns of the rows produced, in order
+   */
+  virtual const PlanColumns &get_columns() const { return columns; }
+
+protected:
+  PlanColumns columns;
+};
+
+/**
+ * @class TableScan - a relation's rows, every column, optionally only those
+ * matching equality predicates that the relation itself evaluates (so its
+ * indexes, zone maps and Bloom filters apply)
+ *
+ * The handles are selected on open(), but each row is projected only when
+ * next() is called for it. Predicate values that are expressions are worked
+ * out on open(), so they may use parameters; a NULL matches nothing.
+ *
+ * Given a DynamicFilter, rows it turns away are skipped. A HeapTable with no
+ * predicates is then read a block at a time, each block's handles selected
+ * only when the last block's rows are used up and with the filter's bound at
+ * that moment, so the zone map can rule out blocks on an INT key column.
+ *
+ * A HeapTable scan can instead be ordered by a column, through
+ * HeapTable::select_ordered(), which reads an ordered index on it if there is
+ * one rather than sorting.
+ */
+class TableScan : public PlanOperator {
+public:
+  /**
+   * @param relation  an open relation (not owned)
+   * @param alias     the table name the columns are qualified with
+   * @param where     predicates to pass to DbRelation::select(), if any
+   */
+  TableScan(DbRelation *relation, const Identifier &alias,
+            const ValueDict *where = nullptr);
+
+  /**
+   * @param where  constant expressions (owned) for the values to select
+   */
+  TableScan(DbRelation *relation, const Identifier &alias,
+            const ExprDict &where);
+
+  virtual ~TableScan();
+
+  virtual void open();
+
+  virtual bool next(Row &row);
+
+  virtual void close();
+
+  /**
+   * @param filter  bound on this scan's rows (not owned), or nullptr for none
+   */
+  virtual void set_filter(const DynamicFilter *filter) {
+    this->filter = filter;
+  }
+
+  /**
+   * @returns  blocks the last open() ruled out with the filter, unread
+   */
+  virtual size_t get_blocks_skipped() const { return blocks_skipped; }
+
+  /**
+   * Give the rows in order of a column (of a HeapTable).
+   * @param column_name  the column, or empty for the table's own order
+   */
+  virtual void set_order(const Identifier &column_name,
+                         bool descending = false) {
+    this->order_by = column_name;
+    this->descending = descending;
+  }
+
+protected:
+  DbRelation *relation;
+  ExprDict where;
+  Handles *handles;
+  size_t next_handle;
+  const DynamicFilter *filter;
+  Identifier order_by; // empty for none
+  bool descending;
+  BlockIDs *block_ids; // when reading a block at a time
+  size_t next_block;
+  size_t blocks_skipped;
+
+  /**
+   * Select the handles of the next block that has any rows left.
+   * @returns  false once there are no more blocks
+   */
+  bool next_block_handles();
+};
+
+/**
+ * @class Filter - the rows of its input for which a predicate is true
+ */
+class Filter : public PlanOperator {
+public:
+  /**
+   * @param input      operator to filter (owned, deleted with this one)
+   * @param predicate  expression over input's columns (owned; compiled and
+   *                   then deleted)
+   */
+  Filter(PlanOperator *input, PlanExpr *predicate);
+
+  virtual ~Filter();
+
+  virtual void open() { input->open(); }
+
+  virtual bool next(Row &row);
+
+  virtual void close() { input->close(); }
+
+protected:
+  PlanOperator *input;
+  CompiledExpr *predicate;
+};
+
+/**
+ * @class Project - computes a row of expressions for each row of its input
+ */
+class Project : public PlanOperator {
+public:
+  /**
+   * @param input        operator to project (owned, deleted with this one)
+   * @param expressions  one per output column, over input's columns (owned;
+   *                     compiled and then deleted)
+   * @param columns      the output columns' names (their types are taken
+   *                     from expressions)
+   */
+  Project(PlanOperator *input, const PlanExprs &expressions,
+          const PlanColumns &columns);
+
+  virtual ~Project();
+
+  virtual void open() { input->open(); }
+
+  virtual bool next(Row &row);
+
+  virtual void close() { input->close(); }
+
+protected:
+  PlanOperator *input;
+  CompiledExprs expressions;
+  Row input_row;
+};
+
+/**
+ * @class NestedLoopJoin - pairs each row of its left input with every row of
+ * its right input for which a condition is true
+ *
+ * Rows have the left input's columns followed by the right input's. The
+ * right input is read into memory on open(); the left one streams. For a
+ * LEFT join, a left row matching nothing comes out once with NULLs for the
+ * right columns.
+ */
+class NestedLoopJoin : public PlanOperator {
+public:
+  /**
+   * @param left, right  inputs (owned, deleted with this one)
+   * @param condition    expression over the joined columns (owned; compiled
+   *                     and then deleted), or nullptr to pair every row with
+   *                     every row
+   * @param left_outer   keep left rows that match nothing
+   */
+  NestedLoopJoin(PlanOperator *left, PlanOperator *right, PlanExpr *condition,
+                 bool left_outer = false);
+
+  virtual ~NestedLoopJoin();
+
+  virtual void open();
+
+  virtual bool next(Row &row);
+
+  virtual void close();
+
+protected:
+  PlanOperator *left;
+  PlanOperator *right;
+  CompiledExpr *condition; // nullptr for none
+  bool left_outer;
+  std::vector<Row> right_rows;
+  Row left_row;
+  bool have_left;    // left_row is current
+  bool left_matched; // left_row has been output at least once
+  size_t next_right; // of right_rows
+};
+
+/**
+ * @class HashJoin - pairs the rows of its left and right inputs whose key
+ * columns are equal, and for which any other condition is true
+ *
+ * Rows have the left input's columns followed by the right input's, as for
+ * NestedLoopJoin. The rows of one input are put into a hash table and the
+ * other input probes it. The table is built on the smaller input: open()
+ * reads a row from each in turn until one runs out, and it becomes the build
+ * side, while the rows read ahead from the other side are probed first. A
+ * NULL key matches nothing. For a LEFT join, a left row matching nothing
+ * comes out once with NULLs for the right columns, whichever side it was on.
+ *
+ * The table uses open addressing with linear probing. Each slot is a key's
+ * hash and its first row, and the rows with the same key are chained, so a
+ * probe walks a short run of adjacent slots.
+ *
+ * If neither input runs out before the rows read ahead take more than the
+ * memory budget, the join falls back to grace partitioning: both inputs are
+ * written to PARTITIONS pairs of SpillFiles by hash of the key, and then each
+ * pair is joined in turn with the table built on the smaller of its sides.
+ * A pair too big for the budget is partitioned again (on other bits of the
+ * hash), up to MAX_DEPTH times, after which it is joined in memory anyway:
+ * its rows must all share a few keys.
+ */
+class HashJoin : public PlanOperator {
+public:
+  static const size_t MEMORY_BUDGET = 16 << 20; // bytes of rows
+  static const uint PARTITIONS = 16;
+  static const uint MAX_DEPTH = 3;
+
+  /**
+   * @param left, right  inputs (owned, deleted with this one)
+   * @param left_keys    key columns of the left input
+   * @param right_keys   of the right input, one to equal each left key
+   * @param residual     rest of the condition, over the joined columns
+   *                     (owned; compiled and then deleted), or nullptr
+   * @param left_outer   keep left rows that match nothing
+   * @param budget       most bytes of rows to hold before partitioning
+   */
+  HashJoin(PlanOperator *left, PlanOperator *right,
+           const std::vector<uint> &left_keys,
+           const std::vector<uint> &right_keys, PlanExpr *residual = nullptr,
+           bool left_outer = false, size_t budget = MEMORY_BUDGET);
+
+  virtual ~HashJoin();
+
+  virtual void open();
+
+  virtual bool next(Row &row);
+
+  virtual void close();
+
+  /**
+   * @returns  the number of pairs of partitions written out by the last
+   *           open(), counting those partitioned again; 0 if it all fit
+   */
+  virtual size_t get_spilled() const { return spilled; }
+
+protected:
+  static const u_int32_t NO_ROW = UINT32_MAX;
+
+  class Slot {
+  public:
+    u_int32_t hash; // low half of the key's hash
+    u_int32_t head; // first build row with the key, or NO_ROW if empty
+  };
+
+  class Partition {
+  public:
+    SpillFile *left;
+    SpillFile *right;
+    uint depth; // times partitioned
+  };
+
+  /**
+   * Rows to be read in turn from a buffer, then an operator or a SpillFile.
+   */
+  class RowSource {
+  public:
+    std::vector<Row> rows;
+    size_t next_row;     // of rows
+    PlanOperator *input; // read after rows, if not nullptr (not owned)
+    SpillFile *file;     // or this, if not nullptr (owned)
+
+    RowSource() : next_row(0), input(nullptr), file(nullptr) {}
+
+    virtual ~RowSource() { clear(); }
+
+    RowSource(const RowSource &other) = delete;
+
+    RowSource(RowSource &&temp) = delete;
+
+    RowSource &operator=(const RowSource &other) = delete;
+
+    RowSource &operator=(RowSource &&temp) = delete;
+
+    virtual bool next(Row &row);
+
+    virtual void clear();
+  };
+
+  PlanOperator *left;
+  PlanOperator *right;
+  std::vector<uint> left_keys;
+  std::vector<uint> right_keys;
+  CompiledExpr *residual;
+  bool left_outer;
+  size_t budget;
+  std::vector<Partition> partitions; // still to be joined (owned)
+  size_t spilled;
+
+  // the join under way: a table on one side's rows probed by the other's
+  bool build_left;
+  std::vector<Row> build_rows;
+  std::vector<u_int32_t> build_next; // next build row with the same key
+  std::vector<bool> build_matched;   // LEFT join built on the left side
+  std::vector<Slot> slots;           // a power of two of them
+  RowSource probe;
+  Row probe_row;
+  bool have_probe;       // probe_row is current
+  bool probe_matched;    // probe_row has been output at least once
+  u_int32_t match;       // next build row to try with probe_row
+  size_t next_unmatched; // of build_rows, once probing is done
+
+  /**
+   * Put rows into the table, keyed on the build side's key columns.
+   */
+  void build(std::vector<Row> &rows);
+
+  /**
+   * @returns  the first build row whose key equals row's, or NO_ROW
+   */
+  u_int32_t lookup(const Row &row, const std::vector<uint> &keys) const;
+
+  /**
+   * Write both sources out to PARTITIONS new pairs by hash of the key, and
+   * add those with rows that can come out to partitions.
+   * @param depth  times the rows have been partitioned already
+   */
+  void partition(RowSource &left_rows, RowSource &right_rows, uint depth);
+
+  /**
+   * Build and probe the next pair of partitions.
+   * @returns  false if there are none left
+   */
+  bool next_partition();
+
+  void join_rows(const Row &build, Row &row) const;
+  void clear();
+};
+
+/**
+ * @class Sort - the rows of its input in order of its sort keys, rows with
+ * equal keys keeping their input order
+ *
+ * open() reads the whole input. Each row's key is normalized as it comes, so
+ * rows are compared with memcmp(). Rows are gathered up to the memory budget,
+ * then sorted into a run and written to a SpillFile, and so on to the end of
+ * the input; the last rows are sorted but stay in memory. next() merges the
+ * runs with a loser tree, which finds the next row with one comparison per
+ * level of the tree.
+ *
+ * Given threads, a batch of rows big enough to share out is cut into that
+ * many slices, each sorted on its own thread into a run of its own.
+ */
+class Sort : public PlanOperator {
+public:
+  static const size_t MEMORY_BUDGET = 16 << 20; // bytes of rows and keys
+  static const size_t MIN_SLICE_ROWS = 4096; // fewest rows sorted by a thread
+
+  /**
+   * @param input    operator to sort (owned, deleted with this one)
+   * @param keys     columns to sort on, the first first
+   * @param budget   most bytes of rows and keys to hold before spilling a run
+   * @param threads  most threads to sort a batch of rows on (0 for one per
+   *                 core)
+   */
+  Sort(PlanOperator *input, const SortKeys &keys,
+       size_t budget = MEMORY_BUDGET, uint threads = 1);
+
+  virtual ~Sort();
+
+  virtual void open();
+
+  virtual bool next(Row &row);
+
+  virtual void close();
+
+  /**
+   * @returns  the number of runs written out by the last open(); 0 if the
+   *           rows all fit in memory
+   */
+  virtual size_t get_spilled() const { return spilled; }
+
+protected:
+  class Keyed {
+  public:
+    std::string key;
+    u_int32_t row; // of rows
+  };
+
+  // a sorted run being merged, in memory or on disk
+  class Run {
+  public:
+    SpillFile *file; // nullptr for rows in memory
+    size_t next;     // in memory: of keyed
+    size_t end;
+    std::string key; // on disk: the current row and its key
+    Row row;
+    bool done;
+
+    Run() : file(nullptr), next(0), end(0), done(false) {}
+
+    virtual ~Run() { delete file; }
+
+    Run(const Run &other) = delete;
+
+    Run(Run &&temp) = delete;
+
+    Run &operator=(const Run &other) = delete;
+
+    Run &operator=(Run &&temp) = delete;
+  };
+
+  PlanOperator *input;
+  SortKeys keys;
+  size_t budget;
+  uint threads;
+  std::vector<Row> rows;       // read since the last run was spilled
+  std::vector<Keyed> keyed;    // their keys, in order once sorted
+  std::vector<Run *> runs;     // in the order their rows were read
+  std::vector<u_int32_t> tree; // tree[0] the winning run, the rest losers
+  size_t spilled;
+
+  /**
+   * Sort keyed into runs, written out if spill, or left in memory.
+   */
+  void sort_runs(bool spill);
+
+  /**
+   * @returns  the key of a run's current row, or nullptr once it's done
+   */
+  const std::string *current(u_int32_t run) const;
+
+  /**
+   * @returns  whether run a's current row goes before run b's
+   */
+  bool beats(u_int32_t a, u_int32_t b) const;
+
+  void advance(u_int32_t run);
+
+  /**
+   * Play off the runs under a node of the tree, leaving the losers at its
+   * nodes.
+   * @returns  the winner
+   */
+  u_int32_t play(u_int32_t node);
+
+  void clear();
+};
+
+/**
+ * @class TopN - the first limit rows of its input in order of its sort keys,
+ * as Sort and then Limit would give them, without sorting the rest
+ *
+ * open() reads the whole input, keeping the best rows so far in a heap with
+ * the worst of them on top, so holding no more than limit rows. Once the heap
+ * is full, its worst row's first key is set as the bound of its filter, which
+ * a scan below can use to skip rows that can't make the cut.
+ */
+class TopN : public PlanOperator {
+public:
+  static const size_t MAX_LIMIT = 1 << 16; // more rows are for Sort and Limit
+
+  /**
+   * @param input  operator to take rows from (owned, deleted with this one)
+   * @param keys   columns to order by, the first first
+   * @param limit  how many rows to keep
+   */
+  TopN(PlanOperator *input, const SortKeys &keys, size_t limit);
+
+  virtual ~TopN();
+
+  virtual void open();
+
+  virtual bool next(Row &row);
+
+  virtual void close();
+
+  /**
+   * @returns  the bound on the first key, over the input's columns, for a
+   *           scan below to skip rows with
+   */
+  virtual const DynamicFilter *get_filter() const { return &filter; }
+
+protected:
+  class Keyed {
+  public:
+    std::string key;
+    size_t sequence; // of the input rows, to break ties in input order
+    Row row;
+  };
+
+  PlanOperator *input;
+  SortKeys keys;
+  size_t limit;
+  DynamicFilter filter;
+  std::vector<Keyed> heap; // the worst kept row on top; sorted by open()
+  size_t next_row;
+
+  /**
+   * @returns  whether a sorts before b
+   */
+  static bool before(const Keyed &a, const Keyed &b);
+};
+
+/**
+ * @class HashAggregate - a row for each group of its input's rows with equal
+ * group-by columns (NULLs grouping together), of those columns followed by
+ * aggregates over the group's rows
+ *
+ * With no group-by columns there is one group, and so one row even for no
+ * input at all. Its COUNT(*) is just counted, rows never being looked into.
+ *
+ * Groups are found through a hash table with open addressing, like
+ * HashJoin's. With a single INT group-by column the slots hold the values
+ * themselves, so finding a group never leaves the slots.
+ *
+ * open() reads the input in batches. Given threads, a batch big enough to
+ * share out is cut into slices, and each thread pre-aggregates its slice
+ * into a table of its own; the tables are merged once the input is done.
+ * Whenever the tables take more than the memory budget, their groups are
+ * written out by hash of the group to PARTITIONS SpillFiles and the tables
+ * emptied. Then at the end each partition in turn is read back and merged
+ * into a table, which holds a share of the groups.
+ */
+class HashAggregate : public PlanOperator {
+public:
+  static const size_t MEMORY_BUDGET = 16 << 20; // bytes of groups
+  static const uint PARTITIONS = 16;
+  static const size_t BATCH_ROWS = 4096; // per thread
+
+  /**
+   * @param input       operator to aggregate (owned, deleted with this one)
+   * @param group_by    columns of input to group by
+   * @param aggregates  what to work out over each group
+   * @param budget      most bytes of groups to hold before spilling
+   * @param threads     most threads to aggregate a batch on (0 for one per
+   *                    core)
+   */
+  HashAggregate(PlanOperator *input, const std::vector<uint> &group_by,
+                const Aggregates &aggregates, size_t budget = MEMORY_BUDGET,
+                uint threads = 1);
+
+  virtual ~HashAggregate();
+
+  virtual void open();
+
+  virtual bool next(Row &row);
+
+  virtual void close();
+
+  /**
+   * @returns  the number of times the last open() wrote groups out; 0 if
+   *           they all fit in memory
+   */
+  virtual size_t get_spilled() const { return spilled; }
+
+protected:
+  static const u_int32_t NO_GROUP = UINT32_MAX;
+
+  class Accumulator {
+  public:
+    int64_t count;
+    int64_t sum;
+  };
+
+  class Slot {
+  public:
+    u_int32_t hash;  // or with a single INT key, the key itself
+    u_int32_t group; // NO_GROUP if empty
+  };
+
+  // groups found so far, by one thread or from one partition
+  class Groups {
+  public:
+    std::vector<Row> keys;                 // each group's group-by values
+    std::vector<Accumulator> accumulators; // each group's, one per aggregate
+    std::vector<Slot> slots;               // a power of two of them
+    u_int32_t null_group; // with a single INT key, the NULL key's group
+    size_t bytes;
+
+    Groups() : null_group(NO_GROUP), bytes(0) {}
+
+    void clear();
+  };
+
+  PlanOperator *input;
+  std::vector<uint> group_by;
+  std::vector<uint> key_columns; // 0 up to the number of group-by columns
+  Aggregates aggregates;
+  size_t budget;
+  uint threads;
+  bool int_key; // a single INT group-by column
+  std::vector<Groups> tables; // one per thread; the first gives the output
+  std::vector<SpillFile *> partitions; // still to be merged (owned)
+  size_t spilled;
+  size_t next_group; // of tables[0], to output
+
+  /**
+   * Add a batch of input rows to tables, sliced out among threads.
+   */
+  void add_rows(const std::vector<Row> &rows);
+
+  /**
+   * Add a row to its group.
+   */
+  void add_row(Groups &groups, const Row &row);
+
+  /**
+   * @param columns  the group-by values' positions in row
+   * @returns        the group with row's group-by values, added if new
+   */
+  u_int32_t find_group(Groups &groups, const Row &row,
+                       const std::vector<uint> &columns);
+
+  u_int32_t new_group(Groups &groups, const Row &row,
+                      const std::vector<uint> &columns);
+
+  /**
+   * Add accumulators into a group's.
+   */
+  void merge(Groups &groups, u_int32_t group, const Accumulator *from);
+
+  /**
+   * Write the groups of every table out to partitions and empty the tables.
+   */
+  void spill();
+
+  /**
+   * Merge the next partition's groups into tables[0].
+   * @returns  false if there are none left
+   */
+  bool next_partition();
+
+  void grow(Groups &groups);
+  void clear();
+};
+
+/**
+ * @class Limit - at most limit rows of its input, after skipping offset
+ */
+class Limit : public PlanOperator {
+public:
+  /**
+   * @param input  operator to limit (owned, deleted with this one)
+   */
+  Limit(PlanOperator *input, size_t limit, size_t offset = 0);
+
+  virtual ~Limit() { delete input; }
+
+  virtual void open();
+
+  virtual bool next(Row &row);
+
+  virtual void close() { input->close(); }
+
+protected:
+  PlanOperator *input;
+  size_t limit;
+  size_t offset;
+  size_t produced; // rows output since open()
+};
@@ -0,0 +1,134 @@
+/**
+ * @file row_codec.h - Per-table row encoder/decoder.
+ * RowCodec
+ *
+ * @see "Seattle University, CPSC5300, Winter Quarter 2024"
+ */
+#pragma once
+
+#include "storage_engine.h"
+#include <unordered_map>
+
+/**
+ * @class RowCodec - marshals rows of one table to and from their on-page bytes
+ *
+ * The codec is compiled once from the table's schema, splitting the columns
+ * into the fixed-width INTs and the variable-width TEXTs. A row is laid out
+ * as runs: the first starts the row, and each TEXT field starts another, the
+ * INT fields between at static offsets within their run. So a row's field
+ * offsets come from one pass over its TEXT lengths, and decoding is a loop
+ * over the INT columns and another over the TEXT columns, with no per-column
+ * type dispatch. The ValueDict is then built in key order, so there are no
+ * name lookups.
+ *
+ * encode(), size() and decode() line values up in scratch space sized for the
+ * schema once, so a codec must not be used by two threads at once for those;
+ * field() and column_index() may be.
+ *
+ * Row format (unchanged from HeapTable's original marshal):
+ *   INT   4-byte little-endian int32
+ *   TEXT  2-byte length followed by that many bytes
+ */
+class RowCodec {
+public:
+  /**
+   * every column takes at least two bytes and a row must fit in a DbBlock
+   */
+  static const uint MAX_COLUMNS = DbBlock::BLOCK_SZ / sizeof(u_int16_t);
+
+  RowCodec(const ColumnNames &column_names,
+           const ColumnAttributes &column_attributes);
+
+  virtual ~RowCodec() {}
+
+  /**
+   * Number of bytes encode() will write for this row. This is the true size
+   * however big the row is; the caller rejects rows too big for its blocks.
+   * @param row  a dictionary holding at least every column of the table
+   * @returns    the encoded size
+   */
+  uint size(const ValueDict *row) const;
+
+  /**
+   * Encode row into bytes, which must hold size(row) bytes.
+   * @param row    a dictionary holding at least every column of the table
+   * @param bytes  destination (usually the record's slot in a block)
+   * @returns      the number of bytes written
+   * @throws       DbRelationError if a TEXT value is over 65535 bytes long
+   */
+  uint encode(const ValueDict *row, char *bytes) const;
+
+  /**
+   * Decode every column of an encoded row.
+   * @param bytes  encoded row
+   * @returns      dictionary keyed by all column names (freed by caller)
+   */
+  ValueDict *decode(const char *bytes) const;
+
+  /**
+   * Decode only the named columns of an encoded row.
+   * @param bytes         encoded row
+   * @param column_names  columns to decode
+   * @returns             dictionary keyed by column_names (freed by caller)
+   * @throws              DbRelationError for an unknown column
+   */
+  ValueDict *decode(const char *bytes, const ColumnNames *column_names) const;
+
+  /**
+   * Decode a single column of an encoded row.
+   * @param bytes   encoded row
+   * @param column  position of the column in the table's schema
+   * @returns       the column's value
+   */
+  Value field(const char *bytes, uint column) const;
+
+  /**
+   * Position of the named column in the table's schema.
+   * @param column_name  column to look up
+   * @returns            its position, or -1 if there is no such column
+   */
+  int column_index(const Identifier &column_name) const;
+
+  /**
+   * @returns  true if every column is fixed width (rows are all the same size)
+   */
+  bool is_fixed_width() const { return texts.empty(); }
+
+protected:
+  // where a column's field is: offset bytes into a run
+  struct Place {
+    u_int16_t run;
+    u_int16_t offset;
+    bool text;
+  };
+
+  std::vector<Place> places;           // one per column, in storage order
+  std::vector<uint> ints;              // the INT columns, in storage order
+  std::vector<uint> texts;             // the TEXT columns, in storage order
+  std::vector<u_int16_t> run_sizes;    // bytes of INT fields in each run
+  u_int16_t fixed_size;                // bytes of all but the TEXT contents
+  ColumnNames names;                   // column names in storage order
+  std::vector<uint> key_order;         // storage positions sorted by name
+  std::unordered_map<Identifier, uint> positions; // name -> storage position
+
+  // scratch, one entry per run or column
+  mutable std::vector<uint> bases;           // where each run starts
+  mutable std::vector<const Value *> values; // a row's values to encode
+  mutable std::vector<Value> decoded;        // a row's values decoded
+
+  /**
+   * Find where each run of an encoded row starts, in bases.
+   */
+  void locate(const char *bytes) const;
+
+  /**
+   * Line the row's values up with the columns in values, and find where each
+   * run of its encoding will start, in bases.
+   */
+  void gather(const ValueDict *row) const;
+
+  /**
+   * @param base  where the column's run starts in the encoded row
+   */
+  Value value(const char *bytes, uint column, uint base) const;
+};
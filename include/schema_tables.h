@@ -0,0 +1,333 @@
+/**
+ * @file schema_tables.h - The system catalog: the _tables, _columns and
+ * _indices relations describing every table and index, and the open tables
+ * cached by name.
+ * Columns Indices Tables
+ *
+ * @see "Seattle University, CPSC5300, Winter Quarter 2024"
+ */
+#pragma once
+
+#include "heap_storage.h"
+#include <functional>
+#include <list>
+#include <unordered_map>
+
+typedef std::vector<Identifier> TableNames;
+
+/**
+ * @class Columns - the _columns schema table: one row (table_name,
+ * column_name, data_type) per column of every table, in column order
+ */
+class Columns : public HeapTable {
+public:
+  static const Identifier TABLE_NAME;
+
+  Columns();
+
+  virtual ~Columns() {}
+
+  Columns(const Columns &other) = delete;
+
+  Columns(Columns &&temp) = delete;
+
+  Columns &operator=(const Columns &other) = delete;
+
+  Columns &operator=(Columns &&temp) = delete;
+
+  /**
+   * Record a table's columns.
+   */
+  virtual void add_columns(const Identifier &table_name,
+                           const ColumnNames &column_names,
+                           const ColumnAttributes &column_attributes);
+
+  /**
+   * Read a table's columns back, in order.
+   * @param table_name         table to look up
+   * @param column_names       set to its columns' names
+   * @param column_attributes  set to their types
+   */
+  virtual void get_columns(const Identifier &table_name,
+                           ColumnNames &column_names,
+                           ColumnAttributes &column_attributes);
+
+  /**
+   * Forget a table's columns.
+   */
+  virtual void del_columns(const Identifier &table_name);
+};
+
+typedef std::vector<Identifier> IndexNames;
+
+/**
+ * @class Indices - the _indices schema table: one row (table_name,
+ * index_name, seq_in_index, column_name, index_type, is_unique) per key
+ * column of every index, seq_in_index counting from 1 in key order
+ */
+class Indices : public HeapTable {
+public:
+  static const Identifier TABLE_NAME;
+
+  Indices();
+
+  virtual ~Indices() {}
+
+  Indices(const Indices &other) = delete;
+
+  Indices(Indices &&temp) = delete;
+
+  Indices &operator=(const Indices &other) = delete;
+
+  Indices &operator=(Indices &&temp) = delete;
+
+  /**
+   * Record an index.
+   * @param index_type  HASH, BTREE or BITMAP
+   */
+  virtual void record_index(const Identifier &table_name,
+                            const Identifier &index_name,
+                            const ColumnNames &key_columns,
+                            const Identifier &index_type, bool unique);
+
+  /**
+   * @returns  the names of a table's indexes, in the order they were created
+   */
+  virtual IndexNames get_index_names(const Identifier &table_name);
+
+  /**
+   * Read an index back.
+   * @param key_columns  set to its key columns, in order
+   * @param index_type   set to its type
+   * @param unique       set to whether it is unique
+   */
+  virtual void get_index(const Identifier &table_name,
+                         const Identifier &index_name,
+                         ColumnNames &key_columns, Identifier &index_type,
+                         bool &unique);
+
+  /**
+   * Forget an index, or all of a table's if index_name is empty.
+   */
+  virtual void forget_index(const Identifier &table_name,
+                            const Identifier &index_name = "");
+};
+
+/**
+ * @class Tables - the _tables schema table and the catalog built on it
+ *
+ * Each row is a table's name and its TableOptions: (table_name, engine,
+ * fillfactor, bloom_columns, bloom_bits, bloom_fp_rate, memtable_bytes), with
+ * the Bloom columns comma-separated and the false-positive rate as text. So a
+ * table is always reopened as it was created, its Bloom filters kept up to
+ * date. The columns are in _columns and the indexes in _indices. The three
+ * schema tables are heap tables that describe themselves.
+ *
+ * A table's indexes are opened and attached to it whenever it is opened, and
+ * closed with it, so they are kept up to date by every change made through
+ * the catalog.
+ *
+ * Tables opened through the catalog are cached by name, so once a table has
+ * been resolved, finding it again is a hash lookup with no catalog scan.
+ * create_table() adds to the cache and drop_table() takes the table out of
+ * it, so the cache never outlives the catalog rows it was built from.
+ *
+ * At most max_open tables are kept open. Opening one more closes the least
+ * recently used table that isn't borrowed; borrowed tables are never closed,
+ * so the cache may run over while more than max_open are borrowed. Nor are
+ * MEMORY tables, since closing one loses its rows: they stay open until they
+ * are dropped or the catalog is closed.
+ */
+class Tables : public HeapTable {
+public:
+  static const Identifier TABLE_NAME;
+  static const size_t MAX_OPEN = 64;
+
+  /**
+   * @param max_open  most tables to keep open at once (at least 1)
+   */
+  Tables(size_t max_open = MAX_OPEN);
+
+  /**
+   * Deletes the cached tables without closing them; close() the catalog
+   * first.
+   */
+  virtual ~Tables();
+
+  Tables(const Tables &other) = delete;
+
+  Tables(Tables &&temp) = delete;
+
+  Tables &operator=(const Tables &other) = delete;
+
+  Tables &operator=(Tables &&temp) = delete;
+
+  /**
+   * @returns  whether the table is one of the schema tables
+   */
+  static bool is_schema_table(const Identifier &table_name);
+
+  /**
+   * @param engine_name  HEAP, COLUMN, PAX, MEMORY or LSM
+   * @returns            the engine by that name
+   * @throws             DbRelationError if there is none
+   */
+  static TableOptions::Engine engine_named(const Identifier &engine_name);
+
+  /**
+   * Create _tables, _columns and _indices, holding their own descriptions.
+   */
+  virtual void create();
+
+  virtual void create_if_not_exists();
+
+  /**
+   * Drop the schema tables (not the tables they list).
+   */
+  virtual void drop();
+
+  virtual void open();
+
+  /**
+   * Close and forget every cached table, then the schema tables.
+   */
+  virtual void close();
+
+  /**
+   * Execute: CREATE TABLE <table_name> ( <columns> )
+   * @returns  the new table, open (owned by the catalog)
+   * @throws   DbRelationError if the table already exists
+   */
+  virtual DbRelation &create_table(const Identifier &table_name,
+                                   const ColumnNames &column_names,
+                                   const ColumnAttributes &column_attributes,
+                                   const TableOptions &options = TableOptions());
+
+  /**
+   * Execute: DROP TABLE <table_name>, and its indexes
+   * @throws  DbRelationError if there's no such table or it's a schema table
+   */
+  virtual void drop_table(const Identifier &table_name);
+
+  /**
+   * Execute: CREATE INDEX <index_name> ON <table_name> USING <index_type>
+   * (<key_columns>), building it from the table's rows
+   * @param index_type  HASH, BTREE or BITMAP
+   * @returns           the new index, attached to its table (owned by the
+   *                    catalog and good while the table is)
+   * @throws            DbRelationError if the table isn't a HEAP table, the
+   *                    index already exists or a key column is unknown
+   */
+  virtual DbIndex &create_index(const Identifier &table_name,
+                                const Identifier &index_name,
+                                const ColumnNames &key_columns,
+                                const Identifier &index_type,
+                                bool unique = false);
+
+  /**
+   * Execute: DROP INDEX <index_name> FROM <table_name>
+   * @throws  DbRelationError if there's no such index
+   */
+  virtual void drop_index(const Identifier &table_name,
+                          const Identifier &index_name);
+
+  /**
+   * Open a table, if need be, and find its indexes.
+   * @returns  the indexes (owned by the catalog and good while the table is)
+   */
+  virtual DbIndexes get_indexes(const Identifier &table_name);
+
+  /**
+   * Resolve a table name, opening the table if it isn't open.
+   * @returns  the open table (owned by the catalog), good until another table
+   *           is opened unless it is borrowed
+   * @throws   DbRelationError if there's no such table
+   */
+  virtual DbRelation &get_table(const Identifier &table_name);
+
+  /**
+   * get_table(), keeping the table open until it is given back: each call
+   * must be matched by a release().
+   */
+  virtual DbRelation &borrow(const Identifier &table_name);
+
+  /**
+   * Give back a table from borrow().
+   */
+  virtual void release(const Identifier &table_name);
+
+  /**
+   * @returns  whether the catalog lists the table
+   */
+  virtual bool exists(const Identifier &table_name);
+
+  /**
+   * @returns  the names of all tables but the schema tables, in the order
+   *           they were created
+   */
+  virtual TableNames get_table_names();
+
+  /**
+   * @returns  how many tables are open in the cache
+   */
+  virtual size_t cached() const { return relations.size(); }
+
+  /**
+   * Change how many tables may be open, closing any over the new limit.
+   */
+  virtual void set_max_open(size_t max_open);
+
+  /**
+   * @returns  how many tables have been closed to make room
+   */
+  virtual size_t get_evictions() const { return evictions; }
+
+  /**
+   * Have a function called with a table's name whenever the catalog is about
+   * to close the table to make room, for whatever still points at it to let
+   * go.
+   */
+  virtual void set_on_evict(std::function<void(const Identifier &)> on_evict) {
+    this->on_evict = on_evict;
+  }
+
+protected:
+  class CachedRelation {
+  public:
+    DbRelation *relation;
+    std::list<Identifier>::iterator recent; // its place in recently_used
+    uint borrowed;
+    DbIndexes indexes; // open and attached to relation
+  };
+
+  Columns columns;
+  Indices indices;
+  std::unordered_map<Identifier, CachedRelation> relations; // open, by name
+  std::list<Identifier> recently_used;                      // most recent first
+  size_t max_open;
+  size_t evictions;
+  std::function<void(const Identifier &)> on_evict;
+
+  virtual Handle find(const Identifier &table_name, bool &found);
+
+  virtual void add_table(const Identifier &table_name,
+                         const ColumnNames &column_names,
+                         const ColumnAttributes &column_attributes,
+                         const TableOptions &options);
+
+  /**
+   * @param indexes  set to its indexes, open and attached
+   */
+  virtual DbRelation *load(const Identifier &table_name, DbIndexes &indexes);
+
+  virtual void cache(const Identifier &table_name, DbRelation *relation,
+                     const DbIndexes &indexes = DbIndexes());
+
+  /**
+   * Close (or, if drop, drop) a cached table and its indexes, deleting them;
+   * the table must already be out of the cache.
+   */
+  virtual void unload(const CachedRelation &cached, bool drop = false);
+
+  virtual void evict();
+};
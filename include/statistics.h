@@ -0,0 +1,164 @@
+/**
+ * @file statistics.h - Table statistics gathered by ANALYZE from a sample of
+ * a relation's blocks, for the planner to estimate with.
+ * HyperLogLog Histogram ColumnStatistics TableStatistics StatisticsFile
+ *
+ * @see "Seattle University, CPSC5300, Winter Quarter 2024"
+ */
+#pragma once
+
+#include "db_cxx.h"
+#include "storage_engine.h"
+
+/**
+ * @class HyperLogLog - estimates the number of distinct values added to it in
+ * a fixed 4 KiB of registers (about 1.6% standard error)
+ */
+class HyperLogLog {
+public:
+  static const uint PRECISION = 12;
+  static const uint REGISTERS = 1 << PRECISION;
+
+  HyperLogLog() : registers(REGISTERS, 0) {}
+
+  void add(const Value &value);
+
+  /**
+   * Fold in the values another sketch has seen.
+   */
+  void merge(const HyperLogLog &other);
+
+  /**
+   * @returns  estimated number of distinct values added
+   */
+  double estimate() const;
+
+protected:
+  std::vector<u_int8_t> registers;
+};
+
+/**
+ * @class Histogram - equi-depth histogram of an INT column
+ *
+ * Each bucket holds about the same number of rows. Bucket i runs from just
+ * above bound i - 1 (from min for the first) up to bound i inclusive, and
+ * values are taken to be spread evenly within a bucket.
+ */
+class Histogram {
+public:
+  static const uint BUCKETS = 32;
+
+  int32_t min;
+  std::vector<int32_t> bounds; // upper bound of each bucket, ascending
+
+  Histogram() : min(0) {}
+
+  /**
+   * @param values   a sample of the column (reordered)
+   * @param buckets  most buckets to use
+   */
+  Histogram(std::vector<int32_t> &values, uint buckets = BUCKETS);
+
+  bool empty() const { return this->bounds.empty(); }
+
+  /**
+   * @returns  estimated fraction of rows with a value within range
+   */
+  double selectivity(const ValueRange &range) const;
+};
+
+/**
+ * @class ColumnStatistics - what ANALYZE learned about one column
+ */
+class ColumnStatistics {
+public:
+  ColumnAttribute::DataType data_type;
+  u_int64_t distinct;  // estimated number of distinct values
+  Histogram histogram; // INT columns only
+
+  ColumnStatistics() : data_type(ColumnAttribute::INT), distinct(0) {}
+};
+
+/**
+ * @class TableStatistics - what ANALYZE learned about a relation
+ */
+class TableStatistics {
+public:
+  Identifier table_name;
+  u_int64_t row_count;    // estimated from the sample unless fully scanned
+  double avg_row_width;   // bytes of a row in RowCodec format
+  u_int32_t block_count;  // blocks (or row groups) in the relation
+  u_int32_t blocks_sampled;
+  std::map<Identifier, ColumnStatistics> columns;
+
+  TableStatistics()
+      : row_count(0), avg_row_width(0), block_count(0), blocks_sampled(0) {}
+
+  /**
+   * @returns  the statistics as bytes for StatisticsFile
+   */
+  std::string marshal() const;
+
+  /**
+   * @param bytes  what marshal() returned
+   * @throws       DbRelationError if they're cut short
+   */
+  static TableStatistics unmarshal(const std::string &bytes);
+};
+
+/**
+ * Gather statistics on a relation, reading whole blocks (row groups) chosen
+ * at random from group_ids().
+ * @param relation       an open relation
+ * @param sample_blocks  most blocks to read; all of them if there are no more
+ * @returns              the statistics (not saved)
+ */
+TableStatistics analyze(DbRelation &relation, uint sample_blocks = 100);
+
+/**
+ * @class StatisticsFile - every table's statistics, kept in the _statistics
+ * Berkeley DB BTree file keyed by table name
+ */
+class StatisticsFile {
+public:
+  StatisticsFile() : db(nullptr) {}
+
+  virtual ~StatisticsFile() { close(); }
+
+  StatisticsFile(const StatisticsFile &other) = delete;
+
+  StatisticsFile(StatisticsFile &&temp) = delete;
+
+  StatisticsFile &operator=(const StatisticsFile &other) = delete;
+
+  StatisticsFile &operator=(StatisticsFile &&temp) = delete;
+
+  /**
+   * Open the file, creating it if need be.
+   */
+  virtual void open();
+
+  virtual void close();
+
+  /**
+   * Save a table's statistics, replacing any it had.
+   */
+  virtual void put(const TableStatistics &statistics);
+
+  /**
+   * @param table_name  table to look up
+   * @param statistics  set to the table's statistics if it has any
+   * @returns           false if the table hasn't been analyzed
+   */
+  virtual bool get(const Identifier &table_name, TableStatistics &statistics);
+
+  /**
+   * Forget a table's statistics (say when it's dropped).
+   */
+  virtual void del(const Identifier &table_name);
+
+protected:
+  static const char *const FILENAME;
+
+  Db *db;
+};
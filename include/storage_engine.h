@@ -12,6 +12,7 @@
 #include "db_cxx.h"
 #include <exception>
 #include <map>
+#include <optional>
 #include <utility>
 #include <vector>
 
@@ -225,6 +226,39 @@ public:
   Value(int32_t n) : n(n) { data_type = ColumnAttribute::INT; }
 
   Value(std::string s) : n(0), s(s) { data_type = ColumnAttribute::TEXT; }
+
+  bool operator==(const Value &other) const {
+    if (data_type != other.data_type)
+      return false;
+    return data_type == ColumnAttribute::INT ? n == other.n : s == other.s;
+  }
+
+  bool operator!=(const Value &other) const { return !(*this == other); }
+
+  bool operator<(const Value &other) const {
+    if (data_type != other.data_type)
+      return data_type < other.data_type;
+    return data_type == ColumnAttribute::INT ? n < other.n : s < other.s;
+  }
+};
+
+/**
+ * @class ValueRange - inclusive bounds on the value of one column; a missing
+ * bound leaves that end of the range open
+ */
+class ValueRange {
+public:
+  std::optional<Value> min;
+  std::optional<Value> max;
+
+  ValueRange() {}
+
+  ValueRange(std::optional<Value> min, std::optional<Value> max)
+      : min(min), max(max) {}
+
+  bool contains(const Value &value) const {
+    return !(min && value < *min) && !(max && *max < value);
+  }
 };
 
 // More type aliases
@@ -235,6 +269,106 @@ typedef std::pair<BlockID, RecordID> Handle;
 typedef std::vector<Handle>
     Handles; // FIXME: will need to turn this into an iterator at some point
 typedef std::map<Identifier, Value> ValueDict;
+typedef std::map<Identifier, ValueRange> RangeDict;
+
+/**
+ * @class ColumnVector - one column's values for a batch of rows
+ */
+class ColumnVector {
+public:
+  ColumnAttribute::DataType data_type;
+  std::vector<int32_t> ints;      // if INT
+  std::vector<std::string> texts; // if TEXT
+
+  ColumnVector(ColumnAttribute::DataType data_type) : data_type(data_type) {}
+
+  size_t size() const {
+    return this->data_type == ColumnAttribute::INT ? this->ints.size()
+                                                   : this->texts.size();
+  }
+
+  Value value(size_t i) const {
+    return this->data_type == ColumnAttribute::INT ? Value(this->ints[i])
+                                                   : Value(this->texts[i]);
+  }
+
+  void push_back(const Value &value) {
+    if (this->data_type == ColumnAttribute::INT)
+      this->ints.push_back(value.n);
+    else
+      this->texts.push_back(value.s);
+  }
+};
+
+/**
+ * @class ColumnBatch - some columns of a run of rows, column by column
+ */
+class ColumnBatch {
+public:
+  Handles handles;
+  ColumnNames column_names;
+  std::vector<ColumnVector> columns; // parallel to column_names
+
+  size_t size() const { return this->handles.size(); }
+
+  void clear() {
+    this->handles.clear();
+    this->column_names.clear();
+    this->columns.clear();
+  }
+};
+
+/**
+ * @class TableOptions - physical storage options chosen when a table is created
+ */
+class TableOptions {
+public:
+  /**
+   * How rows are laid out: HEAP keeps whole rows together in slotted pages
+   * (HeapTable); COLUMN keeps each column in its own file (ColumnTable); PAX
+   * keeps rows within a block but groups each column's values (PaxTable);
+   * MEMORY keeps slotted pages in RAM for the life of the relation object, for
+   * temporary tables (MemTable); LSM buffers writes in memory, behind a
+   * write-ahead log, and merges them into sorted runs, for tables that are
+   * mostly inserted into (LsmTable).
+   */
+  enum Engine { HEAP, COLUMN, PAX, MEMORY, LSM };
+  Engine engine;
+
+  /**
+   * Percentage (10-100) of each block that inserts may fill. The remainder is
+   * left free so rows can grow in place on update.
+   */
+  uint fillfactor;
+
+  /**
+   * Columns to keep a Bloom filter per block on, so equality scans can skip
+   * blocks that certainly lack the value looked for. Empty for none.
+   */
+  ColumnNames bloom_columns;
+
+  /**
+   * Size in bits (a multiple of 8) of each block's Bloom filter.
+   */
+  uint bloom_bits;
+
+  /**
+   * Target false-positive rate of the Bloom filters. Sets how many bits each
+   * value sets; it is met while a block holds no more than about
+   * bloom_bits / (1.44 * log2(1 / bloom_fp_rate)) filtered values.
+   */
+  double bloom_fp_rate;
+
+  /**
+   * Bytes of rows an LSM table holds in memory before writing them out as a
+   * sorted run. Its runs' Bloom filters are sized for bloom_fp_rate.
+   */
+  uint memtable_bytes;
+
+  TableOptions()
+      : engine(HEAP), fillfactor(100), bloom_bits(4096), bloom_fp_rate(0.01),
+        memtable_bytes(4 << 20) {}
+};
 
 /**
  * @class DbRelationError - generic exception class for DbRelation
@@ -355,8 +489,171 @@ public:
   virtual ValueDict *project(Handle handle,
                              const ColumnNames *column_names) = 0;
 
+  /**
+   * The relation's rows split into groups (usually its blocks) that
+   * read_batch() can read a column at a time. By default all the rows are
+   * one group.
+   * @returns  the group ids in order (freed by caller)
+   */
+  virtual BlockIDs *group_ids();
+
+  /**
+   * Read some columns of every row in a group. By default the rows of
+   * select() are projected one at a time.
+   * @param group_id      which group
+   * @param column_names  columns to read
+   * @param batch         replaced with the group's handles and values
+   */
+  virtual void read_batch(BlockID group_id, const ColumnNames *column_names,
+                          ColumnBatch &batch);
+
+  /**
+   * Accessors for the relation's schema.
+   */
+  virtual const Identifier &get_table_name() const { return table_name; }
+
+  virtual const ColumnNames &get_column_names() const { return column_names; }
+
+  virtual const ColumnAttributes &get_column_attributes() const {
+    return column_attributes;
+  }
+
+  /**
+   * Get the attributes of some of the relation's columns.
+   * @param select_column_names  columns to look up
+   * @returns                    their attributes, in the same order
+   * @throws                     DbRelationError for an unknown column
+   */
+  virtual ColumnAttributes
+  get_column_attributes(const ColumnNames &select_column_names) const {
+    ColumnAttributes attributes;
+    for (auto const &select_column : select_column_names) {
+      size_t i = 0;
+      while (i < column_names.size() && column_names[i] != select_column)
+        i++;
+      if (i == column_names.size())
+        throw DbRelationError("unknown column " + select_column);
+      attributes.push_back(column_attributes[i]);
+    }
+    return attributes;
+  }
+
 protected:
   Identifier table_name;
   ColumnNames column_names;
   ColumnAttributes column_attributes;
 };
+
+/**
+ * @class DbIndex - abstract base class for an index on some columns of a
+ * relation, mapping key values to the Handles of the rows holding them
+ *
+ * Methods:
+ *  create()
+ *  drop()
+ *  open()
+ *  close()
+ *  lookup(key_values)
+ *  range(min_key, max_key)
+ *  insert(handle)
+ *  del(handle)
+ */
+class DbIndex {
+public:
+  // ctor/dtor
+  DbIndex(DbRelation &relation, Identifier name, ColumnNames key_columns,
+          bool unique)
+      : relation(relation), name(name), key_columns(key_columns),
+        unique(unique) {}
+
+  virtual ~DbIndex() {}
+
+  /**
+   * Create the index and fill it from the relation's current rows.
+   */
+  virtual void create() = 0;
+
+  /**
+   * Remove the index.
+   */
+  virtual void drop() = 0;
+
+  /**
+   * Open existing index.
+   * Enables: lookup, range, insert, del.
+   */
+  virtual void open() = 0;
+
+  /**
+   * Closes an open index.
+   * Disables: lookup, range, insert, del.
+   */
+  virtual void close() = 0;
+
+  /**
+   * Find all the rows whose key columns equal key_values.
+   * @param key_values  dictionary holding (at least) every key column
+   * @returns           the matching rows' handles (freed by caller)
+   */
+  virtual Handles *lookup(const ValueDict *key_values) const = 0;
+
+  /**
+   * Find all the rows whose key lies in [min_key, max_key], in key order.
+   * Either bound may be nullptr for an open-ended range.
+   * @param min_key  dictionary holding the key columns' lower bound
+   * @param max_key  dictionary holding the key columns' upper bound
+   * @returns        the matching rows' handles (freed by caller)
+   * @throws         DbRelationError if the index is not ordered
+   */
+  virtual Handles *range(const ValueDict * /* min_key */,
+                         const ValueDict * /* max_key */) const {
+    throw DbRelationError("range index query not supported");
+  }
+
+  /**
+   * Add a newly inserted row to the index.
+   * @param handle  the row, which must already be in the relation
+   */
+  virtual void insert(Handle handle) = 0;
+
+  /**
+   * Remove a row from the index.
+   * @param handle  the row, which must still be in the relation
+   */
+  virtual void del(Handle handle) = 0;
+
+  /**
+   * @returns  true if range() is supported and returns rows in key order
+   */
+  virtual bool is_ordered() const { return false; }
+
+  /**
+   * Accessors.
+   */
+  virtual const Identifier &get_name() const { return name; }
+
+  virtual const ColumnNames &get_key_columns() const { return key_columns; }
+
+  virtual bool is_unique() const { return unique; }
+
+protected:
+  DbRelation &relation;
+  Identifier name;
+  ColumnNames key_columns;
+  bool unique;
+};
+
+typedef std::vector<DbIndex *> DbIndexes;
+
+/**
+ * Construct a table with the storage engine its options ask for.
+ * @param table_name         the table's name
+ * @param column_names       its columns
+ * @param column_attributes  their types
+ * @param options            physical storage options, including the engine
+ * @returns                  a new relation of the engine's class, neither
+ *                           created nor opened (freed by caller)
+ */
+DbRelation *new_relation(Identifier table_name, ColumnNames column_names,
+                         ColumnAttributes column_attributes,
+                         TableOptions options = TableOptions());
@@ -0,0 +1,222 @@
+/**
+ * @file vector_exec.h - Vectorized query execution: operators hand each other
+ * batches of column values with a selection vector instead of one row at a
+ * time.
+ * IntKernels VectorBatch VectorOperator VectorScan VectorFilter VectorCompute
+ *
+ * @see "Seattle University, CPSC5300, Winter Quarter 2024"
+ */
+#pragma once
+
+#include "storage_engine.h"
+
+/**
+ * Positions (within a batch) of the rows still selected.
+ */
+typedef std::vector<u_int16_t> SelectionVector;
+
+/**
+ * @class IntKernels - tight loops over INT column arrays
+ *
+ * Each kernel is a single pass over plain int32 arrays. Built with AVX2
+ * (-mavx2) the comparisons use 8-lane intrinsics; otherwise they are written
+ * branch-free so the compiler can vectorize them. Arithmetic wraps around on
+ * overflow.
+ */
+class IntKernels {
+public:
+  enum Compare { EQ, NE, LT, LE, GT, GE };
+  enum Arithmetic { ADD, SUB, MUL };
+
+  /**
+   * Find the rows where values[i] <op> constant.
+   * @param n          number of values
+   * @param selection  where the positions of the matching rows are written
+   *                   (room for n)
+   * @returns          number of matching rows
+   */
+  static uint select(Compare op, const int32_t *values, int32_t constant,
+                     uint n, u_int16_t *selection);
+
+  /**
+   * Narrow a selection to the rows where values[i] <op> constant.
+   * @param selection  positions of the rows to test, overwritten with those
+   *                   that match
+   * @param n          number of positions in selection
+   * @returns          number of matching rows
+   */
+  static uint refine(Compare op, const int32_t *values, int32_t constant,
+                     u_int16_t *selection, uint n);
+
+  /**
+   * result[i] = left[i] <op> right[i] for i < n
+   */
+  static void compute(Arithmetic op, const int32_t *left, const int32_t *right,
+                      int32_t *result, uint n);
+
+  /**
+   * result[i] = left[i] <op> constant for i < n
+   */
+  static void compute(Arithmetic op, const int32_t *left, int32_t constant,
+                      int32_t *result, uint n);
+
+  static int64_t sum(const int32_t *values, uint n);
+
+  static int64_t sum(const int32_t *values, const u_int16_t *selection,
+                     uint n);
+};
+
+/**
+ * @class VectorBatch - up to CAPACITY rows passing between vector operators
+ *
+ * Filters don't move any values; they just narrow the selection vector, and
+ * columns computed along the way are added to data for every row.
+ */
+class VectorBatch {
+public:
+  static const uint CAPACITY = 1024;
+
+  ColumnBatch data;
+  SelectionVector selection; // rows of data selected, if filtered
+  bool filtered;
+
+  VectorBatch() : filtered(false) {}
+
+  /**
+   * @returns  number of rows selected
+   */
+  uint count() const {
+    return this->filtered ? this->selection.size() : this->data.size();
+  }
+
+  /**
+   * @returns  position of a column in data
+   * @throws   DbRelationError if it's not there
+   */
+  uint column_index(const Identifier &column_name) const;
+
+  /**
+   * @returns  an INT column's values (for every row of data)
+   * @throws   DbRelationError if it isn't there or isn't INT
+   */
+  const int32_t *ints(const Identifier &column_name) const;
+
+  /**
+   * Sum an INT column over the selected rows.
+   */
+  int64_t sum(const Identifier &column_name) const;
+
+  void clear() {
+    this->data.clear();
+    this->selection.clear();
+    this->filtered = false;
+  }
+};
+
+/**
+ * @class VectorOperator - a node in a vectorized query plan
+ */
+class VectorOperator {
+public:
+  VectorOperator() {}
+
+  virtual ~VectorOperator() {}
+
+  VectorOperator(const VectorOperator &other) = delete;
+
+  VectorOperator(VectorOperator &&temp) = delete;
+
+  VectorOperator &operator=(const VectorOperator &other) = delete;
+
+  VectorOperator &operator=(VectorOperator &&temp) = delete;
+
+  /**
+   * Produce the next batch with at least one row selected.
+   * @param batch  replaced with the batch
+   * @returns      false once there are no more
+   */
+  virtual bool next(VectorBatch &batch) = 0;
+};
+
+/**
+ * @class VectorScan - batches of some of a relation's columns, read a group at
+ * a time with DbRelation::read_batch() and cut into CAPACITY rows
+ */
+class VectorScan : public VectorOperator {
+public:
+  /**
+   * @param relation      an open relation (not owned)
+   * @param column_names  columns to read
+   */
+  VectorScan(DbRelation *relation, const ColumnNames &column_names);
+
+  virtual ~VectorScan();
+
+  virtual bool next(VectorBatch &batch);
+
+protected:
+  DbRelation *relation;
+  ColumnNames column_names;
+  BlockIDs *group_ids;
+  size_t next_group;
+  ColumnBatch group;
+  size_t next_row; // of group
+};
+
+/**
+ * @class VectorFilter - narrows its input's selection to rows where an INT
+ * column compares true against a constant
+ */
+class VectorFilter : public VectorOperator {
+public:
+  /**
+   * @param input  operator to filter (owned, deleted with this one)
+   */
+  VectorFilter(VectorOperator *input, const Identifier &column_name,
+               IntKernels::Compare op, int32_t constant);
+
+  virtual ~VectorFilter() { delete input; }
+
+  virtual bool next(VectorBatch &batch);
+
+protected:
+  VectorOperator *input;
+  Identifier column_name;
+  IntKernels::Compare op;
+  int32_t constant;
+};
+
+/**
+ * @class VectorCompute - adds an INT column computed from two INT columns, or
+ * from one and a constant
+ */
+class VectorCompute : public VectorOperator {
+public:
+  /**
+   * result = left <op> right
+   * @param input  operator to extend (owned, deleted with this one)
+   */
+  VectorCompute(VectorOperator *input, const Identifier &result,
+                const Identifier &left, IntKernels::Arithmetic op,
+                const Identifier &right);
+
+  /**
+   * result = left <op> constant
+   * @param input  operator to extend (owned, deleted with this one)
+   */
+  VectorCompute(VectorOperator *input, const Identifier &result,
+                const Identifier &left, IntKernels::Arithmetic op,
+                int32_t constant);
+
+  virtual ~VectorCompute() { delete input; }
+
+  virtual bool next(VectorBatch &batch);
+
+protected:
+  VectorOperator *input;
+  Identifier result;
+  Identifier left;
+  IntKernels::Arithmetic op;
+  Identifier right; // empty when using constant
+  int32_t constant;
+};
@@ -0,0 +1,80 @@
+/**
+ * @file zone_map.h - Per-block summaries used to skip blocks during scans.
+ * ZoneMap
+ *
+ * @see "Seattle University, CPSC5300, Winter Quarter 2024"
+ */
+#pragma once
+
+#include "db_cxx.h"
+#include "storage_engine.h"
+
+/**
+ * @class ZoneMap - min/max of each INT column for every block of a table
+ *
+ * A block's zone covers every row whose Handle names that block, including rows
+ * that have since been forwarded elsewhere, since scans reach those through
+ * the stub left in the block. Zones only ever widen: deletes and updates that
+ * shrink a block's range leave it wider than necessary, which costs a block
+ * read but never a wrong answer.
+ *
+ * Stored in a Berkeley DB RecNo file next to the heap file, one fixed-length
+ * record per block holding a (min, max) pair of int32s for each INT column. An
+ * empty zone has min > max. The zones are cached in memory while open, and a
+ * record is written through whenever it widens.
+ */
+class ZoneMap {
+public:
+  ZoneMap(Identifier table_name, const ColumnNames &column_names,
+          const ColumnAttributes &column_attributes);
+
+  virtual ~ZoneMap();
+
+  ZoneMap(const ZoneMap &other) = delete;
+
+  ZoneMap(ZoneMap &&temp) = delete;
+
+  ZoneMap &operator=(const ZoneMap &other) = delete;
+
+  ZoneMap &operator=(ZoneMap &&temp) = delete;
+
+  virtual void create();
+
+  virtual void drop();
+
+  virtual void open();
+
+  virtual void close();
+
+  /**
+   * Widen a block's zone to take in a row.
+   * @param block_id  the block the row's Handle names
+   * @param row       the row (must hold every INT column)
+   */
+  virtual void widen(BlockID block_id, const ValueDict *row);
+
+  /**
+   * Could any row in a block have a column value within range?
+   * @param block_id  block to check
+   * @param column    schema position of the column
+   * @param range     bounds on the column's value
+   * @returns         false only if the block certainly has no such row
+   */
+  virtual bool may_contain(BlockID block_id, uint column,
+                           const ValueRange &range) const;
+
+protected:
+  typedef std::pair<int32_t, int32_t> Zone; // (min, max)
+
+  std::string dbfilename;
+  ColumnNames summarized;  // the INT columns, in schema order
+  std::vector<int> slots;  // schema position -> index in summarized, or -1
+  std::vector<std::vector<Zone>> zones; // [block_id - 1][slot]
+  Db *db; // Berkeley DB handles can't be reopened, so one per open()
+
+  virtual void db_open(uint flags = 0);
+
+  virtual void load();
+
+  virtual void save(BlockID block_id);
+};
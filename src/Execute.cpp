@@ -1,18 +1,284 @@
 #include "Execute.h"
 #include "not_impl.h"
-#include <ios>
+#include "statistics.h"
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
 #include <sstream>
 
+// Split a WHERE clause into the terms ANDed together.
+static void conjuncts(const hsql::Expr *expr,
+                      std::vector<const hsql::Expr *> &terms) {
+  if (expr->type == hsql::kExprOperator && expr->opType == hsql::Expr::AND) {
+    conjuncts(expr->expr, terms);
+    conjuncts(expr->expr2, terms);
+  } else {
+    terms.push_back(expr);
+  }
+}
+
+// Whether a term is column = column with a column from each side of a join,
+// the left side's being the first left_size of columns.
+// @param left_key, right_key  set to the columns' positions on their sides
+static bool join_key(const hsql::Expr *term, const PlanColumns &columns,
+                     size_t left_size, uint &left_key, uint &right_key) {
+  if (term->type != hsql::kExprOperator ||
+      term->opType != hsql::Expr::SIMPLE_OP || term->opChar != '=' ||
+      term->expr->type != hsql::kExprColumnRef ||
+      term->expr2->type != hsql::kExprColumnRef)
+    return false;
+  uint a = find_column(columns, term->expr->table ? term->expr->table : "",
+                       term->expr->name);
+  uint b = find_column(columns, term->expr2->table ? term->expr2->table : "",
+                       term->expr2->name);
+  if (a >= left_size)
+    std::swap(a, b);
+  if (a >= left_size || b < left_size ||
+      columns[a].data_type != columns[b].data_type)
+    return false;
+  left_key = a;
+  right_key = b - left_size;
+  return true;
+}
+
+static Value int_literal(int64_t n) {
+  if (n < INT32_MIN || n > INT32_MAX)
+    throw DbRelationError("integer out of range");
+  return Value((int32_t)n);
+}
+
+static PlanExpr::Kind operator_kind(const hsql::Expr *expr) {
+  switch (expr->opType) {
+  case hsql::Expr::SIMPLE_OP:
+    switch (expr->opChar) {
+    case '=':
+      return PlanExpr::EQ;
+    case '<':
+      return PlanExpr::LT;
+    case '>':
+      return PlanExpr::GT;
+    case '+':
+      return PlanExpr::ADD;
+    case '-':
+      return PlanExpr::SUB;
+    case '*':
+      return PlanExpr::MUL;
+    case '/':
+      return PlanExpr::DIV;
+    case '%':
+      return PlanExpr::MOD;
+    default:
+      break;
+    }
+    break;
+  case hsql::Expr::NOT_EQUALS:
+    return PlanExpr::NE;
+  case hsql::Expr::LESS_EQ:
+    return PlanExpr::LE;
+  case hsql::Expr::GREATER_EQ:
+    return PlanExpr::GE;
+  case hsql::Expr::AND:
+    return PlanExpr::AND;
+  case hsql::Expr::OR:
+    return PlanExpr::OR;
+  case hsql::Expr::NOT:
+    return PlanExpr::NOT;
+  case hsql::Expr::UMINUS:
+    return PlanExpr::NEG;
+  default:
+    break;
+  }
+  throw NotImplementedError("Unknown operator");
+}
+
+static std::string format(const std::optional<Value> &value) {
+  if (!value)
+    return "NULL";
+  if (value->data_type == ColumnAttribute::INT)
+    return std::to_string(value->n);
+  return "\"" + value->s + "\"";
+}
+
+static void find_placeholders(const hsql::Expr *expr,
+                              std::vector<int64_t> &found) {
+  if (expr == nullptr)
+    return;
+  if (expr->type == hsql::kExprPlaceholder)
+    found.push_back(expr->ival);
+  find_placeholders(expr->expr, found);
+  find_placeholders(expr->expr2, found);
+  if (expr->exprList != nullptr)
+    for (const hsql::Expr *item : *expr->exprList)
+      find_placeholders(item, found);
+}
+
+static void find_placeholders(const hsql::TableRef *table,
+                              std::vector<int64_t> &found) {
+  if (table == nullptr)
+    return;
+  if (table->join != nullptr) {
+    find_placeholders(table->join->left, found);
+    find_placeholders(table->join->right, found);
+    find_placeholders(table->join->condition, found);
+  }
+  if (table->list != nullptr)
+    for (const hsql::TableRef *t : *table->list)
+      find_placeholders(t, found);
+}
+
+// The placeholders of a SELECT or INSERT, by their positions in the text.
+static void find_placeholders(const hsql::SQLStatement *statement,
+                              std::vector<int64_t> &found) {
+  if (statement->type() == hsql::kStmtSelect) {
+    const hsql::SelectStatement *select =
+        (const hsql::SelectStatement *)statement;
+    for (const hsql::Expr *item : *select->selectList)
+      find_placeholders(item, found);
+    find_placeholders(select->fromTable, found);
+    find_placeholders(select->whereClause, found);
+  } else if (statement->type() == hsql::kStmtInsert) {
+    const hsql::InsertStatement *insert =
+        (const hsql::InsertStatement *)statement;
+    if (insert->values != nullptr)
+      for (const hsql::Expr *value : *insert->values)
+        find_placeholders(value, found);
+  }
+  std::sort(found.begin(), found.end());
+}
+
+static std::string upper(std::string word) {
+  for (char &c : word)
+    c = std::toupper((unsigned char)c);
+  return word;
+}
+
+// Take the literals out of a statement: normal is its text with each literal
+// replaced by ? and runs of whitespace by one space, types has an I or T per
+// literal, and literals their values in order. LIMIT and OFFSET counts stay,
+// since the grammar only takes numbers there. Returns false for text it
+// doesn't follow: floats, comments, unterminated quotes and ? of its own.
+static bool normalize(const std::string &sql, std::string &normal,
+                      std::string &types, Row &literals) {
+  std::string previous; // the last word, if it was the last token
+  size_t i = 0, n = sql.size();
+  while (i < n) {
+    char c = sql[i];
+    size_t end = i + 1;
+    if (std::isspace((unsigned char)c)) {
+      while (end < n && std::isspace((unsigned char)sql[end]))
+        end++;
+      if (!normal.empty())
+        normal += ' ';
+      i = end;
+      continue;
+    }
+    std::string word;
+    if (std::isalpha((unsigned char)c) || c == '_') {
+      while (end < n && (std::isalnum((unsigned char)sql[end]) ||
+                         sql[end] == '_'))
+        end++;
+      word = upper(sql.substr(i, end - i));
+      normal += sql.substr(i, end - i);
+    } else if (c == '"' || c == '\'') {
+      end = sql.find(c, i + 1);
+      if (end == std::string::npos)
+        return false;
+      end++;
+      if (c == '"') {
+        normal += sql.substr(i, end - i);
+      } else {
+        literals.push_back(Value(sql.substr(i + 1, end - i - 2)));
+        types += 'T';
+        normal += '?';
+      }
+    } else if (std::isdigit((unsigned char)c)) {
+      while (end < n && std::isdigit((unsigned char)sql[end]))
+        end++;
+      if (end < n && (sql[end] == '.' || sql[end] == '_' ||
+                      std::isalpha((unsigned char)sql[end])))
+        return false;
+      std::string digits = sql.substr(i, end - i);
+      if (previous == "LIMIT" || previous == "OFFSET") {
+        normal += digits;
+      } else {
+        if (digits.size() > 10 || std::stoll(digits) > INT32_MAX)
+          return false;
+        literals.push_back(Value((int32_t)std::stoll(digits)));
+        types += 'I';
+        normal += '?';
+      }
+    } else if (c == '?' || (c == '-' && end < n && sql[end] == '-')) {
+      return false;
+    } else {
+      normal += c;
+    }
+    previous = word;
+    i = end;
+  }
+  while (!normal.empty() && (normal.back() == ' ' || normal.back() == ';'))
+    normal.pop_back();
+  return true;
+}
+
+// BEGIN: PreparedStatement //
+
+PreparedStatement::~PreparedStatement() {
+  delete this->plan;
+  for (PlanExpr *value : this->values)
+    delete value;
+}
+
+// END  : PreparedStatement //
+
+// BEGIN: Execute //
+
+const size_t Execute::PLAN_CACHE_SIZE;
+Tables *Execute::tables = nullptr;
+TableOptions Execute::table_options;
+uint Execute::aggregate_threads = 0;
+std::map<Identifier, PreparedStatement *> Execute::prepared;
+std::unordered_map<std::string, Execute::CachedPlan> Execute::plans;
+std::list<std::string> Execute::recently_run;
+size_t Execute::plan_hits = 0;
+Row *Execute::parameters = nullptr;
+std::vector<int64_t> Execute::placeholders;
+
 std::string Execute::execute(const hsql::SQLParserResult *tree) {
   std::stringstream builder;
   for (size_t i = 0; i < tree->size(); i++) {
     const hsql::SQLStatement *statement = tree->getStatement(i);
+    if (i > 0)
+      builder << '\n';
     switch (statement->type()) {
     case hsql::kStmtCreate:
       builder << Execute::create((const hsql::CreateStatement *)statement);
       break;
-    case hsql::kStmtSelect:
-      builder << Execute::select((const hsql::SelectStatement *)statement);
+    case hsql::kStmtDrop:
+      builder << Execute::drop((const hsql::DropStatement *)statement);
+      break;
+    case hsql::kStmtInsert:
+    case hsql::kStmtSelect: {
+      PreparedStatement *once = Execute::prepare_statement(statement);
+      try {
+        if (!once->parameters.empty())
+          throw DbRelationError("placeholders are only allowed in PREPARE");
+        builder << Execute::run(once);
+      } catch (...) {
+        discard(once);
+        throw;
+      }
+      discard(once);
+      break;
+    }
+    case hsql::kStmtShow:
+      builder << Execute::show((const hsql::ShowStatement *)statement);
+      break;
+    case hsql::kStmtPrepare:
+      builder << Execute::prepare((const hsql::PrepareStatement *)statement);
+      break;
+    case hsql::kStmtExecute:
+      builder << Execute::execute_prepared(
+          (const hsql::ExecuteStatement *)statement);
       break;
     default:
       throw NotImplementedError("Unknown statement");
@@ -23,128 +289,856 @@ std::string Execute::execute(const hsql::SQLParserResult *tree) {
   return builder.str();
 }
 
+// A statement's plan is kept under its normal form and literal types, its
+// tables borrowed only while it runs.
+bool Execute::execute_cached(const std::string &sql, std::string &result) {
+  std::string normal, types;
+  Row literals;
+  if (!normalize(sql, normal, types, literals))
+    return false;
+  std::string verb = upper(normal.substr(0, normal.find(' ')));
+  if (verb != "SELECT" && verb != "INSERT")
+    return false;
+
+  std::string key = normal + '\n' + types;
+  PreparedStatement *cached;
+  if (plans.count(key) > 0 && reborrow(key)) {
+    CachedPlan &found = plans[key];
+    recently_run.splice(recently_run.begin(), recently_run, found.recent);
+    cached = found.prepared;
+    plan_hits++;
+  } else {
+    hsql::SQLParserResult *tree = hsql::SQLParser::parseSQLString(normal);
+    if (!tree->isValid() || tree->size() != 1) {
+      delete tree;
+      return false;
+    }
+    try {
+      cached = prepare_statement(tree->getStatement(0), literals);
+    } catch (...) {
+      delete tree;
+      throw;
+    }
+    delete tree;
+    if (cached->parameters.size() != literals.size()) {
+      discard(cached);
+      return false;
+    }
+    recently_run.push_front(key);
+    plans[key] = CachedPlan{cached, recently_run.begin()};
+    if (plans.size() > PLAN_CACHE_SIZE) {
+      discard(plans[recently_run.back()].prepared);
+      plans.erase(recently_run.back());
+      recently_run.pop_back();
+    }
+  }
+  cached->parameters = literals;
+  try {
+    result = run(cached);
+  } catch (...) {
+    give_back(cached);
+    throw;
+  }
+  give_back(cached);
+  return true;
+}
+
+std::string Execute::set_engine(const Identifier &engine_name) {
+  Identifier engine = upper(engine_name);
+  table_options.engine = Tables::engine_named(engine);
+  return "new tables are " + engine + " tables";
+}
+
+std::string Execute::set_threads(uint threads) {
+  aggregate_threads = threads;
+  uncache();
+  if (threads == 0)
+    return "aggregates run on one thread per core";
+  return "aggregates run on up to " + std::to_string(threads) + " threads";
+}
+
+std::string Execute::analyze(const Identifier &table_name) {
+  DbRelation &relation = catalog().borrow(table_name);
+  TableStatistics statistics;
+  try {
+    statistics = ::analyze(relation);
+  } catch (...) {
+    catalog().release(table_name);
+    throw;
+  }
+  catalog().release(table_name);
+  StatisticsFile file;
+  file.put(statistics);
+
+  std::stringstream out;
+  out << "analyzed " << table_name << ": about " << statistics.row_count
+      << " rows in " << statistics.block_count << " blocks ("
+      << statistics.blocks_sampled << " sampled)";
+  return out.str();
+}
+
+void Execute::close() {
+  if (tables == nullptr)
+    return;
+  for (auto const &it : prepared)
+    discard(it.second);
+  prepared.clear();
+  uncache();
+  tables->close();
+  delete tables;
+  tables = nullptr;
+}
+
+Tables &Execute::catalog() {
+  if (tables == nullptr) {
+    Tables *opened = new Tables();
+    // cached plans point at the tables they use
+    opened->set_on_evict(
+        [](const Identifier &table_name) { uncache(table_name); });
+    try {
+      opened->create_if_not_exists();
+    } catch (...) {
+      delete opened;
+      throw;
+    }
+    tables = opened;
+  }
+  return *tables;
+}
+
 std::string Execute::create(const hsql::CreateStatement *create) {
-  std::stringstream builder;
-  builder << "CREATE ";
-  switch (create->type) {
-  case hsql::CreateStatement::kTable:
-    builder << create->tableName << " (";
-    for (hsql::ColumnDefinition *col : *create->columns) {
-      builder << col->name << ' ';
-      switch (col->type) {
-      case hsql::ColumnDefinition::TEXT:
-        builder << "TEXT";
-        break;
-      case hsql::ColumnDefinition::DOUBLE:
-        builder << "DOUBLE";
-        break;
-      case hsql::ColumnDefinition::INT:
-        builder << "INT";
-        break;
-      default:
-        builder << "...";
-        break;
+  if (create->type == hsql::CreateStatement::kIndex) {
+    Identifier index_name = create->indexName;
+    ColumnNames key_columns;
+    for (char *column_name : *create->indexColumns)
+      key_columns.push_back(column_name);
+    uncache(create->tableName);
+    catalog().create_index(create->tableName, index_name, key_columns,
+                           upper(create->indexType ? create->indexType
+                                                   : "BTREE"));
+    return "created index " + index_name;
+  }
+  if (create->type != hsql::CreateStatement::kTable)
+    throw NotImplementedError("Only CREATE TABLE and CREATE INDEX are "
+                              "supported");
+  Identifier table_name = create->tableName;
+  if (create->ifNotExists && catalog().exists(table_name))
+    return "table " + table_name + " already exists";
+
+  ColumnNames column_names;
+  ColumnAttributes column_attributes;
+  for (hsql::ColumnDefinition *column : *create->columns) {
+    Identifier column_name = column->name;
+    if (std::find(column_names.begin(), column_names.end(), column_name) !=
+        column_names.end())
+      throw DbRelationError("duplicate column " + column_name);
+    switch (column->type) {
+    case hsql::ColumnDefinition::INT:
+      column_attributes.push_back(ColumnAttribute(ColumnAttribute::INT));
+      break;
+    case hsql::ColumnDefinition::TEXT:
+      column_attributes.push_back(ColumnAttribute(ColumnAttribute::TEXT));
+      break;
+    default:
+      throw NotImplementedError("Only INT and TEXT columns are supported");
+    }
+    column_names.push_back(column_name);
+  }
+  catalog().create_table(table_name, column_names, column_attributes,
+                         table_options);
+  return "created " + table_name;
+}
+
+std::string Execute::drop(const hsql::DropStatement *drop) {
+  if (drop->type == hsql::DropStatement::kPreparedStatement) {
+    Identifier name = drop->name;
+    auto found = prepared.find(name);
+    if (found == prepared.end())
+      throw DbRelationError("no prepared statement " + name);
+    discard(found->second);
+    prepared.erase(found);
+    return "deallocated " + name;
+  }
+  if (drop->type == hsql::DropStatement::kIndex) {
+    Identifier index_name = drop->indexName;
+    uncache(drop->name);
+    catalog().drop_index(drop->name, index_name);
+    return "dropped index " + index_name;
+  }
+  if (drop->type != hsql::DropStatement::kTable)
+    throw NotImplementedError("Only DROP TABLE and DROP INDEX are supported");
+  Identifier table_name = drop->name;
+  if (drop->ifExists && !catalog().exists(table_name))
+    return "table " + table_name + " does not exist";
+  uncache(table_name);
+  catalog().drop_table(table_name);
+  StatisticsFile().del(table_name);
+  return "dropped " + table_name;
+}
+
+std::string Execute::prepare(const hsql::PrepareStatement *prepare) {
+  Identifier name = prepare->name;
+  if (prepared.find(name) != prepared.end())
+    throw DbRelationError("prepared statement " + name + " already exists");
+  if (prepare->query->size() != 1)
+    throw NotImplementedError("Only one statement can be prepared at a time");
+  prepared[name] = prepare_statement(prepare->query->getStatement(0));
+  return "prepared " + name;
+}
+
+std::string
+Execute::execute_prepared(const hsql::ExecuteStatement *execute) {
+  Identifier name = execute->name;
+  auto found = prepared.find(name);
+  if (found == prepared.end())
+    throw DbRelationError("no prepared statement " + name);
+  PreparedStatement *statement = found->second;
+  size_t given = execute->parameters ? execute->parameters->size() : 0;
+  if (given != statement->parameters.size())
+    throw DbRelationError(name + " takes " +
+                          std::to_string(statement->parameters.size()) +
+                          " parameters, not " + std::to_string(given));
+  // the parameters are constant expressions, evaluated against no row at all
+  Row values;
+  for (size_t i = 0; i < given; i++) {
+    PlanExpr *value = Execute::expr((*execute->parameters)[i], PlanColumns());
+    try {
+      values.push_back(value->eval(Row()));
+    } catch (...) {
+      delete value;
+      throw;
+    }
+    delete value;
+  }
+  statement->parameters = values;
+  return run(statement);
+}
+
+PreparedStatement *
+Execute::prepare_statement(const hsql::SQLStatement *statement,
+                           const Row &values) {
+  PreparedStatement *statement_plan = new PreparedStatement(statement->type());
+  statement_plan->borrowing = true;
+  placeholders.clear();
+  find_placeholders(statement, placeholders);
+  statement_plan->parameters = values;
+  statement_plan->parameters.resize(placeholders.size());
+  parameters = &statement_plan->parameters;
+  try {
+    switch (statement->type()) {
+    case hsql::kStmtSelect:
+      statement_plan->plan = plan((const hsql::SelectStatement *)statement,
+                                  statement_plan->borrowed);
+      break;
+    case hsql::kStmtInsert: {
+      const hsql::InsertStatement *insert =
+          (const hsql::InsertStatement *)statement;
+      if (insert->type != hsql::InsertStatement::kInsertValues)
+        throw NotImplementedError("Only INSERT ... VALUES is supported");
+      Identifier table_name = insert->tableName;
+      if (Tables::is_schema_table(table_name))
+        throw DbRelationError("cannot insert into a schema table");
+      DbRelation &relation = catalog().borrow(table_name);
+      statement_plan->borrowed.push_back(table_name);
+      statement_plan->relation = &relation;
+
+      ColumnNames &column_names = statement_plan->column_names;
+      if (insert->columns != nullptr)
+        for (char *column_name : *insert->columns)
+          column_names.push_back(column_name);
+      else
+        column_names = relation.get_column_names();
+      if (column_names.size() != insert->values->size())
+        throw DbRelationError("INSERT has " +
+                              std::to_string(insert->values->size()) +
+                              " values for " +
+                              std::to_string(column_names.size()) +
+                              " columns");
+      ColumnAttributes column_attributes =
+          relation.get_column_attributes(column_names);
+      for (size_t i = 0; i < column_names.size(); i++) {
+        if (std::find(column_names.begin(), column_names.begin() + i,
+                      column_names[i]) != column_names.begin() + i)
+          throw DbRelationError("duplicate column " + column_names[i]);
+        PlanExpr *value = expr((*insert->values)[i], PlanColumns());
+        statement_plan->values.push_back(value);
+        value->infer(column_attributes[i].get_data_type());
+        if (value->get_data_type() != column_attributes[i].get_data_type())
+          throw DbRelationError("wrong type of value for " + column_names[i]);
       }
-      builder << ", ";
+      break;
     }
-    builder.seekp(-2, std::ios_base::cur); // Remove last seperator
-    builder << ')';
-    break;
-  default:
-    throw NotImplementedError("Unknown create statement");
-    break;
+    default:
+      throw NotImplementedError("Only SELECT and INSERT can be prepared");
+    }
+  } catch (...) {
+    parameters = nullptr;
+    discard(statement_plan);
+    throw;
   }
-  return builder.str();
+  parameters = nullptr;
+  return statement_plan;
 }
 
-std::string Execute::select(const hsql::SelectStatement *select) {
-  std::stringstream builder;
-  builder << "SELECT ";
-  for (hsql::Expr *expr : *select->selectList) {
-    builder << Execute::expr(expr) << ", ";
+std::string Execute::run(PreparedStatement *prepared) {
+  if (prepared->type == hsql::kStmtSelect)
+    return run(prepared->plan);
+
+  // the values are constant expressions, evaluated against no row at all
+  ValueDict row;
+  for (size_t i = 0; i < prepared->values.size(); i++) {
+    std::optional<Value> value = prepared->values[i]->eval(Row());
+    if (!value)
+      throw DbRelationError("no value for " + prepared->column_names[i]);
+    row[prepared->column_names[i]] = *value;
   }
-  builder.seekp(-2, std::ios_base::cur); // Remove last seperator
+  prepared->relation->insert(&row);
+  return "successfully inserted 1 row into " +
+         prepared->relation->get_table_name();
+}
 
-  builder << " FROM " << Execute::table(select->fromTable);
+void Execute::discard(PreparedStatement *prepared) {
+  delete prepared->plan;
+  prepared->plan = nullptr;
+  if (prepared->borrowing)
+    give_back(prepared);
+  delete prepared;
+}
 
-  if (select->whereClause) {
-    builder << " WHERE " << Execute::expr(select->whereClause);
+// Borrowing a table can close any table not borrowed, this plan's included,
+// and so forget the plan, which is checked for once all are borrowed.
+bool Execute::reborrow(const std::string &key) {
+  TableNames table_names = plans[key].prepared->borrowed;
+  TableNames borrowed;
+  try {
+    for (auto const &table_name : table_names) {
+      catalog().borrow(table_name);
+      borrowed.push_back(table_name);
+    }
+  } catch (...) {
+    for (auto const &table_name : borrowed)
+      catalog().release(table_name);
+    throw;
   }
-  return builder.str();
+  auto found = plans.find(key);
+  if (found == plans.end()) {
+    for (auto const &table_name : borrowed)
+      catalog().release(table_name);
+    return false;
+  }
+  found->second.prepared->borrowing = true;
+  return true;
 }
 
-std::string Execute::join(const hsql::JoinDefinition *join) {
-  std::stringstream builder;
-  builder << Execute::table(join->left);
-  switch (join->type) {
-  case hsql::kJoinLeft:
-    builder << " LEFT JOIN ";
+// A table given back may be closed at once, and a cached plan using it
+// forgotten, so the names are copied first.
+void Execute::give_back(PreparedStatement *prepared) {
+  prepared->borrowing = false;
+  TableNames table_names = prepared->borrowed;
+  for (auto const &table_name : table_names)
+    catalog().release(table_name);
+}
+
+void Execute::uncache(const Identifier &table_name) {
+  for (auto it = plans.begin(); it != plans.end();) {
+    const TableNames &borrowed = it->second.prepared->borrowed;
+    if (!table_name.empty() &&
+        std::find(borrowed.begin(), borrowed.end(), table_name) ==
+            borrowed.end()) {
+      it++;
+      continue;
+    }
+    discard(it->second.prepared);
+    recently_run.erase(it->second.recent);
+    it = plans.erase(it);
+  }
+}
+
+// SHOW statements are plans over the schema tables.
+std::string Execute::show(const hsql::ShowStatement *show) {
+  PlanOperator *plan = nullptr;
+  switch (show->type) {
+  case hsql::ShowStatement::kTables: {
+    plan = new TableScan(&catalog(), Tables::TABLE_NAME);
+    uint column = find_column(plan->get_columns(), "", "table_name");
+    PlanColumn table_name = plan->get_columns()[column];
+    PlanExpr *user_table = nullptr;
+    for (auto const &schema_table :
+         {Tables::TABLE_NAME, Columns::TABLE_NAME, Indices::TABLE_NAME}) {
+      PlanExpr *other = PlanExpr::op(
+          PlanExpr::NE, PlanExpr::column(column, ColumnAttribute::TEXT),
+          PlanExpr::constant(Value(schema_table)));
+      user_table = user_table == nullptr
+                       ? other
+                       : PlanExpr::op(PlanExpr::AND, user_table, other);
+    }
+    plan = new Project(new Filter(plan, user_table),
+                       {PlanExpr::column(column, ColumnAttribute::TEXT)},
+                       {table_name});
     break;
-  case hsql::kJoinInner:
-    builder << " JOIN ";
+  }
+  case hsql::ShowStatement::kColumns: {
+    Identifier table_name = show->tableName;
+    if (!catalog().exists(table_name))
+      throw DbRelationError("no such table " + table_name);
+    ValueDict where;
+    where["table_name"] = Value(table_name);
+    plan = new TableScan(&catalog().get_table(Columns::TABLE_NAME),
+                         Columns::TABLE_NAME, &where);
     break;
-  default:
-    throw NotImplementedError("Unknown join statement");
+  }
+  case hsql::ShowStatement::kIndex: {
+    Identifier table_name = show->tableName;
+    if (!catalog().exists(table_name))
+      throw DbRelationError("no such table " + table_name);
+    ValueDict where;
+    where["table_name"] = Value(table_name);
+    plan = new TableScan(&catalog().get_table(Indices::TABLE_NAME),
+                         Indices::TABLE_NAME, &where);
     break;
   }
-  builder << Execute::table(join->right) << " ON "
-          << Execute::expr(join->condition);
-  return builder.str();
+  default:
+    throw NotImplementedError(
+        "Only SHOW TABLES, SHOW COLUMNS and SHOW INDEX are supported");
+  }
+
+  std::string result;
+  try {
+    result = run(plan);
+  } catch (...) {
+    delete plan;
+    throw;
+  }
+  delete plan;
+  return result;
 }
 
-std::string Execute::table(const hsql::TableRef *table) {
+// Rows are written out as the plan produces them.
+std::string Execute::run(PlanOperator *plan) {
   std::stringstream builder;
+  const PlanColumns &columns = plan->get_columns();
+  for (auto const &column : columns)
+    builder << column.name << ' ';
+  builder << "\n+";
+  for (size_t i = 0; i < columns.size(); i++)
+    builder << "----------+";
+  builder << '\n';
+
+  size_t n = 0;
+  Row row;
+  plan->open();
+  while (plan->next(row)) {
+    for (auto const &field : row)
+      builder << format(field) << ' ';
+    builder << '\n';
+    n++;
+  }
+  plan->close();
+  builder << "successfully returned " << n << " rows";
+  return builder.str();
+}
+
+// Whether a select item is a call of an aggregate function.
+// @param aggregate  set to the aggregate, its column one of columns
+static bool aggregate(const hsql::Expr *item, const PlanColumns &columns,
+                      Aggregate &aggregate) {
+  if (item->type != hsql::kExprFunctionRef)
+    return false;
+  std::string name = item->name;
+  std::transform(name.begin(), name.end(), name.begin(), ::toupper);
+  const hsql::Expr *argument =
+      item->exprList != nullptr && item->exprList->size() == 1
+          ? (*item->exprList)[0]
+          : nullptr;
+  if ((name != "COUNT" && name != "SUM" && name != "AVG") ||
+      argument == nullptr)
+    throw NotImplementedError("Only COUNT, SUM and AVG of a column are "
+                              "supported");
+  if (argument->type == hsql::kExprStar && name == "COUNT") {
+    aggregate = Aggregate(Aggregate::COUNT_STAR);
+    return true;
+  }
+  if (argument->type != hsql::kExprColumnRef)
+    throw NotImplementedError("Only COUNT, SUM and AVG of a column are "
+                              "supported");
+  uint column = find_column(columns, argument->table ? argument->table : "",
+                            argument->name);
+  if (name != "COUNT" && columns[column].data_type != ColumnAttribute::INT)
+    throw DbRelationError(name + " needs an INT column");
+  aggregate = Aggregate(name == "COUNT" ? Aggregate::COUNT
+                        : name == "SUM" ? Aggregate::SUM
+                                        : Aggregate::AVG,
+                        column);
+  return true;
+}
+
+// Whether HeapTable::select_ordered() on the first key's column gives the
+// order of keys: the first ordered index leading with that column (the one it
+// reads) has the keys' columns first, and they all go the same way.
+static bool index_order(const SortKeys &keys, const PlanColumns &columns,
+                        const DbIndexes &indexes) {
+  for (DbIndex *index : indexes) {
+    const ColumnNames &key_columns = index->get_key_columns();
+    if (!index->is_ordered() ||
+        key_columns[0] != columns[keys[0].column].name)
+      continue;
+    if (keys.size() > key_columns.size())
+      return false;
+    for (size_t i = 0; i < keys.size(); i++)
+      if (columns[keys[i].column].name != key_columns[i] ||
+          keys[i].descending != keys[0].descending)
+        return false;
+    return true;
+  }
+  return false;
+}
+
+// Scan -> Filter -> HashAggregate -> Sort -> Project -> Limit, with the scan
+// (or join) built from the FROM clause and simple equality terms of WHERE
+// pushed into a lone table's scan. There is a HashAggregate for GROUP BY, or
+// for aggregates without it; then the select list and ORDER BY may only use
+// the GROUP BY columns and aggregates. Otherwise ORDER BY takes columns of
+// the FROM clause. A lone table with an ordered index giving the ORDER BY is
+// scanned through the index, with no sort. Otherwise ORDER BY with a small
+// enough LIMIT is a TopN instead of a Sort, and bounds a lone table's scan as
+// it goes.
+PlanOperator *Execute::plan(const hsql::SelectStatement *select,
+                            TableNames &borrowed) {
+  if (select->fromTable == nullptr || select->selectDistinct ||
+      select->unionSelect != nullptr)
+    throw NotImplementedError("Only SELECT ... FROM ... WHERE ... GROUP BY "
+                              "... ORDER BY ... LIMIT is supported");
+  if (select->groupBy != nullptr && select->groupBy->having != nullptr)
+    throw NotImplementedError("HAVING is not supported");
+
+  Conjuncts where;
+  if (select->whereClause != nullptr)
+    conjuncts(select->whereClause, where);
+  PlanOperator *plan = select->fromTable->type == hsql::kTableName
+                           ? scan(select->fromTable, borrowed, &where)
+                           : table(select->fromTable, borrowed);
+  // a lone table's scan, for a TopN to pass its bound down to
+  TableScan *scanned = dynamic_cast<TableScan *>(plan);
+  PlanExpr *predicate = nullptr;
+  PlanExprs expressions;
+  try {
+    for (const hsql::Expr *term : where) {
+      PlanExpr *term_expr = expr(term, plan->get_columns());
+      PlanExpr *conjoined = predicate;
+      predicate = nullptr; // op() deletes its operands if it throws
+      predicate = conjoined == nullptr
+                      ? term_expr
+                      : PlanExpr::op(PlanExpr::AND, conjoined, term_expr);
+    }
+    if (predicate != nullptr) {
+      if (predicate->get_data_type() != ColumnAttribute::INT)
+        throw DbRelationError("WHERE needs a condition");
+      plan = new Filter(plan, predicate);
+      predicate = nullptr;
+    }
+
+    // the HashAggregate's column for each select item, when there is one
+    std::vector<uint> outputs;
+    bool grouped = select->groupBy != nullptr;
+    Aggregate found(Aggregate::COUNT_STAR);
+    for (const hsql::Expr *item : *select->selectList)
+      grouped = grouped || aggregate(item, plan->get_columns(), found);
+    if (grouped) {
+      const PlanColumns &input_columns = plan->get_columns();
+      std::vector<uint> group_by;
+      if (select->groupBy != nullptr)
+        for (const hsql::Expr *column : *select->groupBy->columns) {
+          if (column->type != hsql::kExprColumnRef)
+            throw NotImplementedError("GROUP BY only takes columns");
+          group_by.push_back(find_column(input_columns,
+                                         column->table ? column->table : "",
+                                         column->name));
+        }
+      Aggregates aggregates;
+      for (const hsql::Expr *item : *select->selectList) {
+        if (aggregate(item, input_columns, found)) {
+          outputs.push_back(group_by.size() + aggregates.size());
+          aggregates.push_back(found);
+          continue;
+        }
+        uint column = input_columns.size();
+        if (item->type == hsql::kExprColumnRef)
+          column = find_column(input_columns, item->table ? item->table : "",
+                               item->name);
+        auto group = std::find(group_by.begin(), group_by.end(), column);
+        if (group == group_by.end())
+          throw DbRelationError("select items must be aggregates or "
+                                "GROUP BY columns");
+        outputs.push_back(group - group_by.begin());
+      }
+      plan = new HashAggregate(plan, group_by, aggregates,
+                               HashAggregate::MEMORY_BUDGET,
+                               aggregate_threads);
+      scanned = nullptr;
+    }
+
+    if (select->order != nullptr) {
+      SortKeys keys;
+      for (const hsql::OrderDescription *order : *select->order) {
+        const hsql::Expr *column = order->expr;
+        if (column->type != hsql::kExprColumnRef)
+          throw NotImplementedError("ORDER BY only takes columns");
+        keys.push_back(SortKey(find_column(plan->get_columns(),
+                                           column->table ? column->table : "",
+                                           column->name),
+                               order->type == hsql::kOrderDesc));
+      }
+      int64_t kept = select->limit == nullptr || select->limit->limit < 0
+                         ? -1
+                         : select->limit->limit +
+                               std::max(select->limit->offset, (int64_t)0);
+      if (scanned != nullptr &&
+          index_order(keys, plan->get_columns(),
+                      catalog().get_indexes(select->fromTable->name))) {
+        scanned->set_order(plan->get_columns()[keys[0].column].name,
+                           keys[0].descending);
+      } else if (kept >= 0 && kept <= (int64_t)TopN::MAX_LIMIT) {
+        TopN *top = new TopN(plan, keys, kept);
+        plan = top;
+        if (scanned != nullptr)
+          scanned->set_filter(top->get_filter());
+      } else {
+        plan = new Sort(plan, keys);
+      }
+    }
 
+    const PlanColumns &input_columns = plan->get_columns();
+    PlanColumns columns;
+    if (grouped) {
+      for (size_t i = 0; i < outputs.size(); i++) {
+        const hsql::Expr *item = (*select->selectList)[i];
+        PlanColumn column = input_columns[outputs[i]];
+        expressions.push_back(PlanExpr::column(outputs[i], column.data_type));
+        if (item->alias != nullptr)
+          column.name = item->alias;
+        columns.push_back(column);
+      }
+    } else {
+      for (const hsql::Expr *item : *select->selectList) {
+        if (item->type == hsql::kExprStar) {
+          for (uint i = 0; i < input_columns.size(); i++) {
+            expressions.push_back(
+                PlanExpr::column(i, input_columns[i].data_type));
+            columns.push_back(input_columns[i]);
+          }
+          continue;
+        }
+        PlanExpr *item_expr = expr(item, input_columns);
+        expressions.push_back(item_expr);
+        PlanColumn column("", "?column?", item_expr->get_data_type());
+        if (item->type == hsql::kExprColumnRef)
+          column = input_columns[find_column(
+              input_columns, item->table ? item->table : "", item->name)];
+        if (item->alias != nullptr)
+          column.name = item->alias;
+        columns.push_back(column);
+      }
+    }
+    plan = new Project(plan, expressions, columns);
+    expressions.clear();
+
+    if (select->limit != nullptr) {
+      int64_t limit = select->limit->limit;
+      int64_t offset = select->limit->offset;
+      plan = new Limit(plan, limit < 0 ? SIZE_MAX : (size_t)limit,
+                       offset < 0 ? 0 : (size_t)offset);
+    }
+  } catch (...) {
+    delete predicate;
+    for (PlanExpr *expression : expressions)
+      delete expression;
+    delete plan;
+    throw;
+  }
+  return plan;
+}
+
+PlanOperator *Execute::scan(const hsql::TableRef *table, TableNames &borrowed,
+                            Conjuncts *where) {
+  Identifier table_name = table->name;
+  DbRelation &relation = catalog().borrow(table_name);
+  borrowed.push_back(table_name);
+  Identifier alias = table->alias != nullptr ? table->alias : table_name;
+  if (where == nullptr)
+    return new TableScan(&relation, alias);
+
+  // column = constant or parameter, when it has the column's type
+  const ColumnNames &column_names = relation.get_column_names();
+  ColumnAttributes column_attributes = relation.get_column_attributes();
+  auto constant = [](const hsql::Expr *expr) {
+    return expr->type == hsql::kExprLiteralInt ||
+           expr->type == hsql::kExprLiteralString ||
+           expr->type == hsql::kExprPlaceholder;
+  };
+  ExprDict pushed;
+  Conjuncts residual;
+  try {
+    for (const hsql::Expr *term : *where) {
+      const hsql::Expr *column = nullptr, *value = nullptr;
+      if (term->type == hsql::kExprOperator &&
+          term->opType == hsql::Expr::SIMPLE_OP && term->opChar == '=') {
+        if (term->expr->type == hsql::kExprColumnRef && constant(term->expr2))
+          column = term->expr, value = term->expr2;
+        else if (term->expr2->type == hsql::kExprColumnRef &&
+                 constant(term->expr))
+          column = term->expr2, value = term->expr;
+      }
+      size_t i = column_names.size();
+      if (column != nullptr &&
+          (column->table == nullptr || alias == column->table))
+        i = std::find(column_names.begin(), column_names.end(),
+                      column->name) -
+            column_names.begin();
+      if (i == column_names.size() ||
+          pushed.find(column_names[i]) != pushed.end()) {
+        residual.push_back(term);
+        continue;
+      }
+      PlanExpr *value_expr = expr(value, PlanColumns());
+      value_expr->infer(column_attributes[i].get_data_type());
+      if (value_expr->get_data_type() !=
+          column_attributes[i].get_data_type()) {
+        delete value_expr;
+        residual.push_back(term);
+        continue;
+      }
+      pushed[column_names[i]] = value_expr;
+    }
+  } catch (...) {
+    for (auto const &it : pushed)
+      delete it.second;
+    throw;
+  }
+  *where = residual;
+  return new TableScan(&relation, alias, pushed);
+}
+
+PlanOperator *Execute::table(const hsql::TableRef *table,
+                             TableNames &borrowed) {
   switch (table->type) {
   case hsql::kTableName:
-    builder << table->name;
-    if (table->alias) {
-      builder << " AS " << table->alias;
-    }
-    break;
+    return scan(table, borrowed);
   case hsql::kTableJoin:
-    builder << Execute::join(table->join);
-    break;
-  case hsql::kTableCrossProduct:
+    return join(table->join, borrowed);
+  case hsql::kTableCrossProduct: {
+    PlanOperator *product = nullptr;
     for (hsql::TableRef *t : *table->list) {
-      builder << Execute::table(t) << ", ";
+      PlanOperator *next = nullptr;
+      try {
+        next = Execute::table(t, borrowed);
+      } catch (...) {
+        delete product;
+        throw;
+      }
+      product = product == nullptr
+                    ? next
+                    : new NestedLoopJoin(product, next, nullptr);
     }
-    builder.seekp(-2, std::ios_base::cur); // Remove last seperator
-    builder << ' ';                        // Write over the comma
-    break;
+    return product;
+  }
   default:
     throw NotImplementedError("Unknown table type");
-    break;
   }
-  return builder.str();
 }
 
-std::string Execute::expr(const hsql::Expr *expr) {
-  std::stringstream builder;
-  switch (expr->type) {
-  case hsql::kExprStar:
-    builder << '*';
+PlanOperator *Execute::join(const hsql::JoinDefinition *join,
+                            TableNames &borrowed) {
+  bool left_outer;
+  switch (join->type) {
+  case hsql::kJoinInner:
+    left_outer = false;
     break;
-  case hsql::kExprOperator:
-    builder << Execute::expr(expr->expr) << ' ' << expr->opChar << ' '
-            << Execute::expr(expr->expr2);
+  case hsql::kJoinLeft:
+  case hsql::kJoinLeftOuter:
+    left_outer = true;
     break;
-  case hsql::kExprColumnRef:
-    if (expr->table) {
-      builder << expr->table << '.';
-    }
-    if (expr->alias) {
-      builder << expr->alias;
-    } else {
-      builder << expr->name;
+  default:
+    throw NotImplementedError("Unknown join statement");
+  }
+  PlanOperator *left = Execute::table(join->left, borrowed);
+  PlanOperator *right = nullptr;
+  PlanExpr *residual = nullptr;
+  std::vector<uint> left_keys, right_keys;
+  try {
+    right = Execute::table(join->right, borrowed);
+    if (join->condition != nullptr) {
+      PlanColumns joined = left->get_columns();
+      const PlanColumns &right_columns = right->get_columns();
+      joined.insert(joined.end(), right_columns.begin(), right_columns.end());
+      // column = column across the two sides makes a key for a hash join
+      Conjuncts terms;
+      conjuncts(join->condition, terms);
+      for (const hsql::Expr *term : terms) {
+        uint left_key, right_key;
+        if (join_key(term, joined, left->get_columns().size(), left_key,
+                     right_key)) {
+          left_keys.push_back(left_key);
+          right_keys.push_back(right_key);
+          continue;
+        }
+        PlanExpr *term_expr = Execute::expr(term, joined);
+        PlanExpr *conjoined = residual;
+        residual = nullptr;
+        residual = conjoined == nullptr
+                       ? term_expr
+                       : PlanExpr::op(PlanExpr::AND, conjoined, term_expr);
+      }
     }
-    break;
+  } catch (...) {
+    delete left;
+    delete right;
+    delete residual;
+    throw;
+  }
+  if (left_keys.empty())
+    return new NestedLoopJoin(left, right, residual, left_outer);
+  return new HashJoin(left, right, left_keys, right_keys, residual,
+                      left_outer);
+}
+
+PlanExpr *Execute::expr(const hsql::Expr *expr, const PlanColumns &columns) {
+  switch (expr->type) {
   case hsql::kExprLiteralInt:
-    builder << expr->ival;
-    break;
+    return PlanExpr::constant(int_literal(expr->ival));
+  case hsql::kExprLiteralString:
+    return PlanExpr::constant(Value(std::string(expr->name)));
+  case hsql::kExprColumnRef: {
+    uint i = find_column(columns, expr->table ? expr->table : "", expr->name);
+    return PlanExpr::column(i, columns[i].data_type);
+  }
+  case hsql::kExprPlaceholder: {
+    if (parameters == nullptr)
+      throw DbRelationError("placeholders are only allowed in PREPARE");
+    uint i = std::lower_bound(placeholders.begin(), placeholders.end(),
+                              expr->ival) -
+             placeholders.begin();
+    PlanExpr *parameter = PlanExpr::parameter(i, parameters);
+    if ((*parameters)[i]) // its value is known already
+      parameter->infer((*parameters)[i]->data_type);
+    return parameter;
+  }
+  case hsql::kExprOperator: {
+    PlanExpr::Kind kind = operator_kind(expr);
+    PlanExpr *left = Execute::expr(expr->expr, columns);
+    PlanExpr *right = nullptr;
+    if (kind != PlanExpr::NOT && kind != PlanExpr::NEG) {
+      try {
+        right = Execute::expr(expr->expr2, columns);
+      } catch (...) {
+        delete left;
+        throw;
+      }
+    }
+    return PlanExpr::op(kind, left, right);
+  }
   default:
     throw NotImplementedError("Unknown expr type");
-    break;
   }
-  return builder.str();
 }
+
+// END  : Execute //
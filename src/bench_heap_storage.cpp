@@ -0,0 +1,338 @@
+#include "column_storage.h"
+#include "heap_storage.h"
+#include "lsm_storage.h"
+#include "mem_storage.h"
+#include "pax_storage.h"
+#include "query_exec.h"
+#include "vector_exec.h"
+#include <chrono>
+#include <iomanip>
+#include <thread>
+
+typedef std::chrono::steady_clock Clock;
+
+static double seconds_since(Clock::time_point start) {
+  return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+// Insert rows, then grow every row by a quarter. Lower fillfactors leave room
+// for the growth in place instead of forwarding rows to new blocks.
+static void bench_update_fillfactor(uint fillfactor, uint rows) {
+  TableOptions options;
+  options.fillfactor = fillfactor;
+  HeapTable table("_bench_fillfactor", {"id", "body"},
+                  {ColumnAttribute(ColumnAttribute::INT),
+                   ColumnAttribute(ColumnAttribute::TEXT)},
+                  options);
+  table.create();
+
+  ValueDict row;
+  row["body"] = Value(std::string(80, 'a'));
+  for (uint i = 0; i < rows; i++) {
+    row["id"] = Value((int32_t)i);
+    table.insert(&row);
+  }
+
+  Handles *handles = table.select();
+  ValueDict change;
+  change["body"] = Value(std::string(100, 'b'));
+  Clock::time_point start = Clock::now();
+  for (auto const &handle : *handles)
+    table.update(handle, &change);
+  double elapsed = seconds_since(start);
+
+  std::cout << "update fillfactor=" << std::setw(3) << fillfactor << ": "
+            << std::fixed << std::setprecision(0) << handles->size() / elapsed
+            << " rows/s" << std::endl;
+  delete handles;
+  table.drop();
+}
+
+// Sum two columns of a 40-column table. The heap reads every column of every
+// row to do it; the column store reads just the two.
+static void bench_wide_sum(uint rows) {
+  const uint width = 40;
+  ColumnNames names;
+  ColumnAttributes attributes;
+  for (uint i = 0; i < width; i++) {
+    names.push_back("c" + std::to_string(i));
+    attributes.push_back(ColumnAttribute(ColumnAttribute::INT));
+  }
+  HeapTable heap("_bench_wide_heap", names, attributes);
+  ColumnTable columns("_bench_wide_column", names, attributes);
+  PaxTable pax("_bench_wide_pax", names, attributes);
+  heap.create();
+  columns.create();
+  pax.create();
+  ValueDict row;
+  for (uint r = 0; r < rows; r++) {
+    for (uint i = 0; i < width; i++)
+      row[names[i]] = Value((int32_t)(r + i));
+    heap.insert(&row);
+    columns.insert(&row);
+    pax.insert(&row);
+  }
+
+  ColumnNames summed = {"c3", "c17"};
+  Clock::time_point start = Clock::now();
+  int64_t heap_sum = 0;
+  Handles *handles = heap.select();
+  for (auto const &handle : *handles) {
+    ValueDict *values = heap.project(handle, &summed);
+    heap_sum += (*values)["c3"].n + (*values)["c17"].n;
+    delete values;
+  }
+  delete handles;
+  double heap_elapsed = seconds_since(start);
+
+  start = Clock::now();
+  int64_t column_sum = 0;
+  ColumnBatch batch;
+  BlockIDs *group_ids = columns.group_ids();
+  for (auto const &group_id : *group_ids) {
+    columns.read_batch(group_id, &summed, batch);
+    for (size_t i = 0; i < batch.size(); i++)
+      column_sum += batch.columns[0].ints[i] + batch.columns[1].ints[i];
+  }
+  delete group_ids;
+  double column_elapsed = seconds_since(start);
+
+  start = Clock::now();
+  int64_t pax_sum = 0;
+  BlockIDs *block_ids = pax.group_ids();
+  for (auto const &block_id : *block_ids) {
+    pax.read_batch(block_id, &summed, batch);
+    for (size_t i = 0; i < batch.size(); i++)
+      pax_sum += batch.columns[0].ints[i] + batch.columns[1].ints[i];
+  }
+  delete block_ids;
+  double pax_elapsed = seconds_since(start);
+
+  std::cout << "sum 2 of " << width << " columns: heap " << std::fixed
+            << std::setprecision(0) << rows / heap_elapsed << " rows/s, column "
+            << rows / column_elapsed << " rows/s, pax " << rows / pax_elapsed
+            << " rows/s"
+            << (heap_sum == column_sum && heap_sum == pax_sum ? ""
+                                                               : " (MISMATCH)")
+            << std::endl;
+  heap.drop();
+  columns.drop();
+  pax.drop();
+}
+
+// SUM(a + b) WHERE c < 30, row at a time through ValueDicts and then through
+// the vectorized operators over the same heap table and over a column table.
+static void bench_vector_filter_sum(uint rows) {
+  ColumnNames names = {"a", "b", "c"};
+  ColumnAttributes attributes(3, ColumnAttribute(ColumnAttribute::INT));
+  HeapTable heap("_bench_vector_heap", names, attributes);
+  ColumnTable columns("_bench_vector_column", names, attributes);
+  heap.create();
+  columns.create();
+  ValueDict row;
+  for (uint r = 0; r < rows; r++) {
+    row["a"] = Value((int32_t)r);
+    row["b"] = Value((int32_t)(r * 3));
+    row["c"] = Value((int32_t)(r % 100));
+    heap.insert(&row);
+    columns.insert(&row);
+  }
+
+  Clock::time_point start = Clock::now();
+  int64_t row_sum = 0;
+  Handles *handles = heap.select();
+  for (auto const &handle : *handles) {
+    ValueDict *values = heap.project(handle, &names);
+    if ((*values)["c"].n < 30)
+      row_sum += (*values)["a"].n + (*values)["b"].n;
+    delete values;
+  }
+  delete handles;
+  double row_elapsed = seconds_since(start);
+
+  double vector_elapsed[2];
+  int64_t vector_sum[2] = {0, 0};
+  DbRelation *relations[2] = {&heap, &columns};
+  for (uint i = 0; i < 2; i++) {
+    start = Clock::now();
+    VectorOperator *plan = new VectorCompute(
+        new VectorFilter(new VectorScan(relations[i], names), "c",
+                         IntKernels::LT, 30),
+        "a_plus_b", "a", IntKernels::ADD, "b");
+    VectorBatch batch;
+    while (plan->next(batch))
+      vector_sum[i] += batch.sum("a_plus_b");
+    delete plan;
+    vector_elapsed[i] = seconds_since(start);
+  }
+
+  std::cout << "sum where: row at a time " << std::fixed
+            << std::setprecision(0) << rows / row_elapsed
+            << " rows/s, vectorized heap " << rows / vector_elapsed[0]
+            << " rows/s, vectorized column " << rows / vector_elapsed[1]
+            << " rows/s"
+            << (row_sum == vector_sum[0] && row_sum == vector_sum[1]
+                    ? ""
+                    : " (MISMATCH)")
+            << std::endl;
+  heap.drop();
+  columns.drop();
+}
+
+// SUM(a) WHERE c = 7 over a heap table with more and more worker threads.
+static void bench_parallel_scan(uint rows) {
+  HeapTable table("_bench_parallel", {"a", "c"},
+                  {ColumnAttribute(ColumnAttribute::INT),
+                   ColumnAttribute(ColumnAttribute::INT)});
+  table.create();
+  ValueDict row;
+  for (uint r = 0; r < rows; r++) {
+    row["a"] = Value((int32_t)r);
+    row["c"] = Value((int32_t)(r % 10));
+    table.insert(&row);
+  }
+  ValueDict where;
+  where["c"] = Value(7);
+  uint cores = std::max(1U, std::thread::hardware_concurrency());
+  for (uint threads = 1; threads <= cores; threads *= 2) {
+    Clock::time_point start = Clock::now();
+    ScanAggregate aggregate = table.parallel_aggregate("a", &where, threads);
+    double elapsed = seconds_since(start);
+    std::cout << "parallel scan threads=" << std::setw(2) << threads << ": "
+              << std::fixed << std::setprecision(0) << rows / elapsed
+              << " rows/s (" << aggregate.count << " matched)" << std::endl;
+  }
+  table.drop();
+}
+
+// Insert and then scan the same rows into a heap table and a memory table.
+static void bench_mem_table(uint rows) {
+  ColumnNames names = {"a", "b"};
+  ColumnAttributes attributes = {ColumnAttribute(ColumnAttribute::INT),
+                                 ColumnAttribute(ColumnAttribute::TEXT)};
+  HeapTable heap("_bench_mem_heap", names, attributes);
+  MemTable mem("_bench_mem_mem", names, attributes);
+  for (DbRelation *table : std::vector<DbRelation *>{&heap, &mem}) {
+    table->create();
+    ValueDict row;
+    row["b"] = Value(std::string(20, 'b'));
+    Clock::time_point start = Clock::now();
+    for (uint r = 0; r < rows; r++) {
+      row["a"] = Value((int32_t)r);
+      table->insert(&row);
+    }
+    double insert_elapsed = seconds_since(start);
+
+    start = Clock::now();
+    int64_t sum = 0;
+    Handles *handles = table->select();
+    for (auto const &handle : *handles) {
+      ValueDict *values = table->project(handle);
+      sum += (*values)["a"].n;
+      delete values;
+    }
+    delete handles;
+    double scan_elapsed = seconds_since(start);
+    std::cout << (table == &heap ? "heap  " : "memory") << " table: insert "
+              << std::fixed << std::setprecision(0) << rows / insert_elapsed
+              << " rows/s, scan " << rows / scan_elapsed << " rows/s (sum "
+              << sum << ")" << std::endl;
+    table->drop();
+  }
+}
+
+// Sustained ingest into a heap table and an LSM table, counting the time to
+// get every row to disk and compacted.
+static void bench_lsm_ingest(uint rows) {
+  ColumnNames names = {"a", "b"};
+  ColumnAttributes attributes = {ColumnAttribute(ColumnAttribute::INT),
+                                 ColumnAttribute(ColumnAttribute::TEXT)};
+  TableOptions options;
+  options.memtable_bytes = 1 << 20;
+  HeapTable heap("_bench_ingest_heap", names, attributes);
+  LsmTable lsm("_bench_ingest_lsm", names, attributes, options);
+  ValueDict row;
+  row["b"] = Value(std::string(40, 'b'));
+
+  heap.create();
+  Clock::time_point start = Clock::now();
+  for (uint r = 0; r < rows; r++) {
+    row["a"] = Value((int32_t)r);
+    heap.insert(&row);
+  }
+  double heap_elapsed = seconds_since(start);
+  heap.drop();
+
+  lsm.create();
+  start = Clock::now();
+  for (uint r = 0; r < rows; r++) {
+    row["a"] = Value((int32_t)r);
+    lsm.insert(&row);
+  }
+  lsm.flush();
+  lsm.wait_for_compaction();
+  double lsm_elapsed = seconds_since(start);
+  std::vector<size_t> level_runs = lsm.get_level_runs();
+  lsm.drop();
+
+  std::cout << "ingest: heap " << std::fixed << std::setprecision(0)
+            << rows / heap_elapsed << " rows/s, lsm " << rows / lsm_elapsed
+            << " rows/s (" << level_runs.size() << " levels)" << std::endl;
+}
+
+// WHERE (a * 3 - 7 > 2 * 5 OR b <= "m") AND c < 30 over rows in memory, by
+// walking the expression tree and by running its compiled form.
+static void bench_compiled_expr(uint rows) {
+  std::vector<Row> data;
+  for (uint r = 0; r < rows; r++)
+    data.push_back({Value((int32_t)r), Value(std::string(1, 'a' + r % 26)),
+                    Value((int32_t)(r % 100))});
+  PlanExpr *a = PlanExpr::column(0, ColumnAttribute::INT);
+  PlanExpr *b = PlanExpr::column(1, ColumnAttribute::TEXT);
+  PlanExpr *c = PlanExpr::column(2, ColumnAttribute::INT);
+  PlanExpr *tree = PlanExpr::op(
+      PlanExpr::AND,
+      PlanExpr::op(
+          PlanExpr::OR,
+          PlanExpr::op(
+              PlanExpr::GT,
+              PlanExpr::op(PlanExpr::SUB,
+                           PlanExpr::op(PlanExpr::MUL, a,
+                                        PlanExpr::constant(Value(3))),
+                           PlanExpr::constant(Value(7))),
+              PlanExpr::op(PlanExpr::MUL, PlanExpr::constant(Value(2)),
+                           PlanExpr::constant(Value(5)))),
+          PlanExpr::op(PlanExpr::LE, b, PlanExpr::constant(Value("m")))),
+      PlanExpr::op(PlanExpr::LT, c, PlanExpr::constant(Value(30))));
+  CompiledExpr compiled(*tree);
+
+  Clock::time_point start = Clock::now();
+  uint tree_count = 0;
+  for (const Row &row : data)
+    tree_count += tree->test(row);
+  double tree_elapsed = seconds_since(start);
+  start = Clock::now();
+  uint compiled_count = 0;
+  for (const Row &row : data)
+    compiled_count += compiled.test(row);
+  double compiled_elapsed = seconds_since(start);
+  delete tree;
+
+  std::cout << "expression: tree " << std::fixed << std::setprecision(0)
+            << rows / tree_elapsed << " rows/s, compiled "
+            << rows / compiled_elapsed << " rows/s"
+            << (tree_count == compiled_count ? "" : " (MISMATCH)") << std::endl;
+}
+
+// benchmark function -- prints throughput figures for the heap storage engine
+void bench_heap_storage() {
+  const uint rows = 20000;
+  for (uint fillfactor : {100, 90, 70})
+    bench_update_fillfactor(fillfactor, rows);
+  bench_wide_sum(rows);
+  bench_vector_filter_sum(rows);
+  bench_parallel_scan(rows * 5);
+  bench_mem_table(rows);
+  bench_lsm_ingest(rows * 10);
+  bench_compiled_expr(rows * 50);
+}
@@ -0,0 +1,411 @@
+#include "bitmap_index.h"
+#include <algorithm>
+#include <cstring>
+#include <iterator>
+
+// BEGIN: Bitmap //
+
+Bitmap::Position Bitmap::position(Handle handle) {
+  if (handle.first >= (1U << (32 - RECORD_BITS)) ||
+      handle.second >= (1U << RECORD_BITS))
+    throw DbRelationError("row position too big for a bitmap");
+  return (handle.first << RECORD_BITS) | handle.second;
+}
+
+Handle Bitmap::handle(Position position) {
+  return Handle(position >> RECORD_BITS,
+                (RecordID)(position & ((1U << RECORD_BITS) - 1)));
+}
+
+void Bitmap::add(Position position) {
+  this->containers[position >> 16].add(position & 0xFFFF);
+}
+
+void Bitmap::remove(Position position) {
+  auto it = this->containers.find(position >> 16);
+  if (it == this->containers.end())
+    return;
+  it->second.remove(position & 0xFFFF);
+  if (it->second.card == 0)
+    this->containers.erase(it);
+}
+
+bool Bitmap::contains(Position position) const {
+  auto it = this->containers.find(position >> 16);
+  return it != this->containers.end() && it->second.contains(position & 0xFFFF);
+}
+
+u_int64_t Bitmap::cardinality() const {
+  u_int64_t count = 0;
+  for (auto const &it : this->containers)
+    count += it.second.card;
+  return count;
+}
+
+Bitmap &Bitmap::operator&=(const Bitmap &other) {
+  for (auto it = this->containers.begin(); it != this->containers.end();) {
+    auto match = other.containers.find(it->first);
+    if (match != other.containers.end())
+      it->second.intersect(match->second);
+    if (match == other.containers.end() || it->second.card == 0)
+      it = this->containers.erase(it);
+    else
+      it++;
+  }
+  return *this;
+}
+
+Bitmap &Bitmap::operator|=(const Bitmap &other) {
+  for (auto const &it : other.containers) {
+    auto match = this->containers.find(it.first);
+    if (match == this->containers.end())
+      this->containers.emplace(it.first, it.second);
+    else
+      match->second.unite(it.second);
+  }
+  return *this;
+}
+
+Bitmap &Bitmap::operator-=(const Bitmap &other) {
+  for (auto it = this->containers.begin(); it != this->containers.end();) {
+    auto match = other.containers.find(it->first);
+    if (match != other.containers.end())
+      it->second.subtract(match->second);
+    if (it->second.card == 0)
+      it = this->containers.erase(it);
+    else
+      it++;
+  }
+  return *this;
+}
+
+Handles *Bitmap::handles() const {
+  Handles *handles = new Handles();
+  handles->reserve(cardinality());
+  for (auto const &it : this->containers) {
+    Position high = (Position)it.first << 16;
+    const Container &container = it.second;
+    if (container.is_bitmap()) {
+      for (uint i = 0; i < WORDS; i++)
+        for (u_int64_t word = container.words[i]; word != 0; word &= word - 1)
+          handles->push_back(handle(high | (i * 64 + __builtin_ctzll(word))));
+    } else {
+      for (u_int16_t low : container.array)
+        handles->push_back(handle(high | low));
+    }
+  }
+  return handles;
+}
+
+bool Bitmap::Container::contains(u_int16_t low) const {
+  if (is_bitmap())
+    return (this->words[low / 64] >> (low % 64)) & 1;
+  return std::binary_search(this->array.begin(), this->array.end(), low);
+}
+
+void Bitmap::Container::add(u_int16_t low) {
+  if (is_bitmap()) {
+    u_int64_t bit = 1ULL << (low % 64);
+    if ((this->words[low / 64] & bit) == 0) {
+      this->words[low / 64] |= bit;
+      this->card++;
+    }
+    return;
+  }
+  auto at = std::lower_bound(this->array.begin(), this->array.end(), low);
+  if (at == this->array.end() || *at != low) {
+    this->array.insert(at, low);
+    normalize();
+  }
+}
+
+void Bitmap::Container::remove(u_int16_t low) {
+  if (is_bitmap()) {
+    u_int64_t bit = 1ULL << (low % 64);
+    if ((this->words[low / 64] & bit) != 0) {
+      this->words[low / 64] &= ~bit;
+      normalize();
+    }
+    return;
+  }
+  auto at = std::lower_bound(this->array.begin(), this->array.end(), low);
+  if (at != this->array.end() && *at == low) {
+    this->array.erase(at);
+    this->card--;
+  }
+}
+
+void Bitmap::Container::intersect(const Container &other) {
+  if (is_bitmap() && other.is_bitmap()) {
+    for (uint i = 0; i < WORDS; i++)
+      this->words[i] &= other.words[i];
+  } else if (is_bitmap()) {
+    std::vector<u_int16_t> kept;
+    for (u_int16_t low : other.array)
+      if (contains(low))
+        kept.push_back(low);
+    this->words.clear();
+    this->array.swap(kept);
+  } else {
+    std::vector<u_int16_t> kept;
+    for (u_int16_t low : this->array)
+      if (other.contains(low))
+        kept.push_back(low);
+    this->array.swap(kept);
+  }
+  normalize();
+}
+
+void Bitmap::Container::unite(const Container &other) {
+  if (is_bitmap() && other.is_bitmap()) {
+    for (uint i = 0; i < WORDS; i++)
+      this->words[i] |= other.words[i];
+  } else if (is_bitmap() || other.is_bitmap()) {
+    const std::vector<u_int16_t> &sparse =
+        is_bitmap() ? other.array : this->array;
+    std::vector<u_int64_t> words = is_bitmap() ? this->words : other.words;
+    for (u_int16_t low : sparse)
+      words[low / 64] |= 1ULL << (low % 64);
+    this->array.clear();
+    this->words.swap(words);
+  } else {
+    std::vector<u_int16_t> merged;
+    std::set_union(this->array.begin(), this->array.end(),
+                   other.array.begin(), other.array.end(),
+                   std::back_inserter(merged));
+    this->array.swap(merged);
+  }
+  normalize();
+}
+
+void Bitmap::Container::subtract(const Container &other) {
+  if (is_bitmap() && other.is_bitmap()) {
+    for (uint i = 0; i < WORDS; i++)
+      this->words[i] &= ~other.words[i];
+  } else if (is_bitmap()) {
+    for (u_int16_t low : other.array)
+      this->words[low / 64] &= ~(1ULL << (low % 64));
+  } else {
+    std::vector<u_int16_t> kept;
+    for (u_int16_t low : this->array)
+      if (!other.contains(low))
+        kept.push_back(low);
+    this->array.swap(kept);
+  }
+  normalize();
+}
+
+void Bitmap::Container::normalize() {
+  if (is_bitmap()) {
+    this->card = 0;
+    for (uint i = 0; i < WORDS; i++)
+      this->card += __builtin_popcountll(this->words[i]);
+    if (this->card <= ARRAY_MAX) {
+      this->array.clear();
+      this->array.reserve(this->card);
+      for (uint i = 0; i < WORDS; i++)
+        for (u_int64_t word = this->words[i]; word != 0; word &= word - 1)
+          this->array.push_back(i * 64 + __builtin_ctzll(word));
+      this->words.clear();
+    }
+  } else {
+    this->card = this->array.size();
+    if (this->card > ARRAY_MAX) {
+      this->words.assign(WORDS, 0);
+      for (u_int16_t low : this->array)
+        this->words[low / 64] |= 1ULL << (low % 64);
+      this->array.clear();
+    }
+  }
+}
+
+std::string Bitmap::Container::marshal() const {
+  std::string bytes(1, is_bitmap() ? 'B' : 'A');
+  if (is_bitmap())
+    bytes.append((const char *)this->words.data(), WORDS * sizeof(u_int64_t));
+  else
+    bytes.append((const char *)this->array.data(),
+                 this->array.size() * sizeof(u_int16_t));
+  return bytes;
+}
+
+void Bitmap::Container::unmarshal(const char *bytes, uint size) {
+  this->array.clear();
+  this->words.clear();
+  if (size > 0 && bytes[0] == 'B') {
+    this->words.resize(WORDS);
+    memcpy(this->words.data(), bytes + 1, WORDS * sizeof(u_int64_t));
+  } else if (size > 0) {
+    this->array.resize((size - 1) / sizeof(u_int16_t));
+    memcpy(this->array.data(), bytes + 1,
+           this->array.size() * sizeof(u_int16_t));
+  }
+  normalize();
+}
+
+// END  : Bitmap //
+
+// BEGIN: BitmapIndex //
+
+BitmapIndex::BitmapIndex(DbRelation &relation, Identifier name,
+                         ColumnNames key_columns, bool unique)
+    : DbIndex(relation, name, key_columns, unique),
+      dbfilename(relation.get_table_name() + "-" + name + ".bitmap.db"),
+      db(nullptr),
+      codec(key_columns, relation.get_column_attributes(key_columns)) {}
+
+BitmapIndex::~BitmapIndex() { close(); }
+
+// Build every bitmap in memory first so each container is written just once.
+void BitmapIndex::create() {
+  db_open(DB_CREATE | DB_EXCL);
+  Handles *handles = this->relation.select();
+  try {
+    for (auto const &handle : *handles) {
+      Bitmap &bitmap = this->bitmaps[key_of(handle)];
+      if (this->unique && !bitmap.empty())
+        throw DbRelationError("duplicate key in unique index " + this->name);
+      bitmap.add(Bitmap::position(handle));
+    }
+  } catch (...) {
+    delete handles;
+    drop();
+    throw;
+  }
+  delete handles;
+  for (auto const &it : this->bitmaps)
+    for (auto const &container : it.second.containers)
+      save(it.first, container.first);
+}
+
+void BitmapIndex::drop() {
+  close();
+  Db(_DB_ENV, 0).remove(this->dbfilename.c_str(), nullptr, 0);
+}
+
+void BitmapIndex::open() {
+  if (this->db == nullptr) {
+    db_open();
+    load();
+  }
+}
+
+void BitmapIndex::close() {
+  if (this->db != nullptr) {
+    this->db->close(0U);
+    delete this->db;
+    this->db = nullptr;
+  }
+  this->bitmaps.clear();
+}
+
+Handles *BitmapIndex::lookup(const ValueDict *key_values) const {
+  auto it = this->bitmaps.find(encode_key(key_values));
+  if (it == this->bitmaps.end())
+    return new Handles();
+  return it->second.handles();
+}
+
+void BitmapIndex::insert(Handle handle) {
+  Bitmap::Position position = Bitmap::position(handle);
+  std::string key = key_of(handle);
+  auto it = this->bitmaps.find(key);
+  if (it == this->bitmaps.end())
+    it = this->bitmaps.emplace(key, Bitmap()).first;
+  else if (this->unique)
+    throw DbRelationError("duplicate key in unique index " + this->name);
+  it->second.add(position);
+  save(key, position >> 16);
+}
+
+void BitmapIndex::del(Handle handle) {
+  Bitmap::Position position = Bitmap::position(handle);
+  auto it = this->bitmaps.find(key_of(handle));
+  if (it == this->bitmaps.end())
+    return;
+  it->second.remove(position);
+  save(it->first, position >> 16);
+  if (it->second.empty())
+    this->bitmaps.erase(it);
+}
+
+Bitmap BitmapIndex::lookup_bitmap(const ValueDict *key_values) const {
+  auto it = this->bitmaps.find(encode_key(key_values));
+  return it == this->bitmaps.end() ? Bitmap() : it->second;
+}
+
+Bitmap BitmapIndex::universe() const {
+  Bitmap all;
+  for (auto const &it : this->bitmaps)
+    all |= it.second;
+  return all;
+}
+
+void BitmapIndex::db_open(uint flags) {
+  this->db = new Db(_DB_ENV, 0);
+  this->db->set_message_stream(_DB_ENV->get_message_stream());
+  this->db->set_error_stream(_DB_ENV->get_error_stream());
+  try {
+    this->db->open(nullptr, this->dbfilename.c_str(), nullptr, DB_BTREE, flags,
+                   0644);
+  } catch (const DbException &) {
+    delete this->db;
+    this->db = nullptr;
+    throw;
+  }
+}
+
+void BitmapIndex::load() {
+  this->bitmaps.clear();
+  Dbc *cursor;
+  this->db->cursor(nullptr, &cursor, 0);
+  Dbt key, data;
+  key.set_flags(DB_DBT_MALLOC);
+  data.set_flags(DB_DBT_MALLOC);
+  while (cursor->get(&key, &data, DB_NEXT) == 0) {
+    // record key: encoded key, then the container's high bits big-endian
+    const u_int8_t *bytes = (const u_int8_t *)key.get_data();
+    uint size = key.get_size();
+    u_int16_t high = (bytes[size - 2] << 8) | bytes[size - 1];
+    Bitmap &bitmap = this->bitmaps[std::string((const char *)bytes, size - 2)];
+    bitmap.containers[high].unmarshal((const char *)data.get_data(),
+                                      data.get_size());
+    free(key.get_data());
+    free(data.get_data());
+  }
+  cursor->close();
+}
+
+// Write one container of a key's bitmap, or remove its record if it's gone.
+void BitmapIndex::save(const std::string &key, u_int16_t high) {
+  std::string record_key = key;
+  record_key.push_back((char)(high >> 8));
+  record_key.push_back((char)(high & 0xFF));
+  Dbt dbkey((void *)record_key.data(), record_key.size());
+
+  const Bitmap &bitmap = this->bitmaps.at(key);
+  auto it = bitmap.containers.find(high);
+  if (it == bitmap.containers.end()) {
+    this->db->del(nullptr, &dbkey, 0);
+    return;
+  }
+  std::string bytes = it->second.marshal();
+  Dbt data((void *)bytes.data(), bytes.size());
+  this->db->put(nullptr, &dbkey, &data, 0U);
+}
+
+std::string BitmapIndex::key_of(Handle handle) const {
+  ValueDict *key_values = this->relation.project(handle, &this->key_columns);
+  std::string key = encode_key(key_values);
+  delete key_values;
+  return key;
+}
+
+std::string BitmapIndex::encode_key(const ValueDict *key_values) const {
+  if (this->codec.size(key_values) > DbBlock::BLOCK_SZ)
+    throw DbRelationError("index key too big");
+  char bytes[DbBlock::BLOCK_SZ];
+  return std::string(bytes, this->codec.encode(key_values, bytes));
+}
+
+// END  : BitmapIndex //
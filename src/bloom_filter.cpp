@@ -0,0 +1,176 @@
+#include "bloom_filter.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+BloomFilter::BloomFilter(Identifier table_name, const ColumnNames &column_names,
+                         const ColumnNames &filtered, uint bits, double fp_rate)
+    : dbfilename(table_name + ".bloom.db"),
+      is_filtered(column_names.size(), false), bits(bits), probes(1),
+      db(nullptr) {
+  if (filtered.empty())
+    return;
+  if (bits == 0 || bits % 8 != 0 || bits > DbBlock::BLOCK_SZ * 8)
+    throw DbRelationError("Bloom filter size must be a multiple of 8 bits "
+                          "no bigger than a block");
+  if (!(fp_rate > 0.0 && fp_rate < 1.0))
+    throw DbRelationError("Bloom filter false-positive rate must be between "
+                          "0 and 1");
+  // with the best number of bits per entry, each probe halves the rate
+  this->probes = std::max(1, (int)std::lround(-std::log2(fp_rate)));
+
+  for (auto const &column_name : filtered) {
+    auto it = std::find(column_names.begin(), column_names.end(), column_name);
+    if (it == column_names.end())
+      throw DbRelationError("unknown column " + column_name);
+    uint column = it - column_names.begin();
+    if (!this->is_filtered[column]) {
+      this->is_filtered[column] = true;
+      this->filtered.push_back(std::make_pair(column_name, column));
+    }
+  }
+}
+
+BloomFilter::~BloomFilter() { close(); }
+
+void BloomFilter::create() {
+  if (!is_enabled())
+    return;
+  db_open(DB_CREATE | DB_EXCL);
+  this->filters.clear();
+}
+
+void BloomFilter::drop() {
+  close();
+  if (!is_enabled())
+    return;
+  try {
+    Db(_DB_ENV, 0).remove(this->dbfilename.c_str(), nullptr, 0);
+  } catch (const DbException &) {
+    // never created
+  }
+}
+
+void BloomFilter::open() {
+  if (this->db == nullptr && is_enabled()) {
+    db_open();
+    load();
+  }
+}
+
+void BloomFilter::close() {
+  if (this->db != nullptr) {
+    this->db->close(0U);
+    delete this->db;
+    this->db = nullptr;
+  }
+  this->filters.clear();
+}
+
+void BloomFilter::add(BlockID block_id, const ValueDict *row) {
+  if (!is_enabled())
+    return;
+  // blocks that never got a row of their own hold nothing
+  BlockID first_new = (BlockID)this->filters.size() + 1;
+  while (this->filters.size() < block_id)
+    this->filters.push_back(Filter(this->bits / 8, 0));
+
+  Filter &filter = this->filters[block_id - 1];
+  bool changed = false;
+  for (auto const &column : this->filtered) {
+    const Value &value = row->at(column.first);
+    u_int64_t h1 = hash(column.second, value, 0);
+    u_int64_t h2 = hash(column.second, value, 1) | 1;
+    for (uint i = 0; i < this->probes; i++) {
+      u_int64_t bit = (h1 + i * h2) % this->bits;
+      u_int8_t mask = 1 << (bit % 8);
+      if ((filter[bit / 8] & mask) == 0) {
+        filter[bit / 8] |= mask;
+        changed = true;
+      }
+    }
+  }
+  for (BlockID id = first_new; id < block_id; id++)
+    save(id);
+  if (changed)
+    save(block_id);
+}
+
+bool BloomFilter::may_contain(BlockID block_id, uint column,
+                              const Value &value) const {
+  if (column >= this->is_filtered.size() || !this->is_filtered[column] ||
+      block_id > this->filters.size())
+    return true;
+  const Filter &filter = this->filters[block_id - 1];
+  u_int64_t h1 = hash(column, value, 0);
+  u_int64_t h2 = hash(column, value, 1) | 1;
+  for (uint i = 0; i < this->probes; i++) {
+    u_int64_t bit = (h1 + i * h2) % this->bits;
+    if ((filter[bit / 8] & (1 << (bit % 8))) == 0)
+      return false;
+  }
+  return true;
+}
+
+void BloomFilter::db_open(uint flags) {
+  this->db = new Db(_DB_ENV, 0);
+  this->db->set_message_stream(_DB_ENV->get_message_stream());
+  this->db->set_error_stream(_DB_ENV->get_error_stream());
+  this->db->set_re_len(this->bits / 8);
+  try {
+    this->db->open(nullptr, this->dbfilename.c_str(), nullptr, DB_RECNO, flags,
+                   0644);
+  } catch (const DbException &) {
+    delete this->db;
+    this->db = nullptr;
+    throw;
+  }
+}
+
+// Read every block's filter into memory. Filters are written densely from
+// block 1 on, so the record count is the number of blocks filtered.
+void BloomFilter::load() {
+  DB_BTREE_STAT *stat;
+  this->db->stat(nullptr, &stat, DB_FAST_STAT);
+  BlockID count = stat->bt_ndata;
+  free(stat);
+
+  this->filters.clear();
+  this->filters.reserve(count);
+  for (BlockID block_id = 1; block_id <= count; block_id++) {
+    Dbt key(&block_id, sizeof(block_id)), data;
+    // a record we can't read might hold anything
+    Filter filter(this->bits / 8, 0xFF);
+    if (this->db->get(nullptr, &key, &data, 0U) == 0)
+      memcpy(filter.data(), data.get_data(), filter.size());
+    this->filters.push_back(filter);
+  }
+}
+
+void BloomFilter::save(BlockID block_id) {
+  Filter &filter = this->filters[block_id - 1];
+  Dbt key(&block_id, sizeof(block_id));
+  Dbt data(filter.data(), filter.size());
+  this->db->put(nullptr, &key, &data, 0U);
+}
+
+// 64-bit FNV-1a over the column's position and the value's bytes. The seed
+// picks between the two hashes double hashing needs.
+u_int64_t BloomFilter::hash(uint column, const Value &value,
+                            u_int64_t seed) const {
+  const u_int64_t prime = 0x100000001b3ULL;
+  u_int64_t h = 0xcbf29ce484222325ULL ^ (seed * 0x9e3779b97f4a7c15ULL);
+  auto mix = [&](const void *bytes, size_t size) {
+    for (size_t i = 0; i < size; i++) {
+      h ^= ((const u_int8_t *)bytes)[i];
+      h *= prime;
+    }
+  };
+  u_int16_t position = column;
+  mix(&position, sizeof(position));
+  if (value.data_type == ColumnAttribute::INT)
+    mix(&value.n, sizeof(value.n));
+  else
+    mix(value.s.data(), value.s.size());
+  return h;
+}
@@ -0,0 +1,467 @@
+#include "btree.h"
+#include <algorithm>
+#include <cstring>
+
+typedef u_int16_t u16;
+typedef u_int32_t u32;
+
+// BEGIN: BTreeIndex //
+
+BTreeIndex::BTreeIndex(DbRelation &relation, Identifier name,
+                       ColumnNames key_columns, bool unique)
+    : DbIndex(relation, name, key_columns, unique),
+      file(relation.get_table_name() + "-" + name + ".btree"), root(0),
+      height(0), closed(true) {
+  for (auto const &ca : relation.get_column_attributes(key_columns)) {
+    ColumnAttribute attribute = ca;
+    this->key_profile.push_back(attribute.get_data_type());
+  }
+}
+
+// Create the file and bulk build the tree from the relation's rows.
+void BTreeIndex::create() {
+  this->file.create();
+  this->closed = false;
+
+  std::vector<std::pair<KeyValue, Handle>> entries;
+  Handles *handles = this->relation.select();
+  for (auto const &handle : *handles)
+    entries.push_back(std::make_pair(key_of(handle), handle));
+  delete handles;
+  std::stable_sort(entries.begin(), entries.end(),
+                   [this](const std::pair<KeyValue, Handle> &a,
+                          const std::pair<KeyValue, Handle> &b) {
+                     return compare(a.first, b.first) < 0;
+                   });
+  if (this->unique)
+    for (size_t i = 1; i < entries.size(); i++)
+      if (compare(entries[i - 1].first, entries[i].first) == 0) {
+        drop();
+        throw DbRelationError("duplicate key in unique index " + this->name);
+      }
+  bulk_load(entries);
+}
+
+void BTreeIndex::drop() {
+  this->file.drop();
+  this->closed = true;
+}
+
+void BTreeIndex::open() {
+  if (!this->closed)
+    return;
+  this->file.open();
+  SlottedPage *stat = this->file.get(STAT);
+  Dbt *data = stat->get(1);
+  memcpy(&this->root, data->get_data(), sizeof(BlockID));
+  memcpy(&this->height, (char *)data->get_data() + sizeof(BlockID),
+         sizeof(u32));
+  delete data;
+  delete stat;
+  this->closed = false;
+}
+
+void BTreeIndex::close() {
+  this->file.close();
+  this->closed = true;
+}
+
+Handles *BTreeIndex::lookup(const ValueDict *key_values) const {
+  return range(key_values, key_values);
+}
+
+// Walk the leaves from the first one that can hold min_key, following the
+// leaf links until passing max_key. Bounds may name just a prefix of the key
+// columns.
+Handles *BTreeIndex::range(const ValueDict *min_key,
+                           const ValueDict *max_key) const {
+  KeyValue min, max;
+  if (min_key != nullptr)
+    min = key_of(min_key);
+  if (max_key != nullptr)
+    max = key_of(max_key);
+
+  Handles *handles = new Handles();
+  BTreeNode *leaf = find_leaf(min, true, nullptr);
+  while (true) {
+    for (size_t i = 0; i < leaf->keys.size(); i++) {
+      if (compare(leaf->keys[i], min) < 0)
+        continue;
+      if (compare(leaf->keys[i], max) > 0) {
+        delete leaf;
+        return handles;
+      }
+      handles->push_back(leaf->handles[i]);
+    }
+    BlockID next = leaf->link;
+    delete leaf;
+    if (next == 0)
+      return handles;
+    leaf = load(next);
+  }
+}
+
+void BTreeIndex::insert(Handle handle) {
+  KeyValue key = key_of(handle);
+  if (key_size(key) > MAX_KEY_SZ)
+    throw DbRelationError("index key too big");
+  if (this->unique) {
+    BTreeNode *leaf = find_leaf(key, true, nullptr);
+    bool found = false;
+    while (leaf != nullptr && !found) {
+      bool past = false;
+      for (auto const &k : leaf->keys) {
+        found = found || compare(k, key) == 0;
+        past = past || compare(k, key) > 0;
+      }
+      BlockID next = past ? 0 : leaf->link;
+      delete leaf;
+      leaf = next == 0 ? nullptr : load(next);
+    }
+    delete leaf;
+    if (found)
+      throw DbRelationError("duplicate key in unique index " + this->name);
+  }
+
+  BlockIDs path;
+  BTreeNode *leaf = find_leaf(key, false, &path);
+  size_t pos =
+      std::upper_bound(leaf->keys.begin(), leaf->keys.end(), key,
+                       [this](const KeyValue &a, const KeyValue &b) {
+                         return compare(a, b) < 0;
+                       }) -
+      leaf->keys.begin();
+  leaf->keys.insert(leaf->keys.begin() + pos, key);
+  leaf->handles.insert(leaf->handles.begin() + pos, handle);
+  insert_into(leaf, path);
+}
+
+// Remove the entry for handle. Underfull nodes are left as they are.
+void BTreeIndex::del(Handle handle) {
+  KeyValue key = key_of(handle);
+  BTreeNode *leaf = find_leaf(key, true, nullptr);
+  while (true) {
+    for (size_t i = 0; i < leaf->keys.size(); i++) {
+      int cmp = compare(leaf->keys[i], key);
+      if (cmp > 0) {
+        delete leaf;
+        return;
+      }
+      if (cmp == 0 && leaf->handles[i] == handle) {
+        leaf->keys.erase(leaf->keys.begin() + i);
+        leaf->handles.erase(leaf->handles.begin() + i);
+        save(leaf);
+        delete leaf;
+        return;
+      }
+    }
+    BlockID next = leaf->link;
+    delete leaf;
+    if (next == 0)
+      return;
+    leaf = load(next);
+  }
+}
+
+void BTreeIndex::bulk_load(
+    const std::vector<std::pair<KeyValue, Handle>> &entries) {
+  const uint budget = (DbBlock::BLOCK_SZ - 1) * BULK_FILL / 100;
+
+  // leaves, linked left to right; level holds each node's first key and id
+  std::vector<std::pair<KeyValue, BlockID>> level;
+  BTreeNode *node = new_node(true);
+  for (auto const &entry : entries) {
+    if (key_size(entry.first) > MAX_KEY_SZ) {
+      delete node;
+      throw DbRelationError("index key too big");
+    }
+    if (!node->keys.empty() &&
+        node_size(node) + key_size(entry.first) + sizeof(BlockID) +
+                sizeof(RecordID) + 4 >
+            budget) {
+      BTreeNode *next = new_node(true);
+      node->link = next->id;
+      level.push_back(std::make_pair(node->keys[0], node->id));
+      save(node);
+      delete node;
+      node = next;
+    }
+    node->keys.push_back(entry.first);
+    node->handles.push_back(entry.second);
+  }
+  level.push_back(std::make_pair(node->keys.empty() ? KeyValue() : node->keys[0],
+                                 node->id));
+  save(node);
+  delete node;
+  this->height = 1;
+
+  // interior levels until a single node is left
+  while (level.size() > 1) {
+    std::vector<std::pair<KeyValue, BlockID>> parents;
+    node = nullptr;
+    for (auto const &child : level) {
+      if (node != nullptr &&
+          node_size(node) + key_size(child.first) + sizeof(BlockID) + 4 >
+              budget) {
+        save(node);
+        delete node;
+        node = nullptr;
+      }
+      if (node == nullptr) {
+        node = new_node(false);
+        node->link = child.second;
+        parents.push_back(std::make_pair(child.first, node->id));
+        continue;
+      }
+      node->keys.push_back(child.first);
+      node->children.push_back(child.second);
+    }
+    save(node);
+    delete node;
+    level = parents;
+    this->height++;
+  }
+  this->root = level[0].second;
+  save_stat();
+}
+
+// Key values for the row at handle, in key column order.
+KeyValue BTreeIndex::key_of(Handle handle) const {
+  ValueDict *row = this->relation.project(handle, &this->key_columns);
+  KeyValue key = key_of(row);
+  delete row;
+  return key;
+}
+
+// Key values from a dictionary, in key column order, stopping at the first key
+// column the dictionary lacks.
+KeyValue BTreeIndex::key_of(const ValueDict *key_values) const {
+  KeyValue key;
+  for (auto const &column : this->key_columns) {
+    auto it = key_values->find(column);
+    if (it == key_values->end())
+      break;
+    key.push_back(it->second);
+  }
+  return key;
+}
+
+// Compare a key against a bound over the bound's length only, so a bound that
+// names a prefix of the key columns matches every key with that prefix.
+int BTreeIndex::compare(const KeyValue &key, const KeyValue &bound) const {
+  size_t n = std::min(key.size(), bound.size());
+  for (size_t i = 0; i < n; i++) {
+    if (key[i] < bound[i])
+      return -1;
+    if (bound[i] < key[i])
+      return 1;
+  }
+  return 0;
+}
+
+// Descend to the leaf for key. With leftmost set, this is the first leaf that
+// can hold key (duplicates may straddle a split); otherwise the last one.
+// Records the interior nodes passed through in path, if given.
+BTreeNode *BTreeIndex::find_leaf(const KeyValue &key, bool leftmost,
+                                 BlockIDs *path) const {
+  BlockID id = this->root;
+  for (uint level = 1; level < this->height; level++) {
+    BTreeNode *node = load(id);
+    size_t i = 0;
+    while (i < node->keys.size() &&
+           (leftmost ? compare(node->keys[i], key) < 0
+                     : compare(node->keys[i], key) <= 0))
+      i++;
+    if (key.empty())
+      i = 0;
+    if (path != nullptr)
+      path->push_back(id);
+    id = i == 0 ? node->link : node->children[i - 1];
+    delete node;
+  }
+  return load(id);
+}
+
+// Write node back, splitting it (and then its ancestors in path) if it no
+// longer fits in a block. Consumes node.
+void BTreeIndex::insert_into(BTreeNode *node, BlockIDs &path) {
+  if (node_size(node) <= DbBlock::BLOCK_SZ - 1) {
+    save(node);
+    delete node;
+    return;
+  }
+
+  BTreeNode *right = new_node(node->leaf);
+  size_t half = node->keys.size() / 2;
+  KeyValue separator = node->keys[half];
+  if (node->leaf) {
+    right->keys.assign(node->keys.begin() + half, node->keys.end());
+    right->handles.assign(node->handles.begin() + half, node->handles.end());
+    right->link = node->link;
+    node->link = right->id;
+    node->handles.resize(half);
+  } else {
+    // the middle key moves up; its subtree becomes right's first child
+    right->link = node->children[half];
+    right->keys.assign(node->keys.begin() + half + 1, node->keys.end());
+    right->children.assign(node->children.begin() + half + 1,
+                           node->children.end());
+    node->children.resize(half);
+  }
+  node->keys.resize(half);
+  save(node);
+  save(right);
+
+  BTreeNode *parent;
+  if (path.empty()) {
+    parent = new_node(false);
+    parent->link = node->id;
+    this->root = parent->id;
+    this->height++;
+    save_stat();
+  } else {
+    parent = load(path.back());
+    path.pop_back();
+  }
+  size_t pos = 0;
+  while (pos < parent->keys.size() && compare(parent->keys[pos], separator) <= 0)
+    pos++;
+  parent->keys.insert(parent->keys.begin() + pos, separator);
+  parent->children.insert(parent->children.begin() + pos, right->id);
+  delete node;
+  delete right;
+  insert_into(parent, path);
+}
+
+BTreeNode *BTreeIndex::load(BlockID id) const {
+  SlottedPage *page = this->file.get(id);
+  Dbt *header = page->get(1);
+  char *bytes = (char *)header->get_data();
+  BTreeNode *node = new BTreeNode(id, bytes[0] != 0);
+  memcpy(&node->link, bytes + 1, sizeof(BlockID));
+  delete header;
+
+  RecordIDs *record_ids = page->ids();
+  for (size_t i = 1; i < record_ids->size(); i++) {
+    bytes = (char *)page->record((*record_ids)[i]);
+    KeyValue key;
+    bytes += unmarshal_key(bytes, key);
+    node->keys.push_back(key);
+    if (node->leaf) {
+      Handle handle;
+      memcpy(&handle.first, bytes, sizeof(BlockID));
+      memcpy(&handle.second, bytes + sizeof(BlockID), sizeof(RecordID));
+      node->handles.push_back(handle);
+    } else {
+      BlockID child;
+      memcpy(&child, bytes, sizeof(BlockID));
+      node->children.push_back(child);
+    }
+  }
+  delete record_ids;
+  delete page;
+  return node;
+}
+
+// Rewrite node's block from scratch: header record, then entries in order.
+void BTreeIndex::save(const BTreeNode *node) {
+  SlottedPage *page = this->file.get(node->id);
+  SlottedPage fresh(*page->get_block(), node->id, true);
+  delete page;
+
+  char bytes[DbBlock::BLOCK_SZ];
+  bytes[0] = node->leaf ? 1 : 0;
+  memcpy(bytes + 1, &node->link, sizeof(BlockID));
+  Dbt header(bytes, 1 + sizeof(BlockID));
+  fresh.add(&header);
+
+  for (size_t i = 0; i < node->keys.size(); i++) {
+    uint size = marshal_key(node->keys[i], bytes);
+    if (node->leaf) {
+      memcpy(bytes + size, &node->handles[i].first, sizeof(BlockID));
+      memcpy(bytes + size + sizeof(BlockID), &node->handles[i].second,
+             sizeof(RecordID));
+      size += sizeof(BlockID) + sizeof(RecordID);
+    } else {
+      memcpy(bytes + size, &node->children[i], sizeof(BlockID));
+      size += sizeof(BlockID);
+    }
+    Dbt entry(bytes, size);
+    fresh.add(&entry);
+  }
+  this->file.put(&fresh);
+}
+
+BTreeNode *BTreeIndex::new_node(bool leaf) {
+  SlottedPage *page = this->file.get_new();
+  BlockID id = page->get_block_id();
+  delete page;
+  return new BTreeNode(id, leaf);
+}
+
+void BTreeIndex::save_stat() {
+  SlottedPage *stat = this->file.get(STAT);
+  SlottedPage fresh(*stat->get_block(), STAT, true);
+  delete stat;
+  char bytes[sizeof(BlockID) + sizeof(u32)];
+  memcpy(bytes, &this->root, sizeof(BlockID));
+  memcpy(bytes + sizeof(BlockID), &this->height, sizeof(u32));
+  Dbt data(bytes, sizeof(bytes));
+  fresh.add(&data);
+  this->file.put(&fresh);
+}
+
+// Bytes the node takes up as a SlottedPage (see SlottedPage::has_room).
+uint BTreeIndex::node_size(const BTreeNode *node) const {
+  uint pointer = node->leaf ? sizeof(BlockID) + sizeof(RecordID)
+                            : sizeof(BlockID);
+  uint size = 2 * sizeof(u16) * 2 + 1 + sizeof(BlockID);
+  for (auto const &key : node->keys)
+    size += 2 * sizeof(u16) + key_size(key) + pointer;
+  return size;
+}
+
+uint BTreeIndex::key_size(const KeyValue &key) const {
+  uint size = 0;
+  for (auto const &value : key)
+    size += value.data_type == ColumnAttribute::INT
+                ? sizeof(int32_t)
+                : sizeof(u16) + value.s.length();
+  return size;
+}
+
+uint BTreeIndex::marshal_key(const KeyValue &key, char *bytes) const {
+  uint offset = 0;
+  for (auto const &value : key) {
+    if (value.data_type == ColumnAttribute::INT) {
+      memcpy(bytes + offset, &value.n, sizeof(int32_t));
+      offset += sizeof(int32_t);
+    } else {
+      u16 size = value.s.length();
+      memcpy(bytes + offset, &size, sizeof(u16));
+      memcpy(bytes + offset + sizeof(u16), value.s.data(), size);
+      offset += sizeof(u16) + size;
+    }
+  }
+  return offset;
+}
+
+uint BTreeIndex::unmarshal_key(const char *bytes, KeyValue &key) const {
+  uint offset = 0;
+  for (auto const &data_type : this->key_profile) {
+    if (data_type == ColumnAttribute::INT) {
+      int32_t n;
+      memcpy(&n, bytes + offset, sizeof(int32_t));
+      key.push_back(Value(n));
+      offset += sizeof(int32_t);
+    } else {
+      u16 size;
+      memcpy(&size, bytes + offset, sizeof(u16));
+      key.push_back(Value(std::string(bytes + offset + sizeof(u16), size)));
+      offset += sizeof(u16) + size;
+    }
+  }
+  return offset;
+}
+
+// END  : BTreeIndex //
@@ -0,0 +1,423 @@
+#include "column_storage.h"
+#include "not_impl.h"
+#include <cstring>
+
+typedef u_int16_t u16;
+typedef u_int32_t u32;
+
+// BEGIN: ColumnBlock //
+
+ColumnBlock::ColumnBlock(Dbt &block, BlockID block_id,
+                         ColumnAttribute::DataType data_type, bool is_new)
+    : DbBlock(block, block_id, is_new), data_type(data_type) {
+  if (is_new) {
+    this->num_values = 0;
+    this->end_free = DbBlock::BLOCK_SZ - 1;
+    put_n(0, this->num_values);
+    put_n(2, this->end_free);
+  } else {
+    this->num_values = get_n(0);
+    this->end_free = get_n(2);
+  }
+}
+
+// Append a value: the 4 bytes of an INT, or the bytes of a TEXT.
+RecordID ColumnBlock::add(const Dbt *data) {
+  u16 size = (u16)data->get_size();
+  if (!has_room(size))
+    throw DbBlockNoRoomError("not enough room for new value");
+  RecordID id = ++this->num_values;
+  if (this->data_type == ColumnAttribute::INT) {
+    memcpy(address(HEADER_SZ + (id - 1) * sizeof(int32_t)), data->get_data(),
+           sizeof(int32_t));
+  } else {
+    this->end_free -= size;
+    u16 loc = this->end_free + 1;
+    memcpy(address(loc), data->get_data(), size);
+    put_n(HEADER_SZ + (id - 1) * sizeof(u16), loc);
+    put_n(2, this->end_free);
+  }
+  put_n(0, this->num_values);
+  return id;
+}
+
+Dbt *ColumnBlock::get(RecordID record_id) {
+  check(record_id);
+  if (this->data_type == ColumnAttribute::INT) {
+    char *bytes = new char[sizeof(int32_t)];
+    memcpy(bytes, address(HEADER_SZ + (record_id - 1) * sizeof(int32_t)),
+           sizeof(int32_t));
+    return new Dbt(bytes, sizeof(int32_t));
+  }
+  std::string text = get_text(record_id);
+  char *bytes = new char[text.size()];
+  memcpy(bytes, text.data(), text.size());
+  return new Dbt(bytes, text.size());
+}
+
+void ColumnBlock::put(RecordID, const Dbt &) {
+  throw NotImplementedError("column blocks are append only");
+}
+
+void ColumnBlock::del(RecordID) {
+  throw NotImplementedError("column blocks are append only");
+}
+
+RecordIDs *ColumnBlock::ids(void) {
+  RecordIDs *ids = new RecordIDs();
+  ids->reserve(this->num_values);
+  for (RecordID id = 1; id <= this->num_values; id++)
+    ids->push_back(id);
+  return ids;
+}
+
+bool ColumnBlock::has_room(u16 size) {
+  if (this->data_type == ColumnAttribute::INT)
+    return HEADER_SZ + (this->num_values + 1) * sizeof(int32_t) <=
+           DbBlock::BLOCK_SZ;
+  u16 slots_end = HEADER_SZ + (this->num_values + 1) * sizeof(u16);
+  return slots_end + size <= this->end_free + 1;
+}
+
+int32_t ColumnBlock::get_int(RecordID record_id) {
+  check(record_id);
+  return *(int32_t *)address(HEADER_SZ + (record_id - 1) * sizeof(int32_t));
+}
+
+std::string ColumnBlock::get_text(RecordID record_id) {
+  check(record_id);
+  u16 loc = get_n(HEADER_SZ + (record_id - 1) * sizeof(u16));
+  u16 end = record_id == 1
+                ? DbBlock::BLOCK_SZ
+                : get_n(HEADER_SZ + (record_id - 2) * sizeof(u16));
+  return std::string((const char *)address(loc), end - loc);
+}
+
+Value ColumnBlock::get_value(RecordID record_id) {
+  if (this->data_type == ColumnAttribute::INT)
+    return Value(get_int(record_id));
+  return Value(get_text(record_id));
+}
+
+void ColumnBlock::check(RecordID record_id) {
+  if (record_id == 0 || record_id > this->num_values)
+    throw DbRelationError("no such row");
+}
+
+// Get 2-byte integer at given offset in block.
+u16 ColumnBlock::get_n(u16 offset) { return *(u16 *)this->address(offset); }
+
+// Put a 2-byte integer at given offset in block.
+void ColumnBlock::put_n(u16 offset, u16 n) {
+  *(u16 *)this->address(offset) = n;
+}
+
+// Make a void* pointer for a given offset into the data block.
+void *ColumnBlock::address(u16 offset) {
+  return (void *)((char *)this->block.get_data() + offset);
+}
+
+// END  : ColumnBlock //
+
+// BEGIN: ColumnFile //
+
+void ColumnFile::create(void) {
+  if (!closed)
+    throw DbException("Cannot create an open file");
+  db_open(DB_CREATE | DB_EXCL);
+  ColumnBlock *first_block = get_new();
+  put(first_block);
+  delete first_block;
+}
+
+void ColumnFile::drop(void) {
+  this->close();
+  Db(_DB_ENV, 0).remove((this->name + ".db").c_str(), nullptr, 0);
+}
+
+void ColumnFile::open(void) {
+  if (closed)
+    db_open();
+}
+
+void ColumnFile::close(void) {
+  if (!closed)
+    this->db.close(0U);
+  this->closed = true;
+}
+
+ColumnBlock *ColumnFile::get_new(void) {
+  char block[DbBlock::BLOCK_SZ];
+  std::memset(block, 0, sizeof(block));
+  Dbt data(block, sizeof(block));
+
+  u32 block_id = ++(this->last);
+  Dbt key(&block_id, sizeof(block_id));
+
+  // as in HeapFile, the block must wrap Berkeley DB's copy, not our buffer
+  ColumnBlock initializer(data, this->last, this->data_type, true);
+  this->db.put(nullptr, &key, &data, 0U);
+  this->db.get(nullptr, &key, &data, 0U);
+  return new ColumnBlock(data, this->last, this->data_type);
+}
+
+ColumnBlock *ColumnFile::get(BlockID block_id) {
+  Dbt key(&block_id, sizeof(block_id)), block;
+  this->db.get(nullptr, &key, &block, 0U);
+  return new ColumnBlock(block, block_id, this->data_type);
+}
+
+void ColumnFile::put(DbBlock *block) {
+  BlockID block_id = block->get_block_id();
+  Dbt key(&block_id, sizeof(block_id));
+  this->db.put(nullptr, &key, block->get_block(), 0U);
+}
+
+BlockIDs *ColumnFile::block_ids() {
+  BlockIDs *ids = new BlockIDs();
+  ids->reserve(this->last);
+  for (u32 i = 1; i <= this->last; i++)
+    ids->emplace_back(i);
+  return ids;
+}
+
+void ColumnFile::db_open(uint flags) {
+  this->db.set_message_stream(_DB_ENV->get_message_stream());
+  this->db.set_error_stream(_DB_ENV->get_error_stream());
+  this->db.set_re_len(DbBlock::BLOCK_SZ);
+  this->db.open(nullptr, (this->name + ".db").c_str(), nullptr, DB_RECNO,
+                flags, 0644);
+  if ((flags & DB_CREATE) == 0U) {
+    DB_BTREE_STAT *stat;
+    this->db.stat(nullptr, &stat, DB_FAST_STAT);
+    this->last = stat->bt_ndata;
+    free(stat);
+  } else {
+    this->last = 0;
+  }
+  this->closed = false;
+}
+
+// END  : ColumnFile //
+
+// BEGIN: ColumnTable //
+
+ColumnTable::ColumnTable(Identifier table_name, ColumnNames column_names,
+                         ColumnAttributes column_attributes)
+    : DbRelation(table_name, column_names, column_attributes) {
+  if (column_names.empty())
+    throw DbRelationError("a table needs at least one column");
+  for (size_t i = 0; i < column_names.size(); i++)
+    this->files.push_back(
+        new ColumnFile(table_name + "." + column_names[i] + ".col",
+                       column_attributes[i].get_data_type()));
+}
+
+ColumnTable::~ColumnTable() {
+  for (ColumnFile *file : this->files)
+    delete file;
+}
+
+void ColumnTable::create() {
+  for (ColumnFile *file : this->files)
+    file->create();
+}
+
+void ColumnTable::create_if_not_exists() {
+  try {
+    this->open();
+  } catch (const DbException &) {
+    this->close();
+    this->create();
+  }
+}
+
+void ColumnTable::drop() {
+  for (ColumnFile *file : this->files)
+    file->drop();
+}
+
+void ColumnTable::open() {
+  for (ColumnFile *file : this->files)
+    file->open();
+}
+
+void ColumnTable::close() {
+  for (ColumnFile *file : this->files)
+    file->close();
+}
+
+// Append the row's values to the last block of every column, starting a new
+// row group in all the files together if any one of them is full.
+Handle ColumnTable::insert(const ValueDict *row) {
+  std::vector<Dbt *> values;
+  std::vector<char *> buffers;
+  try {
+    for (size_t i = 0; i < this->column_names.size(); i++) {
+      auto it = row->find(this->column_names[i]);
+      if (it == row->end())
+        throw DbRelationError("Row missing fields");
+      buffers.push_back(new char[DbBlock::BLOCK_SZ]);
+      values.push_back(marshal(i, it->second, buffers.back()));
+    }
+  } catch (...) {
+    for (Dbt *value : values)
+      delete value;
+    for (char *buffer : buffers)
+      delete[] buffer;
+    throw;
+  }
+
+  // every file has its own Berkeley DB handle, so their blocks can be held
+  // at the same time
+  std::vector<ColumnBlock *> blocks;
+  bool room = true;
+  for (size_t i = 0; i < this->files.size(); i++) {
+    blocks.push_back(this->files[i]->get(this->files[i]->get_last_block_id()));
+    room = room && blocks[i]->has_room(values[i]->get_size());
+  }
+  if (!room)
+    for (size_t i = 0; i < this->files.size(); i++) {
+      delete blocks[i];
+      blocks[i] = this->files[i]->get_new();
+    }
+
+  RecordID record_id = 0;
+  for (size_t i = 0; i < this->files.size(); i++) {
+    record_id = blocks[i]->add(values[i]);
+    this->files[i]->put(blocks[i]);
+  }
+  Handle handle(blocks[0]->get_block_id(), record_id);
+  for (size_t i = 0; i < this->files.size(); i++) {
+    delete blocks[i];
+    delete values[i];
+    delete[] buffers[i];
+  }
+  return handle;
+}
+
+void ColumnTable::update(const Handle, const ValueDict *) {
+  throw NotImplementedError("ColumnTable rows can't be updated");
+}
+
+void ColumnTable::del(const Handle) {
+  throw NotImplementedError("ColumnTable rows can't be deleted");
+}
+
+Handles *ColumnTable::select() {
+  Handles *handles = new Handles();
+  BlockIDs *group_ids = this->group_ids();
+  for (auto const &group_id : *group_ids) {
+    ColumnBlock *block = this->files[0]->get(group_id);
+    for (RecordID id = 1; id <= block->size(); id++)
+      handles->push_back(Handle(group_id, id));
+    delete block;
+  }
+  delete group_ids;
+  return handles;
+}
+
+// Only the where-clause's columns are read, a row group at a time.
+Handles *ColumnTable::select(const ValueDict *where) {
+  if (where->empty())
+    return select();
+  std::vector<std::pair<uint, Value>> predicates;
+  for (auto const &it : *where)
+    predicates.push_back(std::make_pair(column_index(it.first), it.second));
+
+  Handles *handles = new Handles();
+  BlockIDs *group_ids = this->group_ids();
+  for (auto const &group_id : *group_ids) {
+    std::vector<ColumnBlock *> blocks;
+    for (auto const &predicate : predicates)
+      blocks.push_back(this->files[predicate.first]->get(group_id));
+    for (RecordID id = 1; id <= blocks[0]->size(); id++) {
+      bool match = true;
+      for (size_t i = 0; match && i < predicates.size(); i++)
+        match = blocks[i]->get_value(id) == predicates[i].second;
+      if (match)
+        handles->push_back(Handle(group_id, id));
+    }
+    for (ColumnBlock *block : blocks)
+      delete block;
+  }
+  delete group_ids;
+  return handles;
+}
+
+ValueDict *ColumnTable::project(Handle handle) {
+  return project(handle, &this->column_names);
+}
+
+ValueDict *ColumnTable::project(Handle handle,
+                                const ColumnNames *column_names) {
+  ValueDict *row = new ValueDict();
+  try {
+    for (auto const &column_name : *column_names) {
+      ColumnBlock *block =
+          this->files[column_index(column_name)]->get(handle.first);
+      try {
+        (*row)[column_name] = block->get_value(handle.second);
+      } catch (...) {
+        delete block;
+        throw;
+      }
+      delete block;
+    }
+  } catch (...) {
+    delete row;
+    throw;
+  }
+  return row;
+}
+
+BlockIDs *ColumnTable::group_ids() { return this->files[0]->block_ids(); }
+
+void ColumnTable::read_batch(BlockID group_id, const ColumnNames *column_names,
+                             ColumnBatch &batch) {
+  batch.clear();
+  for (auto const &column_name : *column_names) {
+    uint column = column_index(column_name);
+    ColumnBlock *block = this->files[column]->get(group_id);
+    ColumnVector vector(this->column_attributes[column].get_data_type());
+    if (vector.data_type == ColumnAttribute::INT) {
+      vector.ints.reserve(block->size());
+      for (RecordID id = 1; id <= block->size(); id++)
+        vector.ints.push_back(block->get_int(id));
+    } else {
+      vector.texts.reserve(block->size());
+      for (RecordID id = 1; id <= block->size(); id++)
+        vector.texts.push_back(block->get_text(id));
+    }
+    if (batch.handles.empty())
+      for (RecordID id = 1; id <= block->size(); id++)
+        batch.handles.push_back(Handle(group_id, id));
+    delete block;
+    batch.column_names.push_back(column_name);
+    batch.columns.push_back(vector);
+  }
+}
+
+uint ColumnTable::column_index(const Identifier &column_name) {
+  for (size_t i = 0; i < this->column_names.size(); i++)
+    if (this->column_names[i] == column_name)
+      return i;
+  throw DbRelationError("unknown column " + column_name);
+}
+
+// Encode a value as its column stores it, into bytes (BLOCK_SZ long).
+// @returns  a Dbt over bytes (freed by caller; bytes isn't)
+Dbt *ColumnTable::marshal(uint column, const Value &value, char *bytes) {
+  if (this->column_attributes[column].get_data_type() ==
+      ColumnAttribute::INT) {
+    memcpy(bytes, &value.n, sizeof(int32_t));
+    return new Dbt(bytes, sizeof(int32_t));
+  }
+  // a TEXT value and its offset must fit in an empty block
+  if (value.s.size() > DbBlock::BLOCK_SZ - 4 - sizeof(u16))
+    throw DbRelationError("text too big for a column block");
+  memcpy(bytes, value.s.data(), value.s.size());
+  return new Dbt(bytes, value.s.size());
+}
+
+// END  : ColumnTable //
@@ -0,0 +1,123 @@
+#include "hash_index.h"
+#include <cstring>
+
+HashIndex::HashIndex(DbRelation &relation, Identifier name,
+                     ColumnNames key_columns, bool unique)
+    : DbIndex(relation, name, key_columns, unique),
+      dbfilename(relation.get_table_name() + "-" + name + ".hash.db"),
+      db(nullptr), codec(key_columns, relation.get_column_attributes(key_columns)) {}
+
+HashIndex::~HashIndex() { close(); }
+
+void HashIndex::create() {
+  db_open(DB_CREATE | DB_EXCL);
+  Handles *handles = this->relation.select();
+  try {
+    for (auto const &handle : *handles)
+      insert(handle);
+  } catch (...) {
+    delete handles;
+    drop();
+    throw;
+  }
+  delete handles;
+}
+
+void HashIndex::drop() {
+  close();
+  Db(_DB_ENV, 0).remove(this->dbfilename.c_str(), nullptr, 0);
+}
+
+void HashIndex::open() {
+  if (this->db == nullptr)
+    db_open();
+}
+
+void HashIndex::close() {
+  if (this->db != nullptr) {
+    this->db->close(0U);
+    delete this->db;
+    this->db = nullptr;
+  }
+}
+
+Handles *HashIndex::lookup(const ValueDict *key_values) const {
+  char bytes[DbBlock::BLOCK_SZ];
+  Dbt key(bytes, encode_key(key_values, bytes));
+  Dbt data;
+  Handles *handles = new Handles();
+
+  Dbc *cursor;
+  this->db->cursor(nullptr, &cursor, 0);
+  int ret = cursor->get(&key, &data, DB_SET);
+  while (ret == 0) {
+    Handle handle;
+    memcpy(&handle.first, data.get_data(), sizeof(BlockID));
+    memcpy(&handle.second, (char *)data.get_data() + sizeof(BlockID),
+           sizeof(RecordID));
+    handles->push_back(handle);
+    ret = cursor->get(&key, &data, DB_NEXT_DUP);
+  }
+  cursor->close();
+  return handles;
+}
+
+void HashIndex::insert(Handle handle) {
+  ValueDict *key_values = key_of(handle);
+  char bytes[DbBlock::BLOCK_SZ];
+  Dbt key(bytes, encode_key(key_values, bytes));
+  delete key_values;
+
+  char marshaled[HANDLE_SZ];
+  memcpy(marshaled, &handle.first, sizeof(BlockID));
+  memcpy(marshaled + sizeof(BlockID), &handle.second, sizeof(RecordID));
+  Dbt data(marshaled, HANDLE_SZ);
+  if (this->db->put(nullptr, &key, &data,
+                    this->unique ? DB_NOOVERWRITE : 0U) == DB_KEYEXIST &&
+      this->unique)
+    throw DbRelationError("duplicate key in unique index " + this->name);
+}
+
+void HashIndex::del(Handle handle) {
+  ValueDict *key_values = key_of(handle);
+  char bytes[DbBlock::BLOCK_SZ];
+  Dbt key(bytes, encode_key(key_values, bytes));
+  delete key_values;
+
+  char marshaled[HANDLE_SZ];
+  memcpy(marshaled, &handle.first, sizeof(BlockID));
+  memcpy(marshaled + sizeof(BlockID), &handle.second, sizeof(RecordID));
+  Dbt data(marshaled, HANDLE_SZ);
+
+  Dbc *cursor;
+  this->db->cursor(nullptr, &cursor, 0);
+  if (cursor->get(&key, &data, DB_GET_BOTH) == 0)
+    cursor->del(0);
+  cursor->close();
+}
+
+void HashIndex::db_open(uint flags) {
+  this->db = new Db(_DB_ENV, 0);
+  this->db->set_message_stream(_DB_ENV->get_message_stream());
+  this->db->set_error_stream(_DB_ENV->get_error_stream());
+  if (!this->unique)
+    this->db->set_flags(DB_DUPSORT);
+  try {
+    this->db->open(nullptr, this->dbfilename.c_str(), nullptr, DB_HASH, flags,
+                   0644);
+  } catch (const DbException &) {
+    delete this->db;
+    this->db = nullptr;
+    throw;
+  }
+}
+
+ValueDict *HashIndex::key_of(Handle handle) const {
+  return this->relation.project(handle, &this->key_columns);
+}
+
+uint HashIndex::encode_key(const ValueDict *key_values, char *bytes) const {
+  if (this->codec.size(key_values) > DbBlock::BLOCK_SZ)
+    throw DbRelationError("index key too big");
+  return this->codec.encode(key_values, bytes);
+}
@@ -1,11 +1,14 @@
 #include "heap_storage.h"
-#include "not_impl.h"
+#include "bitmap_index.h"
+#include "pax_storage.h"
 #include "storage_engine.h"
+#include <algorithm>
 #include <cstddef>
 #include <cstdint>
 #include <cstdlib>
 #include <cstring>
 #include <db_cxx.h>
+#include <set>
 #include <string>
 #include <utility>
 
@@ -27,40 +30,58 @@ SlottedPage::SlottedPage(Dbt &block, BlockID block_id, bool is_new)
 
 // Add a new record to the block. Return its id.
 RecordID SlottedPage::add(const Dbt *data) {
-  if (!has_room(data->get_size() + sizeof(u16) * 2))
+  RecordID id = reserve((u16)data->get_size());
+  memcpy(this->record(id), data->get_data(), data->get_size());
+  return id;
+}
+
+// Allocate a slot and size bytes of record space without filling it in. The
+// caller writes the record directly into record(id). Fails unless at least
+// slack bytes would still be free afterwards.
+RecordID SlottedPage::reserve(u16 size, u16 slack) {
+  if (!has_room(size + sizeof(u16) * 2 + slack))
     throw DbBlockNoRoomError("not enough room for new record");
   u16 id = ++this->num_records;
-  u16 size = (u16)data->get_size();
   this->end_free -= size;
   u16 loc = this->end_free + 1;
   put_header();
   put_header(id, size, loc);
-  memcpy(this->address(loc), data->get_data(), size);
   return id;
 }
 
+// Address of the given record's bytes within the block.
+void *SlottedPage::record(RecordID record_id) {
+  u16 size, loc;
+  get_header(size, loc, record_id);
+  return loc == 0 ? nullptr : address(loc);
+}
+
 Dbt *SlottedPage::get(RecordID record_id) {
   u16 size, loc;
   this->get_header(size, loc, record_id);
   return loc == 0 ? nullptr : new Dbt(address(loc), size);
 }
 
+// Replace a record's data, growing or shrinking it in place. Records below it
+// in the block are slid over to make (or close up) the room.
 void SlottedPage::put(RecordID record_id, const Dbt &data) {
   u16 size, loc;
   get_header(size, loc, record_id);
+  u16 flags = get_flags(record_id);
   u16 new_size = data.get_size();
   if (new_size > size) {
     u16 extra = new_size - size;
     if (!has_room(extra))
       throw DbBlockNoRoomError("not enough room for new record");
     slide(loc, loc - extra);
-    memcpy(this->address(loc - extra), data.get_data(), new_size);
+    loc -= extra;
+    memcpy(this->address(loc), data.get_data(), new_size);
   } else {
     memcpy(this->address(loc), data.get_data(), new_size);
     slide(loc + new_size, loc + size);
+    loc += size - new_size;
   }
-  get_header(size, loc, record_id);
-  put_header(record_id, size, loc);
+  put_header(record_id, new_size, loc, flags);
 }
 
 void SlottedPage::del(RecordID record_id) {
@@ -76,26 +97,59 @@ RecordIDs *SlottedPage::ids() {
   for (u16 i = 1; i <= this->num_records; i++) {
     u16 size, loc;
     get_header(size, loc, i);
-    if (loc != 0) {
+    if (loc != 0 && (get_flags(i) & MOVED) == 0) {
       records->emplace_back(i);
     }
   }
   return records;
 }
 
+// Flag bits kept in the high end of a record's size.
+u16 SlottedPage::get_flags(RecordID record_id) {
+  return get_n(2 * sizeof(u16) * record_id) & ~SIZE_MASK;
+}
+
+void SlottedPage::set_flags(RecordID record_id, u16 flags) {
+  u16 size, loc;
+  get_header(size, loc, record_id);
+  put_header(record_id, size, loc, flags);
+}
+
+// Turn a record into a forwarding stub pointing at the row's new home.
+void SlottedPage::put_forward(RecordID record_id, Handle to) {
+  char stub[FORWARD_SZ];
+  memcpy(stub, &to.first, sizeof(BlockID));
+  memcpy(stub + sizeof(BlockID), &to.second, sizeof(RecordID));
+  Dbt data(stub, sizeof(stub));
+  put(record_id, data);
+  set_flags(record_id, FORWARDED);
+}
+
+// If the record is a forwarding stub, set to where the row now lives.
+bool SlottedPage::get_forward(RecordID record_id, Handle &to) {
+  if ((get_flags(record_id) & FORWARDED) == 0)
+    return false;
+  char *stub = (char *)record(record_id);
+  memcpy(&to.first, stub, sizeof(BlockID));
+  memcpy(&to.second, stub + sizeof(BlockID), sizeof(RecordID));
+  return true;
+}
+
 void SlottedPage::get_header(u16 &size, u16 &loc, RecordID id) {
   size = get_n(2 * sizeof(u16) * id);
+  if (id != 0)
+    size &= SIZE_MASK;
   loc = get_n(2 * sizeof(u16) * id + sizeof(u16));
 }
 
 // Store the size and offset for given id. For id of zero, store the block
 // header.
-void SlottedPage::put_header(RecordID id, u16 size, u16 loc) {
+void SlottedPage::put_header(RecordID id, u16 size, u16 loc, u16 flags) {
   if (id == 0) { // called the put_header() version and using the default params
     size = this->num_records;
     loc = this->end_free;
   }
-  put_n(2 * sizeof(u16) * id, size);
+  put_n(2 * sizeof(u16) * id, size | flags);
   put_n(2 * sizeof(u16) * id + 2, loc);
 }
 
@@ -104,6 +158,9 @@ bool SlottedPage::has_room(u16 size) {
   return space >= size;
 }
 
+// Move the record data lying between the free space and start over to end
+// (shift may be either direction), fixing up the locations of the records that
+// moved. The caller is responsible for the header of the record being resized.
 void SlottedPage::slide(u16 start, u16 end) {
   int shift = end - start;
   if (shift == 0)
@@ -111,21 +168,17 @@ void SlottedPage::slide(u16 start, u16 end) {
 
   u16 block_start = this->end_free + 1;
   // Memmove should be safer for overlap
-  memmove(address(block_start + shift), address(block_start), abs(shift));
+  memmove(address(block_start + shift), address(block_start),
+          start - block_start);
 
-  RecordIDs *records = this->ids();
-  for (RecordID &it : *records) {
+  for (RecordID id = 1; id <= this->num_records; id++) {
     u16 size, loc;
-    get_header(size, loc, it);
-    if (loc <= start) {
-      loc += shift;
-      put_header(it, size, loc);
-    }
+    get_header(size, loc, id);
+    if (loc != 0 && loc + size <= start)
+      put_n(2 * sizeof(u16) * id + sizeof(u16), loc + shift);
   }
   this->end_free += shift;
   put_header();
-
-  delete records;
 }
 
 // Get 2-byte integer at given offset in block.
@@ -143,28 +196,28 @@ void *SlottedPage::address(u16 offset) {
 
 // END  : SlottedPage //
 
-// BEGIN: HeapFile //
+// BEGIN: BasicHeapFile //
 
-void HeapFile::create(void) {
+template <class Page> void BasicHeapFile<Page>::create(void) {
   if (!closed)
     throw DbException("Cannot create an open file");
   db_open(DB_CREATE | DB_EXCL);
-  SlottedPage *first_block = get_new();
+  Page *first_block = get_new();
   put(first_block);
   delete first_block;
 }
 
-void HeapFile::drop(void) {
+template <class Page> void BasicHeapFile<Page>::drop(void) {
   this->close();
   std::remove(this->dbfilename.c_str());
 }
 
-void HeapFile::open(void) {
+template <class Page> void BasicHeapFile<Page>::open(void) {
   if (closed)
     db_open();
 }
 
-void HeapFile::close(void) {
+template <class Page> void BasicHeapFile<Page>::close(void) {
   if (!closed)
     this->db.close(0U);
   this->closed = true;
@@ -173,7 +226,7 @@ void HeapFile::close(void) {
 // Allocate a new block for the database file.
 // Returns the new empty DbBlock that is managing the records in this block and
 // its block id.
-SlottedPage *HeapFile::get_new(void) {
+template <class Page> Page *BasicHeapFile<Page>::get_new(void) {
   char block[DbBlock::BLOCK_SZ];
   std::memset(block, 0, sizeof(block));
   Dbt data(block, sizeof(block));
@@ -182,28 +235,28 @@ SlottedPage *HeapFile::get_new(void) {
   Dbt key(&block_id, sizeof(block_id));
 
   // write out an empty block and read it back in so Berkeley DB is managing the
-  // memory
-  SlottedPage *page = new SlottedPage(data, this->last, true);
+  // memory (the page must wrap the Berkeley DB copy, not our stack buffer)
+  Page initializer(data, this->last, true);
   this->db.put(nullptr, &key, &data,
                0U); // write it out with initialization applied
   this->db.get(nullptr, &key, &data, 0U);
-  return page;
+  return new Page(data, this->last);
 }
 
-SlottedPage *HeapFile::get(BlockID block_id) {
+template <class Page> Page *BasicHeapFile<Page>::get(BlockID block_id) {
   Dbt key(&block_id, sizeof(block_id)), block;
   this->db.get(nullptr, &key, &block, 0U);
-  SlottedPage *page = new SlottedPage(block, block_id);
+  Page *page = new Page(block, block_id);
   return page;
 }
 
-void HeapFile::put(DbBlock *block) {
+template <class Page> void BasicHeapFile<Page>::put(DbBlock *block) {
   BlockID block_id = block->get_block_id();
   Dbt key(&block_id, sizeof(block_id));
   this->db.put(nullptr, &key, block->get_block(), 0U);
 }
 
-BlockIDs *HeapFile::block_ids() {
+template <class Page> BlockIDs *BasicHeapFile<Page>::block_ids() {
   BlockIDs *ids = new BlockIDs();
   ids->reserve(this->last);
   for (u32 i = 1; i <= this->last; i++) {
@@ -212,16 +265,16 @@ BlockIDs *HeapFile::block_ids() {
   return ids;
 }
 
-void HeapFile::db_open(uint flags) {
-  this->db.set_message_stream(_DB_ENV->get_message_stream());
-  this->db.set_error_stream(_DB_ENV->get_error_stream());
+template <class Page> void BasicHeapFile<Page>::db_open(uint flags) {
+  this->db.set_message_stream(this->env->get_message_stream());
+  this->db.set_error_stream(this->env->get_error_stream());
   this->db.set_re_len(DbBlock::BLOCK_SZ); // Set record length to 4K
   db.open(nullptr, (this->name + ".db").c_str(), nullptr, DB_RECNO, flags,
           0644);
 
   const char *filename, *dbname;
   this->db.get_dbname(&filename, &dbname);
-  _DB_ENV->get_home(&dbname); // We dont need dbname so reuse it.
+  this->env->get_home(&dbname); // We dont need dbname so reuse it.
   this->dbfilename = std::string(dbname) + '/' + std::string(filename);
 
   // If the create flag is set then assume blank file.
@@ -238,16 +291,31 @@ void HeapFile::db_open(uint flags) {
   this->closed = false;
 }
 
-// END  : HeapFile //
+// every page type a heap file is used with
+template class BasicHeapFile<SlottedPage>;
+template class BasicHeapFile<PaxPage>;
+
+// END  : BasicHeapFile //
 
 // BEGIN: HeapTable //
 
 HeapTable::HeapTable(Identifier table_name, ColumnNames column_names,
-                     ColumnAttributes column_attributes)
+                     ColumnAttributes column_attributes, TableOptions options)
     : DbRelation(table_name, column_names, column_attributes),
-      file(table_name) {}
+      file(table_name), codec(column_names, column_attributes),
+      options(options), zones(table_name, column_names, column_attributes),
+      blooms(table_name, column_names, options.bloom_columns,
+             options.bloom_bits, options.bloom_fp_rate) {
+  if (options.fillfactor < 10 || options.fillfactor > 100)
+    throw DbRelationError("fillfactor must be between 10 and 100");
+  this->slack = DbBlock::BLOCK_SZ * (100 - options.fillfactor) / 100;
+}
 
-void HeapTable::create() { this->file.create(); }
+void HeapTable::create() {
+  this->file.create();
+  this->zones.create();
+  this->blooms.create();
+}
 
 void HeapTable::create_if_not_exists() {
   try {
@@ -258,29 +326,149 @@ void HeapTable::create_if_not_exists() {
   }
 }
 
-void HeapTable::drop() { this->file.drop(); }
+void HeapTable::drop() {
+  this->file.drop();
+  this->zones.drop();
+  this->blooms.drop();
+}
 
-void HeapTable::open() { this->file.open(); }
+void HeapTable::open() {
+  this->file.open();
+  this->zones.open();
+  this->blooms.open();
+}
 
-void HeapTable::close() { this->file.close(); }
+void HeapTable::close() {
+  this->file.close();
+  this->zones.close();
+  this->blooms.close();
+}
 
 Handle HeapTable::insert(const ValueDict *row) {
   ValueDict *validated = validate(row);
   Handle added = append(validated);
   delete validated;
+
+  size_t indexed = 0;
+  try {
+    for (; indexed < this->indexes.size(); indexed++)
+      this->indexes[indexed]->insert(added);
+  } catch (const DbRelationError &) {
+    // e.g. a unique index rejected the key: take the row back out again
+    for (size_t i = 0; i < indexed; i++)
+      this->indexes[i]->del(added);
+    del_record(added);
+    throw;
+  }
   return added;
 }
 
+// Rows are rewritten in place whenever they still fit in their block. A row
+// that outgrows its block moves elsewhere and leaves a forwarding stub behind,
+// so the handle callers hold keeps working and nothing else has to change.
 void HeapTable::update(const Handle handle, const ValueDict *new_values) {
-  throw NotImplementedError();
+  ValueDict *row = project(handle);
+  for (auto const &it : *new_values) {
+    auto column = row->find(it.first);
+    if (column == row->end()) {
+      delete row;
+      throw DbRelationError("unknown column " + it.first);
+    }
+    column->second = it.second;
+  }
+
+  // handles survive updates, so only indexes on changed columns need touching
+  DbIndexes changed;
+  for (DbIndex *index : this->indexes)
+    for (auto const &key_column : index->get_key_columns())
+      if (new_values->find(key_column) != new_values->end()) {
+        changed.push_back(index);
+        break;
+      }
+  // a unique key taken by another row is refused before anything is written
+  for (DbIndex *index : changed) {
+    if (!index->is_unique())
+      continue;
+    Handles *taken = index->lookup(row);
+    bool duplicate = std::any_of(taken->begin(), taken->end(),
+                                 [&handle](const Handle &other) {
+                                   return other != handle;
+                                 });
+    delete taken;
+    if (duplicate) {
+      delete row;
+      throw DbRelationError("duplicate key in unique index " +
+                            index->get_name());
+    }
+  }
+
+  Dbt *data;
+  try {
+    data = marshal(row);
+  } catch (...) {
+    delete row;
+    throw;
+  }
+  // the row stays reachable through its home block wherever it ends up
+  this->zones.widen(handle.first, row);
+  this->blooms.add(handle.first, row);
+  delete row;
+
+  for (DbIndex *index : changed)
+    index->del(handle);
+
+  Handle moved;
+  SlottedPage *block = this->file.get(handle.first);
+  bool forwarded = block->get_forward(handle.second, moved);
+  if (try_put(block, handle.second, data, 0)) {
+    // fits at home (which also pulls a moved row back to its own slot)
+    if (forwarded)
+      del_record(moved);
+  } else if (forwarded && try_put(this->file.get(moved.first), moved.second,
+                                  data, SlottedPage::MOVED)) {
+    // fits where it had already moved to
+  } else {
+    Handle to = relocate(data);
+    if (forwarded)
+      del_record(moved);
+    block = this->file.get(handle.first);
+    block->put_forward(handle.second, to);
+    this->file.put(block);
+    delete block;
+  }
+  delete[] (char *)data->get_data();
+  delete data;
+
+  for (DbIndex *index : changed)
+    index->insert(handle);
 }
 
-void HeapTable::del(const Handle handle) { throw NotImplementedError(); }
+void HeapTable::del(const Handle handle) {
+  Handle moved;
+  SlottedPage *block = this->file.get(handle.first);
+  if (block->record(handle.second) == nullptr) {
+    delete block;
+    throw DbRelationError("no such row");
+  }
+  bool forwarded = block->get_forward(handle.second, moved);
+  delete block;
+  for (DbIndex *index : this->indexes)
+    index->del(handle);
+
+  block = this->file.get(handle.first);
+  block->del(handle.second);
+  this->file.put(block);
+  delete block;
+  if (forwarded)
+    del_record(moved);
+}
 
 Handles *HeapTable::select() {
   Handles *handles = new Handles();
   BlockIDs *block_ids = file.block_ids();
+  this->scan_stats = ScanStats();
   for (auto const &block_id : *block_ids) {
+    this->scan_stats.blocks_read++;
     SlottedPage *block = file.get(block_id);
     RecordIDs *record_ids = block->ids();
     for (auto const &record_id : *record_ids)
@@ -292,13 +480,72 @@ Handles *HeapTable::select() {
   return handles;
 }
 
+// Equality lookups go through an index on the where-clause columns when there
+// is one, re-checking any other predicates on just the rows it finds. Short of
+// a unique index, the bitmap indexes on where-clause columns are intersected
+// first so only rows matching all of them are fetched.
+// Otherwise each block the zone map and Bloom filters can't rule out is
+// scanned, testing rows without decoding them.
 Handles *HeapTable::select(const ValueDict *where) {
-  throw NotImplementedError();
+  Predicates predicates = compile(where);
+  Handles *handles = new Handles();
+  this->scan_stats = ScanStats();
+
+  DbIndex *index = index_for(where);
+  if (index == nullptr || !index->is_unique()) {
+    Handles *intersected = bitmap_select(where, predicates);
+    if (intersected != nullptr) {
+      delete handles;
+      return intersected;
+    }
+  }
+  if (index != nullptr) {
+    Handles *candidates = index->lookup(where);
+    bool residual = index->get_key_columns().size() < where->size();
+    for (auto const &handle : *candidates)
+      if (!residual || selected(handle, predicates))
+        handles->push_back(handle);
+    delete candidates;
+    return handles;
+  }
+
+  BlockIDs *block_ids = file.block_ids();
+  for (auto const &block_id : *block_ids) {
+    if (!may_contain(block_id, predicates)) {
+      this->scan_stats.blocks_skipped++;
+      continue;
+    }
+    if (filtered_out(block_id, predicates)) {
+      this->scan_stats.blocks_filtered++;
+      continue;
+    }
+    this->scan_stats.blocks_read++;
+    Handles forwarded;
+    SlottedPage *block = file.get(block_id);
+    RecordIDs *record_ids = block->ids();
+    for (auto const &record_id : *record_ids) {
+      Handle moved;
+      if (block->get_forward(record_id, moved))
+        forwarded.push_back(Handle(block_id, record_id));
+      else if (matches((const char *)block->record(record_id), predicates))
+        handles->push_back(Handle(block_id, record_id));
+    }
+    delete record_ids;
+    delete block;
+    // the block's memory is only good until the next get, so chase forwards
+    // once we are done with it
+    for (auto const &handle : forwarded)
+      if (selected(handle, predicates))
+        handles->push_back(handle);
+  }
+  delete block_ids;
+  return handles;
 }
 
 ValueDict *HeapTable::project(Handle handle) {
-  SlottedPage *block = this->file.get(handle.first);
-  Dbt *data = block->get(handle.second);
+  RecordID record_id;
+  SlottedPage *block = get_row(handle, record_id);
+  Dbt *data = block->get(record_id);
   ValueDict *row = unmarshal(data);
   delete data;
   delete block;
@@ -306,13 +553,202 @@ ValueDict *HeapTable::project(Handle handle) {
 }
 
 ValueDict *HeapTable::project(Handle handle, const ColumnNames *column_names) {
-  ValueDict *result = new ValueDict();
-  ValueDict *row = project(handle);
-  for (auto const &it : *column_names) {
-    result->insert(row->extract(it));
+  RecordID record_id;
+  SlottedPage *block = get_row(handle, record_id);
+  Dbt *data = block->get(record_id);
+  ValueDict *row =
+      this->codec.decode((const char *)data->get_data(), column_names);
+  delete data;
+  delete block;
+  return row;
+}
+
+BlockIDs *HeapTable::group_ids() { return file.block_ids(); }
+
+// Fields are decoded straight from the block; forwarded rows are fetched
+// once the block is released.
+void HeapTable::read_batch(BlockID block_id, const ColumnNames *column_names,
+                           ColumnBatch &batch) {
+  batch.clear();
+  std::vector<uint> columns;
+  for (auto const &column_name : *column_names) {
+    int column = this->codec.column_index(column_name);
+    if (column < 0)
+      throw DbRelationError("unknown column " + column_name);
+    columns.push_back(column);
+    batch.column_names.push_back(column_name);
+    batch.columns.push_back(
+        ColumnVector(this->column_attributes[column].get_data_type()));
   }
-  delete row;
-  return result;
+
+  std::vector<size_t> forwarded;
+  SlottedPage *block = file.get(block_id);
+  RecordIDs *record_ids = block->ids();
+  for (auto const &record_id : *record_ids) {
+    Handle moved;
+    if (block->get_forward(record_id, moved)) {
+      forwarded.push_back(batch.handles.size());
+      for (auto &vector : batch.columns)
+        vector.push_back(Value()); // filled in below
+    } else {
+      const char *bytes = (const char *)block->record(record_id);
+      for (size_t i = 0; i < columns.size(); i++)
+        batch.columns[i].push_back(this->codec.field(bytes, columns[i]));
+    }
+    batch.handles.push_back(Handle(block_id, record_id));
+  }
+  delete record_ids;
+  delete block;
+
+  for (auto const &i : forwarded) {
+    ValueDict *row = project(batch.handles[i], column_names);
+    for (size_t c = 0; c < columns.size(); c++) {
+      ColumnVector &vector = batch.columns[c];
+      if (vector.data_type == ColumnAttribute::INT)
+        vector.ints[i] = (*row)[(*column_names)[c]].n;
+      else
+        vector.texts[i] = (*row)[(*column_names)[c]].s;
+    }
+    delete row;
+  }
+}
+
+// Workers gather handles separately (each on its own cache line) and the
+// lists are merged and put back in block order at the end.
+Handles *HeapTable::parallel_select(const ValueDict *where, uint threads) {
+  struct alignas(64) Found {
+    Handles handles;
+  };
+  Predicates predicates = compile(where);
+  ParallelScan scan(threads);
+  std::vector<Found> found(scan.get_workers());
+  parallel_scan(scan, predicates,
+                [&found](uint worker, Handle handle, const char *) {
+                  found[worker].handles.push_back(handle);
+                });
+  Handles *handles = new Handles();
+  for (auto const &part : found)
+    handles->insert(handles->end(), part.handles.begin(), part.handles.end());
+  std::sort(handles->begin(), handles->end());
+  return handles;
+}
+
+ScanAggregate HeapTable::parallel_aggregate(const Identifier &column_name,
+                                            const ValueDict *where,
+                                            uint threads) {
+  int column = this->codec.column_index(column_name);
+  if (column < 0)
+    throw DbRelationError("unknown column " + column_name);
+  if (this->column_attributes[column].get_data_type() != ColumnAttribute::INT)
+    throw DbRelationError(column_name + " is not an INT column");
+  Predicates predicates = compile(where);
+  ParallelScan scan(threads);
+  std::vector<ScanAggregate> partials(scan.get_workers());
+  parallel_scan(scan, predicates,
+                [&](uint worker, Handle, const char *bytes) {
+                  partials[worker].add(this->codec.field(bytes, column).n);
+                });
+  ScanAggregate aggregate;
+  for (auto const &partial : partials)
+    aggregate.merge(partial);
+  return aggregate;
+}
+
+// Range predicates on a column with an ordered index are answered by a range
+// scan of the index; anything else scans the blocks the zone map lets through.
+Handles *HeapTable::select_range(const RangeDict *where) {
+  RangePredicates predicates = compile(where);
+  this->scan_stats = ScanStats();
+  for (auto const &it : *where) {
+    DbIndex *index = ordered_index_for(it.first);
+    if (index != nullptr)
+      return index_range(index, where);
+  }
+
+  Handles *handles = new Handles();
+  BlockIDs *block_ids = file.block_ids();
+  for (auto const &block_id : *block_ids) {
+    if (select_block(block_id, predicates, *handles))
+      this->scan_stats.blocks_read++;
+    else
+      this->scan_stats.blocks_skipped++;
+  }
+  delete block_ids;
+  return handles;
+}
+
+bool HeapTable::select_range(BlockID block_id, const RangeDict *where,
+                             Handles &handles) {
+  return select_block(block_id, compile(where), handles);
+}
+
+bool HeapTable::select_block(BlockID block_id,
+                             const RangePredicates &predicates,
+                             Handles &handles) {
+  if (!may_contain(block_id, predicates))
+    return false;
+  Handles forwarded;
+  SlottedPage *block = file.get(block_id);
+  RecordIDs *record_ids = block->ids();
+  for (auto const &record_id : *record_ids) {
+    Handle moved;
+    if (block->get_forward(record_id, moved))
+      forwarded.push_back(Handle(block_id, record_id));
+    else if (matches((const char *)block->record(record_id), predicates))
+      handles.push_back(Handle(block_id, record_id));
+  }
+  delete record_ids;
+  delete block;
+  for (auto const &handle : forwarded)
+    if (selected(handle, predicates))
+      handles.push_back(handle);
+  return true;
+}
+
+Handles *HeapTable::select_ordered(const Identifier &order_by,
+                                   const RangeDict *where) {
+  RangeDict none;
+  if (where == nullptr)
+    where = &none;
+  int column = this->codec.column_index(order_by);
+  if (column < 0)
+    throw DbRelationError("unknown column " + order_by);
+
+  DbIndex *index = ordered_index_for(order_by);
+  if (index != nullptr) {
+    this->scan_stats = ScanStats();
+    return index_range(index, where);
+  }
+
+  Handles *handles = select_range(where);
+  std::vector<std::pair<Value, Handle>> keyed;
+  keyed.reserve(handles->size());
+  for (auto const &handle : *handles) {
+    RecordID record_id;
+    SlottedPage *block = get_row(handle, record_id);
+    keyed.push_back(std::make_pair(
+        this->codec.field((const char *)block->record(record_id), column),
+        handle));
+    delete block;
+  }
+  std::stable_sort(keyed.begin(), keyed.end(),
+                   [](const std::pair<Value, Handle> &a,
+                      const std::pair<Value, Handle> &b) {
+                     return a.first < b.first;
+                   });
+  for (size_t i = 0; i < keyed.size(); i++)
+    (*handles)[i] = keyed[i].second;
+  return handles;
+}
+
+void HeapTable::add_index(DbIndex *index) { this->indexes.push_back(index); }
+
+void HeapTable::remove_index(DbIndex *index) {
+  for (auto it = this->indexes.begin(); it != this->indexes.end(); it++)
+    if (*it == index) {
+      this->indexes.erase(it);
+      return;
+    }
 }
 
 ValueDict *HeapTable::validate(const ValueDict *row) {
@@ -327,87 +763,385 @@ ValueDict *HeapTable::validate(const ValueDict *row) {
   return new_row;
 }
 
+// Encode the row straight into its slot in the last block, so an insert costs
+// no intermediate buffers and a single copy of the field values.
 Handle HeapTable::append(const ValueDict *row) {
-  Dbt *data = marshal(row);
-  SlottedPage *block = this->file.get(this->file.get_last_block_id());
   RecordID id;
+  SlottedPage *block = reserve(marshaled_size(row), id, this->slack);
+  marshal(row, (char *)block->record(id));
+  this->file.put(block);
+  this->zones.widen(block->get_block_id(), row);
+  this->blooms.add(block->get_block_id(), row);
+
+  Handle h(block->get_block_id(), id);
+  delete block;
+  return h;
+}
+
+// Make room for a new record of the given size in the last block, or in a new
+// block if the last one is full. Inserts pass the table's slack so blocks are
+// only filled to the fillfactor; a new block always takes the record.
+// @returns  the block holding the reserved record (freed by caller)
+SlottedPage *HeapTable::reserve(u16 size, RecordID &record_id, u16 slack) {
+  SlottedPage *block = this->file.get(this->file.get_last_block_id());
   try {
-    id = block->add(data);
+    record_id = block->reserve(size, slack);
   } catch (const DbBlockNoRoomError &) {
     delete block;
     block = this->file.get_new();
-    id = block->add(data);
+    record_id = block->reserve(size);
   }
+  return block;
+}
+
+// Store an already marshaled row that no longer fits in its home block.
+// @returns  where it went
+Handle HeapTable::relocate(const Dbt *data) {
+  RecordID id;
+  SlottedPage *block = reserve(data->get_size(), id);
+  memcpy(block->record(id), data->get_data(), data->get_size());
+  block->set_flags(id, SlottedPage::MOVED);
   this->file.put(block);
 
   Handle h(block->get_block_id(), id);
-
-  char *bytes = (char *)data->get_data();
-  delete[] bytes;
   delete block;
-  delete data;
   return h;
 }
 
+// Try to replace a record with data within its own block. Consumes block.
+// @returns  false (leaving the record untouched) if the block has no room
+bool HeapTable::try_put(SlottedPage *block, RecordID record_id, const Dbt *data,
+                        u16 flags) {
+  try {
+    block->put(record_id, *data);
+  } catch (const DbBlockNoRoomError &) {
+    delete block;
+    return false;
+  }
+  block->set_flags(record_id, flags);
+  this->file.put(block);
+  delete block;
+  return true;
+}
+
+void HeapTable::del_record(Handle handle) {
+  SlottedPage *block = this->file.get(handle.first);
+  block->del(handle.second);
+  this->file.put(block);
+  delete block;
+}
+
+// Resolve the where-clause's column names to positions once per query.
+HeapTable::Predicates HeapTable::compile(const ValueDict *where) {
+  Predicates predicates;
+  for (auto const &it : *where) {
+    int column = this->codec.column_index(it.first);
+    if (column < 0)
+      throw DbRelationError("unknown column " + it.first);
+    predicates.push_back(std::make_pair((uint)column, it.second));
+  }
+  return predicates;
+}
+
+bool HeapTable::matches(const char *bytes, const Predicates &predicates) {
+  for (auto const &predicate : predicates)
+    if (this->codec.field(bytes, predicate.first) != predicate.second)
+      return false;
+  return true;
+}
+
+bool HeapTable::selected(Handle handle, const Predicates &predicates) {
+  RecordID record_id;
+  SlottedPage *block = get_row(handle, record_id);
+  bool result = matches((const char *)block->record(record_id), predicates);
+  delete block;
+  return result;
+}
+
+// An index that can answer an equality lookup on where, if any. Unique indexes
+// are preferred.
+DbIndex *HeapTable::index_for(const ValueDict *where) {
+  DbIndex *best = nullptr;
+  for (DbIndex *index : this->indexes) {
+    bool usable = true;
+    for (auto const &key_column : index->get_key_columns())
+      usable = usable && where->find(key_column) != where->end();
+    if (usable && (best == nullptr || (index->is_unique() && !best->is_unique())))
+      best = index;
+  }
+  return best;
+}
+
+// AND together the bitmaps of every bitmap index whose key columns are all in
+// where, then check any predicates they don't cover on the rows left.
+// @returns  the qualifying rows, or nullptr if no bitmap index applies
+Handles *HeapTable::bitmap_select(const ValueDict *where,
+                                  const Predicates &predicates) {
+  std::optional<Bitmap> rows;
+  std::set<Identifier> covered;
+  for (DbIndex *index : this->indexes) {
+    BitmapIndex *bitmap_index = dynamic_cast<BitmapIndex *>(index);
+    if (bitmap_index == nullptr)
+      continue;
+    bool usable = true;
+    for (auto const &key_column : index->get_key_columns())
+      usable = usable && where->find(key_column) != where->end();
+    if (!usable)
+      continue;
+    if (rows)
+      *rows &= bitmap_index->lookup_bitmap(where);
+    else
+      rows = bitmap_index->lookup_bitmap(where);
+    for (auto const &key_column : index->get_key_columns())
+      covered.insert(key_column);
+  }
+  if (!rows)
+    return nullptr;
+
+  Handles *candidates = rows->handles();
+  if (covered.size() == where->size())
+    return candidates;
+  Handles *handles = new Handles();
+  for (auto const &handle : *candidates)
+    if (selected(handle, predicates))
+      handles->push_back(handle);
+  delete candidates;
+  return handles;
+}
+
+HeapTable::RangePredicates HeapTable::compile(const RangeDict *where) {
+  RangePredicates predicates;
+  for (auto const &it : *where) {
+    int column = this->codec.column_index(it.first);
+    if (column < 0)
+      throw DbRelationError("unknown column " + it.first);
+    predicates.push_back(std::make_pair((uint)column, it.second));
+  }
+  return predicates;
+}
+
+bool HeapTable::matches(const char *bytes, const RangePredicates &predicates) {
+  for (auto const &predicate : predicates)
+    if (!predicate.second.contains(this->codec.field(bytes, predicate.first)))
+      return false;
+  return true;
+}
+
+bool HeapTable::selected(Handle handle, const RangePredicates &predicates) {
+  RecordID record_id;
+  SlottedPage *block = get_row(handle, record_id);
+  bool result = matches((const char *)block->record(record_id), predicates);
+  delete block;
+  return result;
+}
+
+// Could the block hold a row satisfying every predicate, as far as its zone
+// map summary tells?
+bool HeapTable::may_contain(BlockID block_id, const Predicates &predicates) {
+  for (auto const &predicate : predicates)
+    if (!this->zones.may_contain(
+            block_id, predicate.first,
+            ValueRange(predicate.second, predicate.second)))
+      return false;
+  return true;
+}
+
+bool HeapTable::may_contain(BlockID block_id,
+                            const RangePredicates &predicates) {
+  for (auto const &predicate : predicates)
+    if (!this->zones.may_contain(block_id, predicate.first, predicate.second))
+      return false;
+  return true;
+}
+
+// Does a Bloom filter prove the block lacks a value the predicates require?
+bool HeapTable::filtered_out(BlockID block_id, const Predicates &predicates) {
+  for (auto const &predicate : predicates)
+    if (!this->blooms.may_contain(block_id, predicate.first, predicate.second))
+      return true;
+  return false;
+}
+
+// Scan the blocks of a morsel as select(where) does, through a worker's own
+// file handle.
+void HeapTable::scan_morsel(HeapFile &file, const Morsel &morsel,
+                            const Predicates &predicates, ScanStats &stats,
+                            RowVisitor visit) {
+  for (BlockID block_id = morsel.first; block_id <= morsel.second;
+       block_id++) {
+    if (!may_contain(block_id, predicates)) {
+      stats.blocks_skipped++;
+      continue;
+    }
+    if (filtered_out(block_id, predicates)) {
+      stats.blocks_filtered++;
+      continue;
+    }
+    stats.blocks_read++;
+    std::vector<std::pair<Handle, Handle>> forwarded; // (stub, row)
+    SlottedPage *block = file.get(block_id);
+    RecordIDs *record_ids = block->ids();
+    for (auto const &record_id : *record_ids) {
+      Handle moved;
+      if (block->get_forward(record_id, moved)) {
+        forwarded.push_back(std::make_pair(Handle(block_id, record_id), moved));
+      } else {
+        const char *bytes = (const char *)block->record(record_id);
+        if (matches(bytes, predicates))
+          visit(Handle(block_id, record_id), bytes);
+      }
+    }
+    delete record_ids;
+    delete block;
+    for (auto const &it : forwarded) {
+      block = file.get(it.second.first);
+      const char *bytes = (const char *)block->record(it.second.second);
+      if (bytes != nullptr && matches(bytes, predicates))
+        visit(it.first, bytes);
+      delete block;
+    }
+  }
+}
+
+// Neither the shell's environment handle nor any Db handle in it is opened
+// with DB_THREAD, so none of them may be used from more than one thread. Each
+// worker therefore joins the environment through a DbEnv handle of its own,
+// the way another process would, and opens the file in it; the environment's
+// buffer pool is shared, so the workers see the blocks the calling thread
+// has written. The workers' scan stats are summed.
+void HeapTable::parallel_scan(
+    ParallelScan &scan, const Predicates &predicates,
+    std::function<void(uint worker, Handle, const char *)> visit) {
+  const char *home;
+  _DB_ENV->get_home(&home);
+  std::vector<DbEnv *> envs;
+  std::vector<HeapFile *> files;
+  std::vector<ScanStats> stats(scan.get_workers());
+  auto close_all = [&]() {
+    for (HeapFile *file : files) {
+      file->close();
+      delete file;
+    }
+    for (DbEnv *env : envs) {
+      env->close(0U);
+      delete env;
+    }
+  };
+  try {
+    for (uint worker = 0; worker < scan.get_workers(); worker++) {
+      envs.push_back(new DbEnv(0U));
+      envs.back()->set_message_stream(_DB_ENV->get_message_stream());
+      envs.back()->set_error_stream(_DB_ENV->get_error_stream());
+      envs.back()->open(home, DB_INIT_MPOOL, 0);
+      files.push_back(new HeapFile(this->table_name, envs.back()));
+      files.back()->open();
+    }
+    scan.run(1, this->file.get_last_block_id(),
+             [&](uint worker, const Morsel &morsel) {
+               scan_morsel(*files[worker], morsel, predicates, stats[worker],
+                           [&](Handle handle, const char *bytes) {
+                             visit(worker, handle, bytes);
+                           });
+             });
+  } catch (...) {
+    close_all();
+    throw;
+  }
+  close_all();
+  this->scan_stats = ScanStats();
+  for (auto const &worker_stats : stats) {
+    this->scan_stats.blocks_read += worker_stats.blocks_read;
+    this->scan_stats.blocks_skipped += worker_stats.blocks_skipped;
+    this->scan_stats.blocks_filtered += worker_stats.blocks_filtered;
+  }
+}
+
+// An ordered index whose leading key column is column_name, if any.
+DbIndex *HeapTable::ordered_index_for(const Identifier &column_name) {
+  for (DbIndex *index : this->indexes)
+    if (index->is_ordered() && index->get_key_columns()[0] == column_name)
+      return index;
+  return nullptr;
+}
+
+// Range scan an ordered index over where's bounds on its leading column,
+// checking the remaining predicates on the rows it returns.
+Handles *HeapTable::index_range(DbIndex *index, const RangeDict *where) {
+  const Identifier &column_name = index->get_key_columns()[0];
+  ValueDict min, max;
+  auto bounds = where->find(column_name);
+  if (bounds != where->end()) {
+    if (bounds->second.min)
+      min[column_name] = *bounds->second.min;
+    if (bounds->second.max)
+      max[column_name] = *bounds->second.max;
+  }
+  Handles *candidates = index->range(min.empty() ? nullptr : &min,
+                                     max.empty() ? nullptr : &max);
+
+  RangeDict residual(*where);
+  residual.erase(column_name);
+  if (residual.empty())
+    return candidates;
+  RangePredicates predicates = compile(&residual);
+  Handles *handles = new Handles();
+  for (auto const &handle : *candidates)
+    if (selected(handle, predicates))
+      handles->push_back(handle);
+  delete candidates;
+  return handles;
+}
+
+// Get the block actually holding the row for handle, following a forwarding
+// stub if the row has moved.
+// @returns  the block (freed by caller) and, in record_id, the row's record
+// @throws   DbRelationError if there is no such row
+SlottedPage *HeapTable::get_row(Handle handle, RecordID &record_id) {
+  Handle moved;
+  SlottedPage *block = this->file.get(handle.first);
+  record_id = handle.second;
+  if (block->get_forward(handle.second, moved)) {
+    delete block;
+    block = this->file.get(moved.first);
+    record_id = moved.second;
+  }
+  if (block->record(record_id) == nullptr) {
+    delete block;
+    throw DbRelationError("no such row");
+  }
+  return block;
+}
+
 // return the bits to go into the file
 // caller responsible for freeing the returned Dbt and its enclosed
 // ret->get_data().
 Dbt *HeapTable::marshal(const ValueDict *row) {
-  char *bytes =
-      new char[DbBlock::BLOCK_SZ]; // more than we need (we insist that one row
-                                   // fits into DbBlock::BLOCK_SZ)
-  uint offset = 0;
-  uint col_num = 0;
-  for (auto const &column_name : this->column_names) {
-    ColumnAttribute ca = this->column_attributes[col_num++];
-    ValueDict::const_iterator column = row->find(column_name);
-    Value value = column->second;
-    if (ca.get_data_type() == ColumnAttribute::DataType::INT) {
-      *(int32_t *)(bytes + offset) = value.n;
-      offset += sizeof(int32_t);
-    } else if (ca.get_data_type() == ColumnAttribute::DataType::TEXT) {
-      uint size = value.s.length();
-      *(u16 *)(bytes + offset) = size;
-      offset += sizeof(u16);
-      memcpy(bytes + offset, value.s.c_str(), size); // assume ascii for now
-      offset += size;
-    } else {
-      throw DbRelationError("Only know how to marshal INT and TEXT");
-    }
-  }
-  char *right_size_bytes = new char[offset];
-  memcpy(right_size_bytes, bytes, offset);
-  delete[] bytes;
-  Dbt *data = new Dbt(right_size_bytes, offset);
-  return data;
+  u16 size = marshaled_size(row);
+  char *bytes = new char[size];
+  marshal(row, bytes);
+  return new Dbt(bytes, size);
+}
+
+// Number of bytes marshal() will write for this row. Short rows are padded out
+// to SlottedPage::FORWARD_SZ so they can always be replaced by a forward.
+// @throws DbRelationError if the row could never fit into a DbBlock
+u16 HeapTable::marshaled_size(const ValueDict *row) {
+  uint size = this->codec.size(row);
+  // we insist that one row (plus its header entry) fits into a DbBlock
+  if (size > DbBlock::BLOCK_SZ - 1 - sizeof(u16) * 4)
+    throw DbRelationError("row too big to marshal");
+  return size < SlottedPage::FORWARD_SZ ? SlottedPage::FORWARD_SZ : (u16)size;
+}
+
+// write the bits for row into bytes, which must hold marshaled_size(row)
+void HeapTable::marshal(const ValueDict *row, char *bytes) {
+  uint size = this->codec.encode(row, bytes);
+  if (size < SlottedPage::FORWARD_SZ)
+    memset(bytes + size, 0, SlottedPage::FORWARD_SZ - size);
 }
 
 ValueDict *HeapTable::unmarshal(Dbt *data) {
-  ValueDict *values = new ValueDict();
-  char *bytes = (char *)data->get_data();
-  uint offset = 0;
-  u16 size;
-  std::string text;
-  for (size_t i = 0; i < this->column_names.size(); i++) {
-    switch (this->column_attributes[i].get_data_type()) {
-    case ColumnAttribute::DataType::INT:
-      values->emplace(std::make_pair(this->column_names[i],
-                                     Value(*(int32_t *)(bytes + offset))));
-      offset += sizeof(int32_t);
-      break;
-    case ColumnAttribute::DataType::TEXT:
-      size = *(u16 *)(bytes + offset);
-      offset += sizeof(u16);
-      text = std::string(bytes + offset, size);
-      offset += size;
-      values->emplace(std::make_pair(this->column_names[i], Value(text)));
-      break;
-    default:
-      throw NotImplementedError();
-      break;
-    }
-  }
-  return values;
+  return this->codec.decode((const char *)data->get_data());
 }
 
 // END  : HeapTable //
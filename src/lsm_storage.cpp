@@ -0,0 +1,857 @@
+#include "lsm_storage.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+typedef u_int16_t u16;
+typedef u_int32_t u32;
+typedef u_int64_t u64;
+
+// Little helpers for the manifest's byte layout; fields are written back to
+// back.
+template <class T> static void put_bytes(std::string &bytes, const T &value) {
+  bytes.append((const char *)&value, sizeof(value));
+}
+
+template <class T>
+static void get_bytes(const std::string &bytes, size_t &at, T &value) {
+  if (at + sizeof(value) > bytes.size())
+    throw DbRelationError("LSM manifest record is cut short");
+  memcpy(&value, bytes.data() + at, sizeof(value));
+  at += sizeof(value);
+}
+
+// BEGIN: RunCursor //
+
+RunCursor::RunCursor(std::shared_ptr<LsmRun> run)
+    : run(run), file(run->get_name()), block(nullptr), block_id(0),
+      record_id(0), records(0), current_key(0), current_row(nullptr),
+      current_size(0) {
+  this->file.open();
+  load(1);
+}
+
+RunCursor::~RunCursor() {
+  delete this->block;
+  this->file.close();
+}
+
+void RunCursor::next() {
+  if (++this->record_id <= this->records)
+    position();
+  else
+    load(this->block_id + 1);
+}
+
+// Move to the first entry in the first block from block_id on that has one.
+void RunCursor::load(BlockID block_id) {
+  delete this->block;
+  this->block = nullptr;
+  for (; block_id <= this->file.get_last_block_id(); block_id++) {
+    SlottedPage *block = this->file.get(block_id);
+    RecordIDs *record_ids = block->ids();
+    this->records = record_ids->size();
+    delete record_ids;
+    if (this->records > 0) {
+      this->block = block;
+      this->block_id = block_id;
+      this->record_id = 1;
+      position();
+      return;
+    }
+    delete block;
+  }
+}
+
+void RunCursor::position() {
+  Dbt *data = this->block->get(this->record_id);
+  const char *bytes = (const char *)data->get_data();
+  memcpy(&this->current_key, bytes, sizeof(u64));
+  this->current_row = bytes + sizeof(u64);
+  this->current_size = data->get_size() - sizeof(u64);
+  delete data;
+}
+
+// END  : RunCursor //
+
+// BEGIN: MergeCursor //
+
+MergeCursor::MergeCursor(std::vector<LsmCursor *> sources)
+    : sources(sources), current(nullptr) {
+  settle();
+}
+
+MergeCursor::~MergeCursor() {
+  for (LsmCursor *source : this->sources)
+    delete source;
+}
+
+// Step past the current key in every source that has it, so the older
+// entries it shadowed are skipped too.
+void MergeCursor::next() {
+  u64 key = this->current->key();
+  for (LsmCursor *source : this->sources)
+    if (source->valid() && source->key() == key)
+      source->next();
+  settle();
+}
+
+// The current entry is the smallest key; on a tie the first (newest) source
+// wins.
+void MergeCursor::settle() {
+  this->current = nullptr;
+  for (LsmCursor *source : this->sources)
+    if (source->valid() &&
+        (this->current == nullptr || source->key() < this->current->key()))
+      this->current = source;
+}
+
+// END  : MergeCursor //
+
+// BEGIN: LsmRun //
+
+// splitmix64's finalizer: keys are dense row numbers, so every bit of the
+// hash has to depend on all of theirs.
+static u64 mix_key(u64 key) {
+  key ^= key >> 30;
+  key *= 0xbf58476d1ce4e5b9ULL;
+  key ^= key >> 27;
+  key *= 0x94d049bb133111ebULL;
+  key ^= key >> 31;
+  return key;
+}
+
+LsmRun::LsmRun(Identifier table_name, u32 run_id, uint level)
+    : run_id(run_id), level(level), entries(0), bytes(0), min_key(0),
+      max_key(0), obsolete(false),
+      name(table_name + ".run" + std::to_string(run_id)), file(name),
+      probes(1) {}
+
+LsmRun::~LsmRun() {
+  if (this->obsolete)
+    this->file.drop();
+  else
+    this->file.close();
+}
+
+// Entries are added to blocks in key order, a new block being started when
+// one fills; each block's first key becomes its fence.
+void LsmRun::write(LsmCursor &source, bool keep_tombstones, double fp_rate) {
+  this->file.create();
+  SlottedPage *block = this->file.get(1);
+  std::vector<u64> keys;
+  char record[DbBlock::BLOCK_SZ];
+  try {
+    for (; source.valid(); source.next()) {
+      if (source.size() == 0 && !keep_tombstones)
+        continue;
+      u64 key = source.key();
+      memcpy(record, &key, sizeof(key));
+      memcpy(record + sizeof(key), source.row(), source.size());
+      Dbt data(record, sizeof(key) + source.size());
+      try {
+        block->add(&data);
+      } catch (const DbBlockNoRoomError &) {
+        this->file.put(block);
+        delete block;
+        block = this->file.get_new();
+        block->add(&data);
+      }
+      if (this->fences.size() < block->get_block_id())
+        this->fences.push_back(key);
+      if (keys.empty())
+        this->min_key = key;
+      this->max_key = key;
+      keys.push_back(key);
+      this->bytes += source.size();
+    }
+    this->file.put(block);
+  } catch (...) {
+    delete block;
+    throw;
+  }
+  delete block;
+  this->entries = keys.size();
+
+  // with the best number of bits per key, each probe halves the rate
+  double bits_per_key = 1.44 * -std::log2(fp_rate);
+  u64 bits = std::max<u64>(64, std::ceil(keys.size() * bits_per_key));
+  this->bloom.assign((bits + 7) / 8, 0);
+  bits = this->bloom.size() * 8;
+  this->probes = std::max(1, (int)std::lround(-std::log2(fp_rate)));
+  for (u64 key : keys) {
+    u64 h1 = mix_key(key), h2 = mix_key(~key) | 1;
+    for (uint i = 0; i < this->probes; i++) {
+      u64 bit = (h1 + i * h2) % bits;
+      this->bloom[bit / 8] |= 1 << (bit % 8);
+    }
+  }
+}
+
+void LsmRun::open() { this->file.open(); }
+
+bool LsmRun::get(u64 key, std::string &row, LsmStats &stats) {
+  if (this->entries == 0 || key < this->min_key || key > this->max_key)
+    return false;
+  if (!may_contain(key)) {
+    stats.runs_filtered++;
+    return false;
+  }
+  BlockID block_id =
+      std::upper_bound(this->fences.begin(), this->fences.end(), key) -
+      this->fences.begin();
+  SlottedPage *block = this->file.get(block_id);
+  stats.blocks_read++;
+  RecordIDs *record_ids = block->ids();
+  RecordID low = 1, high = record_ids->size();
+  delete record_ids;
+  bool found = false;
+  while (low <= high && !found) {
+    RecordID middle = (low + high) / 2;
+    Dbt *data = block->get(middle);
+    u64 middle_key;
+    memcpy(&middle_key, data->get_data(), sizeof(middle_key));
+    if (middle_key == key) {
+      row.assign((const char *)data->get_data() + sizeof(u64),
+                 data->get_size() - sizeof(u64));
+      found = true;
+    } else if (middle_key < key) {
+      low = middle + 1;
+    } else {
+      high = middle - 1;
+    }
+    delete data;
+  }
+  delete block;
+  return found;
+}
+
+bool LsmRun::may_contain(u64 key) const {
+  u64 bits = this->bloom.size() * 8;
+  if (bits == 0)
+    return true;
+  u64 h1 = mix_key(key), h2 = mix_key(~key) | 1;
+  for (uint i = 0; i < this->probes; i++) {
+    u64 bit = (h1 + i * h2) % bits;
+    if ((this->bloom[bit / 8] & (1 << (bit % 8))) == 0)
+      return false;
+  }
+  return true;
+}
+
+std::string LsmRun::marshal() const {
+  std::string bytes;
+  put_bytes(bytes, (u32)this->level);
+  put_bytes(bytes, this->entries);
+  put_bytes(bytes, this->bytes);
+  put_bytes(bytes, this->min_key);
+  put_bytes(bytes, this->max_key);
+  put_bytes(bytes, this->probes);
+  put_bytes(bytes, (u32)this->fences.size());
+  bytes.append((const char *)this->fences.data(),
+               this->fences.size() * sizeof(u64));
+  put_bytes(bytes, (u32)this->bloom.size());
+  bytes.append((const char *)this->bloom.data(), this->bloom.size());
+  return bytes;
+}
+
+void LsmRun::unmarshal(const std::string &bytes) {
+  size_t at = 0;
+  u32 level, count;
+  get_bytes(bytes, at, level);
+  this->level = level;
+  get_bytes(bytes, at, this->entries);
+  get_bytes(bytes, at, this->bytes);
+  get_bytes(bytes, at, this->min_key);
+  get_bytes(bytes, at, this->max_key);
+  get_bytes(bytes, at, this->probes);
+  get_bytes(bytes, at, count);
+  this->fences.resize(count);
+  for (auto &fence : this->fences)
+    get_bytes(bytes, at, fence);
+  get_bytes(bytes, at, count);
+  this->bloom.resize(count);
+  for (auto &byte : this->bloom)
+    get_bytes(bytes, at, byte);
+}
+
+// END  : LsmRun //
+
+// BEGIN: LsmTable //
+
+const uint LsmTable::L0_RUNS;
+const uint LsmTable::L0_STALL;
+const uint LsmTable::LEVEL_RATIO;
+
+LsmTable::LsmTable(Identifier table_name, ColumnNames column_names,
+                   ColumnAttributes column_attributes, TableOptions options)
+    : DbRelation(table_name, column_names, column_attributes),
+      codec(column_names, column_attributes), options(options),
+      memtable_bytes(0), next_key(1), levels(1), flushed_key(1), next_run_id(1),
+      manifest(nullptr), wal(nullptr), wal_records(0), stopping(false),
+      compacting(false) {}
+
+// Rows still in the memtable stay in the log, for the next open().
+LsmTable::~LsmTable() {
+  stop_compactor();
+  this->levels.clear();
+  if (this->manifest != nullptr) {
+    this->manifest->close(0U);
+    delete this->manifest;
+  }
+  wal_close();
+}
+
+void LsmTable::create() {
+  manifest_open(DB_CREATE | DB_EXCL);
+  wal_open();
+  this->wal->truncate(nullptr, nullptr, 0U);
+  this->wal_records = 0;
+  this->memtable.clear();
+  this->memtable_bytes = 0;
+  this->next_key = 1;
+  {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    this->levels.assign(1, {});
+    this->flushed_key = 1;
+    this->next_run_id = 1;
+    save_manifest();
+  }
+  start_compactor();
+}
+
+void LsmTable::create_if_not_exists() {
+  try {
+    this->open();
+  } catch (const DbException &) {
+    this->create();
+  }
+}
+
+void LsmTable::drop() {
+  if (this->manifest == nullptr) {
+    try {
+      open(); // to learn which run files there are
+    } catch (const DbException &) {
+      return;
+    }
+  }
+  stop_compactor();
+  for (auto const &level : this->levels)
+    for (auto const &run : level)
+      run->obsolete = true;
+  this->levels.assign(1, {});
+  this->memtable.clear();
+  this->memtable_bytes = 0;
+  this->manifest->close(0U);
+  delete this->manifest;
+  this->manifest = nullptr;
+  wal_close();
+  Db(_DB_ENV, 0).remove((this->table_name + ".lsm.db").c_str(), nullptr, 0);
+  Db(_DB_ENV, 0).remove((this->table_name + ".wal.db").c_str(), nullptr, 0);
+}
+
+void LsmTable::open() {
+  if (this->manifest != nullptr)
+    return;
+  manifest_open();
+  try {
+    {
+      std::lock_guard<std::mutex> lock(this->mutex);
+      load_manifest();
+    }
+    wal_open();
+    replay_wal();
+  } catch (...) {
+    this->levels.assign(1, {});
+    this->memtable.clear();
+    this->memtable_bytes = 0;
+    this->manifest->close(0U);
+    delete this->manifest;
+    this->manifest = nullptr;
+    wal_close();
+    throw;
+  }
+  start_compactor();
+}
+
+// The compaction under way is finished first; any still due resume on open().
+void LsmTable::close() {
+  if (this->manifest == nullptr)
+    return;
+  flush();
+  stop_compactor();
+  this->levels.assign(1, {});
+  this->manifest->close(0U);
+  delete this->manifest;
+  this->manifest = nullptr;
+  wal_close();
+  if (this->compaction_error) {
+    std::exception_ptr error = this->compaction_error;
+    this->compaction_error = nullptr;
+    std::rethrow_exception(error);
+  }
+}
+
+Handle LsmTable::insert(const ValueDict *row) {
+  for (auto const &column_name : this->column_names)
+    if (row->find(column_name) == row->end())
+      throw DbRelationError("Row missing fields");
+  u64 key = this->next_key++;
+  write(key, encode(row));
+  return handle_of(key);
+}
+
+void LsmTable::update(const Handle handle, const ValueDict *new_values) {
+  u64 key = key_of(handle);
+  std::string bytes;
+  if (!lookup(key, bytes))
+    throw DbRelationError("no such row");
+  ValueDict *row = this->codec.decode(bytes.data());
+  for (auto const &it : *new_values) {
+    auto column = row->find(it.first);
+    if (column == row->end()) {
+      delete row;
+      throw DbRelationError("unknown column " + it.first);
+    }
+    column->second = it.second;
+  }
+  try {
+    bytes = encode(row);
+  } catch (...) {
+    delete row;
+    throw;
+  }
+  delete row;
+  write(key, bytes);
+}
+
+void LsmTable::del(const Handle handle) {
+  u64 key = key_of(handle);
+  std::string bytes;
+  if (!lookup(key, bytes))
+    throw DbRelationError("no such row");
+  write(key, std::string());
+}
+
+Handles *LsmTable::select() {
+  Handles *handles = new Handles();
+  MergeCursor *cursor = scan();
+  for (; cursor->valid(); cursor->next())
+    if (cursor->size() > 0)
+      handles->push_back(handle_of(cursor->key()));
+  delete cursor;
+  return handles;
+}
+
+Handles *LsmTable::select(const ValueDict *where) {
+  std::vector<std::pair<uint, Value>> predicates;
+  for (auto const &it : *where)
+    predicates.push_back(std::make_pair(column_index(it.first), it.second));
+
+  Handles *handles = new Handles();
+  MergeCursor *cursor = scan();
+  for (; cursor->valid(); cursor->next()) {
+    if (cursor->size() == 0)
+      continue;
+    bool match = true;
+    for (size_t i = 0; match && i < predicates.size(); i++)
+      match = this->codec.field(cursor->row(), predicates[i].first) ==
+              predicates[i].second;
+    if (match)
+      handles->push_back(handle_of(cursor->key()));
+  }
+  delete cursor;
+  return handles;
+}
+
+ValueDict *LsmTable::project(Handle handle) {
+  std::string bytes;
+  if (!lookup(key_of(handle), bytes))
+    throw DbRelationError("no such row");
+  return this->codec.decode(bytes.data());
+}
+
+ValueDict *LsmTable::project(Handle handle, const ColumnNames *column_names) {
+  std::string bytes;
+  if (!lookup(key_of(handle), bytes))
+    throw DbRelationError("no such row");
+  return this->codec.decode(bytes.data(), column_names);
+}
+
+// Writing the run happens outside the lock, since only this thread adds to
+// level 0 and compaction never takes a run it hasn't been given.
+void LsmTable::flush() {
+  if (this->memtable.empty())
+    return;
+  std::shared_ptr<LsmRun> run;
+  bool keep_tombstones = false;
+  {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    run = std::make_shared<LsmRun>(this->table_name, this->next_run_id++, 0);
+    for (auto const &level : this->levels)
+      keep_tombstones |= !level.empty();
+  }
+  MemtableCursor source(this->memtable);
+  try {
+    run->write(source, keep_tombstones, this->options.bloom_fp_rate);
+  } catch (...) {
+    run->obsolete = true;
+    throw;
+  }
+
+  std::unique_lock<std::mutex> lock(this->mutex);
+  put_run(*run);
+  this->levels[0].insert(this->levels[0].begin(), run);
+  this->flushed_key = this->next_key;
+  save_manifest();
+  this->wal->truncate(nullptr, nullptr, 0U);
+  this->wal_records = 0;
+  this->memtable.clear();
+  this->memtable_bytes = 0;
+  this->wake.notify_one();
+  // don't let level 0 pile up faster than it can be compacted
+  this->idle.wait(lock, [this]() {
+    return this->compaction_error || !this->compactor.joinable() ||
+           this->levels[0].size() < L0_STALL;
+  });
+}
+
+void LsmTable::wait_for_compaction() {
+  std::unique_lock<std::mutex> lock(this->mutex);
+  std::vector<std::shared_ptr<LsmRun>> inputs;
+  uint target;
+  bool keep_tombstones;
+  this->idle.wait(lock, [&]() {
+    return this->compaction_error || !this->compactor.joinable() ||
+           (!this->compacting &&
+            !plan_compaction(inputs, target, keep_tombstones));
+  });
+  if (this->compaction_error)
+    std::rethrow_exception(this->compaction_error);
+}
+
+std::vector<size_t> LsmTable::get_level_runs() {
+  std::lock_guard<std::mutex> lock(this->mutex);
+  std::vector<size_t> runs;
+  for (auto const &level : this->levels)
+    runs.push_back(level.size());
+  return runs;
+}
+
+void LsmTable::manifest_open(uint flags) {
+  this->manifest = new Db(_DB_ENV, 0);
+  this->manifest->set_message_stream(_DB_ENV->get_message_stream());
+  this->manifest->set_error_stream(_DB_ENV->get_error_stream());
+  try {
+    this->manifest->open(nullptr, (this->table_name + ".lsm.db").c_str(),
+                         nullptr, DB_BTREE, flags, 0644);
+  } catch (const DbException &) {
+    delete this->manifest;
+    this->manifest = nullptr;
+    throw;
+  }
+}
+
+// Record 0 holds the counters and each level's run ids; every run's metadata
+// is a record of its own keyed by its id.
+void LsmTable::load_manifest() {
+  u32 root_id = 0;
+  Dbt root_key(&root_id, sizeof(root_id)), root_data;
+  if (this->manifest->get(nullptr, &root_key, &root_data, 0U) != 0)
+    throw DbRelationError("LSM manifest has no root record");
+  std::string root((const char *)root_data.get_data(), root_data.get_size());
+  size_t at = 0;
+  get_bytes(root, at, this->flushed_key);
+  this->next_key = this->flushed_key;
+  get_bytes(root, at, this->next_run_id);
+  u32 level_count;
+  get_bytes(root, at, level_count);
+  this->levels.assign(std::max<u32>(level_count, 1), {});
+  for (u32 level = 0; level < level_count; level++) {
+    u32 run_count;
+    get_bytes(root, at, run_count);
+    for (u32 i = 0; i < run_count; i++) {
+      u32 run_id;
+      get_bytes(root, at, run_id);
+      Dbt key(&run_id, sizeof(run_id)), data;
+      if (this->manifest->get(nullptr, &key, &data, 0U) != 0)
+        throw DbRelationError("LSM manifest is missing run " +
+                              std::to_string(run_id));
+      auto run = std::make_shared<LsmRun>(this->table_name, run_id, level);
+      run->unmarshal(
+          std::string((const char *)data.get_data(), data.get_size()));
+      run->open();
+      this->levels[level].push_back(run);
+    }
+  }
+}
+
+void LsmTable::save_manifest() {
+  std::string root;
+  put_bytes(root, this->flushed_key);
+  put_bytes(root, this->next_run_id);
+  put_bytes(root, (u32)this->levels.size());
+  for (auto const &level : this->levels) {
+    put_bytes(root, (u32)level.size());
+    for (auto const &run : level)
+      put_bytes(root, run->run_id);
+  }
+  u32 root_id = 0;
+  Dbt key(&root_id, sizeof(root_id));
+  Dbt data((void *)root.data(), root.size());
+  this->manifest->put(nullptr, &key, &data, 0U);
+}
+
+void LsmTable::put_run(const LsmRun &run) {
+  std::string bytes = run.marshal();
+  u32 run_id = run.run_id;
+  Dbt key(&run_id, sizeof(run_id));
+  Dbt data((void *)bytes.data(), bytes.size());
+  this->manifest->put(nullptr, &key, &data, 0U);
+}
+
+// The log is a Recno file, its records numbered from 1 in the order written.
+void LsmTable::wal_open() {
+  this->wal = new Db(_DB_ENV, 0);
+  this->wal->set_message_stream(_DB_ENV->get_message_stream());
+  this->wal->set_error_stream(_DB_ENV->get_error_stream());
+  try {
+    this->wal->open(nullptr, (this->table_name + ".wal.db").c_str(), nullptr,
+                    DB_RECNO, DB_CREATE, 0644);
+  } catch (const DbException &) {
+    delete this->wal;
+    this->wal = nullptr;
+    throw;
+  }
+  this->wal_records = 0;
+}
+
+void LsmTable::wal_close() {
+  if (this->wal != nullptr) {
+    this->wal->close(0U);
+    delete this->wal;
+    this->wal = nullptr;
+  }
+}
+
+// Each record is a key and then the row, or nothing for a tombstone. Rows
+// logged before the last flush are already in runs, so replaying them again
+// (if the log wasn't emptied) changes nothing.
+void LsmTable::replay_wal() {
+  Dbc *cursor;
+  this->wal->cursor(nullptr, &cursor, 0);
+  Dbt key, data;
+  try {
+    while (cursor->get(&key, &data, DB_NEXT) == 0) {
+      if (data.get_size() < sizeof(u64))
+        throw DbRelationError("LSM log record is cut short");
+      const char *bytes = (const char *)data.get_data();
+      u64 row_key;
+      std::memcpy(&row_key, bytes, sizeof(row_key));
+      apply(row_key, std::string(bytes + sizeof(row_key),
+                                 data.get_size() - sizeof(row_key)));
+      this->next_key = std::max(this->next_key, row_key + 1);
+      this->wal_records++;
+    }
+  } catch (...) {
+    cursor->close();
+    throw;
+  }
+  cursor->close();
+}
+
+void LsmTable::start_compactor() {
+  this->stopping = false;
+  this->compactor = std::thread(&LsmTable::compact_loop, this);
+}
+
+void LsmTable::stop_compactor() {
+  {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    this->stopping = true;
+  }
+  this->wake.notify_all();
+  if (this->compactor.joinable())
+    this->compactor.join();
+}
+
+// The compaction thread: merge the runs planned into one new run with the
+// lock released, then swap it in for them. A failed merge stops the thread
+// and is rethrown by wait_for_compaction() and close().
+void LsmTable::compact_loop() {
+  std::unique_lock<std::mutex> lock(this->mutex);
+  while (!this->stopping) {
+    std::vector<std::shared_ptr<LsmRun>> inputs;
+    uint target;
+    bool keep_tombstones;
+    if (!plan_compaction(inputs, target, keep_tombstones)) {
+      this->wake.wait(lock);
+      continue;
+    }
+    this->compacting = true;
+    auto output = std::make_shared<LsmRun>(this->table_name,
+                                           this->next_run_id++, target);
+    lock.unlock();
+    try {
+      std::vector<LsmCursor *> sources;
+      try {
+        for (auto const &input : inputs)
+          sources.push_back(new RunCursor(input));
+      } catch (...) {
+        for (LsmCursor *source : sources)
+          delete source;
+        throw;
+      }
+      MergeCursor merge(sources);
+      output->write(merge, keep_tombstones, this->options.bloom_fp_rate);
+    } catch (...) {
+      lock.lock();
+      output->obsolete = true;
+      this->compaction_error = std::current_exception();
+      this->compacting = false;
+      this->idle.notify_all();
+      return;
+    }
+    lock.lock();
+
+    // the new run goes on record before the old ones come off it
+    if (this->levels.size() <= target)
+      this->levels.resize(target + 1);
+    this->levels[target].clear();
+    if (output->entries > 0) {
+      put_run(*output);
+      this->levels[target].push_back(output);
+    } else {
+      output->obsolete = true;
+    }
+    for (auto const &input : inputs) {
+      auto &level = this->levels[input->level];
+      level.erase(std::remove(level.begin(), level.end(), input), level.end());
+    }
+    while (this->levels.size() > 1 && this->levels.back().empty())
+      this->levels.pop_back();
+    save_manifest();
+    for (auto const &input : inputs) {
+      u32 run_id = input->run_id;
+      Dbt key(&run_id, sizeof(run_id));
+      this->manifest->del(nullptr, &key, 0);
+      input->obsolete = true;
+    }
+    this->compacting = false;
+    this->idle.notify_all();
+  }
+}
+
+// Level 0 goes into level 1 once it has L0_RUNS runs; otherwise the first
+// level over its limit goes into the one below. Called with the lock held.
+bool LsmTable::plan_compaction(std::vector<std::shared_ptr<LsmRun>> &inputs,
+                               uint &target, bool &keep_tombstones) {
+  inputs.clear();
+  if (this->levels[0].size() >= L0_RUNS) {
+    target = 1;
+  } else {
+    target = 0;
+    for (uint level = 1; level < this->levels.size() && target == 0; level++) {
+      u64 bytes = 0;
+      for (auto const &run : this->levels[level])
+        bytes += run->bytes;
+      if (bytes > level_limit(level))
+        target = level + 1;
+    }
+    if (target == 0)
+      return false;
+  }
+  inputs = this->levels[target - 1];
+  if (target < this->levels.size())
+    inputs.insert(inputs.end(), this->levels[target].begin(),
+                  this->levels[target].end());
+  keep_tombstones = false;
+  for (uint level = target + 1; level < this->levels.size(); level++)
+    keep_tombstones |= !this->levels[level].empty();
+  return true;
+}
+
+u64 LsmTable::level_limit(uint level) const {
+  u64 limit = (u64)this->options.memtable_bytes * L0_RUNS;
+  for (uint i = 0; i < level; i++)
+    limit *= LEVEL_RATIO;
+  return limit;
+}
+
+// Newest first: the memtable, then the runs level by level. An empty row is
+// a tombstone, so the row was deleted.
+bool LsmTable::lookup(u64 key, std::string &row) {
+  auto it = this->memtable.find(key);
+  if (it != this->memtable.end()) {
+    row = it->second;
+    return !row.empty();
+  }
+  std::lock_guard<std::mutex> lock(this->mutex);
+  for (auto const &level : this->levels)
+    for (auto const &run : level)
+      if (run->get(key, row, this->stats))
+        return !row.empty();
+  return false;
+}
+
+MergeCursor *LsmTable::scan() {
+  std::vector<LsmCursor *> sources;
+  sources.push_back(new MemtableCursor(this->memtable));
+  std::lock_guard<std::mutex> lock(this->mutex);
+  for (auto const &level : this->levels)
+    for (auto const &run : level)
+      sources.push_back(new RunCursor(run));
+  return new MergeCursor(sources);
+}
+
+std::string LsmTable::encode(const ValueDict *row) {
+  uint size = this->codec.size(row);
+  // the row and its key have to fit in a block of a run
+  if (size > DbBlock::BLOCK_SZ - sizeof(u64) - sizeof(u16) * 4)
+    throw DbRelationError("row too big to marshal");
+  std::string bytes(size, '\0');
+  this->codec.encode(row, &bytes[0]);
+  return bytes;
+}
+
+void LsmTable::write(u64 key, const std::string &row) {
+  std::string record((const char *)&key, sizeof(key));
+  record += row;
+  db_recno_t record_number = this->wal_records + 1;
+  Dbt log_key(&record_number, sizeof(record_number));
+  Dbt log_data((void *)record.data(), record.size());
+  this->wal->put(nullptr, &log_key, &log_data, 0U);
+  this->wal_records = record_number;
+  apply(key, row);
+  if (this->memtable_bytes >= this->options.memtable_bytes)
+    flush();
+}
+
+void LsmTable::apply(u64 key, const std::string &row) {
+  auto it = this->memtable.find(key);
+  if (it == this->memtable.end()) {
+    this->memtable_bytes += sizeof(key) + row.size();
+    this->memtable.emplace(key, row);
+  } else {
+    this->memtable_bytes += row.size() - it->second.size();
+    it->second = row;
+  }
+}
+
+uint LsmTable::column_index(const Identifier &column_name) {
+  int column = this->codec.column_index(column_name);
+  if (column < 0)
+    throw DbRelationError("unknown column " + column_name);
+  return column;
+}
+
+u64 LsmTable::key_of(Handle handle) {
+  return (u64)handle.first << 16 | handle.second;
+}
+
+Handle LsmTable::handle_of(u64 key) {
+  return Handle((BlockID)(key >> 16), (RecordID)(key & 0xFFFF));
+}
+
+// END  : LsmTable //
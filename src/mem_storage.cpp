@@ -0,0 +1,298 @@
+#include "mem_storage.h"
+#include <cstring>
+
+typedef u_int16_t u16;
+typedef u_int32_t u32;
+
+// BEGIN: MemFile //
+
+const uint MemFile::CHUNK_BLOCKS;
+
+void MemFile::create(void) {
+  drop();
+  SlottedPage *first_block = get_new();
+  delete first_block;
+}
+
+void MemFile::drop(void) {
+  for (char *chunk : this->chunks)
+    delete[] chunk;
+  this->chunks.clear();
+  this->last = 0;
+}
+
+// Start a new chunk when the last one is full.
+SlottedPage *MemFile::get_new(void) {
+  if (this->last == this->chunks.size() * CHUNK_BLOCKS)
+    this->chunks.push_back(new char[CHUNK_BLOCKS * DbBlock::BLOCK_SZ]);
+  BlockID block_id = ++this->last;
+  char *block = address(block_id);
+  std::memset(block, 0, DbBlock::BLOCK_SZ);
+  Dbt data(block, DbBlock::BLOCK_SZ);
+  return new SlottedPage(data, block_id, true);
+}
+
+SlottedPage *MemFile::get(BlockID block_id) {
+  Dbt data(address(block_id), DbBlock::BLOCK_SZ);
+  return new SlottedPage(data, block_id);
+}
+
+BlockIDs *MemFile::block_ids() {
+  BlockIDs *ids = new BlockIDs();
+  ids->reserve(this->last);
+  for (u32 i = 1; i <= this->last; i++)
+    ids->emplace_back(i);
+  return ids;
+}
+
+char *MemFile::address(BlockID block_id) {
+  if (block_id == 0 || block_id > this->last)
+    throw DbRelationError("no such block");
+  BlockID i = block_id - 1;
+  return this->chunks[i / CHUNK_BLOCKS] + (i % CHUNK_BLOCKS) * DbBlock::BLOCK_SZ;
+}
+
+// END  : MemFile //
+
+// BEGIN: MemTable //
+
+MemTable::MemTable(Identifier table_name, ColumnNames column_names,
+                   ColumnAttributes column_attributes)
+    : DbRelation(table_name, column_names, column_attributes),
+      file(table_name), codec(column_names, column_attributes) {}
+
+void MemTable::create() { this->file.create(); }
+
+void MemTable::create_if_not_exists() {
+  if (this->file.get_last_block_id() == 0)
+    create();
+}
+
+void MemTable::drop() { this->file.drop(); }
+
+// There's nothing to reopen, so a table that isn't there yet opens empty.
+void MemTable::open() { create_if_not_exists(); }
+
+void MemTable::close() { this->file.close(); }
+
+Handle MemTable::insert(const ValueDict *row) {
+  for (auto const &column_name : this->column_names)
+    if (row->find(column_name) == row->end())
+      throw DbRelationError("Row missing fields");
+  char bytes[DbBlock::BLOCK_SZ];
+  u16 size = encode(row, bytes);
+  return append(bytes, size, 0);
+}
+
+// Rows that no longer fit in their block move to one with room and leave a
+// forwarding stub behind, as in HeapTable, so their handles stay good.
+void MemTable::update(const Handle handle, const ValueDict *new_values) {
+  ValueDict *row = project(handle);
+  for (auto const &it : *new_values) {
+    auto column = row->find(it.first);
+    if (column == row->end()) {
+      delete row;
+      throw DbRelationError("unknown column " + it.first);
+    }
+    column->second = it.second;
+  }
+  char bytes[DbBlock::BLOCK_SZ];
+  u16 size;
+  try {
+    size = encode(row, bytes);
+  } catch (...) {
+    delete row;
+    throw;
+  }
+  delete row;
+  Dbt data(bytes, size);
+
+  // a SlottedPage caches its block's header, so each one is made just before
+  // its block is changed and not used after another block object might have
+  // changed the same block
+  Handle moved;
+  bool forwarded;
+  {
+    Dbt home_data(this->file.address(handle.first), DbBlock::BLOCK_SZ);
+    SlottedPage home(home_data, handle.first);
+    forwarded = home.get_forward(handle.second, moved);
+    if (!forwarded) {
+      try {
+        home.put(handle.second, data);
+        return;
+      } catch (const DbBlockNoRoomError &) {
+        // move it below
+      }
+    }
+  }
+  if (forwarded) {
+    Dbt moved_data(this->file.address(moved.first), DbBlock::BLOCK_SZ);
+    SlottedPage there(moved_data, moved.first);
+    try {
+      there.put(moved.second, data);
+      return;
+    } catch (const DbBlockNoRoomError &) {
+      there.del(moved.second);
+    }
+  }
+  Handle to = append(bytes, size, SlottedPage::MOVED);
+  Dbt home_data(this->file.address(handle.first), DbBlock::BLOCK_SZ);
+  SlottedPage home(home_data, handle.first);
+  home.put_forward(handle.second, to);
+}
+
+void MemTable::del(const Handle handle) {
+  Handle moved;
+  bool forwarded;
+  {
+    Dbt home_data(this->file.address(handle.first), DbBlock::BLOCK_SZ);
+    SlottedPage home(home_data, handle.first);
+    if (home.record(handle.second) == nullptr)
+      throw DbRelationError("no such row");
+    forwarded = home.get_forward(handle.second, moved);
+  }
+  if (forwarded) {
+    Dbt moved_data(this->file.address(moved.first), DbBlock::BLOCK_SZ);
+    SlottedPage there(moved_data, moved.first);
+    there.del(moved.second);
+  }
+  Dbt home_data(this->file.address(handle.first), DbBlock::BLOCK_SZ);
+  SlottedPage home(home_data, handle.first);
+  home.del(handle.second);
+}
+
+Handles *MemTable::select() {
+  Handles *handles = new Handles();
+  for (BlockID block_id = 1; block_id <= this->file.get_last_block_id();
+       block_id++) {
+    Dbt data(this->file.address(block_id), DbBlock::BLOCK_SZ);
+    SlottedPage block(data, block_id);
+    RecordIDs *record_ids = block.ids();
+    for (auto const &record_id : *record_ids)
+      handles->push_back(Handle(block_id, record_id));
+    delete record_ids;
+  }
+  return handles;
+}
+
+// Every block is in memory, so forwarded rows are tested as they come up.
+Handles *MemTable::select(const ValueDict *where) {
+  std::vector<std::pair<uint, Value>> predicates;
+  for (auto const &it : *where)
+    predicates.push_back(std::make_pair(column_index(it.first), it.second));
+
+  Handles *handles = new Handles();
+  for (BlockID block_id = 1; block_id <= this->file.get_last_block_id();
+       block_id++) {
+    Dbt data(this->file.address(block_id), DbBlock::BLOCK_SZ);
+    SlottedPage block(data, block_id);
+    RecordIDs *record_ids = block.ids();
+    for (auto const &record_id : *record_ids) {
+      Handle handle(block_id, record_id);
+      const char *bytes = locate(handle);
+      bool match = true;
+      for (size_t i = 0; match && i < predicates.size(); i++)
+        match = this->codec.field(bytes, predicates[i].first) ==
+                predicates[i].second;
+      if (match)
+        handles->push_back(handle);
+    }
+    delete record_ids;
+  }
+  return handles;
+}
+
+ValueDict *MemTable::project(Handle handle) {
+  return this->codec.decode(locate(handle));
+}
+
+ValueDict *MemTable::project(Handle handle, const ColumnNames *column_names) {
+  return this->codec.decode(locate(handle), column_names);
+}
+
+BlockIDs *MemTable::group_ids() { return this->file.block_ids(); }
+
+void MemTable::read_batch(BlockID block_id, const ColumnNames *column_names,
+                          ColumnBatch &batch) {
+  batch.clear();
+  std::vector<uint> columns;
+  for (auto const &column_name : *column_names) {
+    uint column = column_index(column_name);
+    columns.push_back(column);
+    batch.column_names.push_back(column_name);
+    batch.columns.push_back(
+        ColumnVector(this->column_attributes[column].get_data_type()));
+  }
+  Dbt data(this->file.address(block_id), DbBlock::BLOCK_SZ);
+  SlottedPage block(data, block_id);
+  RecordIDs *record_ids = block.ids();
+  for (auto const &record_id : *record_ids) {
+    Handle handle(block_id, record_id);
+    const char *bytes = locate(handle);
+    for (size_t i = 0; i < columns.size(); i++)
+      batch.columns[i].push_back(this->codec.field(bytes, columns[i]));
+    batch.handles.push_back(handle);
+  }
+  delete record_ids;
+}
+
+// Encode a row into bytes (BLOCK_SZ long), padded so it can later be turned
+// into a forwarding stub in place.
+// @returns  the record's size
+u16 MemTable::encode(const ValueDict *row, char *bytes) {
+  uint size = this->codec.size(row);
+  if (size > DbBlock::BLOCK_SZ - 1 - sizeof(u16) * 4)
+    throw DbRelationError("row too big to marshal");
+  this->codec.encode(row, bytes);
+  if (size < SlottedPage::FORWARD_SZ) {
+    std::memset(bytes + size, 0, SlottedPage::FORWARD_SZ - size);
+    size = SlottedPage::FORWARD_SZ;
+  }
+  return size;
+}
+
+// Add a record to the last block, or to a new block if it's full.
+Handle MemTable::append(const char *bytes, u16 size, u16 flags) {
+  BlockID block_id = this->file.get_last_block_id();
+  Dbt data(this->file.address(block_id), DbBlock::BLOCK_SZ);
+  SlottedPage *block = new SlottedPage(data, block_id);
+  RecordID record_id;
+  try {
+    record_id = block->reserve(size);
+  } catch (const DbBlockNoRoomError &) {
+    delete block;
+    block = this->file.get_new();
+    record_id = block->reserve(size);
+  }
+  std::memcpy(block->record(record_id), bytes, size);
+  if (flags != 0)
+    block->set_flags(record_id, flags);
+  Handle handle(block->get_block_id(), record_id);
+  delete block;
+  return handle;
+}
+
+// The bytes of a row, following its forwarding stub if it has moved.
+const char *MemTable::locate(Handle handle) {
+  Dbt data(this->file.address(handle.first), DbBlock::BLOCK_SZ);
+  SlottedPage block(data, handle.first);
+  Handle moved;
+  if (block.get_forward(handle.second, moved)) {
+    Dbt moved_data(this->file.address(moved.first), DbBlock::BLOCK_SZ);
+    SlottedPage there(moved_data, moved.first);
+    return (const char *)there.record(moved.second);
+  }
+  const char *bytes = (const char *)block.record(handle.second);
+  if (bytes == nullptr)
+    throw DbRelationError("no such row");
+  return bytes;
+}
+
+uint MemTable::column_index(const Identifier &column_name) {
+  int column = this->codec.column_index(column_name);
+  if (column < 0)
+    throw DbRelationError("unknown column " + column_name);
+  return column;
+}
+
+// END  : MemTable //
@@ -0,0 +1,87 @@
+#include "parallel_scan.h"
+#include <exception>
+#include <stdexcept>
+#include <thread>
+
+// BEGIN: MorselQueue //
+
+MorselQueue::MorselQueue(BlockID first, BlockID last, uint morsel_blocks,
+                         uint workers)
+    : queues(workers), locks(workers), steals(0) {
+  if (workers == 0 || morsel_blocks == 0)
+    throw std::invalid_argument("need a worker and a block per morsel");
+  std::vector<Morsel> morsels;
+  for (u_int64_t start = first; start <= last; start += morsel_blocks)
+    morsels.push_back(Morsel(
+        start, std::min<u_int64_t>(start + morsel_blocks - 1, last)));
+  // contiguous shares, the first few workers taking one extra
+  size_t share = morsels.size() / workers, extra = morsels.size() % workers;
+  size_t next = 0;
+  for (uint worker = 0; worker < workers; worker++) {
+    size_t count = share + (worker < extra ? 1 : 0);
+    this->queues[worker].assign(morsels.begin() + next,
+                                morsels.begin() + next + count);
+    next += count;
+  }
+}
+
+bool MorselQueue::pop(uint worker, Morsel &morsel) {
+  {
+    std::lock_guard<std::mutex> lock(this->locks[worker]);
+    if (!this->queues[worker].empty()) {
+      morsel = this->queues[worker].front();
+      this->queues[worker].pop_front();
+      return true;
+    }
+  }
+  for (uint i = 1; i < this->queues.size(); i++) {
+    uint victim = (worker + i) % this->queues.size();
+    std::lock_guard<std::mutex> lock(this->locks[victim]);
+    if (!this->queues[victim].empty()) {
+      morsel = this->queues[victim].back();
+      this->queues[victim].pop_back();
+      this->steals++;
+      return true;
+    }
+  }
+  return false;
+}
+
+// END  : MorselQueue //
+
+// BEGIN: ParallelScan //
+
+const uint ParallelScan::MORSEL_BLOCKS;
+
+ParallelScan::ParallelScan(uint workers, uint morsel_blocks)
+    : workers(workers), morsel_blocks(morsel_blocks), steals(0) {
+  if (this->workers == 0)
+    this->workers = std::max(1U, std::thread::hardware_concurrency());
+}
+
+void ParallelScan::run(BlockID first, BlockID last, MorselTask task) {
+  this->steals = 0;
+  if (first > last)
+    return;
+  MorselQueue queue(first, last, this->morsel_blocks, this->workers);
+  std::vector<std::exception_ptr> errors(this->workers);
+  std::vector<std::thread> threads;
+  for (uint worker = 0; worker < this->workers; worker++)
+    threads.push_back(std::thread([&, worker]() {
+      try {
+        Morsel morsel;
+        while (queue.pop(worker, morsel))
+          task(worker, morsel);
+      } catch (...) {
+        errors[worker] = std::current_exception();
+      }
+    }));
+  for (auto &thread : threads)
+    thread.join();
+  this->steals = queue.get_steals();
+  for (auto const &error : errors)
+    if (error)
+      std::rethrow_exception(error);
+}
+
+// END  : ParallelScan //
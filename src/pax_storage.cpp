@@ -0,0 +1,501 @@
+#include "pax_storage.h"
+#include <algorithm>
+#include <cstring>
+
+typedef u_int16_t u16;
+typedef u_int32_t u32;
+
+// offsets of minipages are kept 8-byte aligned
+static u16 align8(uint n) { return (n + 7) & ~7U; }
+
+// BEGIN: PaxPage //
+
+PaxPage::PaxPage(Dbt &block, BlockID block_id, bool is_new)
+    : DbBlock(block, block_id, is_new) {
+  if (is_new) {
+    this->num_records = 0;
+    this->end_free = DbBlock::BLOCK_SZ - 1;
+    this->capacity = 0;
+    this->num_columns = 0;
+    put_header();
+  } else {
+    this->num_records = get_n(0);
+    this->end_free = get_n(2);
+    this->capacity = get_n(4);
+    this->num_columns = get_n(6);
+  }
+}
+
+// Size the minipages so that a page of rows whose TEXT values average
+// TEXT_GUESS bytes fills the block.
+void PaxPage::format(const ColumnAttributes &column_attributes) {
+  uint columns = column_attributes.size();
+  uint texts = 0;
+  for (ColumnAttribute ca : column_attributes)
+    if (ca.get_data_type() == ColumnAttribute::TEXT)
+      texts++;
+  uint base = align8(HEADER_SZ + columns * sizeof(u16));
+  auto needed = [&](uint rows) {
+    return base + align8((rows + 7) / 8) + columns * align8(rows * 4) +
+           rows * texts * TEXT_GUESS;
+  };
+  // kept under 1024 so positions still pack into a Bitmap
+  uint rows = (DbBlock::BLOCK_SZ - base) * 8 / (8 * (4 * columns + texts * TEXT_GUESS) + 1);
+  rows = std::min(rows, 1023U);
+  while (rows > 0 && needed(rows) > DbBlock::BLOCK_SZ)
+    rows--;
+  if (rows == 0)
+    throw DbBlockNoRoomError("too many columns for a PAX page");
+
+  this->num_records = 0;
+  this->end_free = DbBlock::BLOCK_SZ - 1;
+  this->capacity = rows;
+  this->num_columns = columns;
+  u16 offset = base;
+  memset(address(offset), 0, align8((rows + 7) / 8)); // presence bitmap
+  offset += align8((rows + 7) / 8);
+  for (uint i = 0; i < columns; i++) {
+    ColumnAttribute ca = column_attributes[i];
+    put_n(HEADER_SZ + i * sizeof(u16),
+          offset | (ca.get_data_type() == ColumnAttribute::TEXT ? TEXT_FLAG : 0));
+    offset += align8(rows * 4);
+  }
+  put_header();
+}
+
+RecordID PaxPage::add(const Dbt *data) {
+  if (!has_room(data))
+    throw DbBlockNoRoomError("not enough room for new record");
+  RecordID id = ++this->num_records;
+  uint slot = id - 1;
+  const char *bytes = (const char *)data->get_data();
+  for (uint column = 0; column < this->num_columns; column++) {
+    u16 at = minipage(column) + slot * 4;
+    if (is_text(column)) {
+      u16 size = *(const u16 *)bytes;
+      this->end_free -= size;
+      memcpy(address(this->end_free + 1), bytes + sizeof(u16), size);
+      put_n(at, this->end_free + 1);
+      put_n(at + sizeof(u16), size);
+      bytes += sizeof(u16) + size;
+    } else {
+      memcpy(address(at), bytes, sizeof(int32_t));
+      bytes += sizeof(int32_t);
+    }
+  }
+  set_present(id, true);
+  put_header();
+  return id;
+}
+
+// Reassemble the record in the RowCodec row format.
+Dbt *PaxPage::get(RecordID record_id) {
+  check(record_id);
+  uint slot = record_id - 1;
+  uint size = 0;
+  for (uint column = 0; column < this->num_columns; column++)
+    size += is_text(column)
+                ? sizeof(u16) + get_n(minipage(column) + slot * 4 + sizeof(u16))
+                : sizeof(int32_t);
+  char *bytes = new char[size];
+  char *at = bytes;
+  for (uint column = 0; column < this->num_columns; column++) {
+    u16 slot_at = minipage(column) + slot * 4;
+    if (is_text(column)) {
+      u16 loc = get_n(slot_at), text_size = get_n(slot_at + sizeof(u16));
+      memcpy(at, &text_size, sizeof(u16));
+      memcpy(at + sizeof(u16), address(loc), text_size);
+      at += sizeof(u16) + text_size;
+    } else {
+      memcpy(at, address(slot_at), sizeof(int32_t));
+      at += sizeof(int32_t);
+    }
+  }
+  return new Dbt(bytes, size);
+}
+
+// TEXT values that shrink stay where they are; ones that grow are moved to the
+// free end of the text area, compacting it first if need be.
+void PaxPage::put(RecordID record_id, const Dbt &data) {
+  check(record_id);
+  uint slot = record_id - 1;
+  const char *bytes = (const char *)data.get_data();
+  uint grown = 0;
+  const char *at = bytes;
+  for (uint column = 0; column < this->num_columns; column++) {
+    if (is_text(column)) {
+      u16 size = *(const u16 *)at;
+      if (size > get_n(minipage(column) + slot * 4 + sizeof(u16)))
+        grown += size;
+      at += sizeof(u16) + size;
+    } else {
+      at += sizeof(int32_t);
+    }
+  }
+  u16 text_start = minipage(this->num_columns - 1) + align8(this->capacity * 4);
+  if (grown > (uint)(this->end_free + 1 - text_start)) {
+    compact();
+    if (grown > (uint)(this->end_free + 1 - text_start))
+      throw DbBlockNoRoomError("not enough room for enlarged record");
+  }
+
+  for (uint column = 0; column < this->num_columns; column++) {
+    u16 slot_at = minipage(column) + slot * 4;
+    if (is_text(column)) {
+      u16 size = *(const u16 *)bytes;
+      u16 loc = get_n(slot_at);
+      if (size > get_n(slot_at + sizeof(u16))) {
+        this->end_free -= size;
+        loc = this->end_free + 1;
+      }
+      memcpy(address(loc), bytes + sizeof(u16), size);
+      put_n(slot_at, loc);
+      put_n(slot_at + sizeof(u16), size);
+      bytes += sizeof(u16) + size;
+    } else {
+      memcpy(address(slot_at), bytes, sizeof(int32_t));
+      bytes += sizeof(int32_t);
+    }
+  }
+  put_header();
+}
+
+// Deleted records keep their slot (record ids aren't reused); their text is
+// reclaimed by the next compaction.
+void PaxPage::del(RecordID record_id) {
+  check(record_id);
+  set_present(record_id, false);
+}
+
+RecordIDs *PaxPage::ids(void) {
+  RecordIDs *ids = new RecordIDs();
+  for (RecordID id = 1; id <= this->num_records; id++)
+    if (is_present(id))
+      ids->push_back(id);
+  return ids;
+}
+
+bool PaxPage::has_room(const Dbt *data) {
+  if (this->num_records >= this->capacity)
+    return false;
+  u16 text_start = minipage(this->num_columns - 1) + align8(this->capacity * 4);
+  return text_size((const char *)data->get_data()) <=
+         (uint)(this->end_free + 1 - text_start);
+}
+
+bool PaxPage::is_present(RecordID record_id) {
+  if (record_id == 0 || record_id > this->num_records)
+    return false;
+  uint slot = record_id - 1;
+  return (*(u_int8_t *)address(presence() + slot / 8) >> (slot % 8)) & 1;
+}
+
+const int32_t *PaxPage::int_column(uint column) {
+  return (const int32_t *)address(minipage(column));
+}
+
+std::string PaxPage::get_text(RecordID record_id, uint column) {
+  u16 slot_at = minipage(column) + (record_id - 1) * 4;
+  return std::string((const char *)address(get_n(slot_at)),
+                     get_n(slot_at + sizeof(u16)));
+}
+
+Value PaxPage::get_value(RecordID record_id, uint column) {
+  if (is_text(column))
+    return Value(get_text(record_id, column));
+  return Value(int_column(column)[record_id - 1]);
+}
+
+void PaxPage::put_header() {
+  put_n(0, this->num_records);
+  put_n(2, this->end_free);
+  put_n(4, this->capacity);
+  put_n(6, this->num_columns);
+}
+
+bool PaxPage::is_text(uint column) {
+  return (get_n(HEADER_SZ + column * sizeof(u16)) & TEXT_FLAG) != 0;
+}
+
+u16 PaxPage::minipage(uint column) {
+  return get_n(HEADER_SZ + column * sizeof(u16)) & ~TEXT_FLAG;
+}
+
+u16 PaxPage::presence() {
+  return align8(HEADER_SZ + this->num_columns * sizeof(u16));
+}
+
+void PaxPage::set_present(RecordID record_id, bool present) {
+  uint slot = record_id - 1;
+  u_int8_t *byte = (u_int8_t *)address(presence() + slot / 8);
+  if (present)
+    *byte |= 1 << (slot % 8);
+  else
+    *byte &= ~(1 << (slot % 8));
+}
+
+// bytes of text in an encoded row
+uint PaxPage::text_size(const char *bytes) {
+  uint size = 0;
+  for (uint column = 0; column < this->num_columns; column++) {
+    if (is_text(column)) {
+      u16 n = *(const u16 *)bytes;
+      size += n;
+      bytes += sizeof(u16) + n;
+    } else {
+      bytes += sizeof(int32_t);
+    }
+  }
+  return size;
+}
+
+// Repack the text of the records still present at the end of the block.
+void PaxPage::compact() {
+  std::vector<std::pair<u16, std::string>> texts; // (slot offset, text)
+  for (RecordID id = 1; id <= this->num_records; id++)
+    if (is_present(id))
+      for (uint column = 0; column < this->num_columns; column++)
+        if (is_text(column))
+          texts.push_back(std::make_pair(minipage(column) + (id - 1) * 4,
+                                         get_text(id, column)));
+  this->end_free = DbBlock::BLOCK_SZ - 1;
+  for (auto const &text : texts) {
+    this->end_free -= text.second.size();
+    memcpy(address(this->end_free + 1), text.second.data(), text.second.size());
+    put_n(text.first, this->end_free + 1);
+  }
+  put_header();
+}
+
+void PaxPage::check(RecordID record_id) {
+  if (!is_present(record_id))
+    throw DbRelationError("no such row");
+}
+
+// Get 2-byte integer at given offset in block.
+u16 PaxPage::get_n(u16 offset) { return *(u16 *)this->address(offset); }
+
+// Put a 2-byte integer at given offset in block.
+void PaxPage::put_n(u16 offset, u16 n) { *(u16 *)this->address(offset) = n; }
+
+// Make a void* pointer for a given offset into the data block.
+void *PaxPage::address(u16 offset) {
+  return (void *)((char *)this->block.get_data() + offset);
+}
+
+// END  : PaxPage //
+
+// BEGIN: PaxTable //
+
+PaxTable::PaxTable(Identifier table_name, ColumnNames column_names,
+                   ColumnAttributes column_attributes)
+    : DbRelation(table_name, column_names, column_attributes),
+      file(table_name), codec(column_names, column_attributes) {}
+
+void PaxTable::create() { this->file.create(); }
+
+void PaxTable::create_if_not_exists() {
+  try {
+    this->open();
+  } catch (const DbException &) {
+    this->create();
+  }
+}
+
+void PaxTable::drop() { this->file.drop(); }
+
+void PaxTable::open() { this->file.open(); }
+
+void PaxTable::close() { this->file.close(); }
+
+Handle PaxTable::insert(const ValueDict *row) {
+  for (auto const &column_name : this->column_names)
+    if (row->find(column_name) == row->end())
+      throw DbRelationError("Row missing fields");
+  uint size = this->codec.size(row);
+  if (size > DbBlock::BLOCK_SZ)
+    throw DbRelationError("row too big to marshal");
+  char bytes[DbBlock::BLOCK_SZ];
+  Dbt data(bytes, this->codec.encode(row, bytes));
+
+  PaxPage *page = get_page(this->file.get_last_block_id());
+  if (!page->has_room(&data)) {
+    delete page;
+    page = this->file.get_new();
+    page->format(this->column_attributes);
+    if (!page->has_room(&data)) {
+      delete page;
+      throw DbRelationError("row too big for a PAX page");
+    }
+  }
+  RecordID id = page->add(&data);
+  this->file.put(page);
+  Handle handle(page->get_block_id(), id);
+  delete page;
+  return handle;
+}
+
+void PaxTable::update(const Handle handle, const ValueDict *new_values) {
+  ValueDict *row = project(handle);
+  for (auto const &it : *new_values) {
+    auto column = row->find(it.first);
+    if (column == row->end()) {
+      delete row;
+      throw DbRelationError("unknown column " + it.first);
+    }
+    column->second = it.second;
+  }
+  char bytes[DbBlock::BLOCK_SZ];
+  if (this->codec.size(row) > DbBlock::BLOCK_SZ) {
+    delete row;
+    throw DbBlockNoRoomError("row too big to marshal");
+  }
+  Dbt data(bytes, this->codec.encode(row, bytes));
+  delete row;
+
+  PaxPage *page = get_page(handle.first);
+  try {
+    page->put(handle.second, data);
+  } catch (...) {
+    delete page;
+    throw;
+  }
+  this->file.put(page);
+  delete page;
+}
+
+void PaxTable::del(const Handle handle) {
+  PaxPage *page = get_page(handle.first);
+  try {
+    page->del(handle.second);
+  } catch (...) {
+    delete page;
+    throw;
+  }
+  this->file.put(page);
+  delete page;
+}
+
+Handles *PaxTable::select() {
+  Handles *handles = new Handles();
+  BlockIDs *block_ids = this->file.block_ids();
+  for (auto const &block_id : *block_ids) {
+    PaxPage *page = get_page(block_id);
+    RecordIDs *record_ids = page->ids();
+    for (auto const &record_id : *record_ids)
+      handles->push_back(Handle(block_id, record_id));
+    delete record_ids;
+    delete page;
+  }
+  delete block_ids;
+  return handles;
+}
+
+// Narrow a page's rows one predicate at a time; an INT predicate is a pass
+// down that column's minipage.
+Handles *PaxTable::select(const ValueDict *where) {
+  std::vector<std::pair<uint, Value>> predicates;
+  for (auto const &it : *where)
+    predicates.push_back(std::make_pair(column_index(it.first), it.second));
+
+  Handles *handles = new Handles();
+  BlockIDs *block_ids = this->file.block_ids();
+  std::vector<u_int8_t> matches;
+  for (auto const &block_id : *block_ids) {
+    PaxPage *page = get_page(block_id);
+    uint rows = page->size();
+    matches.assign(rows, 0);
+    for (uint r = 0; r < rows; r++)
+      matches[r] = page->is_present(r + 1);
+    for (auto const &predicate : predicates) {
+      ColumnAttribute::DataType data_type =
+          this->column_attributes[predicate.first].get_data_type();
+      if (predicate.second.data_type != data_type) {
+        matches.assign(rows, 0);
+      } else if (data_type == ColumnAttribute::INT) {
+        const int32_t *values = page->int_column(predicate.first);
+        int32_t n = predicate.second.n;
+        for (uint r = 0; r < rows; r++)
+          matches[r] &= values[r] == n;
+      } else {
+        for (uint r = 0; r < rows; r++)
+          if (matches[r])
+            matches[r] = page->get_text(r + 1, predicate.first) ==
+                         predicate.second.s;
+      }
+    }
+    for (uint r = 0; r < rows; r++)
+      if (matches[r])
+        handles->push_back(Handle(block_id, r + 1));
+    delete page;
+  }
+  delete block_ids;
+  return handles;
+}
+
+ValueDict *PaxTable::project(Handle handle) {
+  return project(handle, &this->column_names);
+}
+
+ValueDict *PaxTable::project(Handle handle, const ColumnNames *column_names) {
+  PaxPage *page = get_page(handle.first);
+  Dbt *data;
+  try {
+    data = page->get(handle.second);
+  } catch (...) {
+    delete page;
+    throw;
+  }
+  delete page;
+  ValueDict *row =
+      this->codec.decode((const char *)data->get_data(), column_names);
+  delete[] (char *)data->get_data();
+  delete data;
+  return row;
+}
+
+BlockIDs *PaxTable::group_ids() { return this->file.block_ids(); }
+
+void PaxTable::read_batch(BlockID block_id, const ColumnNames *column_names,
+                          ColumnBatch &batch) {
+  batch.clear();
+  PaxPage *page = get_page(block_id);
+  RecordIDs *record_ids = page->ids();
+  for (auto const &record_id : *record_ids)
+    batch.handles.push_back(Handle(block_id, record_id));
+  for (auto const &column_name : *column_names) {
+    uint column = column_index(column_name);
+    ColumnVector vector(this->column_attributes[column].get_data_type());
+    if (vector.data_type == ColumnAttribute::INT) {
+      const int32_t *values = page->int_column(column);
+      vector.ints.reserve(record_ids->size());
+      for (auto const &record_id : *record_ids)
+        vector.ints.push_back(values[record_id - 1]);
+    } else {
+      vector.texts.reserve(record_ids->size());
+      for (auto const &record_id : *record_ids)
+        vector.texts.push_back(page->get_text(record_id, column));
+    }
+    batch.column_names.push_back(column_name);
+    batch.columns.push_back(vector);
+  }
+  delete record_ids;
+  delete page;
+}
+
+// Blocks are blank until their first row, so format them as they're read.
+PaxPage *PaxTable::get_page(BlockID block_id) {
+  PaxPage *page = this->file.get(block_id);
+  if (!page->is_formatted())
+    page->format(this->column_attributes);
+  return page;
+}
+
+uint PaxTable::column_index(const Identifier &column_name) {
+  int column = this->codec.column_index(column_name);
+  if (column < 0)
+    throw DbRelationError("unknown column " + column_name);
+  return column;
+}
+
+// END  : PaxTable //
@@ -0,0 +1,1914 @@
+#include "query_exec.h"
+#include <algorithm>
+#include <cstring>
+#include <thread>
+#include <unistd.h>
+
+typedef u_int16_t u16;
+typedef u_int32_t u32;
+typedef u_int64_t u64;
+
+uint find_column(const PlanColumns &columns, const Identifier &table,
+                 const Identifier &name) {
+  uint found = columns.size();
+  for (uint i = 0; i < columns.size(); i++) {
+    if (columns[i].name != name ||
+        (!table.empty() && columns[i].table != table))
+      continue;
+    if (found != columns.size())
+      throw DbRelationError("ambiguous column " + name);
+    found = i;
+  }
+  if (found == columns.size())
+    throw DbRelationError("unknown column " +
+                          (table.empty() ? name : table + "." + name));
+  return found;
+}
+
+// BEGIN: PlanExpr //
+
+PlanExpr::PlanExpr(Kind kind, ColumnAttribute::DataType data_type)
+    : kind(kind), data_type(data_type), column_index(0), parameters(nullptr),
+      typed(true), left(nullptr), right(nullptr) {}
+
+PlanExpr::~PlanExpr() {
+  delete left;
+  delete right;
+}
+
+PlanExpr *PlanExpr::column(uint column, ColumnAttribute::DataType data_type) {
+  PlanExpr *expr = new PlanExpr(COLUMN, data_type);
+  expr->column_index = column;
+  return expr;
+}
+
+PlanExpr *PlanExpr::constant(const Value &value) {
+  PlanExpr *expr = new PlanExpr(CONSTANT, value.data_type);
+  expr->value = value;
+  return expr;
+}
+
+PlanExpr *PlanExpr::parameter(uint index, const Row *parameters) {
+  PlanExpr *expr = new PlanExpr(PARAMETER, ColumnAttribute::INT);
+  expr->column_index = index;
+  expr->parameters = parameters;
+  expr->typed = false;
+  return expr;
+}
+
+PlanExpr *PlanExpr::op(Kind kind, PlanExpr *left, PlanExpr *right) {
+  const ColumnAttribute::DataType INT = ColumnAttribute::INT;
+  bool unary = kind == NOT || kind == NEG;
+  bool ok = (right == nullptr) == unary && kind > PARAMETER;
+  if (ok && kind >= EQ && kind <= GE) {
+    left->infer(right->get_data_type());
+    right->infer(left->get_data_type());
+    ok = left->get_data_type() == right->get_data_type();
+  } else if (ok) {
+    left->infer(INT);
+    if (!unary)
+      right->infer(INT);
+    ok = left->get_data_type() == INT &&
+         (unary || right->get_data_type() == INT);
+  }
+  if (!ok) {
+    delete left;
+    delete right;
+    throw DbRelationError("operand types don't match the operator");
+  }
+  PlanExpr *expr = new PlanExpr(kind, INT);
+  expr->left = left;
+  expr->right = right;
+  return expr;
+}
+
+bool PlanExpr::infer(ColumnAttribute::DataType data_type) {
+  if (this->typed)
+    return false;
+  this->data_type = data_type;
+  this->typed = true;
+  return true;
+}
+
+// Arithmetic is done unsigned so that it wraps around on overflow.
+std::optional<Value> PlanExpr::eval(const Row &row) const {
+  switch (this->kind) {
+  case COLUMN:
+    return row[this->column_index];
+  case CONSTANT:
+    return this->value;
+  case PARAMETER: {
+    const std::optional<Value> &value = (*this->parameters)[this->column_index];
+    if (value && value->data_type != this->data_type)
+      throw DbRelationError("parameter " +
+                            std::to_string(this->column_index + 1) +
+                            " has the wrong type");
+    return value;
+  }
+  case AND:
+  case OR: {
+    // either side being false (AND) or true (OR) settles it, even with NULLs
+    int32_t settled = this->kind == OR;
+    std::optional<Value> l = this->left->eval(row);
+    if (l && (l->n != 0) == settled)
+      return Value(settled);
+    std::optional<Value> r = this->right->eval(row);
+    if (r && (r->n != 0) == settled)
+      return Value(settled);
+    if (!l || !r)
+      return std::nullopt;
+    return Value((int32_t)!settled);
+  }
+  case NOT:
+  case NEG: {
+    std::optional<Value> operand = this->left->eval(row);
+    if (!operand)
+      return std::nullopt;
+    if (this->kind == NOT)
+      return Value((int32_t)(operand->n == 0));
+    return Value((int32_t)(0u - (u32)operand->n));
+  }
+  default:
+    break;
+  }
+
+  std::optional<Value> l = this->left->eval(row);
+  std::optional<Value> r = this->right->eval(row);
+  if (!l || !r)
+    return std::nullopt;
+  int32_t a = l->n, b = r->n;
+  switch (this->kind) {
+  case EQ:
+    return Value((int32_t)(*l == *r));
+  case NE:
+    return Value((int32_t)(*l != *r));
+  case LT:
+    return Value((int32_t)(*l < *r));
+  case LE:
+    return Value((int32_t) !(*r < *l));
+  case GT:
+    return Value((int32_t)(*r < *l));
+  case GE:
+    return Value((int32_t) !(*l < *r));
+  case ADD:
+    return Value((int32_t)((u32)a + (u32)b));
+  case SUB:
+    return Value((int32_t)((u32)a - (u32)b));
+  case MUL:
+    return Value((int32_t)((u32)a * (u32)b));
+  case DIV:
+  case MOD:
+    if (b == 0)
+      throw DbRelationError("division by zero");
+    if (b == -1) // INT32_MIN / -1 overflows
+      return Value(this->kind == DIV ? (int32_t)(0u - (u32)a) : 0);
+    return Value(this->kind == DIV ? a / b : a % b);
+  default:
+    throw DbRelationError("unknown expression");
+  }
+}
+
+bool PlanExpr::test(const Row &row) const {
+  std::optional<Value> result = eval(row);
+  return result && result->n != 0;
+}
+
+bool PlanExpr::is_constant() const {
+  if (this->kind == COLUMN || this->kind == PARAMETER)
+    return false;
+  return (this->left == nullptr || this->left->is_constant()) &&
+         (this->right == nullptr || this->right->is_constant());
+}
+
+// END  : PlanExpr //
+
+// BEGIN: CompiledExpr //
+
+// The value of an expression that is the same for every row, if it can be
+// worked out without error (so 1 / 0 is left to fail when it is run).
+static bool fold(const PlanExpr &expr, Value &value) {
+  if (!expr.is_constant())
+    return false;
+  try {
+    std::optional<Value> result = expr.eval(Row());
+    if (!result)
+      return false;
+    value = *result;
+    return true;
+  } catch (DbRelationError &e) {
+    return false;
+  }
+}
+
+CompiledExpr::CompiledExpr(const PlanExpr &expr)
+    : parameters(nullptr), data_type(expr.get_data_type()) {
+  this->result = compile(expr);
+}
+
+uint CompiledExpr::emit(Opcode opcode, uint a, uint b, int32_t n) {
+  uint dest = this->registers.size();
+  this->registers.push_back(Register());
+  this->code.push_back(Instruction{opcode, dest, a, b, n});
+  return dest;
+}
+
+uint CompiledExpr::load(const Value &value) {
+  if (value.data_type == ColumnAttribute::INT)
+    return emit(INT_CONSTANT, 0, 0, value.n);
+  this->constants.push_back(value.s);
+  return emit(TEXT_CONSTANT, this->constants.size() - 1);
+}
+
+uint CompiledExpr::compile(const PlanExpr &expr) {
+  Value value;
+  if (fold(expr, value))
+    return load(value);
+
+  bool is_int = expr.get_data_type() == ColumnAttribute::INT;
+  PlanExpr::Kind kind = expr.get_kind();
+  const PlanExpr *left = expr.get_left(), *right = expr.get_right();
+  switch (kind) {
+  case PlanExpr::COLUMN:
+    return emit(is_int ? INT_COLUMN : TEXT_COLUMN, expr.get_column_index());
+  case PlanExpr::CONSTANT:
+    return load(expr.get_value());
+  case PlanExpr::PARAMETER:
+    this->parameters = expr.get_parameters();
+    return emit(is_int ? INT_PARAMETER : TEXT_PARAMETER,
+                expr.get_column_index());
+  case PlanExpr::EQ:
+  case PlanExpr::NE:
+  case PlanExpr::LT:
+  case PlanExpr::LE:
+  case PlanExpr::GT:
+  case PlanExpr::GE: {
+    int relation = kind - PlanExpr::EQ;
+    if (left->get_data_type() == ColumnAttribute::TEXT)
+      return emit((Opcode)(EQ_TEXT + relation), compile(*left),
+                  compile(*right));
+    // a column compared with a constant needs no registers for either
+    if (left->get_kind() == PlanExpr::COLUMN && fold(*right, value))
+      return emit((Opcode)(EQ_INT_COLUMN + relation), left->get_column_index(),
+                  0, value.n);
+    if (right->get_kind() == PlanExpr::COLUMN && fold(*left, value)) {
+      static const Opcode mirrored[] = {EQ_INT_COLUMN, NE_INT_COLUMN,
+                                        GT_INT_COLUMN, GE_INT_COLUMN,
+                                        LT_INT_COLUMN, LE_INT_COLUMN};
+      return emit(mirrored[relation], right->get_column_index(), 0, value.n);
+    }
+    return emit((Opcode)(EQ_INT + relation), compile(*left), compile(*right));
+  }
+  case PlanExpr::AND:
+  case PlanExpr::OR: {
+    // a constant side either settles it or leaves just the other side's truth
+    bool settled = kind == PlanExpr::OR;
+    for (const PlanExpr *side : {left, right}) {
+      if (!fold(*side, value))
+        continue;
+      if ((value.n != 0) == settled)
+        return load(Value((int32_t)settled));
+      return emit(TRUTH, compile(side == left ? *right : *left));
+    }
+    uint a = compile(*left);
+    uint dest = emit(settled ? SKIP_IF_TRUE : SKIP_IF_FALSE, a);
+    size_t skip = this->code.size() - 1;
+    uint b = compile(*right);
+    this->code.push_back(Instruction{settled ? OR : AND, dest, a, b, 0});
+    this->code[skip].n = this->code.size() - 1 - skip;
+    return dest;
+  }
+  case PlanExpr::NOT:
+    return emit(NOT, compile(*left));
+  case PlanExpr::NEG:
+    return emit(NEG, compile(*left));
+  default:
+    return emit((Opcode)(ADD + (kind - PlanExpr::ADD)), compile(*left),
+                compile(*right));
+  }
+}
+
+// Arithmetic is done unsigned so that it wraps around on overflow.
+void CompiledExpr::run(const Row &row) const {
+  Register *r = this->registers.data();
+  const size_t size = this->code.size();
+  for (size_t pc = 0; pc < size; pc++) {
+    const Instruction &in = this->code[pc];
+    Register &dest = r[in.dest];
+    switch (in.opcode) {
+    case INT_COLUMN:
+    case TEXT_COLUMN: {
+      const std::optional<Value> &field = row[in.a];
+      dest.null = !field;
+      if (field) {
+        dest.n = field->n;
+        dest.s = &field->s;
+      }
+      break;
+    }
+    case INT_CONSTANT:
+      dest.null = false;
+      dest.n = in.n;
+      break;
+    case TEXT_CONSTANT:
+      dest.null = false;
+      dest.s = &this->constants[in.a];
+      break;
+    case INT_PARAMETER:
+    case TEXT_PARAMETER: {
+      const std::optional<Value> &value = (*this->parameters)[in.a];
+      ColumnAttribute::DataType data_type = in.opcode == INT_PARAMETER
+                                                ? ColumnAttribute::INT
+                                                : ColumnAttribute::TEXT;
+      if (value && value->data_type != data_type)
+        throw DbRelationError("parameter " + std::to_string(in.a + 1) +
+                              " has the wrong type");
+      dest.null = !value;
+      if (value) {
+        dest.n = value->n;
+        dest.s = &value->s;
+      }
+      break;
+    }
+    case EQ_INT:
+      dest.null = r[in.a].null || r[in.b].null;
+      dest.n = r[in.a].n == r[in.b].n;
+      break;
+    case NE_INT:
+      dest.null = r[in.a].null || r[in.b].null;
+      dest.n = r[in.a].n != r[in.b].n;
+      break;
+    case LT_INT:
+      dest.null = r[in.a].null || r[in.b].null;
+      dest.n = r[in.a].n < r[in.b].n;
+      break;
+    case LE_INT:
+      dest.null = r[in.a].null || r[in.b].null;
+      dest.n = r[in.a].n <= r[in.b].n;
+      break;
+    case GT_INT:
+      dest.null = r[in.a].null || r[in.b].null;
+      dest.n = r[in.a].n > r[in.b].n;
+      break;
+    case GE_INT:
+      dest.null = r[in.a].null || r[in.b].null;
+      dest.n = r[in.a].n >= r[in.b].n;
+      break;
+    case EQ_TEXT:
+    case NE_TEXT:
+    case LT_TEXT:
+    case LE_TEXT:
+    case GT_TEXT:
+    case GE_TEXT: {
+      dest.null = r[in.a].null || r[in.b].null;
+      if (dest.null)
+        break;
+      int order = r[in.a].s->compare(*r[in.b].s);
+      switch (in.opcode) {
+      case EQ_TEXT:
+        dest.n = order == 0;
+        break;
+      case NE_TEXT:
+        dest.n = order != 0;
+        break;
+      case LT_TEXT:
+        dest.n = order < 0;
+        break;
+      case LE_TEXT:
+        dest.n = order <= 0;
+        break;
+      case GT_TEXT:
+        dest.n = order > 0;
+        break;
+      default:
+        dest.n = order >= 0;
+        break;
+      }
+      break;
+    }
+    case EQ_INT_COLUMN:
+      dest.null = !row[in.a];
+      dest.n = !dest.null && row[in.a]->n == in.n;
+      break;
+    case NE_INT_COLUMN:
+      dest.null = !row[in.a];
+      dest.n = !dest.null && row[in.a]->n != in.n;
+      break;
+    case LT_INT_COLUMN:
+      dest.null = !row[in.a];
+      dest.n = !dest.null && row[in.a]->n < in.n;
+      break;
+    case LE_INT_COLUMN:
+      dest.null = !row[in.a];
+      dest.n = !dest.null && row[in.a]->n <= in.n;
+      break;
+    case GT_INT_COLUMN:
+      dest.null = !row[in.a];
+      dest.n = !dest.null && row[in.a]->n > in.n;
+      break;
+    case GE_INT_COLUMN:
+      dest.null = !row[in.a];
+      dest.n = !dest.null && row[in.a]->n >= in.n;
+      break;
+    case ADD:
+      dest.null = r[in.a].null || r[in.b].null;
+      dest.n = (int32_t)((u32)r[in.a].n + (u32)r[in.b].n);
+      break;
+    case SUB:
+      dest.null = r[in.a].null || r[in.b].null;
+      dest.n = (int32_t)((u32)r[in.a].n - (u32)r[in.b].n);
+      break;
+    case MUL:
+      dest.null = r[in.a].null || r[in.b].null;
+      dest.n = (int32_t)((u32)r[in.a].n * (u32)r[in.b].n);
+      break;
+    case DIV:
+    case MOD: {
+      dest.null = r[in.a].null || r[in.b].null;
+      if (dest.null)
+        break;
+      int32_t a = r[in.a].n, b = r[in.b].n;
+      if (b == 0)
+        throw DbRelationError("division by zero");
+      if (b == -1) // INT32_MIN / -1 overflows
+        dest.n = in.opcode == DIV ? (int32_t)(0u - (u32)a) : 0;
+      else
+        dest.n = in.opcode == DIV ? a / b : a % b;
+      break;
+    }
+    case NOT:
+      dest.null = r[in.a].null;
+      dest.n = r[in.a].n == 0;
+      break;
+    case NEG:
+      dest.null = r[in.a].null;
+      dest.n = (int32_t)(0u - (u32)r[in.a].n);
+      break;
+    case TRUTH:
+      dest.null = r[in.a].null;
+      dest.n = r[in.a].n != 0;
+      break;
+    case SKIP_IF_FALSE:
+    case SKIP_IF_TRUE:
+      if (!r[in.a].null && (r[in.a].n != 0) == (in.opcode == SKIP_IF_TRUE)) {
+        dest.null = false;
+        dest.n = in.opcode == SKIP_IF_TRUE;
+        pc += in.n;
+      }
+      break;
+    case AND:
+    case OR: {
+      // the left side didn't settle it, so only the right side can
+      bool settled = in.opcode == OR;
+      if (!r[in.b].null && (r[in.b].n != 0) == settled) {
+        dest.null = false;
+        dest.n = settled;
+      } else {
+        dest.null = r[in.a].null || r[in.b].null;
+        dest.n = !settled;
+      }
+      break;
+    }
+    }
+  }
+}
+
+std::optional<Value> CompiledExpr::eval(const Row &row) const {
+  run(row);
+  const Register &result = this->registers[this->result];
+  if (result.null)
+    return std::nullopt;
+  if (this->data_type == ColumnAttribute::INT)
+    return Value(result.n);
+  return Value(*result.s);
+}
+
+bool CompiledExpr::test(const Row &row) const {
+  run(row);
+  const Register &result = this->registers[this->result];
+  return !result.null && result.n != 0;
+}
+
+// END  : CompiledExpr //
+
+// BEGIN: SpillFile //
+
+std::atomic<u_int32_t> SpillFile::created(0);
+
+// tags of the fields of a spilled row
+static const char NULL_FIELD = 0, INT_FIELD = 1, TEXT_FIELD = 2;
+
+std::string SpillFile::next_name() {
+  return "_spill_" + std::to_string(getpid()) + "_" +
+         std::to_string(++created);
+}
+
+SpillFile::SpillFile()
+    : file(next_name()), block(nullptr), record_ids(nullptr), next_record(0),
+      writing(true), rows(0), bytes(0) {
+  this->file.create();
+  this->block = this->file.get(this->file.get_last_block_id());
+}
+
+SpillFile::~SpillFile() {
+  delete this->block;
+  delete this->record_ids;
+  this->file.drop();
+}
+
+// Rows are encoded straight into their slots, as HeapTable::append() does.
+void SpillFile::append(const Row &row) {
+  if (!this->writing)
+    throw DbRelationError("can't append to a spill file being read");
+  size_t size = row.size(); // the tags
+  for (auto const &field : row) {
+    if (field && field->data_type == ColumnAttribute::INT)
+      size += sizeof(int32_t);
+    else if (field)
+      size += sizeof(u16) + field->s.size();
+  }
+  RecordID id = 0;
+  bool placed = false;
+  if (size < DbBlock::BLOCK_SZ) {
+    try {
+      id = this->block->reserve(size);
+      placed = true;
+    } catch (const DbBlockNoRoomError &) {
+      this->file.put(this->block);
+      delete this->block;
+      this->block = nullptr;
+      this->block = this->file.get_new();
+      try {
+        id = this->block->reserve(size);
+        placed = true;
+      } catch (const DbBlockNoRoomError &) {
+      }
+    }
+  }
+  if (!placed)
+    throw DbRelationError("row too big to spill to disk");
+
+  char *bytes = (char *)this->block->record(id);
+  for (auto const &field : row) {
+    if (!field) {
+      *bytes++ = NULL_FIELD;
+    } else if (field->data_type == ColumnAttribute::INT) {
+      *bytes++ = INT_FIELD;
+      memcpy(bytes, &field->n, sizeof(int32_t));
+      bytes += sizeof(int32_t);
+    } else {
+      *bytes++ = TEXT_FIELD;
+      u16 length = field->s.size();
+      memcpy(bytes, &length, sizeof(u16));
+      memcpy(bytes + sizeof(u16), field->s.data(), length);
+      bytes += sizeof(u16) + length;
+    }
+  }
+  this->rows++;
+  this->bytes += size;
+}
+
+void SpillFile::rewind() {
+  if (this->writing)
+    this->file.put(this->block);
+  this->writing = false;
+  delete this->block;
+  this->block = nullptr;
+  delete this->record_ids;
+  this->record_ids = nullptr;
+  this->next_record = 0;
+}
+
+bool SpillFile::next(Row &row) {
+  if (this->writing)
+    throw DbRelationError("spill file must be rewound to be read");
+  while (this->block == nullptr ||
+         this->next_record == this->record_ids->size()) {
+    BlockID block_id =
+        this->block == nullptr ? 1 : this->block->get_block_id() + 1;
+    if (block_id > this->file.get_last_block_id())
+      return false;
+    delete this->block;
+    delete this->record_ids;
+    this->record_ids = nullptr;
+    this->block = nullptr;
+    this->block = this->file.get(block_id);
+    this->record_ids = this->block->ids();
+    this->next_record = 0;
+  }
+  Dbt *data = this->block->get((*this->record_ids)[this->next_record++]);
+  const char *bytes = (const char *)data->get_data();
+  const char *end = bytes + data->get_size();
+  row.clear();
+  while (bytes < end) {
+    char tag = *bytes++;
+    if (tag == NULL_FIELD) {
+      row.push_back(std::nullopt);
+    } else if (tag == INT_FIELD) {
+      int32_t n;
+      memcpy(&n, bytes, sizeof(int32_t));
+      bytes += sizeof(int32_t);
+      row.push_back(Value(n));
+    } else {
+      u16 length;
+      memcpy(&length, bytes, sizeof(u16));
+      row.push_back(Value(std::string(bytes + sizeof(u16), length)));
+      bytes += sizeof(u16) + length;
+    }
+  }
+  delete data;
+  return true;
+}
+
+// END  : SpillFile //
+
+// BEGIN: SortKey //
+
+void normalize_key(const Row &row, const SortKeys &keys, std::string &key) {
+  key.clear();
+  for (const SortKey &sort_key : keys) {
+    size_t start = key.size();
+    const std::optional<Value> &field = row[sort_key.column];
+    if (!field) {
+      key.push_back('\0');
+    } else if (field->data_type == ColumnAttribute::INT) {
+      key.push_back('\1');
+      u32 n = (u32)field->n ^ 0x80000000u;
+      for (int shift = 24; shift >= 0; shift -= 8)
+        key.push_back((char)(n >> shift));
+    } else {
+      key.push_back('\1');
+      for (char c : field->s) {
+        key.push_back(c);
+        if (c == '\0')
+          key.push_back('\xff');
+      }
+      key.append(2, '\0');
+    }
+    if (sort_key.descending)
+      for (size_t i = start; i < key.size(); i++)
+        key[i] = ~key[i];
+  }
+}
+
+int compare_keys(const std::string &a, const std::string &b) {
+  int order = memcmp(a.data(), b.data(), std::min(a.size(), b.size()));
+  if (order != 0)
+    return order;
+  return a.size() < b.size() ? -1 : a.size() > b.size();
+}
+
+// END  : SortKey //
+
+// BEGIN: DynamicFilter //
+
+void DynamicFilter::set_bound(const std::optional<Value> &value) {
+  Row row(this->keys[0].column + 1);
+  row[this->keys[0].column] = value;
+  normalize_key(row, this->keys, this->bound_key);
+  this->bound = value;
+  this->bounded = true;
+}
+
+bool DynamicFilter::passes(const Row &row) const {
+  if (!this->bounded)
+    return true;
+  normalize_key(row, this->keys, this->row_key);
+  return compare_keys(this->row_key, this->bound_key) <= 0;
+}
+
+// END  : DynamicFilter //
+
+// BEGIN: TableScan //
+
+TableScan::TableScan(DbRelation *relation, const Identifier &alias,
+                     const ValueDict *where)
+    : TableScan(relation, alias, ExprDict()) {
+  if (where != nullptr)
+    for (auto const &it : *where)
+      this->where[it.first] = PlanExpr::constant(it.second);
+}
+
+TableScan::TableScan(DbRelation *relation, const Identifier &alias,
+                     const ExprDict &where)
+    : relation(relation), where(where), handles(nullptr), next_handle(0),
+      filter(nullptr), descending(false), block_ids(nullptr), next_block(0),
+      blocks_skipped(0) {
+  const ColumnNames &column_names = relation->get_column_names();
+  ColumnAttributes column_attributes = relation->get_column_attributes();
+  for (size_t i = 0; i < column_names.size(); i++)
+    this->columns.push_back(PlanColumn(alias, column_names[i],
+                                       column_attributes[i].get_data_type()));
+}
+
+TableScan::~TableScan() {
+  delete this->handles;
+  delete this->block_ids;
+  for (auto const &it : this->where)
+    delete it.second;
+}
+
+void TableScan::open() {
+  close();
+  this->blocks_skipped = 0;
+  ValueDict where;
+  bool matchable = true;
+  for (auto const &it : this->where) {
+    std::optional<Value> value = it.second->eval(Row());
+    if (value)
+      where[it.first] = *value;
+    else
+      matchable = false;
+  }
+  HeapTable *heap = dynamic_cast<HeapTable *>(this->relation);
+  if (!this->order_by.empty() && heap == nullptr)
+    throw DbRelationError("only HEAP tables can be scanned in order");
+  if (!matchable) {
+    this->handles = new Handles();
+  } else if (!this->order_by.empty()) {
+    RangeDict ranges;
+    for (auto const &it : where)
+      ranges[it.first] = ValueRange(it.second, it.second);
+    this->handles = heap->select_ordered(this->order_by, &ranges);
+    if (this->descending)
+      std::reverse(this->handles->begin(), this->handles->end());
+  } else if (where.empty() && this->filter != nullptr && heap != nullptr) {
+    this->handles = new Handles();
+    this->block_ids = heap->group_ids();
+    this->next_block = 0;
+  } else if (where.empty()) {
+    this->handles = this->relation->select();
+  } else {
+    this->handles = this->relation->select(&where);
+  }
+  this->next_handle = 0;
+}
+
+bool TableScan::next(Row &row) {
+  if (this->handles == nullptr)
+    return false;
+  while (true) {
+    if (this->next_handle == this->handles->size() && !next_block_handles())
+      return false;
+    ValueDict *values =
+        this->relation->project((*this->handles)[this->next_handle++]);
+    row.resize(this->columns.size());
+    for (size_t i = 0; i < this->columns.size(); i++)
+      row[i] = (*values)[this->columns[i].name];
+    delete values;
+    if (this->filter == nullptr || this->filter->passes(row))
+      return true;
+  }
+}
+
+void TableScan::close() {
+  delete this->handles;
+  this->handles = nullptr;
+  delete this->block_ids;
+  this->block_ids = nullptr;
+}
+
+// A table's fields are never NULL, so a NULL bound lets all of them through
+// when descending (NULLs last) and none when ascending.
+bool TableScan::next_block_handles() {
+  if (this->block_ids == nullptr)
+    return false;
+  HeapTable *heap = static_cast<HeapTable *>(this->relation);
+  const SortKey &key = this->filter->get_key();
+  const PlanColumn &column = this->columns[key.column];
+  this->handles->clear();
+  this->next_handle = 0;
+  while (this->next_block < this->block_ids->size()) {
+    RangeDict where;
+    if (this->filter->is_bounded()) {
+      const std::optional<Value> &bound = this->filter->get_bound();
+      if (!bound && !key.descending) {
+        this->blocks_skipped += this->block_ids->size() - this->next_block;
+        this->next_block = this->block_ids->size();
+        return false;
+      }
+      if (bound && column.data_type == ColumnAttribute::INT)
+        where[column.name] = key.descending
+                                 ? ValueRange(bound, std::nullopt)
+                                 : ValueRange(std::nullopt, bound);
+    }
+    BlockID block_id = (*this->block_ids)[this->next_block++];
+    if (!heap->select_range(block_id, &where, *this->handles))
+      this->blocks_skipped++;
+    else if (!this->handles->empty())
+      return true;
+  }
+  return false;
+}
+
+// END  : TableScan //
+
+// BEGIN: Filter //
+
+Filter::Filter(PlanOperator *input, PlanExpr *predicate)
+    : input(input), predicate(new CompiledExpr(*predicate)) {
+  this->columns = input->get_columns();
+  delete predicate;
+}
+
+Filter::~Filter() {
+  delete this->input;
+  delete this->predicate;
+}
+
+bool Filter::next(Row &row) {
+  while (this->input->next(row))
+    if (this->predicate->test(row))
+      return true;
+  return false;
+}
+
+// END  : Filter //
+
+// BEGIN: Project //
+
+Project::Project(PlanOperator *input, const PlanExprs &expressions,
+                 const PlanColumns &columns)
+    : input(input) {
+  this->columns = columns;
+  for (size_t i = 0; i < columns.size(); i++)
+    this->columns[i].data_type = expressions[i]->get_data_type();
+  for (PlanExpr *expr : expressions) {
+    this->expressions.push_back(new CompiledExpr(*expr));
+    delete expr;
+  }
+}
+
+Project::~Project() {
+  delete this->input;
+  for (CompiledExpr *expr : this->expressions)
+    delete expr;
+}
+
+bool Project::next(Row &row) {
+  if (!this->input->next(this->input_row))
+    return false;
+  row.resize(this->expressions.size());
+  for (size_t i = 0; i < this->expressions.size(); i++)
+    row[i] = this->expressions[i]->eval(this->input_row);
+  return true;
+}
+
+// END  : Project //
+
+// BEGIN: NestedLoopJoin //
+
+NestedLoopJoin::NestedLoopJoin(PlanOperator *left, PlanOperator *right,
+                               PlanExpr *condition, bool left_outer)
+    : left(left), right(right), condition(nullptr), left_outer(left_outer),
+      have_left(false), left_matched(false), next_right(0) {
+  if (condition != nullptr) {
+    this->condition = new CompiledExpr(*condition);
+    delete condition;
+  }
+  this->columns = left->get_columns();
+  const PlanColumns &right_columns = right->get_columns();
+  this->columns.insert(this->columns.end(), right_columns.begin(),
+                       right_columns.end());
+}
+
+NestedLoopJoin::~NestedLoopJoin() {
+  delete this->left;
+  delete this->right;
+  delete this->condition;
+}
+
+void NestedLoopJoin::open() {
+  this->right_rows.clear();
+  this->right->open();
+  Row row;
+  while (this->right->next(row))
+    this->right_rows.push_back(row);
+  this->right->close();
+  this->left->open();
+  this->have_left = false;
+}
+
+bool NestedLoopJoin::next(Row &row) {
+  while (true) {
+    if (!this->have_left) {
+      if (!this->left->next(this->left_row))
+        return false;
+      this->have_left = true;
+      this->left_matched = false;
+      this->next_right = 0;
+    }
+    while (this->next_right < this->right_rows.size()) {
+      const Row &right_row = this->right_rows[this->next_right++];
+      row = this->left_row;
+      row.insert(row.end(), right_row.begin(), right_row.end());
+      if (this->condition == nullptr || this->condition->test(row)) {
+        this->left_matched = true;
+        return true;
+      }
+    }
+    this->have_left = false;
+    if (this->left_outer && !this->left_matched) {
+      row = this->left_row;
+      row.resize(this->columns.size());
+      return true;
+    }
+  }
+}
+
+void NestedLoopJoin::close() {
+  this->left->close();
+  std::vector<Row>().swap(this->right_rows);
+  this->have_left = false;
+}
+
+// END  : NestedLoopJoin //
+
+// BEGIN: HashJoin //
+
+const size_t HashJoin::MEMORY_BUDGET;
+const uint HashJoin::PARTITIONS;
+const uint HashJoin::MAX_DEPTH;
+const u_int32_t HashJoin::NO_ROW;
+
+// FNV-1a over the key's values, then a final mix so every bit depends on all
+// of them: the table uses the low 32 bits and partitioning the ones above.
+// @returns  false if any of the key is NULL (so it matches nothing)
+static bool hash_key(const Row &row, const std::vector<uint> &keys,
+                     u64 &hash) {
+  u64 h = 14695981039346656037ULL;
+  auto mix = [&h](const void *bytes, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+      h ^= ((const u_int8_t *)bytes)[i];
+      h *= 1099511628211ULL;
+    }
+  };
+  for (uint key : keys) {
+    const std::optional<Value> &field = row[key];
+    if (!field)
+      return false;
+    if (field->data_type == ColumnAttribute::INT)
+      mix(&field->n, sizeof(field->n));
+    else
+      mix(field->s.data(), field->s.size());
+  }
+  h ^= h >> 33;
+  h *= 0xff51afd7ed558ccdULL;
+  h ^= h >> 33;
+  h *= 0xc4ceb9fe1a85ec53ULL;
+  h ^= h >> 33;
+  hash = h;
+  return true;
+}
+
+// Each level of partitioning takes the next few bits above the table's.
+static uint partition_of(u64 hash, uint depth) {
+  return (hash >> (32 + 4 * depth)) % HashJoin::PARTITIONS;
+}
+
+static bool same_key(const Row &a, const std::vector<uint> &a_keys,
+                     const Row &b, const std::vector<uint> &b_keys) {
+  for (size_t i = 0; i < a_keys.size(); i++)
+    if (*a[a_keys[i]] != *b[b_keys[i]])
+      return false;
+  return true;
+}
+
+// What a row takes in memory, near enough.
+static size_t row_bytes(const Row &row) {
+  size_t bytes = sizeof(Row) + row.size() * sizeof(std::optional<Value>);
+  for (auto const &field : row)
+    if (field)
+      bytes += field->s.size();
+  return bytes;
+}
+
+bool HashJoin::RowSource::next(Row &row) {
+  if (this->next_row < this->rows.size()) {
+    row = std::move(this->rows[this->next_row++]);
+    return true;
+  }
+  if (this->input != nullptr)
+    return this->input->next(row);
+  if (this->file != nullptr)
+    return this->file->next(row);
+  return false;
+}
+
+void HashJoin::RowSource::clear() {
+  std::vector<Row>().swap(this->rows);
+  this->next_row = 0;
+  this->input = nullptr;
+  delete this->file;
+  this->file = nullptr;
+}
+
+HashJoin::HashJoin(PlanOperator *left, PlanOperator *right,
+                   const std::vector<uint> &left_keys,
+                   const std::vector<uint> &right_keys, PlanExpr *residual,
+                   bool left_outer, size_t budget)
+    : left(left), right(right), left_keys(left_keys), right_keys(right_keys),
+      residual(nullptr), left_outer(left_outer), budget(budget), spilled(0),
+      build_left(false), have_probe(false), probe_matched(false),
+      match(NO_ROW), next_unmatched(0) {
+  if (residual != nullptr) {
+    this->residual = new CompiledExpr(*residual);
+    delete residual;
+  }
+  this->columns = left->get_columns();
+  const PlanColumns &right_columns = right->get_columns();
+  this->columns.insert(this->columns.end(), right_columns.begin(),
+                       right_columns.end());
+}
+
+HashJoin::~HashJoin() {
+  clear();
+  delete this->left;
+  delete this->right;
+  delete this->residual;
+}
+
+// Read from whichever side has the fewer bytes read so far, so the side
+// that runs out first is the smaller one.
+void HashJoin::open() {
+  clear();
+  this->spilled = 0;
+  this->left->open();
+  this->right->open();
+  std::vector<Row> rows[2]; // left, right
+  size_t bytes[2] = {0, 0};
+  PlanOperator *inputs[2] = {this->left, this->right};
+  Row row;
+  while (true) {
+    int side = bytes[0] <= bytes[1] ? 0 : 1;
+    if (!inputs[side]->next(row)) {
+      this->build_left = side == 0;
+      break;
+    }
+    bytes[side] += row_bytes(row);
+    rows[side].push_back(std::move(row));
+    if (bytes[0] > this->budget && bytes[1] > this->budget) {
+      RowSource left_rows, right_rows;
+      left_rows.rows.swap(rows[0]);
+      left_rows.input = this->left;
+      right_rows.rows.swap(rows[1]);
+      right_rows.input = this->right;
+      partition(left_rows, right_rows, 0);
+      this->left->close();
+      this->right->close();
+      return;
+    }
+  }
+
+  int build_side = this->build_left ? 0 : 1;
+  inputs[build_side]->close();
+  build(rows[build_side]);
+  this->probe.rows.swap(rows[1 - build_side]);
+  this->probe.input = inputs[1 - build_side];
+}
+
+bool HashJoin::next(Row &row) {
+  while (true) {
+    if (this->have_probe) {
+      while (this->match != NO_ROW) {
+        u32 i = this->match;
+        this->match = this->build_next[i];
+        join_rows(this->build_rows[i], row);
+        if (this->residual != nullptr && !this->residual->test(row))
+          continue;
+        this->probe_matched = true;
+        if (!this->build_matched.empty())
+          this->build_matched[i] = true;
+        return true;
+      }
+      this->have_probe = false;
+      if (this->left_outer && !this->build_left && !this->probe_matched) {
+        row = this->probe_row;
+        row.resize(this->columns.size());
+        return true;
+      }
+    }
+
+    if (this->probe.next(this->probe_row)) {
+      this->have_probe = true;
+      this->probe_matched = false;
+      this->match = lookup(this->probe_row, this->build_left
+                                                ? this->right_keys
+                                                : this->left_keys);
+      continue;
+    }
+
+    // a LEFT join built on the left side has its unmatched rows still to come
+    while (this->next_unmatched < this->build_matched.size()) {
+      size_t i = this->next_unmatched++;
+      if (!this->build_matched[i]) {
+        row = this->build_rows[i];
+        row.resize(this->columns.size());
+        return true;
+      }
+    }
+    if (!next_partition())
+      return false;
+  }
+}
+
+void HashJoin::close() {
+  this->left->close();
+  this->right->close();
+  clear();
+}
+
+void HashJoin::clear() {
+  for (auto const &pair : this->partitions) {
+    delete pair.left;
+    delete pair.right;
+  }
+  this->partitions.clear();
+  std::vector<Row>().swap(this->build_rows);
+  std::vector<u32>().swap(this->build_next);
+  std::vector<bool>().swap(this->build_matched);
+  std::vector<Slot>().swap(this->slots);
+  this->probe.clear();
+  this->have_probe = false;
+  this->match = NO_ROW;
+  this->next_unmatched = 0;
+}
+
+// Rows are chained from the last to the first, so each key's come out in the
+// order they were read.
+void HashJoin::build(std::vector<Row> &rows) {
+  this->build_rows.clear();
+  this->build_rows.swap(rows);
+  const std::vector<uint> &keys =
+      this->build_left ? this->left_keys : this->right_keys;
+  u32 n = this->build_rows.size();
+  size_t capacity = 16;
+  while (capacity < 2 * (size_t)n)
+    capacity *= 2;
+  this->slots.assign(capacity, Slot{0, NO_ROW});
+  this->build_next.assign(n, NO_ROW);
+  this->build_matched.assign(this->left_outer && this->build_left ? n : 0,
+                             false);
+  this->next_unmatched = 0;
+  size_t mask = capacity - 1;
+  for (u32 i = n; i-- > 0;) {
+    u64 hash;
+    if (!hash_key(this->build_rows[i], keys, hash))
+      continue;
+    for (size_t s = hash & mask;; s = (s + 1) & mask) {
+      Slot &slot = this->slots[s];
+      if (slot.head == NO_ROW) {
+        slot.hash = (u32)hash;
+        slot.head = i;
+        break;
+      }
+      if (slot.hash == (u32)hash &&
+          same_key(this->build_rows[slot.head], keys, this->build_rows[i],
+                   keys)) {
+        this->build_next[i] = slot.head;
+        slot.head = i;
+        break;
+      }
+    }
+  }
+}
+
+u32 HashJoin::lookup(const Row &row, const std::vector<uint> &keys) const {
+  u64 hash;
+  if (!hash_key(row, keys, hash))
+    return NO_ROW;
+  const std::vector<uint> &build_keys =
+      this->build_left ? this->left_keys : this->right_keys;
+  size_t mask = this->slots.size() - 1;
+  for (size_t s = hash & mask;; s = (s + 1) & mask) {
+    const Slot &slot = this->slots[s];
+    if (slot.head == NO_ROW)
+      return NO_ROW;
+    if (slot.hash == (u32)hash &&
+        same_key(row, keys, this->build_rows[slot.head], build_keys))
+      return slot.head;
+  }
+}
+
+// Left rows with a NULL key go to the first partition, to come out of a LEFT
+// join unmatched; right ones can never come out, so they are dropped.
+void HashJoin::partition(RowSource &left_rows, RowSource &right_rows,
+                         uint depth) {
+  size_t first = this->partitions.size();
+  for (uint i = 0; i < PARTITIONS; i++) {
+    this->partitions.push_back(Partition{nullptr, nullptr, depth + 1});
+    this->partitions.back().left = new SpillFile();
+    this->partitions.back().right = new SpillFile();
+  }
+  Row row;
+  u64 hash;
+  while (left_rows.next(row)) {
+    uint i = hash_key(row, this->left_keys, hash) ? partition_of(hash, depth)
+                                                  : 0;
+    this->partitions[first + i].left->append(row);
+  }
+  while (right_rows.next(row))
+    if (hash_key(row, this->right_keys, hash))
+      this->partitions[first + partition_of(hash, depth)].right->append(row);
+
+  // keep only the pairs that can give rows
+  size_t kept = first;
+  for (size_t i = first; i < this->partitions.size(); i++) {
+    Partition &pair = this->partitions[i];
+    if (pair.left->size() > 0 &&
+        (this->left_outer || pair.right->size() > 0)) {
+      pair.left->rewind();
+      pair.right->rewind();
+      this->partitions[kept++] = pair;
+    } else {
+      delete pair.left;
+      delete pair.right;
+    }
+  }
+  this->partitions.resize(kept);
+  this->spilled += kept - first;
+}
+
+bool HashJoin::next_partition() {
+  this->probe.clear();
+  while (!this->partitions.empty()) {
+    Partition pair = this->partitions.back();
+    this->partitions.pop_back();
+    RowSource left_rows, right_rows; // deleting the files when done
+    left_rows.file = pair.left;
+    right_rows.file = pair.right;
+    bool build_left = pair.left->get_bytes() <= pair.right->get_bytes();
+    size_t build_bytes = build_left ? pair.left->get_bytes()
+                                    : pair.right->get_bytes();
+    if (build_bytes > this->budget && pair.depth < MAX_DEPTH) {
+      partition(left_rows, right_rows, pair.depth);
+      continue;
+    }
+
+    this->build_left = build_left;
+    RowSource &build_rows = build_left ? left_rows : right_rows;
+    RowSource &probe_rows = build_left ? right_rows : left_rows;
+    std::vector<Row> rows;
+    Row row;
+    while (build_rows.next(row))
+      rows.push_back(std::move(row));
+    build(rows);
+    this->probe.file = probe_rows.file;
+    probe_rows.file = nullptr;
+    return true;
+  }
+  return false;
+}
+
+void HashJoin::join_rows(const Row &build, Row &row) const {
+  const Row &left_row = this->build_left ? build : this->probe_row;
+  const Row &right_row = this->build_left ? this->probe_row : build;
+  row = left_row;
+  row.insert(row.end(), right_row.begin(), right_row.end());
+}
+
+// END  : HashJoin //
+
+// BEGIN: Sort //
+
+const size_t Sort::MEMORY_BUDGET;
+const size_t Sort::MIN_SLICE_ROWS;
+
+Sort::Sort(PlanOperator *input, const SortKeys &keys, size_t budget,
+           uint threads)
+    : input(input), keys(keys), budget(budget), threads(threads), spilled(0) {
+  if (this->threads == 0)
+    this->threads = std::max(1U, std::thread::hardware_concurrency());
+  this->columns = input->get_columns();
+}
+
+Sort::~Sort() {
+  clear();
+  delete this->input;
+}
+
+void Sort::open() {
+  clear();
+  this->spilled = 0;
+  this->input->open();
+  Row row;
+  size_t bytes = 0;
+  while (this->input->next(row)) {
+    Keyed keyed;
+    normalize_key(row, this->keys, keyed.key);
+    keyed.row = this->rows.size();
+    bytes += row_bytes(row) + sizeof(Keyed) + keyed.key.size();
+    this->keyed.push_back(std::move(keyed));
+    this->rows.push_back(std::move(row));
+    if (bytes > this->budget) {
+      sort_runs(true);
+      bytes = 0;
+    }
+  }
+  this->input->close();
+  sort_runs(false);
+
+  for (u32 run = 0; run < this->runs.size(); run++)
+    if (this->runs[run]->file != nullptr)
+      advance(run);
+  this->tree.assign(this->runs.size(), 0);
+  if (this->runs.size() > 1)
+    this->tree[0] = play(1);
+}
+
+bool Sort::next(Row &row) {
+  if (this->runs.empty())
+    return false;
+  u32 winner = this->tree[0];
+  if (current(winner) == nullptr)
+    return false; // the winner is done, so they all are
+  Run *run = this->runs[winner];
+  if (run->file == nullptr)
+    row = std::move(this->rows[this->keyed[run->next].row]);
+  else
+    row = std::move(run->row);
+  advance(winner);
+
+  // the winner's next row plays its way back up from its leaf
+  u32 leaves = this->runs.size();
+  for (u32 node = (winner + leaves) / 2; node > 0; node /= 2)
+    if (beats(this->tree[node], winner))
+      std::swap(this->tree[node], winner);
+  this->tree[0] = winner;
+  return true;
+}
+
+void Sort::close() {
+  this->input->close();
+  clear();
+}
+
+void Sort::clear() {
+  for (Run *run : this->runs)
+    delete run;
+  this->runs.clear();
+  std::vector<Row>().swap(this->rows);
+  std::vector<Keyed>().swap(this->keyed);
+  this->tree.clear();
+}
+
+// Rows with equal keys keep their order: each slice is sorted stably, and
+// ties between runs go to the earlier run.
+void Sort::sort_runs(bool spill) {
+  size_t n = this->keyed.size();
+  if (n == 0)
+    return;
+  size_t slices = std::max((size_t)1,
+                           std::min((size_t)this->threads, n / MIN_SLICE_ROWS));
+  auto by_key = [](const Keyed &a, const Keyed &b) {
+    return compare_keys(a.key, b.key) < 0;
+  };
+  auto slice = [&](size_t i) {
+    return this->keyed.begin() + n * i / slices;
+  };
+  if (slices == 1) {
+    std::stable_sort(this->keyed.begin(), this->keyed.end(), by_key);
+  } else {
+    std::vector<std::exception_ptr> errors(slices);
+    std::vector<std::thread> workers;
+    for (size_t i = 0; i < slices; i++)
+      workers.push_back(std::thread([&, i]() {
+        try {
+          std::stable_sort(slice(i), slice(i + 1), by_key);
+        } catch (...) {
+          errors[i] = std::current_exception();
+        }
+      }));
+    for (auto &worker : workers)
+      worker.join();
+    for (auto const &error : errors)
+      if (error)
+        std::rethrow_exception(error);
+  }
+
+  for (size_t i = 0; i < slices; i++) {
+    Run *run = new Run();
+    this->runs.push_back(run);
+    run->next = slice(i) - this->keyed.begin();
+    run->end = slice(i + 1) - this->keyed.begin();
+    if (!spill)
+      continue;
+    run->file = new SpillFile();
+    for (size_t k = run->next; k < run->end; k++)
+      run->file->append(this->rows[this->keyed[k].row]);
+    run->file->rewind();
+    this->spilled++;
+  }
+  if (spill) {
+    this->rows.clear();
+    this->keyed.clear();
+  }
+}
+
+const std::string *Sort::current(u32 run) const {
+  const Run *r = this->runs[run];
+  if (r->file != nullptr)
+    return r->done ? nullptr : &r->key;
+  return r->next < r->end ? &this->keyed[r->next].key : nullptr;
+}
+
+bool Sort::beats(u32 a, u32 b) const {
+  const std::string *a_key = current(a), *b_key = current(b);
+  if (a_key == nullptr || b_key == nullptr)
+    return b_key == nullptr && (a_key != nullptr || a < b);
+  int order = compare_keys(*a_key, *b_key);
+  return order < 0 || (order == 0 && a < b);
+}
+
+void Sort::advance(u32 run) {
+  Run *r = this->runs[run];
+  if (r->file == nullptr) {
+    r->next++;
+    return;
+  }
+  r->done = !r->file->next(r->row);
+  if (!r->done)
+    normalize_key(r->row, this->keys, r->key);
+}
+
+// The runs are the leaves, numbered from runs.size() up, below nodes 1 up.
+u32 Sort::play(u32 node) {
+  u32 leaves = this->runs.size();
+  if (node >= leaves)
+    return node - leaves;
+  u32 a = play(2 * node), b = play(2 * node + 1);
+  if (beats(a, b)) {
+    this->tree[node] = b;
+    return a;
+  }
+  this->tree[node] = a;
+  return b;
+}
+
+// END  : Sort //
+
+// BEGIN: TopN //
+
+const size_t TopN::MAX_LIMIT;
+
+TopN::TopN(PlanOperator *input, const SortKeys &keys, size_t limit)
+    : input(input), keys(keys), limit(limit),
+      filter(keys.empty() ? SortKey(0) : keys[0]), next_row(0) {
+  this->columns = input->get_columns();
+}
+
+TopN::~TopN() { delete this->input; }
+
+// Once the heap is full, a row goes in only if it sorts before the worst one
+// kept, which it then takes the place of.
+void TopN::open() {
+  this->heap.clear();
+  this->next_row = 0;
+  this->filter.reset();
+  this->input->open();
+  Keyed keyed;
+  Row row;
+  for (size_t sequence = 0; this->limit > 0 && this->input->next(row);
+       sequence++) {
+    normalize_key(row, this->keys, keyed.key);
+    if (this->heap.size() == this->limit) {
+      if (compare_keys(keyed.key, this->heap.front().key) >= 0)
+        continue;
+      std::pop_heap(this->heap.begin(), this->heap.end(), before);
+      this->heap.pop_back();
+    }
+    keyed.sequence = sequence;
+    keyed.row = std::move(row);
+    this->heap.push_back(std::move(keyed));
+    std::push_heap(this->heap.begin(), this->heap.end(), before);
+    if (this->heap.size() == this->limit && !this->keys.empty())
+      this->filter.set_bound(this->heap.front().row[this->keys[0].column]);
+  }
+  this->input->close();
+  std::sort_heap(this->heap.begin(), this->heap.end(), before);
+}
+
+bool TopN::next(Row &row) {
+  if (this->next_row == this->heap.size())
+    return false;
+  row = std::move(this->heap[this->next_row++].row);
+  return true;
+}
+
+void TopN::close() {
+  this->input->close();
+  std::vector<Keyed>().swap(this->heap);
+  this->next_row = 0;
+}
+
+bool TopN::before(const Keyed &a, const Keyed &b) {
+  int order = compare_keys(a.key, b.key);
+  return order != 0 ? order < 0 : a.sequence < b.sequence;
+}
+
+// END  : TopN //
+
+// BEGIN: HashAggregate //
+
+const size_t HashAggregate::MEMORY_BUDGET;
+const uint HashAggregate::PARTITIONS;
+const size_t HashAggregate::BATCH_ROWS;
+const u_int32_t HashAggregate::NO_GROUP;
+
+// FNV-1a over the group-by values, with NULL as a value of its own, then
+// the same final mix as hash_key().
+static u64 hash_group(const Row &row, const std::vector<uint> &columns) {
+  u64 h = 14695981039346656037ULL;
+  auto mix = [&h](const void *bytes, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+      h ^= ((const u_int8_t *)bytes)[i];
+      h *= 1099511628211ULL;
+    }
+  };
+  for (uint column : columns) {
+    const std::optional<Value> &field = row[column];
+    u_int8_t tag = !field ? 0 : 1 + field->data_type;
+    mix(&tag, sizeof(tag));
+    if (field && field->data_type == ColumnAttribute::INT)
+      mix(&field->n, sizeof(field->n));
+    else if (field)
+      mix(field->s.data(), field->s.size());
+  }
+  h ^= h >> 33;
+  h *= 0xff51afd7ed558ccdULL;
+  h ^= h >> 33;
+  h *= 0xc4ceb9fe1a85ec53ULL;
+  h ^= h >> 33;
+  return h;
+}
+
+// MurmurHash3's 32-bit finalizer, to spread single INT keys over the slots.
+static u32 mix_int(u32 n) {
+  n ^= n >> 16;
+  n *= 0x85ebca6bU;
+  n ^= n >> 13;
+  n *= 0xc2b2ae35U;
+  n ^= n >> 16;
+  return n;
+}
+
+static Value aggregate_value(int64_t n) {
+  if (n < INT32_MIN || n > INT32_MAX)
+    throw DbRelationError("aggregate out of range");
+  return Value((int32_t)n);
+}
+
+void HashAggregate::Groups::clear() {
+  std::vector<Row>().swap(this->keys);
+  std::vector<Accumulator>().swap(this->accumulators);
+  std::vector<Slot>().swap(this->slots);
+  this->null_group = NO_GROUP;
+  this->bytes = 0;
+}
+
+HashAggregate::HashAggregate(PlanOperator *input,
+                             const std::vector<uint> &group_by,
+                             const Aggregates &aggregates, size_t budget,
+                             uint threads)
+    : input(input), group_by(group_by), aggregates(aggregates),
+      budget(budget), threads(threads), spilled(0), next_group(0) {
+  if (this->threads == 0)
+    this->threads = std::max(1U, std::thread::hardware_concurrency());
+  const PlanColumns &input_columns = input->get_columns();
+  for (uint i = 0; i < group_by.size(); i++) {
+    this->key_columns.push_back(i);
+    this->columns.push_back(input_columns[group_by[i]]);
+  }
+  this->int_key = group_by.size() == 1 &&
+                  input_columns[group_by[0]].data_type == ColumnAttribute::INT;
+  static const char *const names[] = {"count", "count", "sum", "avg"};
+  for (const Aggregate &aggregate : aggregates)
+    this->columns.push_back(
+        PlanColumn("", names[aggregate.function], ColumnAttribute::INT));
+}
+
+HashAggregate::~HashAggregate() {
+  clear();
+  delete this->input;
+}
+
+void HashAggregate::open() {
+  clear();
+  this->spilled = 0;
+  this->input->open();
+  Row row;
+  bool count_only = this->group_by.empty();
+  for (const Aggregate &aggregate : this->aggregates)
+    count_only = count_only && aggregate.function == Aggregate::COUNT_STAR;
+  if (count_only) {
+    int64_t count = 0;
+    while (this->input->next(row))
+      count++;
+    for (Accumulator &accumulator : this->tables[0].accumulators)
+      accumulator.count = count;
+  } else {
+    std::vector<Row> batch;
+    bool more = true;
+    while (more) {
+      batch.clear();
+      while ((more = batch.size() < BATCH_ROWS * this->threads &&
+                     this->input->next(row)))
+        batch.push_back(std::move(row));
+      more = more || batch.size() == BATCH_ROWS * this->threads;
+      add_rows(batch);
+      size_t bytes = 0;
+      for (const Groups &groups : this->tables)
+        bytes += groups.bytes;
+      if (bytes > this->budget)
+        spill();
+    }
+  }
+  this->input->close();
+
+  if (!this->partitions.empty()) {
+    spill(); // the rest, to be merged a partition at a time
+    for (SpillFile *partition : this->partitions)
+      partition->rewind();
+    next_partition();
+    return;
+  }
+  Groups &into = this->tables[0];
+  size_t width = this->aggregates.size();
+  for (size_t t = 1; t < this->tables.size(); t++) {
+    Groups &from = this->tables[t];
+    for (u32 group = 0; group < from.keys.size(); group++)
+      merge(into,
+            this->group_by.empty()
+                ? 0
+                : find_group(into, from.keys[group], this->key_columns),
+            &from.accumulators[group * width]);
+    from.clear();
+  }
+}
+
+bool HashAggregate::next(Row &row) {
+  while (this->next_group == this->tables[0].keys.size())
+    if (!next_partition())
+      return false;
+  const Groups &groups = this->tables[0];
+  u32 group = this->next_group++;
+  row = groups.keys[group];
+  const Accumulator *accumulators =
+      &groups.accumulators[group * this->aggregates.size()];
+  for (size_t i = 0; i < this->aggregates.size(); i++) {
+    const Accumulator &accumulator = accumulators[i];
+    switch (this->aggregates[i].function) {
+    case Aggregate::COUNT_STAR:
+    case Aggregate::COUNT:
+      row.push_back(aggregate_value(accumulator.count));
+      break;
+    case Aggregate::SUM:
+      if (accumulator.count == 0)
+        row.push_back(std::nullopt);
+      else
+        row.push_back(aggregate_value(accumulator.sum));
+      break;
+    case Aggregate::AVG:
+      if (accumulator.count == 0)
+        row.push_back(std::nullopt);
+      else
+        row.push_back(Value((int32_t)(accumulator.sum / accumulator.count)));
+      break;
+    }
+  }
+  return true;
+}
+
+void HashAggregate::close() {
+  this->input->close();
+  clear();
+}
+
+// Every table starts out empty, except that without group-by columns each
+// has its single group.
+void HashAggregate::clear() {
+  for (SpillFile *partition : this->partitions)
+    delete partition;
+  this->partitions.clear();
+  this->tables.assign(this->threads, Groups());
+  if (this->group_by.empty())
+    for (Groups &groups : this->tables) {
+      groups.keys.push_back(Row());
+      groups.accumulators.assign(this->aggregates.size(), Accumulator{0, 0});
+    }
+  this->next_group = 0;
+}
+
+void HashAggregate::add_rows(const std::vector<Row> &rows) {
+  size_t n = rows.size();
+  size_t slices = std::max((size_t)1,
+                           std::min((size_t)this->threads, n / BATCH_ROWS));
+  if (slices == 1) {
+    for (const Row &row : rows)
+      add_row(this->tables[0], row);
+    return;
+  }
+  std::vector<std::exception_ptr> errors(slices);
+  std::vector<std::thread> workers;
+  for (size_t i = 0; i < slices; i++)
+    workers.push_back(std::thread([&, i]() {
+      try {
+        for (size_t r = n * i / slices; r < n * (i + 1) / slices; r++)
+          add_row(this->tables[i], rows[r]);
+      } catch (...) {
+        errors[i] = std::current_exception();
+      }
+    }));
+  for (auto &worker : workers)
+    worker.join();
+  for (auto const &error : errors)
+    if (error)
+      std::rethrow_exception(error);
+}
+
+void HashAggregate::add_row(Groups &groups, const Row &row) {
+  u32 group =
+      this->group_by.empty() ? 0 : find_group(groups, row, this->group_by);
+  Accumulator *accumulators =
+      &groups.accumulators[group * this->aggregates.size()];
+  for (size_t i = 0; i < this->aggregates.size(); i++) {
+    const Aggregate &aggregate = this->aggregates[i];
+    if (aggregate.function == Aggregate::COUNT_STAR) {
+      accumulators[i].count++;
+      continue;
+    }
+    const std::optional<Value> &field = row[aggregate.column];
+    if (field) {
+      accumulators[i].count++;
+      accumulators[i].sum += field->n;
+    }
+  }
+}
+
+u32 HashAggregate::find_group(Groups &groups, const Row &row,
+                              const std::vector<uint> &columns) {
+  if (2 * (groups.keys.size() + 1) > groups.slots.size())
+    grow(groups);
+  size_t mask = groups.slots.size() - 1;
+  if (this->int_key) {
+    const std::optional<Value> &field = row[columns[0]];
+    if (!field) {
+      if (groups.null_group == NO_GROUP)
+        groups.null_group = new_group(groups, row, columns);
+      return groups.null_group;
+    }
+    u32 key = (u32)field->n;
+    for (size_t s = mix_int(key) & mask;; s = (s + 1) & mask) {
+      Slot &slot = groups.slots[s];
+      if (slot.group == NO_GROUP) {
+        slot.hash = key;
+        slot.group = new_group(groups, row, columns);
+        return slot.group;
+      }
+      if (slot.hash == key)
+        return slot.group;
+    }
+  }
+
+  u32 hash = (u32)hash_group(row, columns);
+  for (size_t s = hash & mask;; s = (s + 1) & mask) {
+    Slot &slot = groups.slots[s];
+    if (slot.group == NO_GROUP) {
+      slot.hash = hash;
+      slot.group = new_group(groups, row, columns);
+      return slot.group;
+    }
+    if (slot.hash != hash)
+      continue;
+    const Row &keys = groups.keys[slot.group];
+    bool same = true;
+    for (size_t i = 0; i < columns.size() && same; i++)
+      same = keys[i] == row[columns[i]];
+    if (same)
+      return slot.group;
+  }
+}
+
+u32 HashAggregate::new_group(Groups &groups, const Row &row,
+                             const std::vector<uint> &columns) {
+  Row keys;
+  for (uint column : columns)
+    keys.push_back(row[column]);
+  groups.bytes += row_bytes(keys) +
+                  this->aggregates.size() * sizeof(Accumulator) +
+                  2 * sizeof(Slot);
+  groups.keys.push_back(std::move(keys));
+  groups.accumulators.resize(groups.accumulators.size() +
+                                 this->aggregates.size(),
+                             Accumulator{0, 0});
+  return groups.keys.size() - 1;
+}
+
+// Double the slots (to at least 16) and put every group back.
+void HashAggregate::grow(Groups &groups) {
+  size_t capacity = std::max((size_t)16, 2 * groups.slots.size());
+  groups.slots.assign(capacity, Slot{0, NO_GROUP});
+  size_t mask = capacity - 1;
+  for (u32 group = 0; group < groups.keys.size(); group++) {
+    if (group == groups.null_group)
+      continue;
+    const Row &keys = groups.keys[group];
+    u32 hash = this->int_key ? (u32)keys[0]->n
+                             : (u32)hash_group(keys, this->key_columns);
+    size_t s = (this->int_key ? mix_int(hash) : hash) & mask;
+    while (groups.slots[s].group != NO_GROUP)
+      s = (s + 1) & mask;
+    groups.slots[s] = Slot{hash, group};
+  }
+}
+
+void HashAggregate::merge(Groups &groups, u32 group, const Accumulator *from) {
+  Accumulator *into = &groups.accumulators[group * this->aggregates.size()];
+  for (size_t i = 0; i < this->aggregates.size(); i++) {
+    into[i].count += from[i].count;
+    into[i].sum += from[i].sum;
+  }
+}
+
+// A group goes out as its group-by values, then for each aggregate its count
+// and sum, each as two INTs (high half first).
+void HashAggregate::spill() {
+  if (this->partitions.empty())
+    for (uint i = 0; i < PARTITIONS; i++)
+      this->partitions.push_back(new SpillFile());
+  size_t width = this->aggregates.size();
+  for (Groups &groups : this->tables) {
+    for (u32 group = 0; group < groups.keys.size(); group++) {
+      Row row = groups.keys[group];
+      for (size_t i = 0; i < width; i++) {
+        const Accumulator &accumulator =
+            groups.accumulators[group * width + i];
+        for (int64_t n : {accumulator.count, accumulator.sum}) {
+          row.push_back(Value((int32_t)((u64)n >> 32)));
+          row.push_back(Value((int32_t)(u32)n));
+        }
+      }
+      u64 hash = hash_group(groups.keys[group], this->key_columns);
+      this->partitions[(hash >> 32) % PARTITIONS]->append(row);
+    }
+    groups.clear();
+  }
+  this->spilled++;
+}
+
+bool HashAggregate::next_partition() {
+  Groups &into = this->tables[0];
+  into.clear();
+  this->next_group = 0;
+  if (this->partitions.empty())
+    return false;
+  SpillFile *partition = this->partitions.back();
+  this->partitions.pop_back();
+  size_t width = this->aggregates.size();
+  std::vector<Accumulator> from(width);
+  size_t keys = this->key_columns.size();
+  Row row;
+  try {
+    while (partition->next(row)) {
+      for (size_t i = 0; i < width; i++) {
+        u64 halves[4];
+        for (size_t h = 0; h < 4; h++)
+          halves[h] = (u32)row[keys + 4 * i + h]->n;
+        from[i].count = (int64_t)(halves[0] << 32 | halves[1]);
+        from[i].sum = (int64_t)(halves[2] << 32 | halves[3]);
+      }
+      merge(into, find_group(into, row, this->key_columns), from.data());
+    }
+  } catch (...) {
+    delete partition;
+    throw;
+  }
+  delete partition;
+  return true;
+}
+
+// END  : HashAggregate //
+
+// BEGIN: Limit //
+
+Limit::Limit(PlanOperator *input, size_t limit, size_t offset)
+    : input(input), limit(limit), offset(offset), produced(0) {
+  this->columns = input->get_columns();
+}
+
+void Limit::open() {
+  this->input->open();
+  this->produced = 0;
+  Row row;
+  for (size_t skipped = 0; skipped < this->offset && this->input->next(row);
+       skipped++)
+    ;
+}
+
+bool Limit::next(Row &row) {
+  if (this->produced == this->limit || !this->input->next(row))
+    return false;
+  this->produced++;
+  return true;
+}
+
+// END  : Limit //
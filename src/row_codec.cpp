@@ -0,0 +1,175 @@
+#include "row_codec.h"
+#include <algorithm>
+#include <cstring>
+
+typedef u_int16_t u16;
+
+// Run 0 starts the row and run j + 1 starts with the j-th TEXT field, so a
+// TEXT column's field is at the end of the run before its own.
+RowCodec::RowCodec(const ColumnNames &column_names,
+                   const ColumnAttributes &column_attributes)
+    : run_sizes(1, 0), fixed_size(0), names(column_names) {
+  if (column_names.size() > MAX_COLUMNS)
+    throw DbRelationError("too many columns");
+  for (size_t i = 0; i < column_names.size(); i++) {
+    ColumnAttribute ca = column_attributes[i];
+    u16 run = this->run_sizes.size() - 1;
+    switch (ca.get_data_type()) {
+    case ColumnAttribute::DataType::INT:
+      this->places.push_back(Place{run, this->run_sizes[run], false});
+      this->ints.push_back(i);
+      this->run_sizes[run] += sizeof(int32_t);
+      this->fixed_size += sizeof(int32_t);
+      break;
+    case ColumnAttribute::DataType::TEXT:
+      this->places.push_back(Place{run, this->run_sizes[run], true});
+      this->texts.push_back(i);
+      this->run_sizes.push_back(0);
+      this->fixed_size += sizeof(u16);
+      break;
+    default:
+      throw DbRelationError("Only know how to marshal INT and TEXT");
+    }
+    this->positions[column_names[i]] = i;
+  }
+  this->bases.resize(this->run_sizes.size());
+  this->values.resize(column_names.size());
+  this->decoded.resize(column_names.size());
+
+  // ValueDict is ordered by name, so decoding in name order lets every
+  // insertion go at the end of the map.
+  for (uint i = 0; i < column_names.size(); i++)
+    this->key_order.push_back(i);
+  std::sort(this->key_order.begin(), this->key_order.end(),
+            [&column_names](uint a, uint b) {
+              return column_names[a] < column_names[b];
+            });
+}
+
+uint RowCodec::size(const ValueDict *row) const {
+  if (is_fixed_width())
+    return this->fixed_size;
+  gather(row);
+  return this->bases.back() + this->run_sizes.back();
+}
+
+uint RowCodec::encode(const ValueDict *row, char *bytes) const {
+  gather(row);
+  for (uint i : this->ints)
+    memcpy(bytes + this->bases[this->places[i].run] + this->places[i].offset,
+           &this->values[i]->n, sizeof(int32_t));
+  for (uint i : this->texts) {
+    char *field =
+        bytes + this->bases[this->places[i].run] + this->places[i].offset;
+    if (this->values[i]->s.length() > UINT16_MAX)
+      throw DbRelationError("text too long to marshal");
+    u16 size = this->values[i]->s.length();
+    memcpy(field, &size, sizeof(u16));
+    memcpy(field + sizeof(u16), this->values[i]->s.data(),
+           size); // assume ascii for now
+  }
+  return this->bases.back() + this->run_sizes.back();
+}
+
+ValueDict *RowCodec::decode(const char *bytes) const {
+  locate(bytes);
+  for (uint i : this->ints) {
+    const char *field =
+        bytes + this->bases[this->places[i].run] + this->places[i].offset;
+    int32_t n;
+    memcpy(&n, field, sizeof(int32_t));
+    this->decoded[i] = Value(n);
+  }
+  for (uint i : this->texts) {
+    const char *field =
+        bytes + this->bases[this->places[i].run] + this->places[i].offset;
+    u16 size;
+    memcpy(&size, field, sizeof(u16));
+    this->decoded[i] = Value(std::string(field + sizeof(u16), size));
+  }
+  ValueDict *row = new ValueDict();
+  for (uint i : this->key_order)
+    row->emplace_hint(row->end(), this->names[i],
+                      std::move(this->decoded[i]));
+  return row;
+}
+
+ValueDict *RowCodec::decode(const char *bytes,
+                            const ColumnNames *column_names) const {
+  locate(bytes);
+  ValueDict *row = new ValueDict();
+  for (auto const &column_name : *column_names) {
+    int i = column_index(column_name);
+    if (i < 0)
+      throw DbRelationError("unknown column " + column_name);
+    row->emplace(column_name,
+                 value(bytes, i, this->bases[this->places[i].run]));
+  }
+  return row;
+}
+
+// Walks the TEXT lengths only as far as the column's run, without scratch, so
+// it may be called from several threads.
+Value RowCodec::field(const char *bytes, uint column) const {
+  uint base = 0;
+  for (u16 run = 0; run < this->places[column].run; run++) {
+    u16 size;
+    memcpy(&size, bytes + base + this->run_sizes[run], sizeof(u16));
+    base += this->run_sizes[run] + sizeof(u16) + size;
+  }
+  return value(bytes, column, base);
+}
+
+int RowCodec::column_index(const Identifier &column_name) const {
+  auto it = this->positions.find(column_name);
+  return it == this->positions.end() ? -1 : (int)it->second;
+}
+
+void RowCodec::locate(const char *bytes) const {
+  uint base = 0;
+  for (size_t run = 0; run + 1 < this->run_sizes.size(); run++) {
+    this->bases[run] = base;
+    u16 size;
+    memcpy(&size, bytes + base + this->run_sizes[run], sizeof(u16));
+    base += this->run_sizes[run] + sizeof(u16) + size;
+  }
+  this->bases.back() = base;
+}
+
+// A validated row has exactly the table's columns, which map iteration yields
+// in name order, so a single merge pass replaces a find() per column.
+void RowCodec::gather(const ValueDict *row) const {
+  auto it = row->begin();
+  bool exact = row->size() == this->names.size();
+  for (uint i : this->key_order) {
+    if (exact && it->first == this->names[i]) {
+      this->values[i] = &(it++)->second;
+      continue;
+    }
+    exact = false;
+    auto column = row->find(this->names[i]);
+    if (column == row->end())
+      throw DbRelationError("Row missing fields");
+    this->values[i] = &column->second;
+  }
+  // summed wide, so a row too big for any block says so rather than wrapping
+  uint base = 0;
+  for (size_t j = 0; j < this->texts.size(); j++) {
+    this->bases[j] = base;
+    base += this->run_sizes[j] + sizeof(u16) +
+            this->values[this->texts[j]]->s.length();
+  }
+  this->bases.back() = base;
+}
+
+Value RowCodec::value(const char *bytes, uint column, uint base) const {
+  const char *field = bytes + base + this->places[column].offset;
+  if (!this->places[column].text) {
+    int32_t n;
+    memcpy(&n, field, sizeof(int32_t));
+    return Value(n);
+  }
+  u16 size;
+  memcpy(&size, field, sizeof(u16));
+  return Value(std::string(field + sizeof(u16), size));
+}
@@ -0,0 +1,570 @@
+#include "schema_tables.h"
+#include "bitmap_index.h"
+#include "btree.h"
+#include "hash_index.h"
+#include "mem_storage.h"
+#include <algorithm>
+#include <iomanip>
+#include <sstream>
+
+// Names the catalog records engines, data types and index types by.
+static const char *const ENGINE_NAMES[] = {"HEAP", "COLUMN", "PAX", "MEMORY",
+                                           "LSM"};
+static const char *const DATA_TYPE_NAMES[] = {"INT", "TEXT"};
+static const char *const INDEX_TYPE_NAMES[] = {"HASH", "BTREE", "BITMAP"};
+
+template <size_t N>
+static uint name_index(const char *const (&names)[N], const std::string &name,
+                       const std::string &what) {
+  for (uint i = 0; i < N; i++)
+    if (name == names[i])
+      return i;
+  throw DbRelationError("unknown " + what + " " + name + " in the catalog");
+}
+
+// BEGIN: Columns //
+
+const Identifier Columns::TABLE_NAME = "_columns";
+
+Columns::Columns()
+    : HeapTable(TABLE_NAME, {"table_name", "column_name", "data_type"},
+                {ColumnAttribute(ColumnAttribute::TEXT),
+                 ColumnAttribute(ColumnAttribute::TEXT),
+                 ColumnAttribute(ColumnAttribute::TEXT)}) {}
+
+void Columns::add_columns(const Identifier &table_name,
+                          const ColumnNames &column_names,
+                          const ColumnAttributes &column_attributes) {
+  ValueDict row;
+  row["table_name"] = Value(table_name);
+  for (size_t i = 0; i < column_names.size(); i++) {
+    ColumnAttribute column_attribute = column_attributes[i];
+    row["column_name"] = Value(column_names[i]);
+    row["data_type"] =
+        Value(DATA_TYPE_NAMES[column_attribute.get_data_type()]);
+    insert(&row);
+  }
+}
+
+// Rows come back in handle order, which is the order they were added in.
+void Columns::get_columns(const Identifier &table_name,
+                          ColumnNames &column_names,
+                          ColumnAttributes &column_attributes) {
+  column_names.clear();
+  column_attributes.clear();
+  ValueDict where;
+  where["table_name"] = Value(table_name);
+  Handles *handles = select(&where);
+  std::sort(handles->begin(), handles->end());
+  ColumnNames wanted = {"column_name", "data_type"};
+  for (auto const &handle : *handles) {
+    ValueDict *row = project(handle, &wanted);
+    uint data_type =
+        name_index(DATA_TYPE_NAMES, (*row)["data_type"].s, "data type");
+    column_names.push_back((*row)["column_name"].s);
+    column_attributes.push_back(
+        ColumnAttribute((ColumnAttribute::DataType)data_type));
+    delete row;
+  }
+  delete handles;
+}
+
+void Columns::del_columns(const Identifier &table_name) {
+  ValueDict where;
+  where["table_name"] = Value(table_name);
+  Handles *handles = select(&where);
+  for (auto const &handle : *handles)
+    del(handle);
+  delete handles;
+}
+
+// END  : Columns //
+
+// BEGIN: Indices //
+
+const Identifier Indices::TABLE_NAME = "_indices";
+
+Indices::Indices()
+    : HeapTable(TABLE_NAME,
+                {"table_name", "index_name", "seq_in_index", "column_name",
+                 "index_type", "is_unique"},
+                {ColumnAttribute(ColumnAttribute::TEXT),
+                 ColumnAttribute(ColumnAttribute::TEXT),
+                 ColumnAttribute(ColumnAttribute::INT),
+                 ColumnAttribute(ColumnAttribute::TEXT),
+                 ColumnAttribute(ColumnAttribute::TEXT),
+                 ColumnAttribute(ColumnAttribute::INT)}) {}
+
+void Indices::record_index(const Identifier &table_name,
+                           const Identifier &index_name,
+                           const ColumnNames &key_columns,
+                           const Identifier &index_type, bool unique) {
+  ValueDict row;
+  row["table_name"] = Value(table_name);
+  row["index_name"] = Value(index_name);
+  row["index_type"] = Value(index_type);
+  row["is_unique"] = Value(unique ? 1 : 0);
+  for (size_t i = 0; i < key_columns.size(); i++) {
+    row["seq_in_index"] = Value((int32_t)i + 1);
+    row["column_name"] = Value(key_columns[i]);
+    insert(&row);
+  }
+}
+
+IndexNames Indices::get_index_names(const Identifier &table_name) {
+  IndexNames index_names;
+  ValueDict where;
+  where["table_name"] = Value(table_name);
+  Handles *handles = select(&where);
+  std::sort(handles->begin(), handles->end());
+  ColumnNames wanted = {"index_name", "seq_in_index"};
+  for (auto const &handle : *handles) {
+    ValueDict *row = project(handle, &wanted);
+    if ((*row)["seq_in_index"].n == 1)
+      index_names.push_back((*row)["index_name"].s);
+    delete row;
+  }
+  delete handles;
+  return index_names;
+}
+
+void Indices::get_index(const Identifier &table_name,
+                        const Identifier &index_name, ColumnNames &key_columns,
+                        Identifier &index_type, bool &unique) {
+  ValueDict where;
+  where["table_name"] = Value(table_name);
+  where["index_name"] = Value(index_name);
+  Handles *handles = select(&where);
+  key_columns.assign(handles->size(), "");
+  for (auto const &handle : *handles) {
+    ValueDict *row = project(handle);
+    key_columns[(*row)["seq_in_index"].n - 1] = (*row)["column_name"].s;
+    index_type = (*row)["index_type"].s;
+    unique = (*row)["is_unique"].n != 0;
+    delete row;
+  }
+  delete handles;
+}
+
+void Indices::forget_index(const Identifier &table_name,
+                           const Identifier &index_name) {
+  ValueDict where;
+  where["table_name"] = Value(table_name);
+  if (!index_name.empty())
+    where["index_name"] = Value(index_name);
+  Handles *handles = select(&where);
+  for (auto const &handle : *handles)
+    del(handle);
+  delete handles;
+}
+
+// END  : Indices //
+
+// BEGIN: Tables //
+
+// An index of a type the catalog records, not yet created or opened.
+static DbIndex *new_index(DbRelation &relation, const Identifier &index_name,
+                          const ColumnNames &key_columns,
+                          const Identifier &index_type, bool unique) {
+  switch (name_index(INDEX_TYPE_NAMES, index_type, "index type")) {
+  case 0:
+    return new HashIndex(relation, index_name, key_columns, unique);
+  case 1:
+    return new BTreeIndex(relation, index_name, key_columns, unique);
+  default:
+    return new BitmapIndex(relation, index_name, key_columns, unique);
+  }
+}
+
+const Identifier Tables::TABLE_NAME = "_tables";
+const size_t Tables::MAX_OPEN;
+
+Tables::Tables(size_t max_open)
+    : HeapTable(TABLE_NAME,
+                {"table_name", "engine", "fillfactor", "bloom_columns",
+                 "bloom_bits", "bloom_fp_rate", "memtable_bytes"},
+                {ColumnAttribute(ColumnAttribute::TEXT),
+                 ColumnAttribute(ColumnAttribute::TEXT),
+                 ColumnAttribute(ColumnAttribute::INT),
+                 ColumnAttribute(ColumnAttribute::TEXT),
+                 ColumnAttribute(ColumnAttribute::INT),
+                 ColumnAttribute(ColumnAttribute::TEXT),
+                 ColumnAttribute(ColumnAttribute::INT)}),
+      max_open(std::max<size_t>(max_open, 1)), evictions(0) {}
+
+Tables::~Tables() {
+  for (auto const &it : this->relations) {
+    for (DbIndex *index : it.second.indexes)
+      delete index;
+    delete it.second.relation;
+  }
+}
+
+bool Tables::is_schema_table(const Identifier &table_name) {
+  return table_name == TABLE_NAME || table_name == Columns::TABLE_NAME ||
+         table_name == Indices::TABLE_NAME;
+}
+
+TableOptions::Engine Tables::engine_named(const Identifier &engine_name) {
+  for (uint i = 0; i < sizeof(ENGINE_NAMES) / sizeof(*ENGINE_NAMES); i++)
+    if (engine_name == ENGINE_NAMES[i])
+      return (TableOptions::Engine)i;
+  throw DbRelationError("unknown engine " + engine_name);
+}
+
+void Tables::create() {
+  HeapTable::create();
+  this->columns.create();
+  this->indices.create();
+  add_table(TABLE_NAME, this->column_names, this->column_attributes,
+            TableOptions());
+  add_table(Columns::TABLE_NAME, this->columns.get_column_names(),
+            this->columns.get_column_attributes(), TableOptions());
+  add_table(Indices::TABLE_NAME, this->indices.get_column_names(),
+            this->indices.get_column_attributes(), TableOptions());
+}
+
+void Tables::create_if_not_exists() {
+  try {
+    this->open();
+  } catch (const DbException &) {
+    this->create();
+  }
+}
+
+void Tables::drop() {
+  close();
+  HeapTable::drop();
+  this->columns.drop();
+  this->indices.drop();
+}
+
+void Tables::open() {
+  HeapTable::open();
+  this->columns.open();
+  this->indices.open();
+}
+
+void Tables::close() {
+  for (auto const &it : this->relations)
+    unload(it.second);
+  this->relations.clear();
+  this->recently_used.clear();
+  HeapTable::close();
+  this->columns.close();
+  this->indices.close();
+}
+
+DbRelation &Tables::create_table(const Identifier &table_name,
+                                 const ColumnNames &column_names,
+                                 const ColumnAttributes &column_attributes,
+                                 const TableOptions &options) {
+  if (exists(table_name))
+    throw DbRelationError("table " + table_name + " already exists");
+  DbRelation *relation =
+      new_relation(table_name, column_names, column_attributes, options);
+  try {
+    relation->create();
+  } catch (...) {
+    delete relation;
+    throw;
+  }
+  try {
+    add_table(table_name, column_names, column_attributes, options);
+  } catch (...) {
+    relation->drop();
+    delete relation;
+    throw;
+  }
+  cache(table_name, relation);
+  return *relation;
+}
+
+void Tables::drop_table(const Identifier &table_name) {
+  if (is_schema_table(table_name))
+    throw DbRelationError("cannot drop a schema table");
+  get_table(table_name);
+  auto cached = this->relations.find(table_name);
+  if (cached->second.borrowed > 0)
+    throw DbRelationError("table " + table_name + " is in use");
+  CachedRelation dropped = cached->second;
+  this->recently_used.erase(cached->second.recent);
+  this->relations.erase(cached);
+  unload(dropped, true);
+
+  bool found;
+  Handle handle = find(table_name, found);
+  this->indices.forget_index(table_name);
+  this->columns.del_columns(table_name);
+  del(handle);
+}
+
+DbIndex &Tables::create_index(const Identifier &table_name,
+                              const Identifier &index_name,
+                              const ColumnNames &key_columns,
+                              const Identifier &index_type, bool unique) {
+  HeapTable *table = dynamic_cast<HeapTable *>(&get_table(table_name));
+  if (table == nullptr || is_schema_table(table_name))
+    throw DbRelationError("only HEAP tables can be indexed");
+  IndexNames index_names = this->indices.get_index_names(table_name);
+  if (std::find(index_names.begin(), index_names.end(), index_name) !=
+      index_names.end())
+    throw DbRelationError("index " + index_name + " already exists");
+  if (std::find(std::begin(INDEX_TYPE_NAMES), std::end(INDEX_TYPE_NAMES),
+                index_type) == std::end(INDEX_TYPE_NAMES))
+    throw DbRelationError("unknown index type " + index_type);
+  if (key_columns.empty())
+    throw DbRelationError("an index needs key columns");
+  const ColumnNames &column_names = table->get_column_names();
+  for (auto const &key_column : key_columns)
+    if (std::find(column_names.begin(), column_names.end(), key_column) ==
+        column_names.end())
+      throw DbRelationError("unknown column " + key_column);
+  DbIndex *index =
+      new_index(*table, index_name, key_columns, index_type, unique);
+  try {
+    index->create();
+  } catch (...) {
+    delete index;
+    throw;
+  }
+  try {
+    this->indices.record_index(table_name, index_name, key_columns,
+                               index_type, unique);
+  } catch (...) {
+    this->indices.forget_index(table_name, index_name);
+    index->drop();
+    delete index;
+    throw;
+  }
+  table->add_index(index);
+  this->relations[table_name].indexes.push_back(index);
+  return *index;
+}
+
+void Tables::drop_index(const Identifier &table_name,
+                        const Identifier &index_name) {
+  if (is_schema_table(table_name))
+    throw DbRelationError("no index " + index_name + " on " + table_name);
+  HeapTable *table = dynamic_cast<HeapTable *>(&get_table(table_name));
+  DbIndexes &indexes = this->relations[table_name].indexes;
+  for (auto it = indexes.begin(); it != indexes.end(); it++)
+    if ((*it)->get_name() == index_name) {
+      DbIndex *index = *it;
+      indexes.erase(it);
+      table->remove_index(index);
+      index->drop();
+      delete index;
+      this->indices.forget_index(table_name, index_name);
+      return;
+    }
+  throw DbRelationError("no index " + index_name + " on " + table_name);
+}
+
+DbIndexes Tables::get_indexes(const Identifier &table_name) {
+  get_table(table_name);
+  auto cached = this->relations.find(table_name);
+  return cached == this->relations.end() ? DbIndexes()
+                                         : cached->second.indexes;
+}
+
+DbRelation &Tables::get_table(const Identifier &table_name) {
+  if (table_name == TABLE_NAME)
+    return *this;
+  if (table_name == Columns::TABLE_NAME)
+    return this->columns;
+  if (table_name == Indices::TABLE_NAME)
+    return this->indices;
+  auto cached = this->relations.find(table_name);
+  if (cached != this->relations.end()) {
+    this->recently_used.splice(this->recently_used.begin(),
+                               this->recently_used, cached->second.recent);
+    return *cached->second.relation;
+  }
+  DbIndexes indexes;
+  DbRelation *relation = load(table_name, indexes);
+  cache(table_name, relation, indexes);
+  return *relation;
+}
+
+DbRelation &Tables::borrow(const Identifier &table_name) {
+  DbRelation &relation = get_table(table_name);
+  auto cached = this->relations.find(table_name);
+  if (cached != this->relations.end())
+    cached->second.borrowed++;
+  return relation;
+}
+
+void Tables::release(const Identifier &table_name) {
+  auto cached = this->relations.find(table_name);
+  if (cached == this->relations.end() || cached->second.borrowed == 0)
+    return; // a schema table, which is always open
+  cached->second.borrowed--;
+  evict();
+}
+
+void Tables::set_max_open(size_t max_open) {
+  this->max_open = std::max<size_t>(max_open, 1);
+  evict();
+}
+
+bool Tables::exists(const Identifier &table_name) {
+  if (this->relations.find(table_name) != this->relations.end())
+    return true;
+  bool found;
+  find(table_name, found);
+  return found;
+}
+
+TableNames Tables::get_table_names() {
+  TableNames table_names;
+  Handles *handles = select();
+  std::sort(handles->begin(), handles->end());
+  ColumnNames wanted = {"table_name"};
+  for (auto const &handle : *handles) {
+    ValueDict *row = project(handle, &wanted);
+    Identifier table_name = (*row)["table_name"].s;
+    if (!is_schema_table(table_name))
+      table_names.push_back(table_name);
+    delete row;
+  }
+  delete handles;
+  return table_names;
+}
+
+// The catalog row for a table.
+Handle Tables::find(const Identifier &table_name, bool &found) {
+  ValueDict where;
+  where["table_name"] = Value(table_name);
+  Handles *handles = select(&where);
+  found = !handles->empty();
+  Handle handle = found ? handles->front() : Handle();
+  delete handles;
+  return handle;
+}
+
+void Tables::add_table(const Identifier &table_name,
+                       const ColumnNames &column_names,
+                       const ColumnAttributes &column_attributes,
+                       const TableOptions &options) {
+  ValueDict row;
+  row["table_name"] = Value(table_name);
+  row["engine"] = Value(ENGINE_NAMES[options.engine]);
+  row["fillfactor"] = Value((int32_t)options.fillfactor);
+  std::string bloom_columns;
+  for (auto const &column_name : options.bloom_columns)
+    bloom_columns += (bloom_columns.empty() ? "" : ",") + column_name;
+  row["bloom_columns"] = Value(bloom_columns);
+  row["bloom_bits"] = Value((int32_t)options.bloom_bits);
+  std::ostringstream bloom_fp_rate; // exactly, to be read back the same
+  bloom_fp_rate << std::setprecision(17) << options.bloom_fp_rate;
+  row["bloom_fp_rate"] = Value(bloom_fp_rate.str());
+  row["memtable_bytes"] = Value((int32_t)options.memtable_bytes);
+  Handle handle = insert(&row);
+  try {
+    this->columns.add_columns(table_name, column_names, column_attributes);
+  } catch (...) {
+    this->columns.del_columns(table_name);
+    del(handle);
+    throw;
+  }
+}
+
+// Build a table from its catalog rows and open it, with its indexes.
+DbRelation *Tables::load(const Identifier &table_name, DbIndexes &indexes) {
+  bool found;
+  Handle handle = find(table_name, found);
+  if (!found)
+    throw DbRelationError("no such table " + table_name);
+  ValueDict *row = project(handle);
+  TableOptions options;
+  options.engine = (TableOptions::Engine)name_index(
+      ENGINE_NAMES, (*row)["engine"].s, "engine");
+  options.fillfactor = (*row)["fillfactor"].n;
+  std::istringstream bloom_columns((*row)["bloom_columns"].s);
+  Identifier column_name;
+  while (std::getline(bloom_columns, column_name, ','))
+    options.bloom_columns.push_back(column_name);
+  options.bloom_bits = (*row)["bloom_bits"].n;
+  options.bloom_fp_rate = std::stod((*row)["bloom_fp_rate"].s);
+  options.memtable_bytes = (*row)["memtable_bytes"].n;
+  delete row;
+
+  ColumnNames column_names;
+  ColumnAttributes column_attributes;
+  this->columns.get_columns(table_name, column_names, column_attributes);
+  DbRelation *relation =
+      new_relation(table_name, column_names, column_attributes, options);
+  try {
+    relation->open();
+  } catch (...) {
+    delete relation;
+    throw;
+  }
+
+  indexes.clear();
+  try {
+    for (auto const &index_name : this->indices.get_index_names(table_name)) {
+      ColumnNames key_columns;
+      Identifier index_type;
+      bool unique;
+      this->indices.get_index(table_name, index_name, key_columns, index_type,
+                              unique);
+      DbIndex *index =
+          new_index(*relation, index_name, key_columns, index_type, unique);
+      indexes.push_back(index);
+      index->open();
+      dynamic_cast<HeapTable &>(*relation).add_index(index);
+    }
+  } catch (...) {
+    unload(CachedRelation{relation, this->recently_used.end(), 0, indexes});
+    throw;
+  }
+  return relation;
+}
+
+void Tables::cache(const Identifier &table_name, DbRelation *relation,
+                   const DbIndexes &indexes) {
+  this->recently_used.push_front(table_name);
+  this->relations[table_name] =
+      CachedRelation{relation, this->recently_used.begin(), 0, indexes};
+  evict();
+}
+
+void Tables::unload(const CachedRelation &cached, bool drop) {
+  for (DbIndex *index : cached.indexes) {
+    if (drop)
+      index->drop();
+    else
+      index->close();
+    delete index;
+  }
+  if (drop)
+    cached.relation->drop();
+  else
+    cached.relation->close();
+  delete cached.relation;
+}
+
+// Close least recently used tables that aren't borrowed until few enough
+// are open. The most recently used table stays, since its caller has it, and
+// so do MEMORY tables, whose rows would go with them.
+void Tables::evict() {
+  auto it = this->recently_used.end();
+  while (this->relations.size() > this->max_open &&
+         --it != this->recently_used.begin()) {
+    auto cached = this->relations.find(*it);
+    if (cached->second.borrowed > 0 ||
+        dynamic_cast<MemTable *>(cached->second.relation) != nullptr)
+      continue;
+    if (this->on_evict)
+      this->on_evict(*it);
+    CachedRelation evicted = cached->second;
+    this->relations.erase(cached);
+    it = this->recently_used.erase(it);
+    unload(evicted);
+    this->evictions++;
+  }
+}
+
+// END  : Tables //
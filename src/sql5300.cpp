@@ -20,6 +20,9 @@ DbEnv *_DB_ENV;
 
 const char *DB_NAME = "cs5300.db";
 const std::string QUIT = "quit";
+const std::string ANALYZE = "analyze ";
+const std::string SET_ENGINE = "set engine ";
+const std::string SET_THREADS = "set threads ";
 
 /**
  * Prints the program usage and exits
@@ -81,25 +84,63 @@ void sqlShell(void) {
       std::cout << "test_heap_storage: " << (tester ? "ok" : "failed")
                 << std::endl;
       continue;
+    } else if (input == "bench") {
+      bench_heap_storage();
+      continue;
+    } else if (input.compare(0, ANALYZE.size(), ANALYZE) == 0) {
+      // the parser has no ANALYZE statement
+      try {
+        std::cout << Execute::analyze(input.substr(ANALYZE.size())) << '\n';
+      } catch (DbRelationError &e) {
+        std::cerr << "Error: " << e.what() << '\n';
+      }
+      continue;
+    } else if (input.compare(0, SET_ENGINE.size(), SET_ENGINE) == 0) {
+      // nor a way to choose the engine in CREATE TABLE
+      try {
+        std::cout << Execute::set_engine(input.substr(SET_ENGINE.size()))
+                  << '\n';
+      } catch (DbRelationError &e) {
+        std::cerr << "Error: " << e.what() << '\n';
+      }
+      continue;
+    } else if (input.compare(0, SET_THREADS.size(), SET_THREADS) == 0) {
+      // nor a way to say how many threads an aggregate query may use
+      std::string count = input.substr(SET_THREADS.size());
+      if (count.empty() || count.size() > 4 ||
+          count.find_first_not_of("0123456789") != std::string::npos) {
+        std::cerr << "Error: set threads needs a count (0 for one per core)\n";
+      } else {
+        std::cout << Execute::set_threads(std::stoul(count)) << '\n';
+      }
+      continue;
     }
 
     // END:   SHELL COMMANDS //
 
-    SQLParserResult *result = SQLParser::parseSQLString(input);
-
-    if (result->isValid()) {
-      try {
-        std::cout << Execute::execute(result) << '\n';
-      } catch (NotImplementedError &e) {
-        std::cerr << e.what() << '\n';
+    // SELECTs and INSERTs seen before run from the plan cache unparsed
+    SQLParserResult *result = nullptr;
+    try {
+      std::string output;
+      if (Execute::execute_cached(input, output)) {
+        std::cout << output << '\n';
+        continue;
       }
-    } else {
-      std::cerr << result->errorMsg() << '\n';
-      std::cerr << input << '\n';
-      for (int i = 0; i < result->errorColumn() - 1; i++) {
-        std::cerr << '.';
+      result = SQLParser::parseSQLString(input);
+      if (result->isValid()) {
+        std::cout << Execute::execute(result) << '\n';
+      } else {
+        std::cerr << result->errorMsg() << '\n';
+        std::cerr << input << '\n';
+        for (int i = 0; i < result->errorColumn() - 1; i++) {
+          std::cerr << '.';
+        }
+        std::cerr << "^ Here\n";
       }
-      std::cerr << "^ Here\n";
+    } catch (NotImplementedError &e) {
+      std::cerr << e.what() << '\n';
+    } catch (DbRelationError &e) {
+      std::cerr << "Error: " << e.what() << '\n';
     }
 
     delete result;
@@ -119,6 +160,7 @@ int main(int argc, char *argv[]) {
   _DB_ENV = &env;
 
   sqlShell();
+  Execute::close();
 
   return EXIT_SUCCESS;
 }
@@ -0,0 +1,311 @@
+#include "statistics.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <random>
+
+typedef u_int16_t u16;
+typedef u_int32_t u32;
+typedef u_int64_t u64;
+
+// BEGIN: HyperLogLog //
+
+const uint HyperLogLog::PRECISION;
+const uint HyperLogLog::REGISTERS;
+
+// FNV-1a over the value's bytes, then a final mix so every bit depends on all
+// of them (HyperLogLog reads the high bits and the leading zeros).
+static u64 hash_value(const Value &value) {
+  u64 h = 14695981039346656037ULL;
+  auto mix = [&h](const void *bytes, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+      h ^= ((const u_int8_t *)bytes)[i];
+      h *= 1099511628211ULL;
+    }
+  };
+  if (value.data_type == ColumnAttribute::INT)
+    mix(&value.n, sizeof(value.n));
+  else
+    mix(value.s.data(), value.s.size());
+  h ^= h >> 33;
+  h *= 0xff51afd7ed558ccdULL;
+  h ^= h >> 33;
+  h *= 0xc4ceb9fe1a85ec53ULL;
+  h ^= h >> 33;
+  return h;
+}
+
+// The top PRECISION bits choose a register, which keeps the longest run of
+// leading zeros (plus one) seen in the rest.
+void HyperLogLog::add(const Value &value) {
+  u64 h = hash_value(value);
+  uint index = h >> (64 - PRECISION);
+  u64 rest = h << PRECISION;
+  u_int8_t rank =
+      rest == 0 ? 64 - PRECISION + 1 : (u_int8_t)__builtin_clzll(rest) + 1;
+  this->registers[index] = std::max(this->registers[index], rank);
+}
+
+void HyperLogLog::merge(const HyperLogLog &other) {
+  for (uint i = 0; i < REGISTERS; i++)
+    this->registers[i] = std::max(this->registers[i], other.registers[i]);
+}
+
+// The harmonic mean of the registers, switching to linear counting of the
+// empty registers while few values have been seen.
+double HyperLogLog::estimate() const {
+  const double m = REGISTERS;
+  double sum = 0;
+  uint zeros = 0;
+  for (u_int8_t rank : this->registers) {
+    sum += std::ldexp(1.0, -rank);
+    zeros += rank == 0;
+  }
+  double estimate = 0.7213 / (1 + 1.079 / m) * m * m / sum;
+  if (estimate <= 2.5 * m && zeros > 0)
+    estimate = m * std::log(m / zeros);
+  return estimate;
+}
+
+// END  : HyperLogLog //
+
+// BEGIN: Histogram //
+
+const uint Histogram::BUCKETS;
+
+Histogram::Histogram(std::vector<int32_t> &values, uint buckets) : min(0) {
+  if (values.empty())
+    return;
+  std::sort(values.begin(), values.end());
+  this->min = values.front();
+  buckets = std::min<size_t>(buckets, values.size());
+  for (uint i = 1; i <= buckets; i++)
+    this->bounds.push_back(values[i * values.size() / buckets - 1]);
+}
+
+double Histogram::selectivity(const ValueRange &range) const {
+  if (empty())
+    return 1.0;
+  double lo = range.min ? range.min->n : (double)INT32_MIN;
+  double hi = range.max ? range.max->n : (double)INT32_MAX;
+  if (lo > hi)
+    return 0.0;
+  double covered = 0;
+  double bottom = this->min;
+  for (size_t i = 0; i < this->bounds.size(); i++) {
+    double top = this->bounds[i];
+    // the first bucket includes min; the rest start just above the last bound,
+    // unless they repeat it (a value common enough to fill whole buckets)
+    double start = i == 0 || top == bottom ? bottom : bottom + 1;
+    if (top >= start) {
+      double from = std::max(lo, start), to = std::min(hi, top);
+      if (from <= to)
+        covered += (to - from + 1) / (top - start + 1);
+    }
+    bottom = top;
+  }
+  return covered / this->bounds.size();
+}
+
+// END  : Histogram //
+
+// BEGIN: TableStatistics //
+
+// Little helpers for the byte layout; fields are written back to back.
+template <class T> static void put_bytes(std::string &bytes, const T &value) {
+  bytes.append((const char *)&value, sizeof(value));
+}
+
+static void put_string(std::string &bytes, const std::string &s) {
+  put_bytes(bytes, (u16)s.size());
+  bytes.append(s);
+}
+
+template <class T>
+static void get_bytes(const std::string &bytes, size_t &at, T &value) {
+  if (at + sizeof(value) > bytes.size())
+    throw DbRelationError("statistics record is cut short");
+  memcpy(&value, bytes.data() + at, sizeof(value));
+  at += sizeof(value);
+}
+
+static std::string get_string(const std::string &bytes, size_t &at) {
+  u16 size;
+  get_bytes(bytes, at, size);
+  if (at + size > bytes.size())
+    throw DbRelationError("statistics record is cut short");
+  at += size;
+  return bytes.substr(at - size, size);
+}
+
+std::string TableStatistics::marshal() const {
+  std::string bytes;
+  put_string(bytes, this->table_name);
+  put_bytes(bytes, this->row_count);
+  put_bytes(bytes, this->avg_row_width);
+  put_bytes(bytes, this->block_count);
+  put_bytes(bytes, this->blocks_sampled);
+  put_bytes(bytes, (u16)this->columns.size());
+  for (auto const &it : this->columns) {
+    put_string(bytes, it.first);
+    put_bytes(bytes, (u_int8_t)it.second.data_type);
+    put_bytes(bytes, it.second.distinct);
+    put_bytes(bytes, it.second.histogram.min);
+    put_bytes(bytes, (u16)it.second.histogram.bounds.size());
+    for (int32_t bound : it.second.histogram.bounds)
+      put_bytes(bytes, bound);
+  }
+  return bytes;
+}
+
+TableStatistics TableStatistics::unmarshal(const std::string &bytes) {
+  TableStatistics statistics;
+  size_t at = 0;
+  statistics.table_name = get_string(bytes, at);
+  get_bytes(bytes, at, statistics.row_count);
+  get_bytes(bytes, at, statistics.avg_row_width);
+  get_bytes(bytes, at, statistics.block_count);
+  get_bytes(bytes, at, statistics.blocks_sampled);
+  u16 count;
+  get_bytes(bytes, at, count);
+  for (u16 i = 0; i < count; i++) {
+    Identifier column_name = get_string(bytes, at);
+    ColumnStatistics &column = statistics.columns[column_name];
+    u_int8_t data_type;
+    get_bytes(bytes, at, data_type);
+    column.data_type = (ColumnAttribute::DataType)data_type;
+    get_bytes(bytes, at, column.distinct);
+    get_bytes(bytes, at, column.histogram.min);
+    u16 buckets;
+    get_bytes(bytes, at, buckets);
+    column.histogram.bounds.resize(buckets);
+    for (auto &bound : column.histogram.bounds)
+      get_bytes(bytes, at, bound);
+  }
+  return statistics;
+}
+
+// END  : TableStatistics //
+
+// BEGIN: analyze //
+
+// A sample only shows a lower bound on the distinct values. When nearly every
+// sampled row was distinct the column is taken to be a key and the count scaled
+// up with the rows; otherwise the sample is assumed to have seen them all.
+TableStatistics analyze(DbRelation &relation, uint sample_blocks) {
+  TableStatistics statistics;
+  statistics.table_name = relation.get_table_name();
+  const ColumnNames &column_names = relation.get_column_names();
+  const ColumnAttributes &column_attributes = relation.get_column_attributes();
+
+  BlockIDs *group_ids = relation.group_ids();
+  statistics.block_count = group_ids->size();
+  BlockIDs sample;
+  if (group_ids->size() <= sample_blocks) {
+    sample = *group_ids;
+  } else {
+    std::mt19937 random(5300); // the same sample each time for the same table
+    std::sample(group_ids->begin(), group_ids->end(),
+                std::back_inserter(sample), sample_blocks, random);
+  }
+  delete group_ids;
+  statistics.blocks_sampled = sample.size();
+
+  std::vector<HyperLogLog> sketches(column_names.size());
+  std::vector<std::vector<int32_t>> ints(column_names.size());
+  u64 rows = 0, bytes = 0;
+  ColumnBatch batch;
+  for (auto const &group_id : sample) {
+    relation.read_batch(group_id, &column_names, batch);
+    rows += batch.size();
+    for (size_t c = 0; c < batch.columns.size(); c++) {
+      const ColumnVector &vector = batch.columns[c];
+      if (vector.data_type == ColumnAttribute::INT) {
+        bytes += vector.size() * sizeof(int32_t);
+        ints[c].insert(ints[c].end(), vector.ints.begin(), vector.ints.end());
+        for (int32_t n : vector.ints)
+          sketches[c].add(Value(n));
+      } else {
+        for (auto const &s : vector.texts) {
+          bytes += sizeof(u16) + s.size();
+          sketches[c].add(Value(s));
+        }
+      }
+    }
+  }
+
+  statistics.row_count =
+      statistics.blocks_sampled == statistics.block_count
+          ? rows
+          : (u64)std::llround((double)rows * statistics.block_count /
+                              std::max<u32>(statistics.blocks_sampled, 1));
+  statistics.avg_row_width = rows == 0 ? 0 : (double)bytes / rows;
+  for (size_t c = 0; c < column_names.size(); c++) {
+    ColumnStatistics &column = statistics.columns[column_names[c]];
+    ColumnAttribute column_attribute = column_attributes[c];
+    column.data_type = column_attribute.get_data_type();
+    double distinct = std::min(sketches[c].estimate(), (double)rows);
+    if (rows > 0 && statistics.row_count > rows && distinct >= 0.95 * rows)
+      distinct *= (double)statistics.row_count / rows;
+    column.distinct = std::llround(distinct);
+    if (column.data_type == ColumnAttribute::INT)
+      column.histogram = Histogram(ints[c]);
+  }
+  return statistics;
+}
+
+// END  : analyze //
+
+// BEGIN: StatisticsFile //
+
+const char *const StatisticsFile::FILENAME = "_statistics.db";
+
+void StatisticsFile::open() {
+  if (this->db != nullptr)
+    return;
+  this->db = new Db(_DB_ENV, 0);
+  this->db->set_message_stream(_DB_ENV->get_message_stream());
+  this->db->set_error_stream(_DB_ENV->get_error_stream());
+  try {
+    this->db->open(nullptr, FILENAME, nullptr, DB_BTREE, DB_CREATE, 0644);
+  } catch (const DbException &) {
+    delete this->db;
+    this->db = nullptr;
+    throw;
+  }
+}
+
+void StatisticsFile::close() {
+  if (this->db != nullptr) {
+    this->db->close(0U);
+    delete this->db;
+    this->db = nullptr;
+  }
+}
+
+void StatisticsFile::put(const TableStatistics &statistics) {
+  open();
+  std::string bytes = statistics.marshal();
+  Dbt key((void *)statistics.table_name.data(), statistics.table_name.size());
+  Dbt data((void *)bytes.data(), bytes.size());
+  this->db->put(nullptr, &key, &data, 0U);
+}
+
+bool StatisticsFile::get(const Identifier &table_name,
+                         TableStatistics &statistics) {
+  open();
+  Dbt key((void *)table_name.data(), table_name.size()), data;
+  if (this->db->get(nullptr, &key, &data, 0U) != 0)
+    return false;
+  statistics = TableStatistics::unmarshal(
+      std::string((const char *)data.get_data(), data.get_size()));
+  return true;
+}
+
+void StatisticsFile::del(const Identifier &table_name) {
+  open();
+  Dbt key((void *)table_name.data(), table_name.size());
+  this->db->del(nullptr, &key, 0);
+}
+
+// END  : StatisticsFile //
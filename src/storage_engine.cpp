@@ -0,0 +1,47 @@
+#include "storage_engine.h"
+#include "column_storage.h"
+#include "heap_storage.h"
+#include "lsm_storage.h"
+#include "mem_storage.h"
+#include "pax_storage.h"
+
+BlockIDs *DbRelation::group_ids() { return new BlockIDs{1}; }
+
+void DbRelation::read_batch(BlockID group_id, const ColumnNames *column_names,
+                            ColumnBatch &batch) {
+  batch.clear();
+  if (group_id != 1)
+    throw DbRelationError("no such group");
+  ColumnAttributes column_attributes = get_column_attributes(*column_names);
+  for (size_t i = 0; i < column_names->size(); i++) {
+    batch.column_names.push_back((*column_names)[i]);
+    batch.columns.push_back(ColumnVector(column_attributes[i].get_data_type()));
+  }
+  Handles *handles = select();
+  for (auto const &handle : *handles) {
+    ValueDict *row = project(handle, column_names);
+    for (size_t i = 0; i < column_names->size(); i++)
+      batch.columns[i].push_back((*row)[(*column_names)[i]]);
+    delete row;
+    batch.handles.push_back(handle);
+  }
+  delete handles;
+}
+
+DbRelation *new_relation(Identifier table_name, ColumnNames column_names,
+                         ColumnAttributes column_attributes,
+                         TableOptions options) {
+  switch (options.engine) {
+  case TableOptions::COLUMN:
+    return new ColumnTable(table_name, column_names, column_attributes);
+  case TableOptions::PAX:
+    return new PaxTable(table_name, column_names, column_attributes);
+  case TableOptions::MEMORY:
+    return new MemTable(table_name, column_names, column_attributes);
+  case TableOptions::LSM:
+    return new LsmTable(table_name, column_names, column_attributes, options);
+  case TableOptions::HEAP:
+  default:
+    return new HeapTable(table_name, column_names, column_attributes, options);
+  }
+}
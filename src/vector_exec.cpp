@@ -0,0 +1,330 @@
+#include "vector_exec.h"
+#include <algorithm>
+#include <utility>
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+typedef u_int16_t u16;
+typedef u_int32_t u32;
+
+// BEGIN: IntKernels //
+
+// Branch-free selection: every position is written and the count only moves
+// on for matches, so there's no branch to mispredict.
+template <class Test>
+static uint select_scalar(const int32_t *values, uint n, u16 *selection,
+                          Test test) {
+  uint count = 0;
+  for (uint i = 0; i < n; i++) {
+    selection[count] = i;
+    count += test(values[i]);
+  }
+  return count;
+}
+
+template <class Test>
+static uint refine_scalar(const int32_t *values, u16 *selection, uint n,
+                          Test test) {
+  uint count = 0;
+  for (uint i = 0; i < n; i++) {
+    u16 position = selection[i];
+    selection[count] = position;
+    count += test(values[position]);
+  }
+  return count;
+}
+
+#ifdef __AVX2__
+// Compare 8 values at a time, then write out the positions of the set bits of
+// the resulting mask.
+static uint select_avx2(IntKernels::Compare op, const int32_t *values,
+                        int32_t constant, uint n, u16 *selection) {
+  const __m256i c = _mm256_set1_epi32(constant);
+  uint count = 0, i = 0;
+  for (; i + 8 <= n; i += 8) {
+    __m256i v = _mm256_loadu_si256((const __m256i *)(values + i));
+    __m256i m;
+    bool negate = false;
+    switch (op) {
+    case IntKernels::EQ:
+    case IntKernels::NE:
+      m = _mm256_cmpeq_epi32(v, c);
+      negate = op == IntKernels::NE;
+      break;
+    case IntKernels::GT:
+    case IntKernels::LE:
+      m = _mm256_cmpgt_epi32(v, c);
+      negate = op == IntKernels::LE;
+      break;
+    default: // LT, GE
+      m = _mm256_cmpgt_epi32(c, v);
+      negate = op == IntKernels::GE;
+      break;
+    }
+    uint mask = _mm256_movemask_ps(_mm256_castsi256_ps(m));
+    if (negate)
+      mask ^= 0xFF;
+    while (mask != 0) {
+      selection[count++] = i + __builtin_ctz(mask);
+      mask &= mask - 1;
+    }
+  }
+  // the last few values go through the scalar loop
+  uint tail = IntKernels::select(op, values + i, constant, n - i,
+                                 selection + count);
+  for (uint k = count; k < count + tail; k++)
+    selection[k] += i;
+  count += tail;
+  return count;
+}
+#endif
+
+uint IntKernels::select(Compare op, const int32_t *values, int32_t constant,
+                        uint n, u16 *selection) {
+#ifdef __AVX2__
+  if (n >= 8)
+    return select_avx2(op, values, constant, n, selection);
+#endif
+  switch (op) {
+  case EQ:
+    return select_scalar(values, n, selection,
+                         [constant](int32_t v) { return v == constant; });
+  case NE:
+    return select_scalar(values, n, selection,
+                         [constant](int32_t v) { return v != constant; });
+  case LT:
+    return select_scalar(values, n, selection,
+                         [constant](int32_t v) { return v < constant; });
+  case LE:
+    return select_scalar(values, n, selection,
+                         [constant](int32_t v) { return v <= constant; });
+  case GT:
+    return select_scalar(values, n, selection,
+                         [constant](int32_t v) { return v > constant; });
+  case GE:
+    return select_scalar(values, n, selection,
+                         [constant](int32_t v) { return v >= constant; });
+  }
+  return 0;
+}
+
+// Selected rows are scattered, so this is a gather; it stays scalar.
+uint IntKernels::refine(Compare op, const int32_t *values, int32_t constant,
+                        u16 *selection, uint n) {
+  switch (op) {
+  case EQ:
+    return refine_scalar(values, selection, n,
+                         [constant](int32_t v) { return v == constant; });
+  case NE:
+    return refine_scalar(values, selection, n,
+                         [constant](int32_t v) { return v != constant; });
+  case LT:
+    return refine_scalar(values, selection, n,
+                         [constant](int32_t v) { return v < constant; });
+  case LE:
+    return refine_scalar(values, selection, n,
+                         [constant](int32_t v) { return v <= constant; });
+  case GT:
+    return refine_scalar(values, selection, n,
+                         [constant](int32_t v) { return v > constant; });
+  case GE:
+    return refine_scalar(values, selection, n,
+                         [constant](int32_t v) { return v >= constant; });
+  }
+  return 0;
+}
+
+// Done in unsigned arithmetic so overflow wraps instead of being undefined.
+void IntKernels::compute(Arithmetic op, const int32_t *left,
+                         const int32_t *right, int32_t *result, uint n) {
+  switch (op) {
+  case ADD:
+    for (uint i = 0; i < n; i++)
+      result[i] = (int32_t)((u32)left[i] + (u32)right[i]);
+    break;
+  case SUB:
+    for (uint i = 0; i < n; i++)
+      result[i] = (int32_t)((u32)left[i] - (u32)right[i]);
+    break;
+  case MUL:
+    for (uint i = 0; i < n; i++)
+      result[i] = (int32_t)((u32)left[i] * (u32)right[i]);
+    break;
+  }
+}
+
+void IntKernels::compute(Arithmetic op, const int32_t *left, int32_t constant,
+                         int32_t *result, uint n) {
+  u32 c = (u32)constant;
+  switch (op) {
+  case ADD:
+    for (uint i = 0; i < n; i++)
+      result[i] = (int32_t)((u32)left[i] + c);
+    break;
+  case SUB:
+    for (uint i = 0; i < n; i++)
+      result[i] = (int32_t)((u32)left[i] - c);
+    break;
+  case MUL:
+    for (uint i = 0; i < n; i++)
+      result[i] = (int32_t)((u32)left[i] * c);
+    break;
+  }
+}
+
+int64_t IntKernels::sum(const int32_t *values, uint n) {
+  int64_t total = 0;
+  for (uint i = 0; i < n; i++)
+    total += values[i];
+  return total;
+}
+
+int64_t IntKernels::sum(const int32_t *values, const u16 *selection, uint n) {
+  int64_t total = 0;
+  for (uint i = 0; i < n; i++)
+    total += values[selection[i]];
+  return total;
+}
+
+// END  : IntKernels //
+
+// BEGIN: VectorBatch //
+
+const uint VectorBatch::CAPACITY;
+
+uint VectorBatch::column_index(const Identifier &column_name) const {
+  for (size_t i = 0; i < this->data.column_names.size(); i++)
+    if (this->data.column_names[i] == column_name)
+      return i;
+  throw DbRelationError("unknown column " + column_name);
+}
+
+const int32_t *VectorBatch::ints(const Identifier &column_name) const {
+  const ColumnVector &vector = this->data.columns[column_index(column_name)];
+  if (vector.data_type != ColumnAttribute::INT)
+    throw DbRelationError(column_name + " is not an INT column");
+  return vector.ints.data();
+}
+
+int64_t VectorBatch::sum(const Identifier &column_name) const {
+  const int32_t *values = ints(column_name);
+  if (this->filtered)
+    return IntKernels::sum(values, this->selection.data(),
+                           this->selection.size());
+  return IntKernels::sum(values, this->data.size());
+}
+
+// END  : VectorBatch //
+
+// BEGIN: VectorScan //
+
+VectorScan::VectorScan(DbRelation *relation, const ColumnNames &column_names)
+    : relation(relation), column_names(column_names), group_ids(nullptr),
+      next_group(0), next_row(0) {
+  this->group_ids = relation->group_ids();
+}
+
+VectorScan::~VectorScan() { delete this->group_ids; }
+
+// A group that fits is swapped into the batch whole; a bigger one is handed out
+// CAPACITY rows at a time.
+bool VectorScan::next(VectorBatch &batch) {
+  batch.clear();
+  while (this->next_row >= this->group.size()) {
+    if (this->next_group >= this->group_ids->size())
+      return false;
+    this->relation->read_batch((*this->group_ids)[this->next_group++],
+                               &this->column_names, this->group);
+    this->next_row = 0;
+    if (this->group.size() <= VectorBatch::CAPACITY &&
+        this->group.size() > 0) {
+      std::swap(batch.data, this->group);
+      this->group.clear();
+      return true;
+    }
+  }
+
+  size_t begin = this->next_row;
+  size_t end = std::min(begin + VectorBatch::CAPACITY, this->group.size());
+  this->next_row = end;
+  batch.data.handles.assign(this->group.handles.begin() + begin,
+                            this->group.handles.begin() + end);
+  batch.data.column_names = this->group.column_names;
+  for (auto const &vector : this->group.columns) {
+    ColumnVector slice(vector.data_type);
+    if (vector.data_type == ColumnAttribute::INT)
+      slice.ints.assign(vector.ints.begin() + begin, vector.ints.begin() + end);
+    else
+      slice.texts.assign(vector.texts.begin() + begin,
+                         vector.texts.begin() + end);
+    batch.data.columns.push_back(slice);
+  }
+  return true;
+}
+
+// END  : VectorScan //
+
+// BEGIN: VectorFilter //
+
+VectorFilter::VectorFilter(VectorOperator *input, const Identifier &column_name,
+                           IntKernels::Compare op, int32_t constant)
+    : input(input), column_name(column_name), op(op), constant(constant) {}
+
+// Batches the filter empties are skipped rather than passed on.
+bool VectorFilter::next(VectorBatch &batch) {
+  while (this->input->next(batch)) {
+    const int32_t *values = batch.ints(this->column_name);
+    uint count;
+    if (batch.filtered) {
+      count = IntKernels::refine(this->op, values, this->constant,
+                                 batch.selection.data(), batch.selection.size());
+    } else {
+      batch.selection.resize(batch.data.size());
+      count = IntKernels::select(this->op, values, this->constant,
+                                 batch.data.size(), batch.selection.data());
+      batch.filtered = true;
+    }
+    batch.selection.resize(count);
+    if (count > 0)
+      return true;
+  }
+  return false;
+}
+
+// END  : VectorFilter //
+
+// BEGIN: VectorCompute //
+
+VectorCompute::VectorCompute(VectorOperator *input, const Identifier &result,
+                             const Identifier &left, IntKernels::Arithmetic op,
+                             const Identifier &right)
+    : input(input), result(result), left(left), op(op), right(right),
+      constant(0) {}
+
+VectorCompute::VectorCompute(VectorOperator *input, const Identifier &result,
+                             const Identifier &left, IntKernels::Arithmetic op,
+                             int32_t constant)
+    : input(input), result(result), left(left), op(op), right(),
+      constant(constant) {}
+
+// Every row is computed, selected or not: a dense pass vectorizes and costs
+// less than skipping about.
+bool VectorCompute::next(VectorBatch &batch) {
+  if (!this->input->next(batch))
+    return false;
+  ColumnVector computed(ColumnAttribute::INT);
+  computed.ints.resize(batch.data.size());
+  const int32_t *left = batch.ints(this->left);
+  if (this->right.empty())
+    IntKernels::compute(this->op, left, this->constant, computed.ints.data(),
+                        batch.data.size());
+  else
+    IntKernels::compute(this->op, left, batch.ints(this->right),
+                        computed.ints.data(), batch.data.size());
+  batch.data.column_names.push_back(this->result);
+  batch.data.columns.push_back(computed);
+  return true;
+}
+
+// END  : VectorCompute //
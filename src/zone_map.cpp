@@ -0,0 +1,142 @@
+#include "zone_map.h"
+#include <climits>
+
+ZoneMap::ZoneMap(Identifier table_name, const ColumnNames &column_names,
+                 const ColumnAttributes &column_attributes)
+    : dbfilename(table_name + ".zone.db"), db(nullptr) {
+  for (size_t i = 0; i < column_names.size(); i++) {
+    ColumnAttribute ca = column_attributes[i];
+    if (ca.get_data_type() == ColumnAttribute::INT) {
+      this->slots.push_back((int)this->summarized.size());
+      this->summarized.push_back(column_names[i]);
+    } else {
+      this->slots.push_back(-1);
+    }
+  }
+}
+
+ZoneMap::~ZoneMap() { close(); }
+
+void ZoneMap::create() {
+  if (this->summarized.empty())
+    return;
+  db_open(DB_CREATE | DB_EXCL);
+  this->zones.clear();
+}
+
+void ZoneMap::drop() {
+  close();
+  if (this->summarized.empty())
+    return;
+  try {
+    Db(_DB_ENV, 0).remove(this->dbfilename.c_str(), nullptr, 0);
+  } catch (const DbException &) {
+    // never created
+  }
+}
+
+void ZoneMap::open() {
+  if (this->db == nullptr && !this->summarized.empty()) {
+    db_open();
+    load();
+  }
+}
+
+void ZoneMap::close() {
+  if (this->db != nullptr) {
+    this->db->close(0U);
+    delete this->db;
+    this->db = nullptr;
+  }
+  this->zones.clear();
+}
+
+void ZoneMap::widen(BlockID block_id, const ValueDict *row) {
+  if (this->summarized.empty())
+    return;
+  // blocks that never got a row of their own summarize nothing
+  BlockID first_new = (BlockID)this->zones.size() + 1;
+  while (this->zones.size() < block_id)
+    this->zones.push_back(std::vector<Zone>(this->summarized.size(),
+                                            Zone(INT32_MAX, INT32_MIN)));
+
+  std::vector<Zone> &zone = this->zones[block_id - 1];
+  bool changed = false;
+  for (size_t i = 0; i < this->summarized.size(); i++) {
+    int32_t n = row->at(this->summarized[i]).n;
+    if (n < zone[i].first) {
+      zone[i].first = n;
+      changed = true;
+    }
+    if (n > zone[i].second) {
+      zone[i].second = n;
+      changed = true;
+    }
+  }
+  for (BlockID id = first_new; id < block_id; id++)
+    save(id);
+  if (changed)
+    save(block_id);
+}
+
+bool ZoneMap::may_contain(BlockID block_id, uint column,
+                          const ValueRange &range) const {
+  if (column >= this->slots.size() || this->slots[column] < 0 ||
+      block_id > this->zones.size())
+    return true;
+  const Zone &zone = this->zones[block_id - 1][this->slots[column]];
+  if (zone.first > zone.second)
+    return false;
+  return !(range.min && zone.second < range.min->n) &&
+         !(range.max && range.max->n < zone.first);
+}
+
+void ZoneMap::db_open(uint flags) {
+  this->db = new Db(_DB_ENV, 0);
+  this->db->set_message_stream(_DB_ENV->get_message_stream());
+  this->db->set_error_stream(_DB_ENV->get_error_stream());
+  this->db->set_re_len(this->summarized.size() * sizeof(int32_t) * 2);
+  try {
+    this->db->open(nullptr, this->dbfilename.c_str(), nullptr, DB_RECNO, flags,
+                   0644);
+  } catch (const DbException &) {
+    delete this->db;
+    this->db = nullptr;
+    throw;
+  }
+}
+
+// Read every block's zone into memory. Zones are written densely from block 1
+// on, so the record count is the number of blocks summarized.
+void ZoneMap::load() {
+  DB_BTREE_STAT *stat;
+  this->db->stat(nullptr, &stat, DB_FAST_STAT);
+  BlockID count = stat->bt_ndata;
+  free(stat);
+
+  this->zones.clear();
+  this->zones.reserve(count);
+  for (BlockID block_id = 1; block_id <= count; block_id++) {
+    Dbt key(&block_id, sizeof(block_id)), data;
+    // a record we can't read might summarize anything
+    std::vector<Zone> zone(this->summarized.size(), Zone(INT32_MIN, INT32_MAX));
+    if (this->db->get(nullptr, &key, &data, 0U) == 0) {
+      const int32_t *bounds = (const int32_t *)data.get_data();
+      for (size_t i = 0; i < zone.size(); i++)
+        zone[i] = Zone(bounds[2 * i], bounds[2 * i + 1]);
+    }
+    this->zones.push_back(zone);
+  }
+}
+
+void ZoneMap::save(BlockID block_id) {
+  std::vector<Zone> &zone = this->zones[block_id - 1];
+  std::vector<int32_t> bounds;
+  for (auto const &it : zone) {
+    bounds.push_back(it.first);
+    bounds.push_back(it.second);
+  }
+  Dbt key(&block_id, sizeof(block_id));
+  Dbt data(bounds.data(), bounds.size() * sizeof(int32_t));
+  this->db->put(nullptr, &key, &data, 0U);
+}
@@ -0,0 +1,161 @@
+#include "Execute.h"
+#include <gtest/gtest.h>
+
+/**
+ * Runs statements through Execute, and opens up its catalog to the tests.
+ * Each test starts with no catalog and leaves none behind.
+ */
+class ExecuteTest : public testing::Test {
+protected:
+  void TearDown() override {
+    Execute::close();
+    Tables tables;
+    tables.open();
+    tables.drop();
+  }
+
+  static Tables &catalog() { return Execute::catalog(); }
+
+  static std::string execute(const std::string &sql) {
+    hsql::SQLParserResult *result = hsql::SQLParser::parseSQLString(sql);
+    EXPECT_TRUE(result->isValid()) << sql;
+    std::string output;
+    try {
+      output = Execute::execute(result);
+    } catch (...) {
+      delete result;
+      throw;
+    }
+    delete result;
+    return output;
+  }
+
+  static std::string cached(const std::string &sql) {
+    std::string output;
+    EXPECT_TRUE(Execute::execute_cached(sql, output)) << sql;
+    return output;
+  }
+};
+
+/**
+ * @tests statements that differ only in their literals and spacing share a
+ * plan, other literal types and LIMIT counts get plans of their own, and
+ * text that can't be normalized isn't cached at all
+ */
+TEST_F(ExecuteTest, LiteralsTakenOut) {
+  execute("CREATE TABLE _test_cache_a (id INT, name TEXT)");
+  size_t plans = Execute::get_cached_plans();
+  size_t hits = Execute::get_plan_hits();
+  cached("INSERT INTO _test_cache_a VALUES (1, 'one')");
+  ASSERT_EQ(Execute::get_cached_plans(), plans + 1);
+  cached("INSERT   INTO _test_cache_a\nVALUES (2, 'two');");
+  ASSERT_EQ(Execute::get_plan_hits(), hits + 1);
+  ASSERT_THROW(cached("INSERT INTO _test_cache_a VALUES ('3', 'three')"),
+               DbRelationError);
+  ASSERT_EQ(Execute::get_cached_plans(), plans + 1);
+
+  std::string output = cached("SELECT * FROM _test_cache_a WHERE id = 2");
+  ASSERT_NE(output.find("\"two\""), std::string::npos);
+  output = cached("SELECT * FROM _test_cache_a WHERE id = 1");
+  ASSERT_NE(output.find("\"one\""), std::string::npos);
+  ASSERT_EQ(output.find("\"two\""), std::string::npos);
+  ASSERT_EQ(Execute::get_plan_hits(), hits + 2);
+  cached("SELECT * FROM _test_cache_a LIMIT 1");
+  cached("SELECT * FROM _test_cache_a LIMIT 2");
+  ASSERT_EQ(Execute::get_plan_hits(), hits + 2);
+  ASSERT_EQ(Execute::get_cached_plans(), plans + 4);
+
+  for (const char *sql : {"SELECT * FROM _test_cache_a WHERE id = 1.5",
+                          "SELECT * FROM _test_cache_a WHERE id = ?",
+                          "SELECT * FROM _test_cache_a -- all of it",
+                          "SELECT * FROM _test_cache_a WHERE name = 'one",
+                          "DROP TABLE _test_cache_a"}) {
+    ASSERT_FALSE(Execute::execute_cached(sql, output)) << sql;
+  }
+  execute("DROP TABLE _test_cache_a");
+}
+
+/**
+ * @tests a cached plan gives its tables back between runs, so the catalog
+ * can close them, and is planned again once it has
+ */
+TEST_F(ExecuteTest, TablesGivenBack) {
+  execute("CREATE TABLE _test_cache_b (id INT, name TEXT)");
+  execute("CREATE TABLE _test_cache_c (id INT, name TEXT)");
+  cached("INSERT INTO _test_cache_b VALUES (1, 'b1')");
+  cached("INSERT INTO _test_cache_c VALUES (1, 'c1')");
+  catalog().set_max_open(1);
+  ASSERT_EQ(catalog().cached(), 1u);
+
+  size_t hits = Execute::get_plan_hits();
+  cached("SELECT * FROM _test_cache_b WHERE id = 2");
+  std::string output = cached("SELECT * FROM _test_cache_b WHERE id = 1");
+  ASSERT_NE(output.find("\"b1\""), std::string::npos);
+  ASSERT_EQ(Execute::get_plan_hits(), hits + 1);
+  ASSERT_EQ(catalog().cached(), 1u);
+
+  // c takes b's place, and b's plans go with it
+  output = cached("SELECT * FROM _test_cache_c WHERE id = 1");
+  ASSERT_NE(output.find("\"c1\""), std::string::npos);
+  ASSERT_EQ(catalog().cached(), 1u);
+  output = cached("SELECT * FROM _test_cache_b WHERE id = 1");
+  ASSERT_NE(output.find("\"b1\""), std::string::npos);
+  ASSERT_EQ(Execute::get_plan_hits(), hits + 1);
+  ASSERT_EQ(catalog().cached(), 1u);
+
+  execute("DROP TABLE _test_cache_b");
+  execute("DROP TABLE _test_cache_c");
+}
+
+/**
+ * @tests dropping a table forgets the plans that use it, so they aren't run
+ * against a table that's gone
+ */
+TEST_F(ExecuteTest, DropForgetsPlans) {
+  execute("CREATE TABLE _test_cache_d (id INT, name TEXT)");
+  execute("CREATE TABLE _test_cache_e (id INT)");
+  cached("INSERT INTO _test_cache_d VALUES (1, 'one')");
+  cached("SELECT * FROM _test_cache_d WHERE id = 1");
+  cached("SELECT * FROM _test_cache_e WHERE id = 1");
+  size_t plans = Execute::get_cached_plans();
+  size_t hits = Execute::get_plan_hits();
+
+  execute("DROP TABLE _test_cache_d");
+  ASSERT_EQ(Execute::get_cached_plans(), plans - 2);
+  std::string output;
+  ASSERT_THROW(Execute::execute_cached(
+                   "SELECT * FROM _test_cache_d WHERE id = 1", output),
+               DbRelationError);
+  cached("SELECT * FROM _test_cache_e WHERE id = 2");
+  ASSERT_EQ(Execute::get_plan_hits(), hits + 1);
+  execute("DROP TABLE _test_cache_e");
+}
+
+/**
+ * @tests a GROUP BY planned after set_threads() pre-aggregates batches on that
+ * many threads and merges their groups, giving what one thread gives
+ */
+TEST_F(ExecuteTest, GroupByOnThreads) {
+  execute("CREATE TABLE _test_group_by (id INT, grp INT)");
+  // enough rows for a batch to be shared out between two threads
+  const int rows = 2 * HashAggregate::BATCH_ROWS + 100;
+  for (int i = 0; i < rows; i++)
+    cached("INSERT INTO _test_group_by VALUES (" + std::to_string(i) + ", " +
+           std::to_string(i % 5) + ")");
+  const std::string sql =
+      "SELECT grp, COUNT(*), SUM(id) FROM _test_group_by GROUP BY grp";
+  Execute::set_threads(1);
+  std::string one = execute(sql);
+  Execute::set_threads(2);
+  std::string two = execute(sql);
+  Execute::set_threads(0);
+  for (int grp = 0; grp < 5; grp++) {
+    int64_t count = (rows - grp + 4) / 5;
+    int64_t sum = count * grp + 5 * count * (count - 1) / 2;
+    std::string line = std::to_string(grp) + " " + std::to_string(count) +
+                       " " + std::to_string(sum);
+    ASSERT_NE(one.find(line + " \n"), std::string::npos) << line;
+    ASSERT_NE(two.find(line + " \n"), std::string::npos) << line;
+  }
+  execute("DROP TABLE _test_group_by");
+}
@@ -0,0 +1,202 @@
+#include "bitmap_index.h"
+#include "heap_storage.h"
+#include <gtest/gtest.h>
+#include <set>
+
+/**
+ * @tests Bitmap AND, OR and AND NOT across array and bitmap containers
+ */
+TEST(BitmapTest, SetOperations) {
+  Bitmap evens, threes;
+  std::set<Bitmap::Position> expected_and, expected_or, expected_not;
+  // dense enough in the first container to turn it into a bitmap
+  for (Bitmap::Position p = 0; p < 200000; p += 2)
+    evens.add(p);
+  for (Bitmap::Position p = 0; p < 200000; p += 3)
+    threes.add(p);
+  for (Bitmap::Position p = 0; p < 200000; p++) {
+    bool even = p % 2 == 0, three = p % 3 == 0;
+    if (even && three)
+      expected_and.insert(p);
+    if (even || three)
+      expected_or.insert(p);
+    if (even && !three)
+      expected_not.insert(p);
+  }
+  ASSERT_EQ(evens.cardinality(), 100000u);
+
+  Bitmap both = evens, either = evens, only = evens;
+  both &= threes;
+  either |= threes;
+  only -= threes;
+  ASSERT_EQ(both.cardinality(), expected_and.size());
+  ASSERT_EQ(either.cardinality(), expected_or.size());
+  ASSERT_EQ(only.cardinality(), expected_not.size());
+  for (Bitmap::Position p = 0; p < 200000; p += 997) {
+    ASSERT_EQ(both.contains(p), expected_and.count(p) == 1);
+    ASSERT_EQ(either.contains(p), expected_or.count(p) == 1);
+    ASSERT_EQ(only.contains(p), expected_not.count(p) == 1);
+  }
+
+  // sparse against dense
+  Bitmap few;
+  few.add(6);
+  few.add(7);
+  few.add(150001);
+  few &= evens;
+  ASSERT_EQ(few.cardinality(), 1u);
+  ASSERT_TRUE(few.contains(6));
+
+  // thinning a bitmap container back to an array keeps its members
+  for (Bitmap::Position p = 0; p < 65536; p += 2)
+    if (p % 1000 != 0)
+      evens.remove(p);
+  ASSERT_TRUE(evens.contains(2000));
+  ASSERT_FALSE(evens.contains(2002));
+}
+
+/**
+ * @tests Bitmap packs handles into positions in heap order
+ */
+TEST(BitmapTest, Handles) {
+  Bitmap rows;
+  rows.add(Bitmap::position(Handle(70, 3)));
+  rows.add(Bitmap::position(Handle(2, 400)));
+  rows.add(Bitmap::position(Handle(2, 1)));
+  Handles *handles = rows.handles();
+  ASSERT_EQ(*handles,
+            (Handles{Handle(2, 1), Handle(2, 400), Handle(70, 3)}));
+  delete handles;
+  ASSERT_THROW(Bitmap::position(Handle(1, 1 << Bitmap::RECORD_BITS)),
+               DbRelationError);
+}
+
+class BitmapIndexTest : public testing::Test {
+protected:
+  void SetUp() override {
+    table = new HeapTable(
+        testing::UnitTest::GetInstance()->current_test_info()->name(),
+        {"id", "status", "flag"},
+        {ColumnAttribute(ColumnAttribute::INT),
+         ColumnAttribute(ColumnAttribute::TEXT),
+         ColumnAttribute(ColumnAttribute::INT)});
+    table->create();
+    const char *statuses[] = {"new", "open", "closed"};
+    for (int32_t i = 0; i < 3000; i++) {
+      ValueDict row;
+      row["id"] = Value(i);
+      row["status"] = Value(statuses[i % 3]);
+      row["flag"] = Value(i % 2);
+      added.push_back(table->insert(&row));
+    }
+  }
+
+  void TearDown() override {
+    table->drop();
+    delete table;
+  }
+
+  HeapTable *table;
+  Handles added;
+};
+
+/**
+ * @tests BitmapIndex lookups, maintenance and persistence
+ */
+TEST_F(BitmapIndexTest, LookupAndMaintain) {
+  BitmapIndex index(*table, "status_ix", {"status"});
+  index.create();
+  ASSERT_EQ(index.get_key_count(), 3u);
+
+  ValueDict key;
+  key["status"] = Value("open");
+  Handles *handles = index.lookup(&key);
+  ASSERT_EQ(handles->size(), 1000u);
+  ASSERT_EQ((*handles)[0], added[1]);
+  delete handles;
+
+  table->add_index(&index);
+  ValueDict change;
+  change["status"] = Value("open");
+  table->update(added[0], &change);
+  table->del(added[4]);
+  ASSERT_EQ(index.lookup_bitmap(&key).cardinality(), 1000u);
+
+  index.close();
+  index.open();
+  ASSERT_EQ(index.lookup_bitmap(&key).cardinality(), 1000u);
+  ASSERT_EQ(index.universe().cardinality(), 2999u);
+  key["status"] = Value("gone");
+  handles = index.lookup(&key);
+  ASSERT_TRUE(handles->empty());
+  delete handles;
+
+  table->remove_index(&index);
+  index.drop();
+}
+
+/**
+ * @tests HeapTable::select(where) intersects bitmap indexes without scanning;
+ * NOT through BitmapIndex::universe
+ */
+TEST_F(BitmapIndexTest, CombinePredicates) {
+  BitmapIndex status(*table, "status_ix", {"status"});
+  BitmapIndex flag(*table, "flag_ix", {"flag"});
+  status.create();
+  flag.create();
+  table->add_index(&status);
+  table->add_index(&flag);
+
+  ValueDict where;
+  where["status"] = Value("closed");
+  where["flag"] = Value(1);
+  Handles *handles = table->select(&where);
+  ASSERT_EQ(handles->size(), 500u); // i % 6 == 5
+  ASSERT_EQ(table->get_scan_stats().blocks_read, 0u);
+  for (auto const &handle : *handles) {
+    ValueDict *row = table->project(handle);
+    ASSERT_EQ((*row)["id"].n % 6, 5);
+    delete row;
+  }
+  delete handles;
+
+  // residual predicate on a column without a bitmap
+  where["id"] = Value(11);
+  handles = table->select(&where);
+  ASSERT_EQ(*handles, Handles{added[11]});
+  delete handles;
+
+  // status = 'new' OR NOT flag = 1
+  ValueDict key;
+  key["status"] = Value("new");
+  Bitmap rows = status.lookup_bitmap(&key);
+  key.clear();
+  key["flag"] = Value(1);
+  Bitmap not_flagged = flag.universe();
+  not_flagged -= flag.lookup_bitmap(&key);
+  rows |= not_flagged;
+  ASSERT_EQ(rows.cardinality(), 2000u); // i % 3 == 0 or i even
+
+  table->remove_index(&status);
+  table->remove_index(&flag);
+  status.drop();
+  flag.drop();
+}
+
+/**
+ * @tests BitmapIndex rejects duplicates when unique
+ */
+TEST_F(BitmapIndexTest, Unique) {
+  BitmapIndex id(*table, "id_ix", {"id"}, true);
+  id.create();
+  table->add_index(&id);
+  ValueDict row;
+  row["id"] = Value(7);
+  row["status"] = Value("new");
+  row["flag"] = Value(0);
+  ASSERT_THROW(table->insert(&row), DbRelationError);
+  BitmapIndex status(*table, "status_ix", {"status"}, true);
+  ASSERT_THROW(status.create(), DbRelationError);
+  table->remove_index(&id);
+  id.drop();
+}
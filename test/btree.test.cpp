@@ -0,0 +1,142 @@
+#include "btree.h"
+#include "heap_storage.h"
+#include <algorithm>
+#include <gtest/gtest.h>
+#include <string>
+
+class BTreeIndexTest : public testing::Test {
+protected:
+  void SetUp() override {
+    table = new HeapTable(
+        testing::UnitTest::GetInstance()->current_test_info()->name(),
+        {"ts", "tag"},
+        {ColumnAttribute(ColumnAttribute::INT),
+         ColumnAttribute(ColumnAttribute::TEXT)});
+    table->create();
+  }
+
+  void TearDown() override {
+    table->drop();
+    delete table;
+  }
+
+  Handle insert(int32_t ts, std::string tag) {
+    ValueDict row;
+    row["ts"] = Value(ts);
+    row["tag"] = Value(tag);
+    return table->insert(&row);
+  }
+
+  std::vector<int32_t> ts_of(const Handles *handles) {
+    std::vector<int32_t> result;
+    for (auto const &handle : *handles) {
+      ValueDict *row = table->project(handle);
+      result.push_back(row->at("ts").n);
+      delete row;
+    }
+    return result;
+  }
+
+  HeapTable *table;
+};
+
+/**
+ * @tests BTreeIndex::create bulk builds a multi-level tree over existing rows
+ */
+TEST_F(BTreeIndexTest, BulkBuildAndRange) {
+  // insert out of order so the table order differs from key order
+  for (int32_t i = 0; i < 3000; i++)
+    insert((i * 7919) % 3000, "t" + std::to_string(i % 10));
+  BTreeIndex index(*table, "ts_ix", {"ts"});
+  index.create();
+  ASSERT_GE(index.get_height(), 2u);
+
+  ValueDict min, max;
+  min["ts"] = Value(100);
+  max["ts"] = Value(199);
+  Handles *handles = index.range(&min, &max);
+  std::vector<int32_t> got = ts_of(handles);
+  ASSERT_EQ(got.size(), 100u);
+  ASSERT_TRUE(std::is_sorted(got.begin(), got.end()));
+  ASSERT_EQ(got.front(), 100);
+  delete handles;
+
+  // open-ended
+  handles = index.range(&min, nullptr);
+  ASSERT_EQ(handles->size(), 2900u);
+  delete handles;
+  index.drop();
+}
+
+/**
+ * @tests BTreeIndex::insert splits nodes; BTreeIndex::del; TEXT keys
+ */
+TEST_F(BTreeIndexTest, InsertSplitsAndDelete) {
+  BTreeIndex index(*table, "tag_ix", {"tag", "ts"});
+  index.create();
+  Handles added;
+  for (int32_t i = 0; i < 2000; i++)
+    added.push_back(insert(i, "tag" + std::to_string(i % 3)));
+  for (auto const &handle : added)
+    index.insert(handle);
+  ASSERT_GE(index.get_height(), 2u);
+
+  ValueDict key;
+  key["tag"] = Value("tag1");
+  Handles *handles = index.lookup(&key);
+  std::vector<int32_t> got = ts_of(handles);
+  ASSERT_EQ(got.size(), 667u);
+  ASSERT_TRUE(std::is_sorted(got.begin(), got.end()));
+  delete handles;
+
+  index.del(added[1]);
+  index.del(added[4]);
+  handles = index.lookup(&key);
+  ASSERT_EQ(handles->size(), 665u);
+  delete handles;
+
+  key["ts"] = Value(7);
+  handles = index.lookup(&key);
+  ASSERT_EQ(*handles, Handles{added[7]});
+  delete handles;
+  index.drop();
+}
+
+/**
+ * @tests HeapTable::select_range, select_ordered with and without an index
+ */
+TEST_F(BTreeIndexTest, TableRangeAndOrder) {
+  for (int32_t i = 0; i < 500; i++)
+    insert((i * 37) % 500, i % 2 ? "odd" : "even");
+  RangeDict where;
+  where["ts"] = ValueRange(Value(10), Value(19));
+  where["tag"] = ValueRange(Value("odd"), Value("odd"));
+
+  Handles *scanned = table->select_range(&where);
+  Handles *sorted = table->select_ordered("ts", &where);
+  std::vector<int32_t> expected = ts_of(sorted);
+  ASSERT_EQ(scanned->size(), 5u);
+  ASSERT_EQ(expected.size(), 5u);
+  ASSERT_TRUE(std::is_sorted(expected.begin(), expected.end()));
+
+  BTreeIndex index(*table, "ts_ix", {"ts"});
+  index.create();
+  table->add_index(&index);
+  Handles *indexed = table->select_ordered("ts", &where);
+  ASSERT_EQ(ts_of(indexed), expected);
+  Handles *ranged = table->select_range(&where);
+  ASSERT_EQ(ranged->size(), 5u);
+
+  // the table keeps the index current
+  insert(15, "odd");
+  delete indexed;
+  indexed = table->select_ordered("ts", &where);
+  ASSERT_EQ(indexed->size(), 6u);
+
+  table->remove_index(&index);
+  index.drop();
+  delete scanned;
+  delete sorted;
+  delete indexed;
+  delete ranged;
+}
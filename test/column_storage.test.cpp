@@ -0,0 +1,145 @@
+#include "column_storage.h"
+#include "not_impl.h"
+#include <gtest/gtest.h>
+#include <memory>
+
+/**
+ * @tests ColumnBlock stores INT and TEXT values by type
+ */
+TEST(ColumnBlockTest, AddGet) {
+  char ints_bytes[DbBlock::BLOCK_SZ], texts_bytes[DbBlock::BLOCK_SZ];
+  Dbt ints_block(ints_bytes, sizeof(ints_bytes));
+  Dbt texts_block(texts_bytes, sizeof(texts_bytes));
+  ColumnBlock ints(ints_block, 1, ColumnAttribute::INT, true);
+  ColumnBlock texts(texts_block, 1, ColumnAttribute::TEXT, true);
+
+  int32_t n = 0;
+  Dbt value(&n, sizeof(n));
+  while (ints.has_room(sizeof(n))) {
+    ints.add(&value);
+    n++;
+  }
+  ASSERT_EQ(ints.size(), (DbBlock::BLOCK_SZ - 4) / 4);
+  ASSERT_EQ(ints.get_int(1), 0);
+  ASSERT_EQ(ints.get_int(ints.size()), n - 1);
+  ASSERT_THROW(ints.add(&value), DbBlockNoRoomError);
+
+  std::string hello = "hello", empty = "", world = "world!";
+  Dbt a((void *)hello.data(), hello.size()), b((void *)empty.data(), 0),
+      c((void *)world.data(), world.size());
+  texts.add(&a);
+  texts.add(&b);
+  texts.add(&c);
+  ASSERT_EQ(texts.get_text(1), hello);
+  ASSERT_EQ(texts.get_text(2), empty);
+  ASSERT_EQ(texts.get_value(3), Value(world));
+  ASSERT_FALSE(texts.has_room(DbBlock::BLOCK_SZ));
+  ASSERT_THROW(texts.get_text(4), DbRelationError);
+
+  // reread from the bytes
+  ColumnBlock reread(texts_block, 1, ColumnAttribute::TEXT);
+  ASSERT_EQ(reread.size(), 3u);
+  ASSERT_EQ(reread.get_text(3), world);
+}
+
+class ColumnTableTest : public testing::Test {
+protected:
+  void SetUp() override {
+    TableOptions options;
+    options.engine = TableOptions::COLUMN;
+    table.reset(new_relation(
+        testing::UnitTest::GetInstance()->current_test_info()->name(),
+        {"id", "name", "score"},
+        {ColumnAttribute(ColumnAttribute::INT),
+         ColumnAttribute(ColumnAttribute::TEXT),
+         ColumnAttribute(ColumnAttribute::INT)},
+        options));
+    table->create();
+  }
+
+  void TearDown() override { table->drop(); }
+
+  Handle insert(int32_t id, std::string name, int32_t score) {
+    ValueDict row;
+    row["id"] = Value(id);
+    row["name"] = Value(name);
+    row["score"] = Value(score);
+    return table->insert(&row);
+  }
+
+  std::unique_ptr<DbRelation> table;
+};
+
+/**
+ * @tests ColumnTable insert, select and project across row groups
+ */
+TEST_F(ColumnTableTest, InsertSelectProject) {
+  ASSERT_NE(dynamic_cast<ColumnTable *>(table.get()), nullptr);
+  Handles added;
+  for (int32_t i = 0; i < 2000; i++)
+    added.push_back(insert(i, "name " + std::to_string(i), i % 10));
+  // the TEXT column fills first and every column moves on with it
+  ASSERT_GT(added.back().first, 2u);
+
+  Handles *handles = table->select();
+  ASSERT_EQ(*handles, added);
+  delete handles;
+
+  ValueDict *row = table->project(added[1234]);
+  ASSERT_EQ((*row)["id"], Value(1234));
+  ASSERT_EQ((*row)["name"], Value("name 1234"));
+  ASSERT_EQ((*row)["score"], Value(4));
+  delete row;
+  ColumnNames just_score = {"score"};
+  row = table->project(added[7], &just_score);
+  ASSERT_EQ(row->size(), 1u);
+  ASSERT_EQ((*row)["score"], Value(7));
+  delete row;
+
+  ValueDict where;
+  where["score"] = Value(3);
+  handles = table->select(&where);
+  ASSERT_EQ(handles->size(), 200u);
+  delete handles;
+  where["name"] = Value("name 13");
+  handles = table->select(&where);
+  ASSERT_EQ(*handles, Handles{added[13]});
+  delete handles;
+
+  table->close();
+  table->open();
+  handles = table->select();
+  ASSERT_EQ(handles->size(), 2000u);
+  delete handles;
+
+  ValueDict change;
+  ASSERT_THROW(table->update(added[0], &change), NotImplementedError);
+  ASSERT_THROW(table->del(added[0]), NotImplementedError);
+}
+
+/**
+ * @tests ColumnTable::read_batch reads a row group column by column
+ */
+TEST_F(ColumnTableTest, ReadBatch) {
+  for (int32_t i = 0; i < 3000; i++)
+    insert(i, "n", i);
+  ColumnTable *columns = dynamic_cast<ColumnTable *>(table.get());
+  BlockIDs *group_ids = columns->group_ids();
+  ColumnNames wanted = {"score", "id"};
+  ColumnBatch batch;
+  int64_t sum = 0;
+  size_t rows = 0;
+  for (auto const &group_id : *group_ids) {
+    columns->read_batch(group_id, &wanted, batch);
+    ASSERT_EQ(batch.columns.size(), 2u);
+    ASSERT_EQ(batch.columns[0].size(), batch.size());
+    for (size_t i = 0; i < batch.size(); i++) {
+      ASSERT_EQ(batch.columns[0].ints[i], batch.columns[1].ints[i]);
+      sum += batch.columns[0].ints[i];
+    }
+    rows += batch.size();
+  }
+  delete group_ids;
+  ASSERT_EQ(rows, 3000u);
+  ASSERT_EQ(sum, 2999 * 3000 / 2);
+}
@@ -1,11 +1,42 @@
+#include "btree.h"
+#include "hash_index.h"
 #include "heap_storage.h"
 #include "storage_engine.h"
 #include "gmock/gmock.h"
+#include <algorithm>
 #include <cstring>
 #include <gtest/gtest.h>
 #include <string>
 
-DbEnv *_DB_ENV; // TODO: Mock when needed
+DbEnv *_DB_ENV;
+
+/**
+ * Opens a Berkeley DB environment in a scratch directory for the tests that
+ * need real files.
+ */
+class DbEnvEnvironment : public testing::Environment {
+public:
+  void SetUp() override {
+    char dir[] = "/tmp/sql5300_test_XXXXXX";
+    ASSERT_NE(mkdtemp(dir), nullptr);
+    env = new DbEnv(0U);
+    env->set_message_stream(&std::cout);
+    env->set_error_stream(&std::cerr);
+    env->open(dir, DB_CREATE | DB_INIT_MPOOL, 0);
+    _DB_ENV = env;
+  }
+
+  void TearDown() override {
+    env->close(0U);
+    delete env;
+    _DB_ENV = nullptr;
+  }
+
+  DbEnv *env;
+};
+
+testing::Environment *const db_env =
+    testing::AddGlobalTestEnvironment(new DbEnvEnvironment);
 
 class SlottedPageTest : public testing::Test {
 protected:
@@ -242,3 +273,408 @@ TEST_F(SlottedPageTest, HasRoom) {
   ASSERT_FALSE(
       wrap_has_room(DbBlock::BLOCK_SZ / 2 - sizeof(u_int16_t) * 2 * 6));
 }
+
+/**
+ * @tests SlottedPage::reserve
+ */
+TEST_F(SlottedPageTest, ReserveThenFillInPlace) {
+  page = new SlottedPage(wrapper, 0, true);
+  std::string field_a("ABCDEFGHIJKLM");
+
+  RecordID id = page->reserve(field_a.length());
+  memcpy(page->record(id), field_a.data(), field_a.length());
+
+  Dbt *got = page->get(id);
+  ASSERT_EQ(std::string((char *)got->get_data(), got->get_size()), field_a);
+  ASSERT_EQ(page->record(id), (void *)&buf[DbBlock::BLOCK_SZ - 13]);
+  delete got;
+
+  // Reserving never partially allocates
+  ASSERT_THROW(page->reserve(DbBlock::BLOCK_SZ), DbBlockNoRoomError);
+  ASSERT_EQ(get_num_records(), 1);
+}
+
+/**
+ * @tests SlottedPage::put growing and shrinking around other records
+ */
+TEST_F(SlottedPageTest, PutResizeKeepsNeighbours) {
+  page = new SlottedPage(wrapper, 0, true);
+  std::string mem_a("AAAA"), mem_b("BBBBBBBB"), mem_c("CCCCCC");
+  Dbt f_1(mem_a.data(), mem_a.length());
+  Dbt f_2(mem_b.data(), mem_b.length());
+  Dbt f_3(mem_c.data(), mem_c.length());
+  RecordID a = page->add(&f_1);
+  RecordID b = page->add(&f_2);
+  RecordID c = page->add(&f_3);
+
+  std::string grown("bbbbbbbbbbbbbbbbbbbb"), shrunk("b");
+  Dbt g(grown.data(), grown.length());
+  Dbt s(shrunk.data(), shrunk.length());
+  for (Dbt *put : {&g, &s}) {
+    page->put(b, *put);
+    Dbt *got_a = page->get(a), *got_b = page->get(b), *got_c = page->get(c);
+    ASSERT_EQ(std::string((char *)got_a->get_data(), got_a->get_size()), mem_a);
+    ASSERT_EQ(std::string((char *)got_b->get_data(), got_b->get_size()),
+              std::string((char *)put->get_data(), put->get_size()));
+    ASSERT_EQ(std::string((char *)got_c->get_data(), got_c->get_size()), mem_c);
+    delete got_a;
+    delete got_b;
+    delete got_c;
+  }
+  ASSERT_EQ(get_end_free(), DbBlock::BLOCK_SZ - 1 - 4 - 1 - 6);
+}
+
+/**
+ * @tests SlottedPage::put_forward, SlottedPage::get_forward
+ */
+TEST_F(SlottedPageTest, ForwardingStub) {
+  page = new SlottedPage(wrapper, 0, true);
+  std::string mem_a("ABCDEFGHIJKLM");
+  Dbt f_1(mem_a.data(), mem_a.length());
+  RecordID a = page->add(&f_1);
+  RecordID b = page->add(&f_1);
+  page->set_flags(b, SlottedPage::MOVED);
+
+  Handle to;
+  ASSERT_FALSE(page->get_forward(a, to));
+  page->put_forward(a, Handle(12, 34));
+  ASSERT_TRUE(page->get_forward(a, to));
+  ASSERT_EQ(to, Handle(12, 34));
+
+  // moved records are only reachable through their stub
+  RecordIDs *ids = page->ids();
+  ASSERT_EQ(*ids, RecordIDs{a});
+  delete ids;
+  Dbt *got = page->get(b);
+  ASSERT_EQ(got->get_size(), mem_a.length());
+  delete got;
+}
+
+class HeapTableTest : public testing::Test {
+protected:
+  void SetUp() override {
+    table = new HeapTable(
+        testing::UnitTest::GetInstance()->current_test_info()->name(),
+        {"id", "body"},
+        {ColumnAttribute(ColumnAttribute::INT),
+         ColumnAttribute(ColumnAttribute::TEXT)});
+    table->create();
+  }
+
+  void TearDown() override {
+    table->drop();
+    delete table;
+  }
+
+  Handle insert(int32_t id, std::string body) {
+    ValueDict row;
+    row["id"] = Value(id);
+    row["body"] = Value(body);
+    return table->insert(&row);
+  }
+
+  std::string body(Handle handle) {
+    ValueDict *row = table->project(handle);
+    std::string s = row->at("body").s;
+    delete row;
+    return s;
+  }
+
+  HeapTable *table;
+};
+
+/**
+ * @tests HeapTable::update in place, growing and shrinking
+ */
+TEST_F(HeapTableTest, UpdateInPlace) {
+  Handle a = insert(1, "first");
+  Handle b = insert(2, "second");
+  ValueDict change;
+  change["body"] = Value(std::string(200, 'x'));
+  table->update(a, &change);
+  ASSERT_EQ(body(a), std::string(200, 'x'));
+  ASSERT_EQ(body(b), "second");
+  change["body"] = Value("1");
+  table->update(a, &change);
+  ASSERT_EQ(body(a), "1");
+  ASSERT_EQ(body(b), "second");
+
+  change["nope"] = Value(3);
+  ASSERT_THROW(table->update(a, &change), DbRelationError);
+}
+
+/**
+ * @tests HeapTable::update moving a row out of a full block
+ */
+TEST_F(HeapTableTest, UpdateForwardsWhenFull) {
+  Handle a = insert(1, "small");
+  Handles fill;
+  while (true) {
+    Handle h = insert(2, std::string(100, 'f'));
+    if (h.first != a.first)
+      break;
+    fill.push_back(h);
+  }
+  Handles *before = table->select();
+
+  ValueDict change;
+  change["body"] = Value(std::string(1000, 'g'));
+  table->update(a, &change);
+  ASSERT_EQ(body(a), std::string(1000, 'g'));
+
+  // grows again where it moved to, then shrinks back home
+  change["body"] = Value(std::string(1200, 'h'));
+  table->update(a, &change);
+  ASSERT_EQ(body(a), std::string(1200, 'h'));
+
+  Handles *after = table->select();
+  ASSERT_EQ(*before, *after);
+  delete after;
+
+  change["body"] = Value("tiny");
+  table->update(a, &change);
+  ASSERT_EQ(body(a), "tiny");
+  after = table->select();
+  ASSERT_EQ(*before, *after);
+  delete after;
+  delete before;
+}
+
+/**
+ * @tests HeapTable::del, including forwarded rows
+ */
+TEST_F(HeapTableTest, Delete) {
+  Handle a = insert(1, "small");
+  while (insert(2, std::string(100, 'f')).first == a.first)
+    ;
+  Handle b = insert(3, "other");
+  ValueDict change;
+  change["body"] = Value(std::string(1000, 'g'));
+  table->update(a, &change);
+
+  Handles *before = table->select();
+  table->del(a);
+  table->del(b);
+  Handles *after = table->select();
+  ASSERT_EQ(after->size(), before->size() - 2);
+  ASSERT_THROW(table->project(a), DbRelationError);
+  ASSERT_THROW(table->del(a), DbRelationError);
+  delete before;
+  delete after;
+}
+
+/**
+ * @tests HeapTable honors the fillfactor table option on insert
+ */
+TEST_F(HeapTableTest, FillfactorLeavesSlack) {
+  TableOptions options;
+  options.fillfactor = 50;
+  HeapTable half("FillfactorLeavesSlackHalf", {"id", "body"},
+                 {ColumnAttribute(ColumnAttribute::INT),
+                  ColumnAttribute(ColumnAttribute::TEXT)},
+                 options);
+  half.create();
+  ValueDict row;
+  row["id"] = Value(1);
+  row["body"] = Value(std::string(100, 'f'));
+  size_t full_rows = 0, half_rows = 0;
+  while (table->insert(&row).first == 1)
+    full_rows++;
+  while (half.insert(&row).first == 1)
+    half_rows++;
+  half.drop();
+
+  ASSERT_EQ(full_rows, 37u);
+  ASSERT_EQ(half_rows, 18u);
+
+  options.fillfactor = 5;
+  ASSERT_THROW(HeapTable("bad", {"id"}, {ColumnAttribute(ColumnAttribute::INT)},
+                         options),
+               DbRelationError);
+}
+
+/**
+ * @tests HeapTable::select(where) by scanning and through a HashIndex
+ */
+TEST_F(HeapTableTest, SelectWhere) {
+  for (int32_t i = 0; i < 200; i++)
+    insert(i % 50, "row " + std::to_string(i));
+
+  ValueDict where;
+  where["id"] = Value(7);
+  Handles *scanned = table->select(&where);
+  ASSERT_EQ(scanned->size(), 4u);
+
+  HashIndex index(*table, "ix", {"id"});
+  index.create();
+  table->add_index(&index);
+  Handles *looked_up = table->select(&where);
+  ASSERT_EQ(looked_up->size(), 4u);
+  for (auto const &handle : *looked_up)
+    ASSERT_EQ(std::count(scanned->begin(), scanned->end(), handle), 1);
+  delete looked_up;
+
+  // residual predicate checked on the index's candidates
+  where["body"] = Value("row 57");
+  looked_up = table->select(&where);
+  ASSERT_EQ(looked_up->size(), 1u);
+  ASSERT_EQ(body((*looked_up)[0]), "row 57");
+
+  // maintained through update, insert and delete
+  ValueDict change;
+  change["id"] = Value(1000);
+  table->update((*looked_up)[0], &change);
+  Handle added = insert(7, "new");
+  table->del((*scanned)[0]);
+  where.erase("body");
+  delete looked_up;
+  looked_up = table->select(&where);
+  ASSERT_EQ(looked_up->size(), 3u);
+  ASSERT_EQ(std::count(looked_up->begin(), looked_up->end(), added), 1);
+  delete looked_up;
+  where["id"] = Value(1000);
+  looked_up = table->select(&where);
+  ASSERT_EQ(looked_up->size(), 1u);
+
+  table->remove_index(&index);
+  index.drop();
+  delete looked_up;
+  delete scanned;
+}
+
+/**
+ * @tests HashIndex unique keys are enforced on insert
+ */
+TEST_F(HeapTableTest, UniqueHashIndex) {
+  insert(1, "one");
+  HashIndex index(*table, "pk", {"id"}, true);
+  index.create();
+  table->add_index(&index);
+  ASSERT_THROW(insert(1, "again"), DbRelationError);
+  Handles *all = table->select();
+  ASSERT_EQ(all->size(), 1u);
+  delete all;
+  table->remove_index(&index);
+  index.drop();
+}
+
+/**
+ * @tests an update into a unique key another row holds is refused, leaving
+ * the row and the index as they were
+ */
+TEST_F(HeapTableTest, UpdateIntoDuplicateUniqueKey) {
+  Handle a = insert(1, "one");
+  Handle b = insert(2, "two");
+  HashIndex hashed(*table, "pk", {"id"}, true);
+  BTreeIndex ordered(*table, "pk_tree", {"id"}, true);
+  hashed.create();
+  ordered.create();
+  for (DbIndex *index : DbIndexes{&hashed, &ordered}) {
+    table->add_index(index);
+    ValueDict change;
+    change["id"] = Value(1);
+    change["body"] = Value("clash");
+    ASSERT_THROW(table->update(b, &change), DbRelationError);
+    ASSERT_EQ(body(b), "two");
+    ValueDict key;
+    key["id"] = Value(2);
+    Handles *found = index->lookup(&key);
+    ASSERT_EQ(*found, Handles{b});
+    delete found;
+    // keeping its own key is no clash
+    table->update(a, &change);
+    ASSERT_EQ(body(a), "clash");
+    table->remove_index(index);
+  }
+  ordered.drop();
+  hashed.drop();
+}
+
+/**
+ * @tests HeapTable scans skip blocks ruled out by the zone map
+ */
+TEST_F(HeapTableTest, ZoneMapSkipsBlocks) {
+  Handles added;
+  for (int32_t i = 0; i < 1000; i++)
+    added.push_back(insert(i, std::string(100, 'z')));
+  uint blocks = added.back().first;
+  ASSERT_GT(blocks, 20u);
+
+  RangeDict where;
+  where["id"] = ValueRange(Value(500), Value(510));
+  Handles *handles = table->select_range(&where);
+  ASSERT_EQ(handles->size(), 11u);
+  delete handles;
+  ScanStats stats = table->get_scan_stats();
+  ASSERT_LE(stats.blocks_read, 2u);
+  ASSERT_EQ(stats.blocks_read + stats.blocks_skipped, blocks);
+
+  // an update widens the zone of the row's home block, even once forwarded
+  ValueDict change;
+  change["id"] = Value(505);
+  change["body"] = Value(std::string(1000, 'y'));
+  table->update(added[3], &change);
+  handles = table->select_range(&where);
+  ASSERT_EQ(handles->size(), 12u);
+  ASSERT_EQ(std::count(handles->begin(), handles->end(), added[3]), 1);
+  delete handles;
+
+  // the zones are persisted with the table
+  table->close();
+  table->open();
+  ValueDict equal;
+  equal["id"] = Value(999);
+  handles = table->select(&equal);
+  ASSERT_EQ(*handles, Handles{added.back()});
+  delete handles;
+  ASSERT_EQ(table->get_scan_stats().blocks_read, 1u);
+}
+
+/**
+ * @tests HeapTable equality scans skip blocks ruled out by Bloom filters
+ */
+TEST_F(HeapTableTest, BloomFilterSkipsBlocks) {
+  TableOptions options;
+  options.bloom_columns = {"body"};
+  HeapTable sessions("BloomFilterSkipsBlocksSessions", {"id", "body"},
+                     {ColumnAttribute(ColumnAttribute::INT),
+                      ColumnAttribute(ColumnAttribute::TEXT)},
+                     options);
+  sessions.create();
+  ValueDict row;
+  Handles added;
+  for (int32_t i = 0; i < 1000; i++) {
+    row["id"] = Value(i % 7); // no use to the zone map
+    row["body"] = Value("session-" + std::to_string(i * 7919 % 1000) +
+                        std::string(80, '.'));
+    added.push_back(sessions.insert(&row));
+  }
+  uint blocks = added.back().first;
+
+  ValueDict where;
+  where["body"] = Value("session-123" + std::string(80, '.'));
+  Handles *handles = sessions.select(&where);
+  ASSERT_EQ(handles->size(), 1u);
+  delete handles;
+  ScanStats stats = sessions.get_scan_stats();
+  ASSERT_LE(stats.blocks_read, 3u);
+  ASSERT_EQ(stats.blocks_read + stats.blocks_filtered, blocks);
+
+  // maintained through update, and persisted with the table
+  ValueDict change;
+  change["body"] = Value("renamed");
+  sessions.update(added[500], &change);
+  sessions.close();
+  sessions.open();
+  where["body"] = Value("renamed");
+  handles = sessions.select(&where);
+  ASSERT_EQ(*handles, Handles{added[500]});
+  delete handles;
+  ASSERT_LE(sessions.get_scan_stats().blocks_read, 3u);
+  sessions.drop();
+
+  options.bloom_columns = {"nope"};
+  ASSERT_THROW(HeapTable("bad", {"id"}, {ColumnAttribute(ColumnAttribute::INT)},
+                         options),
+               DbRelationError);
+}
@@ -0,0 +1,159 @@
+#include "lsm_storage.h"
+#include <gtest/gtest.h>
+
+/**
+ * @tests a merge yields each key once, from the newest source holding it
+ */
+TEST(MergeCursorTest, NewestWins) {
+  Memtable newer = {{2, "new"}, {3, ""}, {6, "six"}};
+  Memtable older = {{1, "one"}, {2, "old"}, {3, "three"}, {5, "five"}};
+  MergeCursor merge(
+      {new MemtableCursor(newer), new MemtableCursor(older)});
+  std::vector<std::pair<u_int64_t, std::string>> seen;
+  for (; merge.valid(); merge.next())
+    seen.push_back(std::make_pair(
+        merge.key(), std::string(merge.row(), merge.size())));
+  std::vector<std::pair<u_int64_t, std::string>> expected = {
+      {1, "one"}, {2, "new"}, {3, ""}, {5, "five"}, {6, "six"}};
+  ASSERT_EQ(seen, expected);
+}
+
+/**
+ * @tests rows survive flushes, background compaction and reopening, updates
+ * and deletes shadow older versions, and Bloom filters spare point reads
+ */
+TEST(LsmTableTest, FlushCompactReopen) {
+  ColumnNames column_names = {"id", "body"};
+  ColumnAttributes column_attributes = {ColumnAttribute(ColumnAttribute::INT),
+                                        ColumnAttribute(ColumnAttribute::TEXT)};
+  TableOptions options;
+  options.engine = TableOptions::LSM;
+  options.memtable_bytes = 4096;
+  DbRelation *relation = new_relation("_test_lsm_table", column_names,
+                                      column_attributes, options);
+  LsmTable *table = dynamic_cast<LsmTable *>(relation);
+  ASSERT_NE(table, nullptr);
+  table->create();
+
+  ValueDict row;
+  row["body"] = Value(std::string(20, 'x'));
+  Handles handles;
+  for (int32_t i = 0; i < 10000; i++) {
+    row["id"] = Value(i);
+    handles.push_back(table->insert(&row));
+  }
+  // every tenth row grows, every seventh goes
+  ValueDict change;
+  change["body"] = Value(std::string(50, 'y'));
+  for (size_t i = 0; i < handles.size(); i += 10)
+    table->update(handles[i], &change);
+  for (size_t i = 0; i < handles.size(); i += 7)
+    table->del(handles[i]);
+  ASSERT_THROW(table->del(handles[7]), DbRelationError);
+  table->flush();
+  table->wait_for_compaction();
+
+  std::vector<size_t> level_runs = table->get_level_runs();
+  ASSERT_LT(level_runs[0], LsmTable::L0_RUNS);
+  ASSERT_GE(level_runs.size(), 3u); // level 1 has overflowed into level 2
+  for (size_t level = 1; level < level_runs.size(); level++)
+    ASSERT_LE(level_runs[level], 1u);
+
+  const uint expected_rows = 10000 - (10000 + 6) / 7;
+  const uint expected_grown = 1000 - (1000 + 6) / 7; // multiples of 70 went
+  Handles *all = table->select();
+  ASSERT_EQ(all->size(), expected_rows);
+  delete all;
+  ValueDict where;
+  where["body"] = Value(std::string(50, 'y'));
+  Handles *grown = table->select(&where);
+  ASSERT_EQ(grown->size(), expected_grown);
+  delete grown;
+
+  // rows come back from whichever run holds them, and runs without a row
+  // are mostly ruled out by their Bloom filters
+  LsmStats before = table->get_lookup_stats();
+  for (int32_t i : {1, 10, 4999, 9999}) {
+    ValueDict *values = table->project(handles[i]);
+    ASSERT_EQ((*values)["id"], Value(i));
+    ASSERT_EQ((*values)["body"].s.size(), i % 10 == 0 ? 50u : 20u);
+    delete values;
+  }
+  ASSERT_THROW(table->project(handles[14]), DbRelationError);
+  ASSERT_LE(table->get_lookup_stats().blocks_read - before.blocks_read, 6u);
+
+  // more rows and a change after the last flush
+  row["id"] = Value(10000);
+  Handle last = table->insert(&row);
+  table->update(handles[1], &change);
+  table->close();
+  delete relation;
+
+  LsmTable reopened("_test_lsm_table", column_names, column_attributes,
+                    options);
+  reopened.open();
+  all = reopened.select();
+  ASSERT_EQ(all->size(), expected_rows + 1);
+  delete all;
+  ColumnNames ids = {"id"};
+  ValueDict *values = reopened.project(last, &ids);
+  ASSERT_EQ((*values)["id"], Value(10000));
+  delete values;
+  grown = reopened.select(&where);
+  ASSERT_EQ(grown->size(), expected_grown + 1);
+  delete grown;
+  ASSERT_THROW(reopened.project(handles[21]), DbRelationError);
+  reopened.drop();
+}
+
+/**
+ * @tests writes still in the memtable when a table is let go of without
+ * close() are replayed from the log on open(), and the keys handed out after
+ * that don't reuse theirs
+ */
+TEST(LsmTableTest, LogReplayed) {
+  ColumnNames column_names = {"id", "body"};
+  ColumnAttributes column_attributes = {ColumnAttribute(ColumnAttribute::INT),
+                                        ColumnAttribute(ColumnAttribute::TEXT)};
+  TableOptions options;
+  options.engine = TableOptions::LSM;
+  options.memtable_bytes = 4096;
+  LsmTable *table = new LsmTable("_test_lsm_log", column_names,
+                                 column_attributes, options);
+  table->create();
+  ValueDict row;
+  row["body"] = Value(std::string(20, 'x'));
+  Handles handles;
+  for (int32_t i = 0; i < 1000; i++) { // some flushed, the rest not
+    row["id"] = Value(i);
+    handles.push_back(table->insert(&row));
+  }
+  ValueDict change;
+  change["body"] = Value("changed");
+  table->update(handles[999], &change);
+  table->del(handles[998]);
+  delete table; // never closed
+
+  table = new LsmTable("_test_lsm_log", column_names, column_attributes,
+                       options);
+  table->open();
+  Handles *all = table->select();
+  ASSERT_EQ(all->size(), 999u);
+  delete all;
+  ValueDict *values = table->project(handles[999]);
+  ASSERT_EQ((*values)["body"], Value("changed"));
+  delete values;
+  ASSERT_THROW(table->project(handles[998]), DbRelationError);
+  row["id"] = Value(1000);
+  Handle added = table->insert(&row);
+  ASSERT_GT(added, handles.back());
+
+  // once closed, the log is empty and reopening changes nothing
+  table->close();
+  table->open();
+  all = table->select();
+  ASSERT_EQ(all->size(), 1000u);
+  delete all;
+  table->drop();
+  delete table;
+}
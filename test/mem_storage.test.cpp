@@ -0,0 +1,85 @@
+#include "mem_storage.h"
+#include <gtest/gtest.h>
+
+/**
+ * @tests rows across many blocks go in, come back by select, where, project
+ * and read_batch, move when they grow, and go away by del and drop
+ */
+TEST(MemTableTest, RowsInMemory) {
+  TableOptions options;
+  options.engine = TableOptions::MEMORY;
+  DbRelation *relation = new_relation(
+      "_test_mem_table", {"id", "body"},
+      {ColumnAttribute(ColumnAttribute::INT),
+       ColumnAttribute(ColumnAttribute::TEXT)},
+      options);
+  ASSERT_NE(dynamic_cast<MemTable *>(relation), nullptr);
+  DbRelation &table = *relation;
+  table.create();
+
+  ValueDict row;
+  row["body"] = Value(std::string(30, 'x'));
+  for (int32_t i = 0; i < 8000; i++) {
+    row["id"] = Value(i);
+    table.insert(&row);
+  }
+  BlockIDs *group_ids = table.group_ids();
+  ASSERT_GT(group_ids->size(), MemFile::CHUNK_BLOCKS);
+  ColumnNames ids = {"id"};
+  ColumnBatch batch;
+  uint rows = 0;
+  for (auto const &group_id : *group_ids) {
+    table.read_batch(group_id, &ids, batch);
+    for (size_t i = 0; i < batch.size(); i++)
+      ASSERT_EQ(batch.columns[0].ints[i], (int32_t)rows++);
+  }
+  ASSERT_EQ(rows, 8000u);
+  delete group_ids;
+
+  Handles *handles = table.select();
+  ASSERT_EQ(handles->size(), 8000u);
+  ValueDict *values = table.project((*handles)[1234], &ids);
+  ASSERT_EQ((*values)["id"], Value(1234));
+  delete values;
+
+  // grow rows until they no longer fit in their blocks, then grow them again
+  ValueDict change;
+  for (size_t length : {200, 600}) {
+    change["body"] = Value(std::string(length, 'y'));
+    for (size_t i = 0; i < handles->size(); i += 100)
+      table.update((*handles)[i], &change);
+  }
+  Handles *all = table.select();
+  ASSERT_EQ(all->size(), 8000u);
+  delete all;
+  values = table.project((*handles)[500]);
+  ASSERT_EQ((*values)["id"], Value(500));
+  ASSERT_EQ((*values)["body"], Value(std::string(600, 'y')));
+  delete values;
+
+  ValueDict where;
+  where["body"] = Value(std::string(600, 'y'));
+  Handles *grown = table.select(&where);
+  ASSERT_EQ(grown->size(), 80u);
+  delete grown;
+
+  table.del((*handles)[500]);
+  table.del((*handles)[501]);
+  ASSERT_THROW(table.project((*handles)[500]), DbRelationError);
+  grown = table.select(&where);
+  ASSERT_EQ(grown->size(), 79u);
+  delete grown;
+  all = table.select();
+  ASSERT_EQ(all->size(), 7998u);
+  delete all;
+  delete handles;
+
+  change["body"] = Value(std::string(DbBlock::BLOCK_SZ, 'z'));
+  row["id"] = Value(0);
+  Handle handle = table.insert(&row);
+  ASSERT_THROW(table.update(handle, &change), DbRelationError);
+
+  table.drop();
+  ASSERT_THROW(table.project(handle), DbRelationError);
+  delete relation;
+}
@@ -0,0 +1,90 @@
+#include "heap_storage.h"
+#include "parallel_scan.h"
+#include <algorithm>
+#include <gtest/gtest.h>
+
+/**
+ * @tests every morsel is handed out once, and an idle worker steals
+ */
+TEST(MorselQueueTest, StealsFromOthers) {
+  MorselQueue queue(1, 100, 16, 3);
+  std::vector<bool> seen(101, false);
+  Morsel morsel;
+  uint morsels = 0;
+  // worker 0 does all the work: its own share, then the others'
+  while (queue.pop(0, morsel)) {
+    for (BlockID block_id = morsel.first; block_id <= morsel.second;
+         block_id++) {
+      ASSERT_FALSE(seen[block_id]);
+      seen[block_id] = true;
+    }
+    morsels++;
+  }
+  ASSERT_EQ(morsels, 7u);
+  ASSERT_EQ(std::count(seen.begin() + 1, seen.end(), true), 100);
+  ASSERT_EQ(queue.get_steals(), 4u);
+  ASSERT_FALSE(queue.pop(2, morsel));
+}
+
+/**
+ * @tests parallel_select and parallel_aggregate agree with a serial scan,
+ * forwarded rows included, and the workers' own environment handles see a
+ * row written just before the scan
+ */
+TEST(ParallelScanTest, SelectAndAggregate) {
+  HeapTable table("_test_parallel_scan", {"id", "group", "body"},
+                  {ColumnAttribute(ColumnAttribute::INT),
+                   ColumnAttribute(ColumnAttribute::INT),
+                   ColumnAttribute(ColumnAttribute::TEXT)});
+  table.create();
+  ValueDict row;
+  row["body"] = Value(std::string(40, 'x'));
+  for (int32_t i = 0; i < 5000; i++) {
+    row["id"] = Value(i);
+    row["group"] = Value(i % 7);
+    table.insert(&row);
+  }
+  // grow some rows so they move to other blocks
+  Handles *all = table.select();
+  ValueDict change;
+  change["body"] = Value(std::string(200, 'y'));
+  for (size_t i = 0; i < all->size(); i += 50)
+    table.update((*all)[i], &change);
+  delete all;
+
+  ValueDict where;
+  where["group"] = Value(3);
+  Handles *expected = table.select(&where);
+  std::sort(expected->begin(), expected->end());
+  int64_t sum = 0;
+  for (auto const &handle : *expected) {
+    ValueDict *values = table.project(handle);
+    sum += (*values)["id"].n;
+    delete values;
+  }
+  for (uint threads : {1, 4}) {
+    Handles *handles = table.parallel_select(&where, threads);
+    ASSERT_EQ(*handles, *expected);
+    delete handles;
+    ASSERT_GT(table.get_scan_stats().blocks_read, 1u);
+
+    ScanAggregate aggregate = table.parallel_aggregate("id", &where, threads);
+    ASSERT_EQ(aggregate.count, expected->size());
+    ASSERT_EQ(aggregate.sum, sum);
+    ASSERT_EQ(aggregate.min, 3);
+    ASSERT_EQ(aggregate.max, 4994);
+  }
+  // the workers read the new row's block through their own handles
+  row["id"] = Value(5000);
+  row["group"] = Value(3);
+  expected->push_back(table.insert(&row));
+  Handles *handles = table.parallel_select(&where, 4);
+  ASSERT_EQ(*handles, *expected);
+  delete handles;
+  delete expected;
+
+  ValueDict none;
+  ASSERT_EQ(table.parallel_aggregate("id", &none).count, 5001u);
+  ASSERT_THROW(table.parallel_aggregate("body", &none), DbRelationError);
+  table.drop();
+}
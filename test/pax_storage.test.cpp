@@ -0,0 +1,185 @@
+#include "pax_storage.h"
+#include <gtest/gtest.h>
+#include <memory>
+
+/**
+ * @tests PaxPage keeps rows whole while storing them column by column
+ */
+TEST(PaxPageTest, AddGetPutDel) {
+  ColumnNames column_names = {"a", "b"};
+  ColumnAttributes column_attributes = {ColumnAttribute(ColumnAttribute::INT),
+                                        ColumnAttribute(ColumnAttribute::TEXT)};
+  RowCodec codec(column_names, column_attributes);
+  char block_bytes[DbBlock::BLOCK_SZ];
+  Dbt block(block_bytes, sizeof(block_bytes));
+  PaxPage page(block, 1, true);
+  ASSERT_FALSE(page.is_formatted());
+  page.format(column_attributes);
+  ASSERT_TRUE(page.is_formatted());
+
+  char bytes[DbBlock::BLOCK_SZ];
+  auto encode = [&](int32_t a, std::string b) {
+    ValueDict row;
+    row["a"] = Value(a);
+    row["b"] = Value(b);
+    return Dbt(bytes, codec.encode(&row, bytes));
+  };
+  // longer than TEXT_GUESS, so the text area fills before the minipages
+  auto text = [](int32_t i) {
+    return "row " + std::to_string(i) + std::string(20, '.');
+  };
+  RecordID id = 0;
+  for (int32_t i = 0;; i++) {
+    Dbt data = encode(i, text(i));
+    if (!page.has_room(&data))
+      break;
+    id = page.add(&data);
+  }
+  ASSERT_EQ(id, page.size());
+  ASSERT_GT(page.size(), 100u);
+  Dbt no_text = encode(0, "");
+  ASSERT_TRUE(page.has_room(&no_text)); // slots are left over
+
+  // the INT minipage is a plain, aligned array
+  const int32_t *a = page.int_column(0);
+  ASSERT_EQ((uintptr_t)a % 8, (uintptr_t)block_bytes % 8);
+  for (RecordID r = 1; r <= page.size(); r++)
+    ASSERT_EQ(a[r - 1], (int32_t)r - 1);
+  ASSERT_EQ(page.get_text(5, 1), text(4));
+
+  Dbt *data = page.get(3);
+  ValueDict *row = codec.decode((const char *)data->get_data());
+  ASSERT_EQ((*row)["a"], Value(2));
+  ASSERT_EQ((*row)["b"], Value(text(2)));
+  delete row;
+  delete[] (char *)data->get_data();
+  delete data;
+
+  // growing a value needs the space deleted rows leave behind
+  Dbt bigger = encode(-1, std::string(200, 'x'));
+  ASSERT_THROW(page.put(1, bigger), DbBlockNoRoomError);
+  ASSERT_EQ(page.get_value(1, 1), Value(text(0)));
+  for (RecordID r = 10; r < 40; r++)
+    page.del(r);
+  page.put(1, bigger);
+  ASSERT_EQ(page.get_value(1, 0), Value(-1));
+  ASSERT_EQ(page.get_text(1, 1), std::string(200, 'x'));
+  ASSERT_EQ(page.get_text(41, 1), text(40));
+  ASSERT_THROW(page.get(10), DbRelationError);
+
+  // reread from the bytes with no schema
+  PaxPage reread(block, 1);
+  RecordIDs *ids = reread.ids();
+  ASSERT_EQ(ids->size(), page.size() - 30u);
+  delete ids;
+  ASSERT_EQ(reread.get_value(2, 1), Value(text(1)));
+}
+
+class PaxTableTest : public testing::Test {
+protected:
+  void SetUp() override {
+    TableOptions options;
+    options.engine = TableOptions::PAX;
+    table.reset(new_relation(
+        testing::UnitTest::GetInstance()->current_test_info()->name(),
+        {"id", "name", "score"},
+        {ColumnAttribute(ColumnAttribute::INT),
+         ColumnAttribute(ColumnAttribute::TEXT),
+         ColumnAttribute(ColumnAttribute::INT)},
+        options));
+    table->create();
+  }
+
+  void TearDown() override { table->drop(); }
+
+  Handle insert(int32_t id, std::string name, int32_t score) {
+    ValueDict row;
+    row["id"] = Value(id);
+    row["name"] = Value(name);
+    row["score"] = Value(score);
+    return table->insert(&row);
+  }
+
+  std::unique_ptr<DbRelation> table;
+};
+
+/**
+ * @tests PaxTable insert, select, project, update and delete
+ */
+TEST_F(PaxTableTest, InsertSelectProject) {
+  ASSERT_NE(dynamic_cast<PaxTable *>(table.get()), nullptr);
+  Handles added;
+  for (int32_t i = 0; i < 2000; i++)
+    added.push_back(insert(i, "name " + std::to_string(i), i % 10));
+  ASSERT_GT(added.back().first, 2u);
+
+  Handles *handles = table->select();
+  ASSERT_EQ(*handles, added);
+  delete handles;
+
+  ValueDict *row = table->project(added[1234]);
+  ASSERT_EQ((*row)["id"], Value(1234));
+  ASSERT_EQ((*row)["name"], Value("name 1234"));
+  ASSERT_EQ((*row)["score"], Value(4));
+  delete row;
+  ColumnNames just_score = {"score"};
+  row = table->project(added[7], &just_score);
+  ASSERT_EQ(row->size(), 1u);
+  ASSERT_EQ((*row)["score"], Value(7));
+  delete row;
+
+  ValueDict where;
+  where["score"] = Value(3);
+  handles = table->select(&where);
+  ASSERT_EQ(handles->size(), 200u);
+  delete handles;
+  where["name"] = Value("name 13");
+  handles = table->select(&where);
+  ASSERT_EQ(*handles, Handles{added[13]});
+  delete handles;
+
+  ValueDict change;
+  change["name"] = Value("a somewhat longer name than before");
+  change["score"] = Value(99);
+  table->update(added[13], &change);
+  table->del(added[14]);
+
+  table->close();
+  table->open();
+  handles = table->select();
+  ASSERT_EQ(handles->size(), 1999u);
+  delete handles;
+  row = table->project(added[13]);
+  ASSERT_EQ((*row)["id"], Value(13));
+  ASSERT_EQ((*row)["name"], Value("a somewhat longer name than before"));
+  ASSERT_EQ((*row)["score"], Value(99));
+  delete row;
+  ASSERT_THROW(table->project(added[14]), DbRelationError);
+}
+
+/**
+ * @tests PaxTable::read_batch reads a block minipage by minipage
+ */
+TEST_F(PaxTableTest, ReadBatch) {
+  for (int32_t i = 0; i < 3000; i++)
+    insert(i, "n", i);
+  PaxTable *pax = dynamic_cast<PaxTable *>(table.get());
+  BlockIDs *block_ids = pax->group_ids();
+  ColumnNames wanted = {"score", "id"};
+  ColumnBatch batch;
+  int64_t sum = 0;
+  size_t rows = 0;
+  for (auto const &block_id : *block_ids) {
+    pax->read_batch(block_id, &wanted, batch);
+    ASSERT_EQ(batch.columns.size(), 2u);
+    ASSERT_EQ(batch.columns[0].size(), batch.size());
+    for (size_t i = 0; i < batch.size(); i++) {
+      ASSERT_EQ(batch.columns[0].ints[i], batch.columns[1].ints[i]);
+      sum += batch.columns[0].ints[i];
+    }
+    rows += batch.size();
+  }
+  delete block_ids;
+  ASSERT_EQ(rows, 3000u);
+  ASSERT_EQ(sum, 2999 * 3000 / 2);
+}
@@ -0,0 +1,698 @@
+#include "query_exec.h"
+#include "heap_storage.h"
+#include "btree.h"
+#include <algorithm>
+#include <gtest/gtest.h>
+
+static std::vector<Row> run_plan(PlanOperator &plan) {
+  std::vector<Row> rows;
+  Row row;
+  plan.open();
+  while (plan.next(row))
+    rows.push_back(row);
+  plan.close();
+  return rows;
+}
+
+// rows held in memory, as a plan's input
+class RowsOperator : public PlanOperator {
+public:
+  RowsOperator(const PlanColumns &columns, const std::vector<Row> &rows)
+      : rows(rows), next_row(0) {
+    this->columns = columns;
+  }
+
+  virtual void open() { this->next_row = 0; }
+
+  virtual bool next(Row &row) {
+    if (this->next_row == this->rows.size())
+      return false;
+    row = this->rows[this->next_row++];
+    return true;
+  }
+
+  virtual void close() {}
+
+protected:
+  std::vector<Row> rows;
+  size_t next_row;
+};
+
+/**
+ * @tests expressions are type checked when built, NULLs propagate except
+ * where AND/OR are settled by one side, and arithmetic wraps around
+ */
+TEST(PlanExprTest, TypesNullsArithmetic) {
+  PlanColumns columns = {
+      PlanColumn("t", "n", ColumnAttribute::INT),
+      PlanColumn("t", "s", ColumnAttribute::TEXT),
+      PlanColumn("u", "n", ColumnAttribute::INT)};
+  ASSERT_EQ(find_column(columns, "u", "n"), 2u);
+  ASSERT_EQ(find_column(columns, "", "s"), 1u);
+  ASSERT_THROW(find_column(columns, "", "n"), DbRelationError);
+  ASSERT_THROW(find_column(columns, "t", "x"), DbRelationError);
+
+  ASSERT_THROW(PlanExpr::op(PlanExpr::EQ,
+                            PlanExpr::column(0, ColumnAttribute::INT),
+                            PlanExpr::column(1, ColumnAttribute::TEXT)),
+               DbRelationError);
+  ASSERT_THROW(PlanExpr::op(PlanExpr::ADD,
+                            PlanExpr::column(1, ColumnAttribute::TEXT),
+                            PlanExpr::constant(Value("x"))),
+               DbRelationError);
+
+  // n < 10 OR s = "a", over a row whose n is NULL
+  PlanExpr *either = PlanExpr::op(
+      PlanExpr::OR,
+      PlanExpr::op(PlanExpr::LT, PlanExpr::column(0, ColumnAttribute::INT),
+                   PlanExpr::constant(Value(10))),
+      PlanExpr::op(PlanExpr::EQ, PlanExpr::column(1, ColumnAttribute::TEXT),
+                   PlanExpr::constant(Value("a"))));
+  Row row = {std::nullopt, Value("a"), Value(3)};
+  ASSERT_TRUE(either->test(row));
+  row[1] = Value("b");
+  ASSERT_FALSE(either->eval(row).has_value());
+  ASSERT_FALSE(either->test(row));
+  row[0] = Value(4);
+  ASSERT_EQ(either->eval(row), std::optional<Value>(Value(1)));
+  delete either;
+
+  PlanExpr *wrap = PlanExpr::op(PlanExpr::ADD,
+                                PlanExpr::constant(Value(INT32_MAX)),
+                                PlanExpr::column(2, ColumnAttribute::INT));
+  ASSERT_EQ(wrap->eval(row)->n, INT32_MIN + 2);
+  delete wrap;
+  PlanExpr *divide = PlanExpr::op(PlanExpr::DIV,
+                                  PlanExpr::column(2, ColumnAttribute::INT),
+                                  PlanExpr::constant(Value(0)));
+  ASSERT_THROW(divide->eval(row), DbRelationError);
+  delete divide;
+}
+
+/**
+ * @tests compiled expressions agree with the tree they came from on every
+ * row, fold what is constant and still short-circuit AND/OR
+ */
+TEST(CompiledExprTest, MatchesTreeAndFolds) {
+  PlanExpr *n = PlanExpr::column(0, ColumnAttribute::INT);
+  PlanExpr *s = PlanExpr::column(1, ColumnAttribute::TEXT);
+  // (n * 3 - 7 > 2 * 5 OR s <= "m") AND NOT -n = 4
+  PlanExpr *tree = PlanExpr::op(
+      PlanExpr::AND,
+      PlanExpr::op(
+          PlanExpr::OR,
+          PlanExpr::op(
+              PlanExpr::GT,
+              PlanExpr::op(PlanExpr::SUB,
+                           PlanExpr::op(PlanExpr::MUL, n,
+                                        PlanExpr::constant(Value(3))),
+                           PlanExpr::constant(Value(7))),
+              PlanExpr::op(PlanExpr::MUL, PlanExpr::constant(Value(2)),
+                           PlanExpr::constant(Value(5)))),
+          PlanExpr::op(PlanExpr::LE, s, PlanExpr::constant(Value("m")))),
+      PlanExpr::op(
+          PlanExpr::NOT,
+          PlanExpr::op(PlanExpr::EQ,
+                       PlanExpr::op(PlanExpr::NEG,
+                                    PlanExpr::column(0, ColumnAttribute::INT)),
+                       PlanExpr::constant(Value(-4)))));
+  CompiledExpr compiled(*tree);
+  for (std::optional<Value> text :
+       {std::optional<Value>(), std::optional<Value>(Value("a")),
+        std::optional<Value>(Value("z"))})
+    for (int32_t i = -2; i < 10; i++) {
+      Row row = {i < 0 ? std::nullopt : std::optional<Value>(Value(i)), text};
+      ASSERT_EQ(compiled.eval(row), tree->eval(row));
+      ASSERT_EQ(compiled.test(row), tree->test(row));
+    }
+  delete tree;
+
+  // n > 2 * 25 is a single instruction, and so is 50 < n
+  tree = PlanExpr::op(PlanExpr::GT, PlanExpr::column(0, ColumnAttribute::INT),
+                      PlanExpr::op(PlanExpr::MUL, PlanExpr::constant(Value(2)),
+                                   PlanExpr::constant(Value(25))));
+  CompiledExpr above(*tree);
+  delete tree;
+  tree = PlanExpr::op(PlanExpr::LT, PlanExpr::constant(Value(50)),
+                      PlanExpr::column(0, ColumnAttribute::INT));
+  CompiledExpr mirrored(*tree);
+  delete tree;
+  ASSERT_EQ(above.size(), 1u);
+  ASSERT_EQ(mirrored.size(), 1u);
+  for (int32_t i : {49, 50, 51}) {
+    ASSERT_EQ(above.test({Value(i)}), i > 50);
+    ASSERT_EQ(mirrored.test({Value(i)}), i > 50);
+  }
+  ASSERT_FALSE(above.eval({std::nullopt}).has_value());
+
+  // n AND 0 is false whatever n is; 10 / 0 is left to fail when run
+  tree = PlanExpr::op(PlanExpr::AND, PlanExpr::column(0, ColumnAttribute::INT),
+                      PlanExpr::constant(Value(0)));
+  CompiledExpr never(*tree);
+  delete tree;
+  ASSERT_EQ(never.size(), 1u);
+  ASSERT_EQ(never.eval({std::nullopt}), std::optional<Value>(Value(0)));
+  tree = PlanExpr::op(PlanExpr::DIV, PlanExpr::constant(Value(10)),
+                      PlanExpr::constant(Value(0)));
+  CompiledExpr divide(*tree);
+  delete tree;
+  ASSERT_THROW(divide.eval({}), DbRelationError);
+
+  // n = 0 OR 10 / n > 1 never divides by zero
+  tree = PlanExpr::op(
+      PlanExpr::OR,
+      PlanExpr::op(PlanExpr::EQ, PlanExpr::column(0, ColumnAttribute::INT),
+                   PlanExpr::constant(Value(0))),
+      PlanExpr::op(PlanExpr::GT,
+                   PlanExpr::op(PlanExpr::DIV, PlanExpr::constant(Value(10)),
+                                PlanExpr::column(0, ColumnAttribute::INT)),
+                   PlanExpr::constant(Value(1))));
+  CompiledExpr guarded(*tree);
+  delete tree;
+  ASSERT_TRUE(guarded.test({Value(0)}));
+  ASSERT_TRUE(guarded.test({Value(5)}));
+  ASSERT_FALSE(guarded.test({Value(20)}));
+
+  // a TEXT result is copied out of the row it came from
+  tree = PlanExpr::column(1, ColumnAttribute::TEXT);
+  CompiledExpr field(*tree);
+  delete tree;
+  ASSERT_EQ(field.eval({Value(1), Value("kept")}),
+            std::optional<Value>(Value("kept")));
+}
+
+/**
+ * @tests rows stream from a scan with pushed-down equality through a filter,
+ * a projection and a limit
+ */
+TEST(PlanOperatorTest, ScanFilterProjectLimit) {
+  HeapTable table("_test_plan_scan", {"id", "kind"},
+                  {ColumnAttribute(ColumnAttribute::INT),
+                   ColumnAttribute(ColumnAttribute::TEXT)});
+  table.create();
+  ValueDict row;
+  for (int32_t i = 0; i < 100; i++) {
+    row["id"] = Value(i);
+    row["kind"] = Value(i % 3 == 0 ? "fizz" : "plain");
+    table.insert(&row);
+  }
+
+  // SELECT id * 2 AS twice, kind FROM t WHERE kind = "fizz" AND id > 50
+  // LIMIT 3 OFFSET 1
+  ValueDict where;
+  where["kind"] = Value("fizz");
+  PlanOperator *plan = new TableScan(&table, "t", &where);
+  plan = new Filter(plan, PlanExpr::op(
+                              PlanExpr::GT,
+                              PlanExpr::column(0, ColumnAttribute::INT),
+                              PlanExpr::constant(Value(50))));
+  plan = new Project(
+      plan,
+      {PlanExpr::op(PlanExpr::MUL, PlanExpr::column(0, ColumnAttribute::INT),
+                    PlanExpr::constant(Value(2))),
+       PlanExpr::column(1, ColumnAttribute::TEXT)},
+      {PlanColumn("", "twice", ColumnAttribute::TEXT),
+       PlanColumn("t", "kind", ColumnAttribute::TEXT)});
+  ASSERT_EQ(plan->get_columns()[0].data_type, ColumnAttribute::INT);
+  Limit limit(plan, 3, 1);
+  std::vector<Row> rows = run_plan(limit);
+  std::vector<Row> expected = {{Value(108), Value("fizz")},
+                               {Value(114), Value("fizz")},
+                               {Value(120), Value("fizz")}};
+  ASSERT_EQ(rows, expected);
+  // a plan can run again
+  ASSERT_EQ(run_plan(limit), expected);
+  table.drop();
+}
+
+/**
+ * @tests a nested loop join pairs matching rows, and a left join keeps
+ * unmatched left rows with NULLs
+ */
+TEST(PlanOperatorTest, NestedLoopJoin) {
+  HeapTable people("_test_plan_people", {"id", "name"},
+                   {ColumnAttribute(ColumnAttribute::INT),
+                    ColumnAttribute(ColumnAttribute::TEXT)});
+  HeapTable pets("_test_plan_pets", {"owner", "pet"},
+                 {ColumnAttribute(ColumnAttribute::INT),
+                  ColumnAttribute(ColumnAttribute::TEXT)});
+  people.create();
+  pets.create();
+  ValueDict row;
+  for (auto const &person : {std::make_pair(1, "ann"), std::make_pair(2, "bo"),
+                             std::make_pair(3, "cy")}) {
+    row["id"] = Value(person.first);
+    row["name"] = Value(person.second);
+    people.insert(&row);
+  }
+  row.clear();
+  for (auto const &pet : {std::make_pair(1, "cat"), std::make_pair(3, "dog"),
+                          std::make_pair(1, "eel")}) {
+    row["owner"] = Value(pet.first);
+    row["pet"] = Value(pet.second);
+    pets.insert(&row);
+  }
+
+  for (bool left_outer : {false, true}) {
+    NestedLoopJoin join(
+        new TableScan(&people, "p"), new TableScan(&pets, "q"),
+        PlanExpr::op(PlanExpr::EQ, PlanExpr::column(0, ColumnAttribute::INT),
+                     PlanExpr::column(2, ColumnAttribute::INT)),
+        left_outer);
+    ASSERT_EQ(find_column(join.get_columns(), "q", "pet"), 3u);
+    std::vector<Row> expected = {
+        {Value(1), Value("ann"), Value(1), Value("cat")},
+        {Value(1), Value("ann"), Value(1), Value("eel")},
+        {Value(3), Value("cy"), Value(3), Value("dog")}};
+    if (left_outer)
+      expected.insert(expected.begin() + 2,
+                      {Value(2), Value("bo"), std::nullopt, std::nullopt});
+    ASSERT_EQ(run_plan(join), expected);
+  }
+  people.drop();
+  pets.drop();
+}
+
+/**
+ * @tests parameters take their type from their context, and a plan using
+ * them runs again with new values without being rebuilt
+ */
+TEST(PlanOperatorTest, Parameters) {
+  HeapTable table("_test_plan_parameters", {"id", "kind"},
+                  {ColumnAttribute(ColumnAttribute::INT),
+                   ColumnAttribute(ColumnAttribute::TEXT)});
+  table.create();
+  ValueDict row;
+  for (int32_t i = 0; i < 30; i++) {
+    row["id"] = Value(i);
+    row["kind"] = Value(i % 2 == 0 ? "even" : "odd");
+    table.insert(&row);
+  }
+
+  // SELECT id FROM t WHERE kind = ? AND id < ? + 1
+  Row parameters(2);
+  ExprDict where;
+  where["kind"] = PlanExpr::parameter(0, &parameters);
+  ASSERT_TRUE(where["kind"]->infer(ColumnAttribute::TEXT));
+  ASSERT_FALSE(where["kind"]->infer(ColumnAttribute::INT));
+  PlanExpr *bound = PlanExpr::op(PlanExpr::ADD,
+                                 PlanExpr::parameter(1, &parameters),
+                                 PlanExpr::constant(Value(1)));
+  PlanExpr *below = PlanExpr::op(
+      PlanExpr::LT, PlanExpr::column(0, ColumnAttribute::INT), bound);
+  Project plan(new Filter(new TableScan(&table, "t", where), below),
+               {PlanExpr::column(0, ColumnAttribute::INT)},
+               {PlanColumn("t", "id", ColumnAttribute::INT)});
+
+  parameters = {Value("odd"), Value(5)};
+  std::vector<Row> expected = {{Value(1)}, {Value(3)}, {Value(5)}};
+  ASSERT_EQ(run_plan(plan), expected);
+  parameters = {Value("even"), Value(2)};
+  expected = {{Value(0)}, {Value(2)}};
+  ASSERT_EQ(run_plan(plan), expected);
+  parameters = {std::nullopt, Value(2)}; // NULL matches nothing
+  ASSERT_TRUE(run_plan(plan).empty());
+  parameters = {Value(1), Value(2)};
+  ASSERT_THROW(run_plan(plan), DbRelationError);
+  table.drop();
+}
+
+/**
+ * @tests a hash join gives the rows a nested loop join does, inner and left,
+ * in memory and when partitioned to disk (again and again for a tiny budget),
+ * and NULL keys match nothing
+ */
+TEST(PlanOperatorTest, HashJoin) {
+  PlanColumns left_columns = {PlanColumn("l", "k", ColumnAttribute::INT),
+                              PlanColumn("l", "s", ColumnAttribute::TEXT)};
+  PlanColumns right_columns = {PlanColumn("r", "k", ColumnAttribute::INT),
+                               PlanColumn("r", "n", ColumnAttribute::INT)};
+  for (int32_t keys : {5, 37}) {
+    uint rows = keys == 5 ? 40 : 400;
+    std::vector<Row> left_rows, right_rows;
+    for (int32_t i = 0; i < (int32_t)rows; i++) {
+      left_rows.push_back(
+          {i % 17 == 0 ? std::nullopt : std::optional<Value>(Value(i % keys)),
+           Value(std::string(i % 7, 'x'))});
+      if (i % 3 != 0) // fewer on the right, and some keys only on the left
+        right_rows.push_back(
+            {i % 11 == 0 ? std::nullopt
+                         : std::optional<Value>(Value((i + 1) % (keys + 3))),
+             Value(i)});
+    }
+
+    for (bool left_outer : {false, true}) {
+      // ON l.k = r.k AND r.n > 10
+      auto residual = []() {
+        return PlanExpr::op(PlanExpr::GT,
+                            PlanExpr::column(3, ColumnAttribute::INT),
+                            PlanExpr::constant(Value(10)));
+      };
+      NestedLoopJoin loops(
+          new RowsOperator(left_columns, left_rows),
+          new RowsOperator(right_columns, right_rows),
+          PlanExpr::op(PlanExpr::AND,
+                       PlanExpr::op(PlanExpr::EQ,
+                                    PlanExpr::column(0, ColumnAttribute::INT),
+                                    PlanExpr::column(2, ColumnAttribute::INT)),
+                       residual()),
+          left_outer);
+      std::vector<Row> expected = run_plan(loops);
+      std::sort(expected.begin(), expected.end());
+      ASSERT_FALSE(expected.empty());
+
+      for (size_t budget : {HashJoin::MEMORY_BUDGET, (size_t)2000, (size_t)1}) {
+        if (budget == 1 && keys != 5)
+          continue; // partitioning to the last level takes many files
+        HashJoin join(new RowsOperator(left_columns, left_rows),
+                      new RowsOperator(right_columns, right_rows), {0}, {0},
+                      residual(), left_outer, budget);
+        ASSERT_EQ(join.get_columns().size(), 4u);
+        for (int run = 0; run < 2; run++) {
+          std::vector<Row> joined = run_plan(join);
+          std::sort(joined.begin(), joined.end());
+          ASSERT_EQ(joined, expected) << "budget " << budget;
+          ASSERT_EQ(join.get_spilled() > 0,
+                    budget != HashJoin::MEMORY_BUDGET);
+        }
+      }
+    }
+  }
+}
+
+/**
+ * @tests spilled rows come back as they went out, NULLs and all
+ */
+TEST(PlanOperatorTest, SpillFile) {
+  SpillFile file;
+  std::vector<Row> rows;
+  for (int32_t i = 0; i < 1000; i++)
+    rows.push_back({Value(i), std::nullopt, Value(std::string(i % 50, 'a'))});
+  for (const Row &row : rows)
+    file.append(row);
+  ASSERT_EQ(file.size(), rows.size());
+  ASSERT_THROW(file.append({Value(std::string(5000, 'b'))}), DbRelationError);
+  for (int pass = 0; pass < 2; pass++) {
+    file.rewind();
+    std::vector<Row> read;
+    Row row;
+    while (file.next(row))
+      read.push_back(row);
+    ASSERT_EQ(read, rows);
+  }
+  ASSERT_THROW(file.append(rows[0]), DbRelationError);
+}
+
+/**
+ * @tests normalized keys order NULLs, negative numbers, prefixes and zero
+ * bytes as the values do, and descending keys the other way
+ */
+TEST(SortKeyTest, Normalize) {
+  std::vector<Row> ordered = {{std::nullopt}, {Value(INT32_MIN)}, {Value(-1)},
+                              {Value(0)},     {Value(7)},         {Value(256)},
+                              {Value(INT32_MAX)}};
+  std::vector<Row> texts = {{std::nullopt},
+                            {Value("")},
+                            {Value("a")},
+                            {Value(std::string("a\0", 2))},
+                            {Value(std::string("a\0b", 3))},
+                            {Value("ab")},
+                            {Value("\xe9")}};
+  for (const std::vector<Row> &rows : {ordered, texts})
+    for (bool descending : {false, true}) {
+      SortKeys keys = {SortKey(0, descending)};
+      std::string a, b;
+      for (size_t i = 0; i + 1 < rows.size(); i++) {
+        normalize_key(rows[i], keys, a);
+        normalize_key(rows[i + 1], keys, b);
+        ASSERT_EQ(compare_keys(a, b) < 0, !descending) << i;
+        ASSERT_EQ(compare_keys(a, a), 0);
+      }
+    }
+
+  // a short first column doesn't run into the second
+  SortKeys keys = {SortKey(0), SortKey(1)};
+  std::string a, b;
+  normalize_key({Value("a"), Value("z")}, keys, a);
+  normalize_key({Value("ab"), Value("a")}, keys, b);
+  ASSERT_LT(compare_keys(a, b), 0);
+}
+
+/**
+ * @tests a sort orders rows by several keys, keeps equal ones in input
+ * order, and gives the same rows when spilling runs to disk and merging them
+ * or sorting on several threads
+ */
+TEST(PlanOperatorTest, Sort) {
+  PlanColumns columns = {PlanColumn("t", "kind", ColumnAttribute::TEXT),
+                         PlanColumn("t", "n", ColumnAttribute::INT),
+                         PlanColumn("t", "id", ColumnAttribute::INT)};
+  std::vector<Row> rows;
+  u_int32_t seed = 12345;
+  for (int32_t i = 0; i < 20000; i++) {
+    seed = seed * 1103515245 + 12345;
+    rows.push_back(
+        {Value(std::string(1 + (seed >> 8) % 3, 'a' + (seed >> 12) % 4)),
+         (seed >> 16) % 10 == 0
+             ? std::nullopt
+             : std::optional<Value>(Value((int32_t)(seed >> 16) % 50 - 25)),
+         Value(i)});
+  }
+  // ORDER BY kind, n DESC: NULLs last, and ids ascending among equals
+  std::vector<Row> expected = rows;
+  std::stable_sort(expected.begin(), expected.end(),
+                   [](const Row &a, const Row &b) {
+                     if (a[0] != b[0])
+                       return a[0] < b[0];
+                     if (!a[1] || !b[1])
+                       return a[1].has_value() && !b[1];
+                     return *b[1] < *a[1];
+                   });
+  SortKeys keys = {SortKey(0), SortKey(1, true)};
+
+  for (size_t budget : {Sort::MEMORY_BUDGET, (size_t)100000}) {
+    for (uint threads : {1, 4}) {
+      Sort sort(new RowsOperator(columns, rows), keys, budget, threads);
+      ASSERT_EQ(run_plan(sort), expected)
+          << "budget " << budget << " threads " << threads;
+      ASSERT_EQ(sort.get_spilled() > 1, budget != Sort::MEMORY_BUDGET);
+      ASSERT_EQ(run_plan(sort), expected); // and again
+    }
+  }
+  Sort nothing(new RowsOperator(columns, {}), keys);
+  ASSERT_TRUE(run_plan(nothing).empty());
+}
+
+/**
+ * @tests a top-N gives the rows Sort and then Limit would, for limits from none
+ * to more than all the rows
+ */
+TEST(PlanOperatorTest, TopN) {
+  PlanColumns columns = {PlanColumn("t", "kind", ColumnAttribute::TEXT),
+                         PlanColumn("t", "n", ColumnAttribute::INT),
+                         PlanColumn("t", "id", ColumnAttribute::INT)};
+  std::vector<Row> rows;
+  u_int32_t seed = 777;
+  for (int32_t i = 0; i < 5000; i++) {
+    seed = seed * 1103515245 + 12345;
+    rows.push_back(
+        {Value(std::string(1 + (seed >> 8) % 3, 'a' + (seed >> 12) % 4)),
+         (seed >> 16) % 10 == 0
+             ? std::nullopt
+             : std::optional<Value>(Value((int32_t)(seed >> 16) % 50 - 25)),
+         Value(i)});
+  }
+  for (SortKeys keys : {SortKeys{SortKey(0), SortKey(1, true)},
+                        SortKeys{SortKey(1)}}) {
+    Sort sort(new RowsOperator(columns, rows), keys);
+    std::vector<Row> sorted = run_plan(sort);
+    for (size_t limit : {0, 1, 7, 100, 5000, 6000}) {
+      std::vector<Row> expected(
+          sorted.begin(), sorted.begin() + std::min(limit, sorted.size()));
+      TopN top(new RowsOperator(columns, rows), keys, limit);
+      ASSERT_EQ(run_plan(top), expected) << "limit " << limit;
+      ASSERT_EQ(run_plan(top), expected); // and again
+    }
+  }
+}
+
+/**
+ * @tests a top-N's bound, passed down to a table scan, skips the rows and
+ * the blocks that can't make the cut without changing the result
+ */
+TEST(PlanOperatorTest, TopNDynamicFilter) {
+  DynamicFilter filter(SortKey(0, true));
+  ASSERT_TRUE(filter.passes({Value(1)}));
+  filter.set_bound(Value(5));
+  ASSERT_TRUE(filter.passes({Value(5)}));
+  ASSERT_TRUE(filter.passes({Value(6)}));
+  ASSERT_FALSE(filter.passes({Value(4)}));
+  ASSERT_FALSE(filter.passes({std::nullopt}));
+  filter.reset();
+  ASSERT_TRUE(filter.passes({Value(4)}));
+
+  HeapTable table("_test_plan_top", {"id", "kind"},
+                  {ColumnAttribute(ColumnAttribute::INT),
+                   ColumnAttribute(ColumnAttribute::TEXT)});
+  table.create();
+  ValueDict row;
+  for (int32_t i = 0; i < 3000; i++) {
+    row["id"] = Value(i);
+    row["kind"] = Value(std::string(20, 'a' + i % 26));
+    table.insert(&row);
+  }
+  for (SortKeys keys : {SortKeys{SortKey(0)}, SortKeys{SortKey(0, true)},
+                        SortKeys{SortKey(1), SortKey(0, true)}}) {
+    Sort sort(new TableScan(&table, "t"), keys);
+    std::vector<Row> sorted = run_plan(sort);
+    std::vector<Row> expected(sorted.begin(), sorted.begin() + 10);
+    TableScan *scan = new TableScan(&table, "t");
+    TopN top(scan, keys, 10);
+    scan->set_filter(top.get_filter());
+    ASSERT_EQ(run_plan(top), expected);
+    // ids ascending are in block order, so after the first block the zone
+    // map rules out the rest
+    ASSERT_EQ(scan->get_blocks_skipped() > 0,
+              keys.size() == 1 && !keys[0].descending);
+    ASSERT_EQ(run_plan(top), expected);
+  }
+  table.drop();
+}
+
+/**
+ * @tests a table scan in order of a column reads a B+tree index on it rather
+ * than the blocks, ascending or descending and with equality predicates, and
+ * gives the rows a sort would
+ */
+TEST(PlanOperatorTest, OrderedTableScan) {
+  HeapTable table("_test_plan_ordered", {"id", "n", "kind"},
+                  {ColumnAttribute(ColumnAttribute::INT),
+                   ColumnAttribute(ColumnAttribute::INT),
+                   ColumnAttribute(ColumnAttribute::TEXT)});
+  table.create();
+  ValueDict row;
+  u_int32_t seed = 4242;
+  for (int32_t i = 0; i < 2000; i++) {
+    seed = seed * 1103515245 + 12345;
+    row["id"] = Value(i);
+    row["n"] = Value((int32_t)(seed >> 16) % 1000);
+    row["kind"] = Value(std::string(1, 'a' + i % 3));
+    table.insert(&row);
+  }
+  BTreeIndex index(table, "n_tree", {"n", "id"});
+  index.create();
+  table.add_index(&index);
+
+  // each scan owns its predicates
+  auto predicates = [](bool where) {
+    ExprDict kind;
+    if (where)
+      kind["kind"] = PlanExpr::constant(Value("b"));
+    return kind;
+  };
+  for (bool descending : {false, true}) {
+    for (bool where : {false, true}) {
+      Sort sort(new TableScan(&table, "t", predicates(where)),
+                {SortKey(1, descending), SortKey(0, descending)});
+      TableScan scan(&table, "t", predicates(where));
+      scan.set_order("n", descending);
+      std::vector<Row> ordered = run_plan(scan);
+      ASSERT_EQ(table.get_scan_stats().blocks_read, 0U);
+      ASSERT_EQ(ordered, run_plan(sort));
+    }
+  }
+  table.remove_index(&index);
+  index.drop();
+  table.drop();
+}
+
+/**
+ * @tests hash aggregation gives each group's COUNT, SUM and AVG, NULLs
+ * grouped together and skipped by the aggregates, whether keyed by one INT
+ * column or several, pre-aggregated on several threads, or spilled; and
+ * without GROUP BY gives one row, even for no input
+ */
+TEST(PlanOperatorTest, HashAggregate) {
+  PlanColumns columns = {PlanColumn("t", "kind", ColumnAttribute::TEXT),
+                         PlanColumn("t", "n", ColumnAttribute::INT),
+                         PlanColumn("t", "g", ColumnAttribute::INT)};
+  std::vector<Row> rows;
+  u_int32_t seed = 54321;
+  for (int32_t i = 0; i < 20000; i++) {
+    seed = seed * 1103515245 + 12345;
+    rows.push_back(
+        {Value(std::string(1 + (seed >> 8) % 3, 'a' + (seed >> 12) % 4)),
+         (seed >> 16) % 10 == 0
+             ? std::nullopt
+             : std::optional<Value>(Value((int32_t)(seed >> 16) % 50 - 25)),
+         (seed >> 20) % 100 == 0
+             ? std::nullopt
+             : std::optional<Value>(Value((int32_t)(seed >> 20) % 500))});
+  }
+  Aggregates aggregates = {Aggregate(Aggregate::COUNT_STAR),
+                           Aggregate(Aggregate::COUNT, 1),
+                           Aggregate(Aggregate::SUM, 1),
+                           Aggregate(Aggregate::AVG, 1)};
+
+  for (std::vector<uint> group_by :
+       {std::vector<uint>{2}, std::vector<uint>{0, 2}}) {
+    // count(*), count(n) and sum(n) for each group
+    std::map<Row, std::vector<int64_t>> groups;
+    for (const Row &row : rows) {
+      Row keys;
+      for (uint column : group_by)
+        keys.push_back(row[column]);
+      std::vector<int64_t> &sums = groups[keys];
+      sums.resize(3);
+      sums[0]++;
+      if (row[1]) {
+        sums[1]++;
+        sums[2] += row[1]->n;
+      }
+    }
+    std::vector<Row> expected;
+    for (auto const &[keys, sums] : groups) {
+      Row row = keys;
+      row.push_back(Value((int32_t)sums[0]));
+      row.push_back(Value((int32_t)sums[1]));
+      if (sums[1] == 0) {
+        row.push_back(std::nullopt);
+        row.push_back(std::nullopt);
+      } else {
+        row.push_back(Value((int32_t)sums[2]));
+        row.push_back(Value((int32_t)(sums[2] / sums[1])));
+      }
+      expected.push_back(row);
+    }
+
+    for (size_t budget : {HashAggregate::MEMORY_BUDGET, (size_t)20000}) {
+      for (uint threads : {1, 4}) {
+        HashAggregate aggregate(new RowsOperator(columns, rows), group_by,
+                                aggregates, budget, threads);
+        ASSERT_EQ(aggregate.get_columns().size(), group_by.size() + 4);
+        for (int run = 0; run < 2; run++) {
+          std::vector<Row> result = run_plan(aggregate);
+          std::sort(result.begin(), result.end());
+          ASSERT_EQ(result, expected) << "group by " << group_by.size()
+                                      << " budget " << budget << " threads "
+                                      << threads;
+          ASSERT_EQ(aggregate.get_spilled() > 0,
+                    budget != HashAggregate::MEMORY_BUDGET);
+        }
+      }
+    }
+  }
+
+  // without GROUP BY there is a row even for no rows at all
+  HashAggregate all(new RowsOperator(columns, rows), {}, aggregates);
+  std::vector<Row> result = run_plan(all);
+  ASSERT_EQ(result.size(), 1U);
+  ASSERT_EQ(result[0][0], Value(20000));
+  HashAggregate none(new RowsOperator(columns, {}), {}, aggregates);
+  std::vector<Row> empty = {{Value(0), Value(0), std::nullopt, std::nullopt}};
+  ASSERT_EQ(run_plan(none), empty);
+  HashAggregate count(new RowsOperator(columns, rows), {},
+                      {Aggregate(Aggregate::COUNT_STAR)}, 0, 0);
+  std::vector<Row> counted = {{Value(20000)}};
+  ASSERT_EQ(run_plan(count), counted);
+}
@@ -0,0 +1,144 @@
+#include "heap_storage.h"
+#include "row_codec.h"
+#include "storage_engine.h"
+#include <cstring>
+#include <gtest/gtest.h>
+#include <string>
+
+class RowCodecTest : public testing::Test {
+protected:
+  void SetUp() override {
+    // storage order deliberately differs from name order
+    column_names = {"id", "b_name", "a_count", "c_note"};
+    column_attributes = {ColumnAttribute(ColumnAttribute::INT),
+                         ColumnAttribute(ColumnAttribute::TEXT),
+                         ColumnAttribute(ColumnAttribute::INT),
+                         ColumnAttribute(ColumnAttribute::TEXT)};
+    row["id"] = Value(7);
+    row["b_name"] = Value("seven");
+    row["a_count"] = Value(-3);
+    row["c_note"] = Value("");
+  }
+
+  ColumnNames column_names;
+  ColumnAttributes column_attributes;
+  ValueDict row;
+  char buf[DbBlock::BLOCK_SZ];
+};
+
+/**
+ * @tests RowCodec::encode keeps the original HeapTable row format
+ */
+TEST_F(RowCodecTest, EncodeFormat) {
+  RowCodec codec(column_names, column_attributes);
+  ASSERT_EQ(codec.size(&row), 4u + 2 + 5 + 4 + 2);
+  codec.encode(&row, buf);
+  ASSERT_EQ(*(int32_t *)&buf[0], 7);
+  ASSERT_EQ(*(u_int16_t *)&buf[4], 5);
+  ASSERT_EQ(std::string(&buf[6], 5), "seven");
+  ASSERT_EQ(*(int32_t *)&buf[11], -3);
+  ASSERT_EQ(*(u_int16_t *)&buf[15], 0);
+}
+
+/**
+ * @tests RowCodec::decode round trips, including rows with extra keys
+ */
+TEST_F(RowCodecTest, RoundTrip) {
+  RowCodec codec(column_names, column_attributes);
+  row["zzz_extra"] = Value(99);
+  codec.encode(&row, buf);
+  ValueDict *got = codec.decode(buf);
+  ASSERT_EQ(got->size(), 4u);
+  ASSERT_EQ(got->at("id").n, 7);
+  ASSERT_EQ(got->at("b_name").s, "seven");
+  ASSERT_EQ(got->at("a_count").n, -3);
+  ASSERT_EQ(got->at("c_note").s, "");
+  delete got;
+}
+
+/**
+ * @tests RowCodec::decode of a column subset and RowCodec::field
+ */
+TEST_F(RowCodecTest, PartialDecode) {
+  RowCodec codec(column_names, column_attributes);
+  codec.encode(&row, buf);
+  ColumnNames some = {"a_count", "id"};
+  ValueDict *got = codec.decode(buf, &some);
+  ASSERT_EQ(got->size(), 2u);
+  ASSERT_EQ(got->at("a_count").n, -3);
+  delete got;
+  ASSERT_EQ(codec.field(buf, 1).s, "seven");
+  ASSERT_EQ(codec.field(buf, 2).n, -3);
+  ColumnNames bad = {"nope"};
+  ASSERT_THROW(codec.decode(buf, &bad), DbRelationError);
+}
+
+/**
+ * @tests RowCodec with an all-INT schema has static offsets
+ */
+TEST_F(RowCodecTest, FixedWidth) {
+  RowCodec codec({"x", "y"}, {ColumnAttribute(ColumnAttribute::INT),
+                              ColumnAttribute(ColumnAttribute::INT)});
+  ValueDict fixed;
+  fixed["x"] = Value(1);
+  fixed["y"] = Value(2);
+  ASSERT_TRUE(codec.is_fixed_width());
+  ASSERT_EQ(codec.size(&fixed), 8u);
+  codec.encode(&fixed, buf);
+  ASSERT_EQ(codec.field(buf, 1).n, 2);
+  ValueDict missing;
+  missing["x"] = Value(1);
+  ASSERT_THROW(codec.encode(&missing, buf), DbRelationError);
+}
+
+/**
+ * @tests RowCodec reused for rows of other lengths, with several INT columns
+ * after a TEXT column
+ */
+TEST_F(RowCodecTest, Runs) {
+  RowCodec codec({"t", "x", "y", "u", "z"},
+                 {ColumnAttribute(ColumnAttribute::TEXT),
+                  ColumnAttribute(ColumnAttribute::INT),
+                  ColumnAttribute(ColumnAttribute::INT),
+                  ColumnAttribute(ColumnAttribute::TEXT),
+                  ColumnAttribute(ColumnAttribute::INT)});
+  ASSERT_FALSE(codec.is_fixed_width());
+  for (int32_t i = 0; i < 3; i++) {
+    ValueDict row;
+    row["t"] = Value(std::string(i * 7, 't'));
+    row["x"] = Value(i);
+    row["y"] = Value(-i);
+    row["u"] = Value(std::string(10 - i, 'u'));
+    row["z"] = Value(i * 100);
+    uint size = codec.size(&row);
+    ASSERT_EQ(size, 2u + i * 7 + 8 + 2 + 10 - i + 4);
+    ASSERT_EQ(codec.encode(&row, buf), size);
+    ASSERT_EQ(*(int32_t *)&buf[2 + i * 7 + 4], -i);
+    ValueDict *got = codec.decode(buf);
+    ASSERT_EQ(*got, row);
+    delete got;
+    ASSERT_EQ(codec.field(buf, 4).n, i * 100);
+    ASSERT_EQ(codec.field(buf, 3).s, std::string(10 - i, 'u'));
+  }
+}
+
+/**
+ * @tests RowCodec::size of a row with a TEXT value over 64 KB is its true
+ * size, so HeapTable rejects the row instead of truncating the value
+ */
+TEST_F(RowCodecTest, TextOver64K) {
+  RowCodec codec(column_names, column_attributes);
+  // 16-bit sums would wrap this row round to 76 bytes
+  row["b_name"] = Value(std::string(65600, 'b'));
+  ASSERT_EQ(codec.size(&row), 4u + 2 + 65600 + 4 + 2);
+  std::vector<char> big(codec.size(&row));
+  ASSERT_THROW(codec.encode(&row, big.data()), DbRelationError);
+
+  HeapTable table("_test_row_codec_big", column_names, column_attributes);
+  table.create();
+  ASSERT_THROW(table.insert(&row), DbRelationError);
+  Handles *handles = table.select();
+  ASSERT_TRUE(handles->empty());
+  delete handles;
+  table.drop();
+}
@@ -0,0 +1,269 @@
+#include "column_storage.h"
+#include "schema_tables.h"
+#include <gtest/gtest.h>
+
+/**
+ * @tests tables created through the catalog are found again by name, from
+ * the cache and from the catalog rows, and dropping a table forgets it
+ */
+TEST(TablesTest, CreateResolveDrop) {
+  Tables *tables = new Tables();
+  tables->create();
+  ASSERT_TRUE(tables->exists("_tables"));
+  ColumnNames column_names;
+  ColumnAttributes column_attributes;
+  Columns &columns = dynamic_cast<Columns &>(tables->get_table("_columns"));
+  columns.get_columns("_columns", column_names, column_attributes);
+  ASSERT_EQ(column_names,
+            ColumnNames({"table_name", "column_name", "data_type"}));
+
+  TableOptions options;
+  options.engine = TableOptions::COLUMN;
+  DbRelation &created = tables->create_table(
+      "_test_catalog_c", {"b", "a"},
+      {ColumnAttribute(ColumnAttribute::TEXT),
+       ColumnAttribute(ColumnAttribute::INT)},
+      options);
+  ValueDict row;
+  row["a"] = Value(12);
+  row["b"] = Value("twelve");
+  created.insert(&row);
+  tables->create_table("_test_catalog_h", {"x"},
+                       {ColumnAttribute(ColumnAttribute::INT)});
+  ASSERT_EQ(&tables->get_table("_test_catalog_c"), &created);
+  ASSERT_EQ(tables->cached(), 2u);
+  ASSERT_THROW(tables->create_table("_test_catalog_h", {"y"},
+                                    {ColumnAttribute(ColumnAttribute::INT)}),
+               DbRelationError);
+  ASSERT_EQ(tables->get_table_names(),
+            TableNames({"_test_catalog_c", "_test_catalog_h"}));
+  tables->close();
+  delete tables;
+
+  // a fresh catalog rebuilds the table, engine and schema from its rows
+  tables = new Tables();
+  tables->open();
+  ASSERT_EQ(tables->cached(), 0u);
+  DbRelation &loaded = tables->get_table("_test_catalog_c");
+  ASSERT_NE(dynamic_cast<ColumnTable *>(&loaded), nullptr);
+  ASSERT_EQ(loaded.get_column_names(), ColumnNames({"b", "a"}));
+  ASSERT_EQ(tables->cached(), 1u);
+  ASSERT_EQ(&tables->get_table("_test_catalog_c"), &loaded);
+  Handles *handles = loaded.select();
+  ASSERT_EQ(handles->size(), 1u);
+  ValueDict *values = loaded.project(handles->front());
+  ASSERT_EQ(*values, row);
+  delete values;
+  delete handles;
+
+  tables->drop_table("_test_catalog_c");
+  Columns &reopened = dynamic_cast<Columns &>(tables->get_table("_columns"));
+  ASSERT_FALSE(tables->exists("_test_catalog_c"));
+  ASSERT_THROW(tables->get_table("_test_catalog_c"), DbRelationError);
+  reopened.get_columns("_test_catalog_c", column_names, column_attributes);
+  ASSERT_TRUE(column_names.empty());
+  ASSERT_THROW(tables->drop_table("_columns"), DbRelationError);
+  tables->drop_table("_test_catalog_h");
+  ASSERT_EQ(tables->cached(), 0u);
+  tables->drop();
+  delete tables;
+}
+
+/**
+ * @tests a table's Bloom filter options are recorded with it, so the filters
+ * are kept up to date, and used, whenever the catalog reopens it
+ */
+TEST(TablesTest, OptionsKept) {
+  Tables *tables = new Tables();
+  tables->create();
+  TableOptions options;
+  options.bloom_columns = {"body", "id"};
+  options.bloom_bits = 8192;
+  options.bloom_fp_rate = 0.001;
+  DbRelation *table = &tables->create_table(
+      "_test_catalog_bloom", {"id", "body"},
+      {ColumnAttribute(ColumnAttribute::INT),
+       ColumnAttribute(ColumnAttribute::TEXT)},
+      options);
+  ValueDict row;
+  for (int32_t i = 0; i < 1000; i++) {
+    row["id"] = Value(i % 7);
+    row["body"] = Value("row-" + std::to_string(i) + std::string(80, '.'));
+    table->insert(&row);
+  }
+  tables->close();
+  delete tables;
+
+  tables = new Tables();
+  tables->open();
+  HeapTable *reopened =
+      dynamic_cast<HeapTable *>(&tables->get_table("_test_catalog_bloom"));
+  ASSERT_NE(reopened, nullptr);
+  row["id"] = Value(7);
+  row["body"] = Value("added");
+  Handle added = reopened->insert(&row);
+  ValueDict where;
+  where["body"] = Value("added");
+  Handles *handles = reopened->select(&where);
+  ASSERT_EQ(*handles, Handles{added});
+  delete handles;
+  ASSERT_GT(reopened->get_scan_stats().blocks_filtered, 0u);
+  tables->drop_table("_test_catalog_bloom");
+  tables->drop();
+  delete tables;
+}
+
+/**
+ * @tests at most max_open tables stay open, the least recently used going
+ * first, and borrowed tables stay open regardless
+ */
+TEST(TablesTest, LeastRecentlyUsedClosed) {
+  Tables tables(2);
+  tables.create();
+  for (auto const &table_name : {"_test_lru_a", "_test_lru_b", "_test_lru_c"})
+    tables.create_table(table_name, {"x"},
+                        {ColumnAttribute(ColumnAttribute::INT)});
+  ASSERT_EQ(tables.cached(), 2u);
+  ASSERT_EQ(tables.get_evictions(), 1u); // a made room for c
+
+  tables.get_table("_test_lru_b"); // c is now the oldest
+  DbRelation &a = tables.borrow("_test_lru_a");
+  ASSERT_EQ(tables.get_evictions(), 2u);
+  ValueDict row;
+  row["x"] = Value(1);
+  a.insert(&row);
+  // a is borrowed, so b and c take turns
+  tables.get_table("_test_lru_c");
+  tables.get_table("_test_lru_b");
+  ASSERT_EQ(tables.get_evictions(), 4u);
+  ASSERT_EQ(&tables.get_table("_test_lru_a"), &a);
+  tables.get_table("_test_lru_c");
+  tables.set_max_open(1); // c was used last and a is borrowed
+  ASSERT_EQ(tables.cached(), 2u);
+  tables.release("_test_lru_a");
+  ASSERT_EQ(tables.cached(), 1u);
+
+  Handles *handles = tables.get_table("_test_lru_a").select();
+  ASSERT_EQ(handles->size(), 1u);
+  delete handles;
+  for (auto const &table_name : tables.get_table_names())
+    tables.drop_table(table_name);
+  tables.drop();
+}
+
+/**
+ * @tests MEMORY tables are never closed to make room for other tables, so
+ * their rows survive opening more than max_open tables
+ */
+TEST(TablesTest, MemoryTablesStayOpen) {
+  Tables tables(2);
+  tables.create();
+  TableOptions options;
+  options.engine = TableOptions::MEMORY;
+  DbRelation &memory = tables.create_table(
+      "_test_lru_mem", {"x"}, {ColumnAttribute(ColumnAttribute::INT)},
+      options);
+  ValueDict row;
+  for (int32_t i = 0; i < 100; i++) {
+    row["x"] = Value(i);
+    memory.insert(&row);
+  }
+  for (auto const &table_name : {"_test_lru_a", "_test_lru_b", "_test_lru_c"})
+    tables.create_table(table_name, {"x"},
+                        {ColumnAttribute(ColumnAttribute::INT)});
+  tables.get_table("_test_lru_a");
+  tables.set_max_open(1);
+  ASSERT_EQ(tables.cached(), 2u); // a was used last
+  ASSERT_EQ(tables.get_evictions(), 3u);
+
+  ASSERT_EQ(&tables.get_table("_test_lru_mem"), &memory);
+  Handles *handles = memory.select();
+  ASSERT_EQ(handles->size(), 100u);
+  delete handles;
+  for (auto const &table_name : tables.get_table_names())
+    tables.drop_table(table_name);
+  ASSERT_EQ(tables.cached(), 0u);
+  tables.drop();
+}
+
+/**
+ * @tests indexes created through the catalog are recorded in _indices,
+ * reattached and kept up to date whenever their table is opened, and go
+ * with their table
+ */
+TEST(TablesTest, Indexes) {
+  Tables *tables = new Tables(1);
+  tables->create();
+  DbRelation &created = tables->create_table(
+      "_test_catalog_ix", {"id", "name"},
+      {ColumnAttribute(ColumnAttribute::INT),
+       ColumnAttribute(ColumnAttribute::TEXT)});
+  ValueDict row;
+  for (int32_t i = 0; i < 100; i++) {
+    row["id"] = Value(i);
+    row["name"] = Value("n" + std::to_string(i));
+    created.insert(&row);
+  }
+  tables->create_index("_test_catalog_ix", "by_id", {"id"}, "HASH");
+  tables->create_index("_test_catalog_ix", "by_name", {"name", "id"},
+                       "BTREE", true);
+  ASSERT_THROW(tables->create_index("_test_catalog_ix", "by_id", {"id"},
+                                    "HASH"),
+               DbRelationError);
+  ASSERT_THROW(tables->create_index("_test_catalog_ix", "bad", {"nope"},
+                                    "HASH"),
+               DbRelationError);
+  ASSERT_THROW(tables->create_index("_test_catalog_ix", "bad", {"id"},
+                                    "TRIE"),
+               DbRelationError);
+  ASSERT_THROW(tables->create_index("_tables", "bad", {"engine"}, "HASH"),
+               DbRelationError);
+  tables->close();
+  delete tables;
+
+  tables = new Tables(1);
+  tables->open();
+  Indices &indices = dynamic_cast<Indices &>(tables->get_table("_indices"));
+  ASSERT_EQ(indices.get_index_names("_test_catalog_ix"),
+            IndexNames({"by_id", "by_name"}));
+  ColumnNames key_columns;
+  Identifier index_type;
+  bool unique;
+  indices.get_index("_test_catalog_ix", "by_name", key_columns, index_type,
+                    unique);
+  ASSERT_EQ(key_columns, ColumnNames({"name", "id"}));
+  ASSERT_EQ(index_type, "BTREE");
+  ASSERT_TRUE(unique);
+
+  // each time the table is opened, lookups go through its indexes and its
+  // changes reach them
+  for (int32_t i = 100; i < 103; i++) {
+    tables->create_table("_test_catalog_other" + std::to_string(i), {"x"},
+                         {ColumnAttribute(ColumnAttribute::INT)});
+    HeapTable &table =
+        dynamic_cast<HeapTable &>(tables->get_table("_test_catalog_ix"));
+    ASSERT_EQ(tables->get_indexes("_test_catalog_ix").size(), 2u);
+    row["id"] = Value(i);
+    row["name"] = Value("n" + std::to_string(i));
+    table.insert(&row);
+    ValueDict where;
+    where["id"] = Value(i);
+    Handles *handles = table.select(&where);
+    ASSERT_EQ(handles->size(), 1u);
+    ASSERT_EQ(table.get_scan_stats().blocks_read, 0u);
+    delete handles;
+    ASSERT_THROW(table.insert(&row), DbRelationError); // by_name is unique
+  }
+  ASSERT_GT(tables->get_evictions(), 2u);
+
+  tables->drop_index("_test_catalog_ix", "by_name");
+  ASSERT_THROW(tables->drop_index("_test_catalog_ix", "by_name"),
+               DbRelationError);
+  ASSERT_EQ(indices.get_index_names("_test_catalog_ix"),
+            IndexNames({"by_id"}));
+  for (auto const &table_name : tables->get_table_names())
+    tables->drop_table(table_name);
+  ASSERT_TRUE(indices.get_index_names("_test_catalog_ix").empty());
+  tables->drop();
+  delete tables;
+}
@@ -0,0 +1,98 @@
+#include "statistics.h"
+#include "heap_storage.h"
+#include <gtest/gtest.h>
+
+/**
+ * @tests HyperLogLog estimates within a few percent, small and large
+ */
+TEST(HyperLogLogTest, Estimate) {
+  HyperLogLog small, large, other;
+  for (int32_t i = 0; i < 100; i++) {
+    small.add(Value(i));
+    small.add(Value(i)); // repeats don't count
+  }
+  ASSERT_NEAR(small.estimate(), 100, 3);
+  for (int32_t i = 0; i < 100000; i++)
+    large.add(Value("key " + std::to_string(i)));
+  ASSERT_NEAR(large.estimate(), 100000, 5000);
+  for (int32_t i = 50000; i < 150000; i++)
+    other.add(Value("key " + std::to_string(i)));
+  large.merge(other);
+  ASSERT_NEAR(large.estimate(), 150000, 7500);
+}
+
+/**
+ * @tests Histogram::selectivity over even and skewed data
+ */
+TEST(HistogramTest, Selectivity) {
+  std::vector<int32_t> values;
+  for (int32_t i = 1000; i > 0; i--)
+    values.push_back(i);
+  Histogram even(values, 10);
+  ASSERT_EQ(even.min, 1);
+  ASSERT_EQ(even.bounds.size(), 10u);
+  ASSERT_EQ(even.bounds.back(), 1000);
+  ASSERT_NEAR(even.selectivity(ValueRange(Value(1), Value(100))), 0.1, 0.01);
+  ASSERT_NEAR(even.selectivity(ValueRange(Value(251), std::nullopt)), 0.75,
+              0.01);
+  ASSERT_EQ(even.selectivity(ValueRange(Value(2000), std::nullopt)), 0.0);
+
+  // half the rows are 7
+  values.assign(500, 7);
+  for (int32_t i = 0; i < 500; i++)
+    values.push_back(100 + i);
+  Histogram skewed(values, 10);
+  ASSERT_NEAR(skewed.selectivity(ValueRange(Value(7), Value(7))), 0.5, 0.05);
+  ASSERT_EQ(Histogram().selectivity(ValueRange(Value(7), Value(7))), 1.0);
+}
+
+/**
+ * @tests analyze reads all or a sample of the blocks, and the statistics
+ * survive StatisticsFile
+ */
+TEST(AnalyzeTest, SampleAndPersist) {
+  HeapTable table("_test_analyze", {"id", "kind", "label"},
+                  {ColumnAttribute(ColumnAttribute::INT),
+                   ColumnAttribute(ColumnAttribute::INT),
+                   ColumnAttribute(ColumnAttribute::TEXT)});
+  table.create();
+  ValueDict row;
+  for (int32_t i = 0; i < 20000; i++) {
+    row["id"] = Value(i);
+    row["kind"] = Value(i % 10);
+    row["label"] = Value(i % 2 ? "odd" : "even!");
+    table.insert(&row);
+  }
+
+  TableStatistics full = analyze(table, 100000);
+  ASSERT_EQ(full.blocks_sampled, full.block_count);
+  ASSERT_EQ(full.row_count, 20000u);
+  ASSERT_NEAR(full.avg_row_width, 4 + 4 + 2 + 4, 0.01);
+  ASSERT_NEAR(full.columns["id"].distinct, 20000, 1000);
+  ASSERT_EQ(full.columns["kind"].distinct, 10u);
+  ASSERT_EQ(full.columns["label"].distinct, 2u);
+  ASSERT_TRUE(full.columns["label"].histogram.empty());
+  ASSERT_NEAR(full.columns["id"].histogram.selectivity(
+                  ValueRange(Value(0), Value(4999))),
+              0.25, 0.02);
+
+  TableStatistics sampled = analyze(table, 10);
+  ASSERT_EQ(sampled.blocks_sampled, 10u);
+  ASSERT_NEAR(sampled.row_count, 20000, 2000);
+  ASSERT_NEAR(sampled.columns["id"].distinct, 20000, 3000);
+  ASSERT_EQ(sampled.columns["kind"].distinct, 10u);
+
+  StatisticsFile file;
+  file.put(sampled);
+  file.close();
+  TableStatistics read;
+  ASSERT_TRUE(file.get("_test_analyze", read));
+  ASSERT_EQ(read.row_count, sampled.row_count);
+  ASSERT_EQ(read.avg_row_width, sampled.avg_row_width);
+  ASSERT_EQ(read.columns["kind"].distinct, 10u);
+  ASSERT_EQ(read.columns["id"].histogram.bounds,
+            sampled.columns["id"].histogram.bounds);
+  file.del("_test_analyze");
+  ASSERT_FALSE(file.get("_test_analyze", read));
+  table.drop();
+}
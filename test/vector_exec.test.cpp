@@ -0,0 +1,120 @@
+#include "vector_exec.h"
+#include "column_storage.h"
+#include "heap_storage.h"
+#include <gtest/gtest.h>
+
+/**
+ * @tests IntKernels agree with a plain loop, including the ragged tail
+ */
+TEST(IntKernelsTest, SelectRefineCompute) {
+  const uint n = 1021;
+  std::vector<int32_t> values(n), other(n), parity(n), result(n);
+  for (uint i = 0; i < n; i++) {
+    values[i] = (int32_t)(i * 7919 % 200) - 100;
+    other[i] = i;
+    parity[i] = i % 2;
+  }
+  IntKernels::Compare ops[] = {IntKernels::EQ, IntKernels::NE, IntKernels::LT,
+                               IntKernels::LE, IntKernels::GT, IntKernels::GE};
+  auto test = [](IntKernels::Compare op, int32_t v, int32_t c) {
+    switch (op) {
+    case IntKernels::EQ: return v == c;
+    case IntKernels::NE: return v != c;
+    case IntKernels::LT: return v < c;
+    case IntKernels::LE: return v <= c;
+    case IntKernels::GT: return v > c;
+    default: return v >= c;
+    }
+  };
+  for (IntKernels::Compare op : ops) {
+    for (int32_t c : {-100, 0, 17, 99, 500}) {
+      SelectionVector expected, selection(n);
+      for (uint i = 0; i < n; i++)
+        if (test(op, values[i], c))
+          expected.push_back(i);
+      selection.resize(
+          IntKernels::select(op, values.data(), c, n, selection.data()));
+      ASSERT_EQ(selection, expected) << "op " << op << " c " << c;
+
+      // narrow it to the even positions
+      SelectionVector evens;
+      for (u_int16_t i : expected)
+        if (i % 2 == 0)
+          evens.push_back(i);
+      selection.resize(IntKernels::refine(IntKernels::EQ, parity.data(), 0,
+                                          selection.data(), selection.size()));
+      ASSERT_EQ(selection, evens);
+    }
+  }
+
+  IntKernels::compute(IntKernels::ADD, values.data(), other.data(),
+                      result.data(), n);
+  ASSERT_EQ(result[n - 1], values[n - 1] + (int32_t)(n - 1));
+  IntKernels::compute(IntKernels::SUB, values.data(), 5, result.data(), n);
+  ASSERT_EQ(result[3], values[3] - 5);
+  int32_t big = INT32_MAX;
+  IntKernels::compute(IntKernels::ADD, &big, 1, result.data(), 1);
+  ASSERT_EQ(result[0], INT32_MIN);
+
+  int64_t total = 0;
+  for (uint i = 0; i < n; i++)
+    total += other[i];
+  ASSERT_EQ(IntKernels::sum(other.data(), n), total);
+  u_int16_t some[] = {1, 10, 1000};
+  ASSERT_EQ(IntKernels::sum(other.data(), some, 3), 1011);
+}
+
+/**
+ * @tests a scan-filter-compute pipeline gives the same answer over heap and
+ * column tables
+ */
+TEST(VectorOperatorTest, FilterComputeSum) {
+  ColumnNames column_names = {"a", "b", "c"};
+  ColumnAttributes column_attributes(3, ColumnAttribute(ColumnAttribute::INT));
+  HeapTable heap("_test_vector_heap", column_names, column_attributes);
+  ColumnTable columns("_test_vector_column", column_names, column_attributes);
+  heap.create();
+  columns.create();
+  const int32_t rows = 5000;
+  int64_t expected = 0;
+  ValueDict row;
+  for (int32_t i = 0; i < rows; i++) {
+    row["a"] = Value(i);
+    row["b"] = Value(i * 2);
+    row["c"] = Value(i % 100);
+    heap.insert(&row);
+    columns.insert(&row);
+    if (i % 100 < 30 && i >= 1000)
+      expected += i + i * 2;
+  }
+
+  for (DbRelation *relation : {(DbRelation *)&heap, (DbRelation *)&columns}) {
+    VectorOperator *plan = new VectorCompute(
+        new VectorFilter(
+            new VectorFilter(new VectorScan(relation, {"a", "b", "c"}), "c",
+                             IntKernels::LT, 30),
+            "a", IntKernels::GE, 1000),
+        "a_plus_b", "a", IntKernels::ADD, "b");
+    VectorBatch batch;
+    int64_t sum = 0;
+    uint batches = 0, selected = 0;
+    while (plan->next(batch)) {
+      ASSERT_LE(batch.data.size(), VectorBatch::CAPACITY);
+      ASSERT_GT(batch.count(), 0u);
+      sum += batch.sum("a_plus_b");
+      selected += batch.count();
+      batches++;
+    }
+    delete plan;
+    ASSERT_EQ(sum, expected);
+    ASSERT_EQ(selected, 1200u);
+    ASSERT_GT(batches, 1u);
+  }
+
+  VectorScan scan(&heap, {"a"});
+  VectorBatch batch;
+  ASSERT_TRUE(scan.next(batch));
+  ASSERT_THROW(batch.ints("b"), DbRelationError);
+  heap.drop();
+  columns.drop();
+}